@@ -0,0 +1,331 @@
+/*
+ * BLAKE2bp-256, see blake2.h.
+ *
+ * Leaf i hashes blocks i, i + 4, i + 8... of the input; the root hashes
+ * the four 64-byte leaf values.  A leaf's last block is compressed with
+ * the final flag, so a stride of four blocks is only compressed once
+ * more input is seen behind all of them: up to seven blocks wait in buf
+ * for blake2bp_final.  Until then the leaves have taken equal counts, and
+ * with AVX2 a stride is one compression with a leaf in each 64-bit lane,
+ * the message words transposed into place as they are loaded and the
+ * rotations by whole bytes done as byte shuffles.  Without it the 64-bit
+ * rotations of SSE2 take three instructions and gathering the lanes
+ * costs more than it saves, so the leaves go one at a time.
+ */
+
+#include <string.h>
+#include <pthread.h>
+#include "blake2.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define BLAKE2_AVX2 __attribute__((target("avx2")))
+#endif
+
+#define B2_BLOCK  128
+#define B2_STRIDE (4 * B2_BLOCK)
+#define B2_KEEP   (B2_STRIDE + 3 * B2_BLOCK)   /* a stride goes once more follows */
+
+static const u_int64_t b2_iv[8] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+    0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+};
+
+static const unsigned char b2_sigma[12][16] = {
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+    { 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+    {  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+    {  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+    {  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+    { 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+    { 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+    {  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+    { 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 }
+};
+
+static pthread_once_t blake2_once = PTHREAD_ONCE_INIT;
+static int blake2_avx2_ok;
+
+static void blake2_init(void) {
+#if defined(__x86_64__)
+    blake2_avx2_ok = __builtin_cpu_supports("avx2");
+#endif
+}
+
+static u_int64_t b2_load(const unsigned char *p) {
+    return (u_int64_t)p[0] | (u_int64_t)p[1] << 8 | (u_int64_t)p[2] << 16 | (u_int64_t)p[3] << 24 |
+           (u_int64_t)p[4] << 32 | (u_int64_t)p[5] << 40 | (u_int64_t)p[6] << 48 | (u_int64_t)p[7] << 56;
+}
+
+static void b2_store(unsigned char *p, u_int64_t v) {
+    int i;
+    for (i = 0; i < 8; i++, v >>= 8)
+        p[i] = (unsigned char)v;
+}
+
+/* the same for a u_int64_t or a vector of them; R rotates right */
+#define B2_ROTR(x, n) ((x) >> (n) | (x) << (64 - (n)))
+
+#define B2_G(R, a, b, c, d, x, y)               \
+    do {                                        \
+        a = a + b + (x); d = R(d ^ a, 32);      \
+        c = c + d;       b = R(b ^ c, 24);      \
+        a = a + b + (y); d = R(d ^ a, 16);      \
+        c = c + d;       b = R(b ^ c, 63);      \
+    } while (0)
+
+/* unrolled, so that the message schedule is constant */
+#define B2_ROUNDS(R, v, m)                                                \
+    _Pragma("GCC unroll 12")                                              \
+    for (r = 0; r < 12; r++) {                                            \
+        s = b2_sigma[r];                                                  \
+        B2_G(R, v[0], v[4], v[8],  v[12], m[s[0]],  m[s[1]]);             \
+        B2_G(R, v[1], v[5], v[9],  v[13], m[s[2]],  m[s[3]]);             \
+        B2_G(R, v[2], v[6], v[10], v[14], m[s[4]],  m[s[5]]);             \
+        B2_G(R, v[3], v[7], v[11], v[15], m[s[6]],  m[s[7]]);             \
+        B2_G(R, v[0], v[5], v[10], v[15], m[s[8]],  m[s[9]]);             \
+        B2_G(R, v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);            \
+        B2_G(R, v[2], v[7], v[8],  v[13], m[s[12]], m[s[13]]);            \
+        B2_G(R, v[3], v[4], v[9],  v[14], m[s[14]], m[s[15]]);            \
+    }
+
+/* one BLAKE2b compression; t counts the bytes up to the end of the block */
+static void b2_compress(u_int64_t h[8], const unsigned char *p, u_int64_t t,
+                        u_int64_t last, u_int64_t last_node) {
+    u_int64_t v[16], m[16];
+    const unsigned char *s;
+    int i, r;
+
+    for (i = 0; i < 16; i++)
+        m[i] = b2_load(p + 8 * i);
+    for (i = 0; i < 8; i++) {
+        v[i] = h[i];
+        v[i + 8] = b2_iv[i];
+    }
+    v[12] ^= t;
+    v[14] ^= last;
+    v[15] ^= last_node;
+    B2_ROUNDS(B2_ROTR, v, m)
+    for (i = 0; i < 8; i++)
+        h[i] ^= v[i] ^ v[i + 8];
+}
+
+/* strides of four blocks, a block to each leaf, one leaf at a time */
+static void b2_strides_sw(blake2bp_t *S, const unsigned char *p, size_t strides) {
+    u_int64_t h[8];
+    size_t k;
+    int i, w;
+
+    for (i = 0; i < 4; i++) {
+        for (w = 0; w < 8; w++)
+            h[w] = S->h[w][i];
+        for (k = 0; k < strides; k++)
+            b2_compress(h, p + k * B2_STRIDE + i * B2_BLOCK, S->count + (k + 1) * B2_BLOCK, 0, 0);
+        for (w = 0; w < 8; w++)
+            S->h[w][i] = h[w];
+    }
+}
+
+#ifdef BLAKE2_AVX2
+/* the rotations by whole bytes are byte shuffles within each lane */
+#define B2_ROTR_AVX2(x, n)                                                          \
+    ((n) == 32 ? _mm256_shuffle_epi32((x), _MM_SHUFFLE(2, 3, 0, 1)) :                \
+     (n) == 24 ? _mm256_shuffle_epi8((x), rot24) :                                  \
+     (n) == 16 ? _mm256_shuffle_epi8((x), rot16) :                                  \
+     _mm256_or_si256(_mm256_srli_epi64((x), 63), _mm256_add_epi64((x), (x))))
+
+/* word j of the four blocks at p, 128 bytes apart, for j in w..w + 3 */
+#define B2_LOAD4_AVX2(m, p, w)                                                      \
+    do {                                                                            \
+        __m256i a = _mm256_loadu_si256((const __m256i *)((p) + 8 * (w))),           \
+                b = _mm256_loadu_si256((const __m256i *)((p) + B2_BLOCK + 8 * (w))), \
+                c = _mm256_loadu_si256((const __m256i *)((p) + 2 * B2_BLOCK + 8 * (w))), \
+                d = _mm256_loadu_si256((const __m256i *)((p) + 3 * B2_BLOCK + 8 * (w))), \
+                ab0 = _mm256_unpacklo_epi64(a, b), ab1 = _mm256_unpackhi_epi64(a, b), \
+                cd0 = _mm256_unpacklo_epi64(c, d), cd1 = _mm256_unpackhi_epi64(c, d); \
+        m[(w)]     = _mm256_permute2x128_si256(ab0, cd0, 0x20);                     \
+        m[(w) + 1] = _mm256_permute2x128_si256(ab1, cd1, 0x20);                     \
+        m[(w) + 2] = _mm256_permute2x128_si256(ab0, cd0, 0x31);                     \
+        m[(w) + 3] = _mm256_permute2x128_si256(ab1, cd1, 0x31);                     \
+    } while (0)
+
+/* the same, the four leaves at once (x86-64 is little-endian, so the
+   words load as they are) */
+static BLAKE2_AVX2 void b2_strides_avx2(blake2bp_t *S, const unsigned char *p, size_t strides) {
+    const __m256i rot24 = _mm256_setr_epi8(3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10,
+                                           3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10);
+    const __m256i rot16 = _mm256_setr_epi8(2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9,
+                                           2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9);
+    __m256i h[8], v[16], m[16];
+    const unsigned char *s;
+    u_int64_t t = S->count;
+    int i, r;
+
+    memcpy(h, S->h, sizeof(h));
+    for (; strides > 0; strides--, p += B2_STRIDE) {
+        B2_LOAD4_AVX2(m, p, 0);
+        B2_LOAD4_AVX2(m, p, 4);
+        B2_LOAD4_AVX2(m, p, 8);
+        B2_LOAD4_AVX2(m, p, 12);
+        for (i = 0; i < 8; i++) {
+            v[i] = h[i];
+            v[i + 8] = _mm256_set1_epi64x((long long)b2_iv[i]);
+        }
+        t += B2_BLOCK;
+        v[12] = _mm256_xor_si256(v[12], _mm256_set1_epi64x((long long)t));
+        B2_ROUNDS(B2_ROTR_AVX2, v, m)
+        for (i = 0; i < 8; i++)
+            h[i] = _mm256_xor_si256(h[i], _mm256_xor_si256(v[i], v[i + 8]));
+    }
+    memcpy(S->h, h, sizeof(h));
+}
+#endif
+
+static void b2_strides(blake2bp_t *S, const unsigned char *p, size_t strides) {
+    if (S->sw)
+        b2_strides_sw(S, p, strides);
+#ifdef BLAKE2_AVX2
+    else if (blake2_avx2_ok)
+        b2_strides_avx2(S, p, strides);
+#endif
+    else
+        b2_strides_sw(S, p, strides);
+    S->count += strides * B2_BLOCK;
+}
+
+/* the parameter block of a node: 32-byte digest, fanout 4, depth 2,
+   64-byte leaf values */
+static void b2_node(u_int64_t h[8], int offset, int depth) {
+    memcpy(h, b2_iv, sizeof(b2_iv));
+    h[0] ^= BLAKE2_LEN | 4 << 16 | 2 << 24;
+    h[1] ^= (u_int64_t)offset;
+    h[2] ^= (u_int64_t)depth | 64 << 8;
+}
+
+void blake2bp_init(blake2bp_t *S) {
+    u_int64_t h[8];
+    int i, w;
+
+    pthread_once(&blake2_once, blake2_init);
+    for (i = 0; i < 4; i++) {
+        b2_node(h, i, 0);
+        for (w = 0; w < 8; w++)
+            S->h[w][i] = h[w];
+    }
+    S->count = 0;
+    S->buflen = 0;
+    S->sw = 0;
+}
+
+void blake2bp_update(blake2bp_t *S, const void *buf, size_t len) {
+    const unsigned char *in = buf;
+    size_t take, strides;
+
+    for (;;) {
+        if (S->buflen >= B2_STRIDE) {
+            /* the buffered stride goes if enough follows it */
+            if (S->buflen + len <= B2_KEEP) {
+                memcpy(S->buf + S->buflen, in, len);
+                S->buflen += len;
+                return;
+            }
+            b2_strides(S, S->buf, 1);
+            memmove(S->buf, S->buf + B2_STRIDE, S->buflen - B2_STRIDE);
+            S->buflen -= B2_STRIDE;
+        } else if (S->buflen > 0) {
+            /* fill the buffer up to a stride */
+            take = B2_STRIDE - S->buflen < len ? B2_STRIDE - S->buflen : len;
+            memcpy(S->buf + S->buflen, in, take);
+            S->buflen += take;
+            in += take;
+            len -= take;
+            if (S->buflen < B2_STRIDE)
+                return;
+        } else {
+            /* straight from the input, keeping the tail */
+            strides = len > B2_KEEP ? (len - B2_KEEP + B2_STRIDE - 1) / B2_STRIDE : 0;
+            if (strides > 0)
+                b2_strides(S, in, strides);
+            in += strides * B2_STRIDE;
+            len -= strides * B2_STRIDE;
+            memcpy(S->buf, in, len);
+            S->buflen = len;
+            return;
+        }
+    }
+}
+
+void blake2bp_final(blake2bp_t *S, unsigned char out[BLAKE2_LEN]) {
+    unsigned char leaves[4 * 64], block[B2_BLOCK];
+    u_int64_t h[8], count;
+    size_t at, n;
+    int i, w;
+
+    /* leaf i's blocks in the tail are i and, if there is one, i + 4 */
+    for (i = 0; i < 4; i++) {
+        for (w = 0; w < 8; w++)
+            h[w] = S->h[w][i];
+        at = i * B2_BLOCK;
+        count = S->count;
+        if (S->buflen > at + B2_STRIDE) {
+            count += B2_BLOCK;
+            b2_compress(h, S->buf + at, count, 0, 0);
+            at += B2_STRIDE;
+        }
+        n = S->buflen <= at ? 0 : S->buflen - at < B2_BLOCK ? S->buflen - at : B2_BLOCK;
+        memset(block, 0, sizeof(block));
+        memcpy(block, S->buf + at, n);
+        b2_compress(h, block, count + n, ~0ULL, i == 3 ? ~0ULL : 0);
+        for (w = 0; w < 8; w++)
+            b2_store(leaves + i * 64 + w * 8, h[w]);
+    }
+    b2_node(h, 0, 1);
+    b2_compress(h, leaves, B2_BLOCK, 0, 0);
+    b2_compress(h, leaves + B2_BLOCK, 2 * B2_BLOCK, ~0ULL, ~0ULL);
+    for (w = 0; w < BLAKE2_LEN / 8; w++)
+        b2_store(out + w * 8, h[w]);
+}
+
+void blake2bp(unsigned char out[BLAKE2_LEN], const void *buf, size_t len) {
+    blake2bp_t S;
+
+    blake2bp_init(&S);
+    blake2bp_update(&S, buf, len);
+    blake2bp_final(&S, out);
+}
+
+void blake2bp_sw(unsigned char out[BLAKE2_LEN], const void *buf, size_t len) {
+    blake2bp_t S;
+
+    blake2bp_init(&S);
+    S.sw = 1;
+    blake2bp_update(&S, buf, len);
+    blake2bp_final(&S, out);
+}
+
+void blake2b(unsigned char *out, size_t outlen, const void *buf, size_t len) {
+    const unsigned char *in = buf;
+    unsigned char block[B2_BLOCK], word[8];
+    u_int64_t h[8];
+    size_t at, w;
+
+    memcpy(h, b2_iv, sizeof(b2_iv));
+    h[0] ^= outlen | 1 << 16 | 1 << 24;
+    for (at = 0; len - at > B2_BLOCK; at += B2_BLOCK)
+        b2_compress(h, in + at, at + B2_BLOCK, 0, 0);
+    memset(block, 0, sizeof(block));
+    memcpy(block, in + at, len - at);
+    b2_compress(h, block, len, ~0ULL, 0);
+    for (w = 0; w < outlen; w += 8) {
+        b2_store(word, h[w / 8]);
+        memcpy(out + w, word, outlen - w < 8 ? outlen - w : 8);
+    }
+}
+
+const char *blake2bp_impl(void) {
+    pthread_once(&blake2_once, blake2_init);
+    return blake2_avx2_ok ? "avx2" : "scalar";
+}
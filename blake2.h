@@ -0,0 +1,42 @@
+/*
+ * BLAKE2bp-256 (RFC 7693 BLAKE2b, four leaves under a root as in the
+ * BLAKE2 paper) for the file digests of hash_file.  The four leaves take
+ * alternate 128-byte blocks, so where the CPU has AVX2 (checked at run
+ * time) they are computed side by side in the lanes of 256-bit vectors,
+ * and one after the other otherwise.
+ */
+
+#ifndef SSNFS_BLAKE2_H
+#define SSNFS_BLAKE2_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define BLAKE2_LEN 32                   /* digest bytes */
+
+typedef struct {
+    u_int64_t     h[8][4];              /* the leaves' chain values, word by word */
+    u_int64_t     count;                /* bytes each leaf has compressed */
+    unsigned char buf[896];             /* the tail, held back for the last blocks */
+    size_t        buflen;
+    int           sw;                   /* one leaf at a time */
+} blake2bp_t;
+
+void blake2bp_init(blake2bp_t *S);
+void blake2bp_update(blake2bp_t *S, const void *buf, size_t len);
+void blake2bp_final(blake2bp_t *S, unsigned char out[BLAKE2_LEN]);
+
+/* the digest of len bytes at buf in one go */
+void blake2bp(unsigned char out[BLAKE2_LEN], const void *buf, size_t len);
+
+/* the same without vector instructions */
+void blake2bp_sw(unsigned char out[BLAKE2_LEN], const void *buf, size_t len);
+
+/* plain BLAKE2b with an outlen-byte digest (1 to 64), one block after
+   another: for short inputs, which the four leaves only slow down */
+void blake2b(unsigned char *out, size_t outlen, const void *buf, size_t len);
+
+/* "avx2" or "scalar", whichever blake2bp() uses */
+const char *blake2bp_impl(void);
+
+#endif /* SSNFS_BLAKE2_H */
@@ -1,6 +1,26 @@
 /*
- * SSNFS client: implements Create, Open, Read, Write, Seek, List, Delete, Close
- * and then runs the instructor's test code in main.
+ * SSNFS client: implements Create, Open, Read, Write, Seek, List, Delete, Close,
+ * the whole-file Get/Put calls, and then runs the instructor's test code in main.
+ *
+ * With SSNFS_CACHE=1 in the environment (or CacheEnable(1)) file blocks and
+ * the directory listing are cached locally under read leases granted by the
+ * server.  While a lease runs no other client can change the file, so
+ * repeated reads, seeks and lists are answered without a round trip.
+ *
+ * Unless SSNFS_SYNC=1 is set (or BufferIO(0) is called) writes are buffered
+ * and sent by a background thread in IO_BLOCK multiples, and sequential
+ * readers get read-ahead: small reads are served from a prefetched window
+ * while the next window is fetched in the background.  Buffered writes are
+ * flushed on Close, Seek, Read of the same descriptor, Flush and at exit; a
+ * failed background write is reported by the next call on that descriptor.
+ *
+ * PutDelta replaces a file as Put does but sends only what changed: the
+ * server signs its copy, the client works out a delta against the
+ * signature (delta.h) and the server patches the file from it.
+ *
+ * Export writes the whole home directory to a local file as one stream of
+ * its files and Import loads such a stream back, a megabyte per call,
+ * to move or back up a user without a call per file.
  */
 
 #include <stdlib.h>
@@ -8,13 +28,93 @@
 #include <string.h>
 #include <unistd.h>
 #include <pwd.h>
+#include <time.h>
+#include <pthread.h>
 #include <rpc/rpc.h>
 
 #include "ssnfs.h"
+#include "delta.h"
 
+#define CACHE_BLOCK     4096    /* unit of cached file data */
+#define CACHE_BLOCKS    64
+#define CACHE_LEASES    16
+#define MAX_CLIENT_FDS  20
+#define RETRY_SECS      30      /* give up on RETRY_LATER after this long */
+#define IO_BLOCK        4096
+#define WB_SIZE         (4 * IO_BLOCK)  /* write-behind batch */
+#define RA_SIZE         (4 * IO_BLOCK)  /* read-ahead window */
+#define ARC_CHUNK       (1 << 20)       /* stream bytes per export/import call */
+#define EXPORT_TRIES    3               /* restarts when the directory changes */
+
+/* lease on one file, or on the directory listing when file_name is "" */
+typedef struct {
+    int    in_use;
+    char   file_name[FILE_NAME_SIZE];
+    unsigned int version;      /* server change counter the cache matches */
+    long long size;
+    long long max_size;
+    time_t expires;            /* cached data usable until then, 0 if none */
+    time_t denied_until;       /* last request was refused, don't ask again yet */
+    char  *listing;            /* directory lease only: last List output */
+} lease_state_t;
+
+typedef struct {
+    int    valid;
+    char   file_name[FILE_NAME_SIZE];
+    long long index;           /* block number within the file */
+    int    len;                /* bytes held, short at the end of the file */
+    unsigned long used;        /* LRU stamp */
+    char   data[CACHE_BLOCK];
+} cache_block_t;
+
+enum { IO_IDLE, IO_QUEUED, IO_RUNNING, IO_READY, IO_STALE };
+
+/* Position the application sees vs. the one the server's open entry has;
+   they differ after cached or buffered I/O.  srv_pos is only touched with
+   rpc_lock held, everything else with lib_lock held. */
+typedef struct {
+    int   in_use;
+    int   fd;
+    char  file_name[FILE_NAME_SIZE];
+    long long pos;
+    long long srv_pos;
+    int   error;               /* a background write failed */
+
+    char *wb;                  /* writes being collected */
+    long long wb_off;
+    int   wb_len;
+    char *wf;                  /* batch handed to the I/O thread */
+    long long wf_off;
+    int   wf_len, wf_state;
+
+    long long last_end;        /* where the previous read stopped */
+    char *ra;                  /* read-ahead window */
+    long long ra_off;
+    int   ra_len;
+    char *pf;                  /* next window, fetched in the background */
+    long long pf_off;
+    int   pf_len, pf_state;
+} client_fd_t;
 
 CLIENT *clnt;
 
+static int           cache_on;
+static int           buffer_on = 1;
+static unsigned long cache_clock;
+static lease_state_t lease_state[CACHE_LEASES];
+static cache_block_t cache[CACHE_BLOCKS];
+static client_fd_t   client_fds[MAX_CLIENT_FDS];
+static unsigned long cache_hits, cache_misses; /* per block */
+static unsigned long ra_reads, ra_misses;      /* per Read() */
+
+static pthread_mutex_t lib_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t rpc_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  io_work = PTHREAD_COND_INITIALIZER;  /* job queued */
+static pthread_cond_t  io_done = PTHREAD_COND_INITIALIZER;  /* job finished */
+static pthread_once_t  io_once = PTHREAD_ONCE_INIT;
+
+void FlushAll(void);
+
 /* connect to server */
 void ssnfsprog_1(char *host) {
     clnt = clnt_create(host, SSNFSPROG, SSNFSVER, "tcp");
@@ -36,70 +136,702 @@ static void get_login(char *dst) {
     }
 }
 
+static void set_name(char *dst, const char *name) {
+    strncpy(dst, name, FILE_NAME_SIZE - 1);
+    dst[FILE_NAME_SIZE - 1] = '\0';
+}
+
+static client_fd_t *cfd_find(int fd) {
+    int i;
+    for (i = 0; i < MAX_CLIENT_FDS; i++) {
+        if (client_fds[i].in_use && client_fds[i].fd == fd)
+            return &client_fds[i];
+    }
+    return NULL;
+}
+
+static void cfd_add(int fd, const char *name) {
+    client_fd_t *c = NULL;
+    char *bufs;
+    int i;
+    for (i = 0; i < MAX_CLIENT_FDS; i++) {
+        if (!client_fds[i].in_use) {
+            c = &client_fds[i];
+            break;
+        }
+    }
+    if (c == NULL) return;
+    bufs = buffer_on ? malloc(2 * WB_SIZE + 2 * RA_SIZE) : NULL;
+    memset(c, 0, sizeof(*c));
+    c->in_use = 1;
+    c->fd = fd;
+    set_name(c->file_name, name);
+    if (bufs) {
+        c->wb = bufs;
+        c->wf = bufs + WB_SIZE;
+        c->ra = bufs + 2 * WB_SIZE;
+        c->pf = bufs + 2 * WB_SIZE + RA_SIZE;
+    }
+}
+
+/* drop every cached block of a file */
+static void cache_drop(const char *name) {
+    int i;
+    for (i = 0; i < CACHE_BLOCKS; i++) {
+        if (cache[i].valid &&
+            strncmp(cache[i].file_name, name, FILE_NAME_SIZE) == 0)
+            cache[i].valid = 0;
+    }
+}
+
+static cache_block_t *cache_find(const char *name, long long index) {
+    int i;
+    for (i = 0; i < CACHE_BLOCKS; i++) {
+        if (cache[i].valid && cache[i].index == index &&
+            strncmp(cache[i].file_name, name, FILE_NAME_SIZE) == 0) {
+            cache[i].used = ++cache_clock;
+            return &cache[i];
+        }
+    }
+    return NULL;
+}
+
+static cache_block_t *cache_alloc(const char *name, long long index) {
+    cache_block_t *b = cache_find(name, index);
+    int i;
+    if (b) return b;
+    b = &cache[0];
+    for (i = 0; i < CACHE_BLOCKS; i++) {
+        if (!cache[i].valid) {
+            b = &cache[i];
+            break;
+        }
+        if (cache[i].used < b->used)
+            b = &cache[i];
+    }
+    b->valid = 1;
+    set_name(b->file_name, name);
+    b->index = index;
+    b->len = 0;
+    b->used = ++cache_clock;
+    return b;
+}
+
+/* write-through: patch blocks we already hold with bytes just written */
+static void cache_update(const char *name, long long pos, const char *buf, int n) {
+    while (n > 0) {
+        long long index = pos / CACHE_BLOCK;
+        int off = (int)(pos % CACHE_BLOCK);
+        int k = CACHE_BLOCK - off;
+        cache_block_t *b = cache_find(name, index);
+        if (k > n) k = n;
+        if (b) {
+            if (off <= b->len) {
+                memcpy(b->data + off, buf, k);
+                if (off + k > b->len) b->len = off + k;
+            } else {
+                b->valid = 0;   /* would leave a gap in the block */
+            }
+        }
+        pos += k;
+        buf += k;
+        n -= k;
+    }
+}
+
+static lease_state_t *lease_find(const char *name) {
+    int i;
+    for (i = 0; i < CACHE_LEASES; i++) {
+        if (lease_state[i].in_use &&
+            strncmp(lease_state[i].file_name, name, FILE_NAME_SIZE) == 0)
+            return &lease_state[i];
+    }
+    return NULL;
+}
+
+static int lease_valid(lease_state_t *ls) {
+    return ls != NULL && ls->expires > time(NULL);
+}
+
+static void lease_forget(lease_state_t *ls) {
+    cache_drop(ls->file_name);
+    free(ls->listing);
+    ls->listing = NULL;
+    ls->in_use = 0;
+}
+
+static lease_state_t *lease_slot(const char *name) {
+    lease_state_t *ls = lease_find(name);
+    int i;
+    if (ls) return ls;
+    ls = &lease_state[0];
+    for (i = 0; i < CACHE_LEASES; i++) {
+        if (!lease_state[i].in_use) {
+            ls = &lease_state[i];
+            break;
+        }
+        if (lease_state[i].expires < ls->expires)
+            ls = &lease_state[i];
+    }
+    if (ls->in_use)
+        lease_forget(ls);
+    memset(ls, 0, sizeof(*ls));
+    ls->in_use = 1;
+    set_name(ls->file_name, name);
+    return ls;
+}
+
+/* (re)acquire the lease; cached data survives if the version still matches */
+static lease_state_t *lease_acquire(const char *name) {
+    lease_output  *result;
+    lease_input    arg;
+    lease_state_t *ls = lease_slot(name);
+    time_t         sent = time(NULL);
+
+    get_login(arg.user_name);
+    set_name(arg.file_name, name);
+    arg.op = LEASE_ACQUIRE;
+
+    pthread_mutex_lock(&rpc_lock);
+    result = lease_file_1(&arg, clnt);
+    if (result == NULL || result->granted != 1) {
+        pthread_mutex_unlock(&rpc_lock);
+        cache_drop(name);
+        free(ls->listing);
+        ls->listing = NULL;
+        ls->expires = 0;
+        ls->denied_until = sent + 2;
+        return NULL;
+    }
+    if (result->file_version != ls->version) {
+        cache_drop(name);
+        free(ls->listing);
+        ls->listing = NULL;
+    }
+    ls->version = result->file_version;
+    ls->size = result->size;
+    ls->max_size = result->max_size;
+    /* measured from when we asked, minus a second of slack */
+    ls->expires = sent + result->seconds - 1;
+    pthread_mutex_unlock(&rpc_lock);
+    return ls;
+}
+
+static void lease_release(const char *name) {
+    lease_input    arg;
+    lease_state_t *ls = lease_find(name);
+
+    if (!lease_valid(ls)) return;
+    get_login(arg.user_name);
+    set_name(arg.file_name, name);
+    arg.op = LEASE_RELEASE;
+    pthread_mutex_lock(&rpc_lock);
+    lease_file_1(&arg, clnt);
+    pthread_mutex_unlock(&rpc_lock);
+    ls->expires = 0;    /* blocks kept, revalidated by version on reopen */
+}
+
+/* lease to use for a cached operation, NULL if caching is off or denied */
+static lease_state_t *lease_check(const char *name) {
+    lease_state_t *ls;
+    if (!cache_on) return NULL;
+    ls = lease_find(name);
+    if (lease_valid(ls)) return ls;
+    if (ls && ls->denied_until > time(NULL)) return NULL;
+    return lease_acquire(name);
+}
+
+/* a change we made went through; keep our lease in step with the server */
+static void lease_changed(const char *name) {
+    lease_state_t *ls = lease_find(name);
+    if (lease_valid(ls))
+        ls->version++;
+    else if (ls)
+        lease_forget(ls);
+}
+
+/* move the server's file position to where the application thinks it is;
+   called with rpc_lock held */
+static int sync_pos(client_fd_t *c, long long pos) {
+    seek_output *result;
+    seek_input   arg;
+
+    if (c->srv_pos == pos) return 0;
+    get_login(arg.user_name);
+    arg.fd = c->fd;
+    arg.position = pos;
+    result = seek_position_1(&arg, clnt);
+    if (result == NULL || result->success != 1)
+        return -1;
+    c->srv_pos = pos;
+    return 0;
+}
+
+/* one read through the open fd at pos; rpc_lock held.  Returns bytes or -1 */
+static int read_at(client_fd_t *c, long long pos, char *buf, int n, char *err, int errlen) {
+    read_output *result;
+    read_input   arg;
+    int          bytes;
+
+    if (sync_pos(c, pos) < 0) {
+        snprintf(err, errlen, "cannot restore file position");
+        return -1;
+    }
+    get_login(arg.user_name);
+    arg.fd = c->fd;
+    arg.numbytes = n;
+    result = read_file_1(&arg, clnt);
+    if (result == NULL) {
+        snprintf(err, errlen, "%s", clnt_sperror(clnt, "read_file_1 failed"));
+        return -1;
+    }
+    if (result->success != 1) {
+        snprintf(err, errlen, "%s", result->out_msg.out_msg_val);
+        return -1;
+    }
+    bytes = (int)result->buffer.buffer_len;
+    c->srv_pos += bytes;
+    if (bytes > n) bytes = n;
+    memcpy(buf, result->buffer.buffer_val, bytes);
+    return bytes;
+}
+
+/* one write through the open fd at pos, retrying while another client's
+   lease runs out; rpc_lock held.  Returns the server's success code. */
+static int write_at(client_fd_t *c, int fd, long long pos, const char *buf, int n,
+                    char *msg, int msglen) {
+    write_output *result;
+    write_input   arg;
+    time_t        start = time(NULL);
+
+    if (c && sync_pos(c, pos) < 0) {
+        snprintf(msg, msglen, "cannot restore file position");
+        return -1;
+    }
+    get_login(arg.user_name);
+    arg.fd = fd;
+    arg.numbytes = n;
+
+    /* Copy into a writable buffer; XDR will operate on this */
+    arg.buffer.buffer_len = n;
+    arg.buffer.buffer_val = malloc(n > 0 ? n : 1);
+    if (arg.buffer.buffer_val == NULL) {
+        snprintf(msg, msglen, "Write alloc failed");
+        return -1;
+    }
+    memcpy(arg.buffer.buffer_val, buf, n);
+
+    for (;;) {
+        result = write_file_1(&arg, clnt);
+        if (result == NULL) {
+            snprintf(msg, msglen, "%s", clnt_sperror(clnt, "write_file_1 failed"));
+            free(arg.buffer.buffer_val);
+            return -1;
+        }
+        if (result->success != RETRY_LATER || time(NULL) - start > RETRY_SECS)
+            break;
+        pthread_mutex_unlock(&rpc_lock);
+        sleep(1);
+        pthread_mutex_lock(&rpc_lock);
+        if (c && sync_pos(c, pos) < 0) {
+            snprintf(msg, msglen, "cannot restore file position");
+            free(arg.buffer.buffer_val);
+            return -1;
+        }
+    }
+    free(arg.buffer.buffer_val);
+    snprintf(msg, msglen, "%s", result->out_msg.out_msg_val);
+    if (result->success == 1 && c)
+        c->srv_pos = pos + n;
+    return result->success;
+}
+
+/* bookkeeping after a write reached the server; lib_lock held */
+static void wrote_through(client_fd_t *c, long long pos, const char *buf, int n) {
+    lease_state_t *ls = lease_find(c->file_name);
+    cache_update(c->file_name, pos, buf, n);
+    lease_changed(c->file_name);
+    if (ls && ls->in_use && pos + n > ls->size)
+        ls->size = pos + n;
+}
+
+/* background thread: sends write-behind batches and fetches read-ahead */
+static void *io_thread(void *unused) {
+    char msg[256];
+    int  i, ok;
+
+    pthread_mutex_lock(&lib_lock);
+    for (;;) {
+        client_fd_t *c = NULL;
+        int write_job = 0;
+        for (i = 0; i < MAX_CLIENT_FDS && c == NULL; i++) {
+            if (!client_fds[i].in_use) continue;
+            if (client_fds[i].wf_state == IO_QUEUED) {
+                c = &client_fds[i];
+                write_job = 1;
+            } else if (client_fds[i].pf_state == IO_QUEUED) {
+                c = &client_fds[i];
+            }
+        }
+        if (c == NULL) {
+            pthread_cond_wait(&io_work, &lib_lock);
+            continue;
+        }
+
+        if (write_job) {
+            c->wf_state = IO_RUNNING;
+            pthread_mutex_unlock(&lib_lock);
+            pthread_mutex_lock(&rpc_lock);
+            ok = write_at(c, c->fd, c->wf_off, c->wf, c->wf_len, msg, sizeof(msg)) == 1;
+            pthread_mutex_unlock(&rpc_lock);
+            pthread_mutex_lock(&lib_lock);
+            if (ok) {
+                wrote_through(c, c->wf_off, c->wf, c->wf_len);
+            } else {
+                fprintf(stderr, "Write error (fd %d): %s\n", c->fd, msg);
+                c->error = 1;
+            }
+            c->wf_state = IO_IDLE;
+        } else {
+            c->pf_state = IO_RUNNING;
+            pthread_mutex_unlock(&lib_lock);
+            pthread_mutex_lock(&rpc_lock);
+            c->pf_len = read_at(c, c->pf_off, c->pf, RA_SIZE, msg, sizeof(msg));
+            pthread_mutex_unlock(&rpc_lock);
+            pthread_mutex_lock(&lib_lock);
+            if (c->pf_state == IO_STALE || c->pf_len <= 0)
+                c->pf_state = IO_IDLE;
+            else
+                c->pf_state = IO_READY;
+        }
+        pthread_cond_broadcast(&io_done);
+    }
+    return NULL;
+}
+
+static void io_start(void) {
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, io_thread, NULL) == 0)
+        pthread_detach(tid);
+    atexit(FlushAll);
+}
+
+/* hand the collected writes to the I/O thread; lib_lock held */
+static void wb_submit(client_fd_t *c) {
+    char *t;
+    if (c->wb_len == 0) return;
+    pthread_once(&io_once, io_start);
+    while (c->wf_state != IO_IDLE)
+        pthread_cond_wait(&io_done, &lib_lock);
+    t = c->wf;
+    c->wf = c->wb;
+    c->wb = t;
+    c->wf_off = c->wb_off;
+    c->wf_len = c->wb_len;
+    c->wf_state = IO_QUEUED;
+    c->wb_len = 0;
+    pthread_cond_signal(&io_work);
+}
+
+/* push out buffered writes and wait for them; -1 if any failed */
+static int wb_flush(client_fd_t *c) {
+    wb_submit(c);
+    while (c->wf_state != IO_IDLE)
+        pthread_cond_wait(&io_done, &lib_lock);
+    if (c->error) {
+        c->error = 0;
+        return -1;
+    }
+    return 0;
+}
+
+/* forget read-ahead data; a running prefetch is discarded when it lands */
+static void ra_drop(client_fd_t *c) {
+    c->ra_len = 0;
+    if (c->pf_state == IO_QUEUED || c->pf_state == IO_READY)
+        c->pf_state = IO_IDLE;
+    else if (c->pf_state == IO_RUNNING)
+        c->pf_state = IO_STALE;
+}
+
+/* wait until the I/O thread no longer touches this descriptor */
+static void io_quiesce(client_fd_t *c) {
+    if (c->pf_state == IO_QUEUED)
+        c->pf_state = IO_IDLE;
+    while (c->wf_state != IO_IDLE || c->pf_state == IO_RUNNING ||
+           c->pf_state == IO_STALE)
+        pthread_cond_wait(&io_done, &lib_lock);
+}
+
+/* fetch one cache block through the open fd */
+static cache_block_t *cache_fill(client_fd_t *c, long long index) {
+    cache_block_t *b;
+    char           tmp[CACHE_BLOCK], err[256];
+    int            len;
+
+    pthread_mutex_lock(&rpc_lock);
+    len = read_at(c, index * CACHE_BLOCK, tmp, CACHE_BLOCK, err, sizeof(err));
+    pthread_mutex_unlock(&rpc_lock);
+    if (len < 0)
+        return NULL;
+    b = cache_alloc(c->file_name, index);
+    b->len = len;
+    memcpy(b->data, tmp, len);
+    return b;
+}
+
+/* copy from cached blocks, filling misses; 0 means use the plain path */
+static int cache_read(client_fd_t *c, char *buf, int n) {
+    int got = 0;
+    while (got < n) {
+        long long index = c->pos / CACHE_BLOCK;
+        int off = (int)(c->pos % CACHE_BLOCK), k;
+        cache_block_t *b = cache_find(c->file_name, index);
+        if (b) {
+            cache_hits++;
+        } else {
+            cache_misses++;
+            b = cache_fill(c, index);
+        }
+        if (!b || off >= b->len) break;
+        k = b->len - off;
+        if (k > n - got) k = n - got;
+        memcpy(buf + got, b->data + off, k);
+        got += k;
+        c->pos += k;
+        if (b->len < CACHE_BLOCK) break;    /* end of file */
+    }
+    return got;
+}
+
+/* Serve a read from the read-ahead window, refilling it on a miss and
+   queueing the next window when the reader is sequential. */
+static int ra_read(client_fd_t *c, char *buf, int n) {
+    int  seq = (c->pos == c->last_end);
+    int  got = 0, want, len;
+    char err[256];
+
+    ra_reads++;
+    while (got < n) {
+        if (c->pos >= c->ra_off && c->pos < c->ra_off + c->ra_len) {
+            int k = (int)(c->ra_off + c->ra_len - c->pos);
+            if (k > n - got) k = n - got;
+            memcpy(buf + got, c->ra + (c->pos - c->ra_off), k);
+            got += k;
+            c->pos += k;
+            continue;
+        }
+        if (c->pf_state != IO_IDLE && c->pf_state != IO_STALE && c->pf_off == c->pos) {
+            while (c->pf_state == IO_QUEUED || c->pf_state == IO_RUNNING)
+                pthread_cond_wait(&io_done, &lib_lock);
+            if (c->pf_state == IO_READY) {
+                char *t = c->ra;
+                c->ra = c->pf;
+                c->pf = t;
+                c->ra_off = c->pf_off;
+                c->ra_len = c->pf_len;
+                c->pf_state = IO_IDLE;
+                continue;
+            }
+        }
+        if (got > 0) break;
+        ra_misses++;
+        if (c->pf_state == IO_READY)
+            c->pf_state = IO_IDLE;      /* prefetched the wrong window */
+
+        /* miss: large reads go straight to the caller's buffer */
+        want = seq ? RA_SIZE : IO_BLOCK;
+        pthread_mutex_lock(&rpc_lock);
+        if (n > RA_SIZE) {
+            len = read_at(c, c->pos, buf, n, err, sizeof(err));
+            pthread_mutex_unlock(&rpc_lock);
+            if (len < 0) {
+                printf("Read error: %s\n", err);
+                return -1;
+            }
+            c->pos += len;
+            c->last_end = c->pos;
+            return len;
+        }
+        if (want < n) want = n;
+        len = read_at(c, c->pos, c->ra, want, err, sizeof(err));
+        pthread_mutex_unlock(&rpc_lock);
+        if (len <= 0) {
+            c->ra_len = 0;
+            if (len < 0) printf("Read error: %s\n", err);
+            return len < 0 ? -1 : 0;
+        }
+        c->ra_off = c->pos;
+        c->ra_len = len;
+    }
+
+    if (seq && c->pf_state == IO_IDLE && c->ra_len == RA_SIZE) {
+        pthread_once(&io_once, io_start);
+        c->pf_off = c->ra_off + c->ra_len;
+        c->pf_state = IO_QUEUED;
+        pthread_cond_signal(&io_work);
+    }
+    c->last_end = c->pos;
+    return got;
+}
+
+/* turn caching on or off; turning it off forgets everything cached */
+void CacheEnable(int on) {
+    int i;
+    pthread_mutex_lock(&lib_lock);
+    if (!on) {
+        for (i = 0; i < CACHE_LEASES; i++) {
+            if (lease_state[i].in_use) {
+                lease_release(lease_state[i].file_name);
+                lease_forget(&lease_state[i]);
+            }
+        }
+    }
+    cache_on = on;
+    pthread_mutex_unlock(&lib_lock);
+}
+
+/* write-behind and read-ahead for descriptors opened from now on */
+void BufferIO(int on) {
+    pthread_mutex_lock(&lib_lock);
+    buffer_on = on;
+    pthread_mutex_unlock(&lib_lock);
+}
+
+/* send buffered writes of fd now; returns 0 or -1 if any of them failed */
+int Flush(int fd) {
+    client_fd_t *c;
+    int          rc = 0;
+
+    pthread_mutex_lock(&lib_lock);
+    c = cfd_find(fd);
+    if (c && c->wb)
+        rc = wb_flush(c);
+    pthread_mutex_unlock(&lib_lock);
+    return rc;
+}
+
+void FlushAll(void) {
+    int i;
+    pthread_mutex_lock(&lib_lock);
+    for (i = 0; i < MAX_CLIENT_FDS; i++) {
+        if (client_fds[i].in_use && client_fds[i].wb &&
+            wb_flush(&client_fds[i]) < 0)
+            printf("Flush error on fd %d\n", client_fds[i].fd);
+    }
+    pthread_mutex_unlock(&lib_lock);
+}
+
 /* returns fd >= 0 on success, -1 on failure */
 int Open(char *filename_to_open) {
     open_output *result;
     open_input   arg;
+    int          fd;
 
     get_login(arg.user_name);
     strncpy(arg.file_name, filename_to_open, FILE_NAME_SIZE - 1);
     arg.file_name[FILE_NAME_SIZE - 1] = '\0';
 
+    pthread_mutex_lock(&lib_lock);
+    pthread_mutex_lock(&rpc_lock);
     result = open_file_1(&arg, clnt);
     if (result == NULL) {
         clnt_perror(clnt, "open_file_1 failed");
+        pthread_mutex_unlock(&rpc_lock);
+        pthread_mutex_unlock(&lib_lock);
         return -1;
     }
     printf("Open: %s\n", result->out_msg.out_msg_val);
-    return result->fd;
+    fd = result->fd;
+    pthread_mutex_unlock(&rpc_lock);
+    if (fd >= 0) {
+        cfd_add(fd, arg.file_name);
+        lease_check(arg.file_name);
+    }
+    pthread_mutex_unlock(&lib_lock);
+    return fd;
 }
 
 /* returns 1 on success, -1 on failure */
 int Create(char *filename_to_create) {
     create_output *result;
     create_input   arg;
+    time_t         start = time(NULL);
+    int            success;
 
     get_login(arg.user_name);
     strncpy(arg.file_name, filename_to_create, FILE_NAME_SIZE - 1);
     arg.file_name[FILE_NAME_SIZE - 1] = '\0';
 
-    result = create_file_1(&arg, clnt);
-    if (result == NULL) {
-        clnt_perror(clnt, "create_file_1 failed");
-        return -1;
+    pthread_mutex_lock(&lib_lock);
+    pthread_mutex_lock(&rpc_lock);
+    for (;;) {
+        result = create_file_1(&arg, clnt);
+        if (result == NULL) {
+            clnt_perror(clnt, "create_file_1 failed");
+            pthread_mutex_unlock(&rpc_lock);
+            pthread_mutex_unlock(&lib_lock);
+            return -1;
+        }
+        if (result->success != RETRY_LATER || time(NULL) - start > RETRY_SECS)
+            break;
+        sleep(1);
     }
     printf("Create: %s\n", result->out_msg.out_msg_val);
-    return result->success;
+    success = result->success;
+    pthread_mutex_unlock(&rpc_lock);
+    if (success == 1)
+        lease_changed("");
+    pthread_mutex_unlock(&lib_lock);
+    return success;
 }
 
-/* returns number of bytes written or -1 */
+/* returns number of bytes written (or buffered) or -1 */
 int Write(int fd, const char *buf, int n) {
-    write_output *result;
-    write_input   arg;
-    char          tmp[1024];    /* big enough for n */
+    client_fd_t *c;
+    char         msg[256];
+    int          done = 0, rc;
 
-    if (n > (int)sizeof(tmp)) {
-        fprintf(stderr, "Write error: n=%d too large\n", n);
+    pthread_mutex_lock(&lib_lock);
+    c = cfd_find(fd);
+    if (c && c->error) {
+        c->error = 0;
+        pthread_mutex_unlock(&lib_lock);
+        printf("Write error: an earlier buffered write failed\n");
         return -1;
     }
 
-    get_login(arg.user_name);
-    arg.fd = fd;
-    arg.numbytes = n;
-
-    /* Copy into a writable buffer; XDR will operate on this */
-    memcpy(tmp, buf, n);
-    arg.buffer.buffer_len = n;
-    arg.buffer.buffer_val = tmp;
-
-    result = write_file_1(&arg, clnt);
-    if (result == NULL) {
-        clnt_perror(clnt, "write_file_1 failed");
-        return -1;
+    if (c && c->wb) {
+        ra_drop(c);
+        while (done < n) {
+            int k;
+            if (c->wb_len > 0 && c->wb_off + c->wb_len != c->pos)
+                wb_submit(c);
+            if (c->wb_len == 0)
+                c->wb_off = c->pos;
+            k = WB_SIZE - c->wb_len;
+            if (k > n - done) k = n - done;
+            memcpy(c->wb + c->wb_len, buf + done, k);
+            c->wb_len += k;
+            c->pos += k;
+            done += k;
+            if (c->wb_len == WB_SIZE)
+                wb_submit(c);
+        }
+        pthread_mutex_unlock(&lib_lock);
+        return n;
     }
 
-    printf("Write: %s\n", result->out_msg.out_msg_val);
-    return (result->success == 1) ? n : -1;
+    pthread_mutex_lock(&rpc_lock);
+    rc = write_at(c, fd, c ? c->pos : 0, buf, n, msg, sizeof(msg));
+    pthread_mutex_unlock(&rpc_lock);
+    printf("Write: %s\n", msg);
+    if (rc == 1 && c) {
+        wrote_through(c, c->pos, buf, n);
+        c->pos += n;
+    }
+    pthread_mutex_unlock(&lib_lock);
+    return (rc == 1) ? n : -1;
 }
 
 /* returns number of bytes read or -1 */
@@ -107,44 +839,119 @@ int Read(int fd, char *buf, int n) {
     read_output *result;
     read_input   arg;
     int          bytes;
+    client_fd_t *c;
+    char         err[256];
+
+    pthread_mutex_lock(&lib_lock);
+    c = cfd_find(fd);
+    if (c) {
+        if (c->wb && wb_flush(c) < 0) {
+            pthread_mutex_unlock(&lib_lock);
+            printf("Read error: an earlier buffered write failed\n");
+            return -1;
+        }
+        if (n > 0 && lease_check(c->file_name)) {
+            bytes = cache_read(c, buf, n);
+            if (bytes > 0) {
+                pthread_mutex_unlock(&lib_lock);
+                return bytes;
+            }
+        } else if (n > 0 && c->ra) {
+            bytes = ra_read(c, buf, n);
+            pthread_mutex_unlock(&lib_lock);
+            return bytes;
+        }
+        pthread_mutex_lock(&rpc_lock);
+        bytes = read_at(c, c->pos, buf, n, err, sizeof(err));
+        pthread_mutex_unlock(&rpc_lock);
+        if (bytes < 0) {
+            printf("Read error: %s\n", err);
+        } else {
+            c->pos += bytes;
+            c->last_end = c->pos;
+        }
+        pthread_mutex_unlock(&lib_lock);
+        return bytes;
+    }
+    pthread_mutex_unlock(&lib_lock);
 
     get_login(arg.user_name);
     arg.fd = fd;
     arg.numbytes = n;
 
+    pthread_mutex_lock(&rpc_lock);
     result = read_file_1(&arg, clnt);
     if (result == NULL) {
         clnt_perror(clnt, "read_file_1 failed");
+        pthread_mutex_unlock(&rpc_lock);
         return -1;
     }
     if (result->success != 1) {
         printf("Read error: %s\n", result->out_msg.out_msg_val);
+        pthread_mutex_unlock(&rpc_lock);
         return -1;
     }
     bytes = (int)result->buffer.buffer_len;
     if (bytes > n) bytes = n;
     memcpy(buf, result->buffer.buffer_val, bytes);
+    pthread_mutex_unlock(&rpc_lock);
     return bytes;
 }
 
 /* returns new position or -1 */
-int Seek(int fd, int pos) {
-    seek_output *result;
-    seek_input   arg;
+long long Seek(int fd, long long pos) {
+    seek_output   *result;
+    seek_input     arg;
+    client_fd_t   *c;
+    lease_state_t *ls = NULL;
+
+    pthread_mutex_lock(&lib_lock);
+    c = cfd_find(fd);
+    if (c) {
+        if (c->wb && wb_flush(c) < 0) {
+            pthread_mutex_unlock(&lib_lock);
+            printf("Seek error: an earlier buffered write failed\n");
+            return -1;
+        }
+        ls = lease_check(c->file_name);
+    }
+
+    /* under a lease the position only matters to us until the next miss */
+    if (ls) {
+        if (pos < 0 || pos > ls->max_size) {
+            pthread_mutex_unlock(&lib_lock);
+            printf("Seek error: Invalid position\n");
+            return -1;
+        }
+        c->pos = pos;
+        pthread_mutex_unlock(&lib_lock);
+        return pos;
+    }
 
     get_login(arg.user_name);
     arg.fd = fd;
     arg.position = pos;
 
+    pthread_mutex_lock(&rpc_lock);
     result = seek_position_1(&arg, clnt);
     if (result == NULL) {
         clnt_perror(clnt, "seek_position_1 failed");
+        pthread_mutex_unlock(&rpc_lock);
+        pthread_mutex_unlock(&lib_lock);
         return -1;
     }
     if (result->success != 1) {
         printf("Seek error: %s\n", result->out_msg.out_msg_val);
+        pthread_mutex_unlock(&rpc_lock);
+        pthread_mutex_unlock(&lib_lock);
         return -1;
     }
+    if (c) {
+        c->pos = pos;
+        c->srv_pos = pos;
+    }
+    pthread_mutex_unlock(&rpc_lock);
+    pthread_mutex_unlock(&lib_lock);
     return pos;
 }
 
@@ -152,46 +959,666 @@ int Seek(int fd, int pos) {
 void Close(int fd) {
     close_output *result;
     close_input   arg;
+    client_fd_t  *c;
+
+    pthread_mutex_lock(&lib_lock);
+    c = cfd_find(fd);
+    if (c) {
+        if (c->wb && wb_flush(c) < 0)
+            printf("Close: buffered writes to fd %d were lost\n", fd);
+        io_quiesce(c);
+        free(c->wb < c->wf ? c->wb : c->wf);    /* one allocation, see cfd_add */
+        c->in_use = 0;
+        lease_release(c->file_name);
+    }
 
     get_login(arg.user_name);
     arg.fd = fd;
 
+    pthread_mutex_lock(&rpc_lock);
     result = close_file_1(&arg, clnt);
     if (result == NULL) {
         clnt_perror(clnt, "close_file_1 failed");
-        return;
+    } else {
+        printf("Close: %s\n", result->out_msg.out_msg_val);
     }
-    printf("Close: %s\n", result->out_msg.out_msg_val);
+    pthread_mutex_unlock(&rpc_lock);
+    pthread_mutex_unlock(&lib_lock);
 }
 
 void List(void) {
-    list_output *result;
-    list_input   arg;
+    list_output   *result;
+    list_input     arg;
+    lease_state_t *ls;
+
+    pthread_mutex_lock(&lib_lock);
+    ls = lease_check("");
+    if (ls && ls->listing) {
+        printf("List:\n%s\n", ls->listing);
+        pthread_mutex_unlock(&lib_lock);
+        return;
+    }
 
     get_login(arg.user_name);
 
+    pthread_mutex_lock(&rpc_lock);
     result = list_files_1(&arg, clnt);
     if (result == NULL) {
         clnt_perror(clnt, "list_files_1 failed");
-        return;
+    } else {
+        printf("List:\n%s\n", result->out_msg.out_msg_val);
+        if (ls)
+            ls->listing = strdup(result->out_msg.out_msg_val);
     }
-    printf("List:\n%s\n", result->out_msg.out_msg_val);
+    pthread_mutex_unlock(&rpc_lock);
+    pthread_mutex_unlock(&lib_lock);
 }
 
 void Delete(const char *name) {
     delete_output *result;
     delete_input   arg;
+    time_t         start = time(NULL);
+    lease_state_t *ls;
+    int            deleted;
 
     get_login(arg.user_name);
     strncpy(arg.file_name, name, FILE_NAME_SIZE - 1);
     arg.file_name[FILE_NAME_SIZE - 1] = '\0';
 
-    result = delete_file_1(&arg, clnt);
-    if (result == NULL) {
-        clnt_perror(clnt, "delete_file_1 failed");
-        return;
+    pthread_mutex_lock(&lib_lock);
+    pthread_mutex_lock(&rpc_lock);
+    for (;;) {
+        result = delete_file_1(&arg, clnt);
+        if (result == NULL) {
+            clnt_perror(clnt, "delete_file_1 failed");
+            pthread_mutex_unlock(&rpc_lock);
+            pthread_mutex_unlock(&lib_lock);
+            return;
+        }
+        if (result->success != RETRY_LATER || time(NULL) - start > RETRY_SECS)
+            break;
+        sleep(1);
     }
     printf("Delete: %s\n", result->out_msg.out_msg_val);
+    deleted = result->success == 1;
+    pthread_mutex_unlock(&rpc_lock);
+    if (deleted) {
+        if ((ls = lease_find(arg.file_name)) != NULL)
+            lease_forget(ls);
+        lease_changed("");
+    }
+    pthread_mutex_unlock(&lib_lock);
+}
+
+/* fetch a whole file in one call; returns its size or -1 */
+int Get(const char *name, char *buf, int max) {
+    get_output    *result;
+    get_input      arg;
+    int            bytes;
+    long long      off;
+    lease_state_t *ls;
+
+    get_login(arg.user_name);
+    strncpy(arg.file_name, name, FILE_NAME_SIZE - 1);
+    arg.file_name[FILE_NAME_SIZE - 1] = '\0';
+
+    pthread_mutex_lock(&lib_lock);
+
+    /* answered from the cache when every block of the file is held */
+    ls = lease_check(arg.file_name);
+    if (ls) {
+        for (off = 0; off < ls->size; off += CACHE_BLOCK) {
+            cache_block_t *b = cache_find(arg.file_name, off / CACHE_BLOCK);
+            if (!b || b->len < (ls->size - off < CACHE_BLOCK ? ls->size - off : CACHE_BLOCK))
+                break;
+        }
+        if (off >= ls->size) {
+            bytes = ls->size < max ? (int)ls->size : max;
+            for (off = 0; off < bytes; off += CACHE_BLOCK) {
+                cache_block_t *b = cache_find(arg.file_name, off / CACHE_BLOCK);
+                memcpy(buf + off, b->data, bytes - off < CACHE_BLOCK ? bytes - off : CACHE_BLOCK);
+            }
+            pthread_mutex_unlock(&lib_lock);
+            return bytes;
+        }
+    }
+
+    pthread_mutex_lock(&rpc_lock);
+    result = get_file_1(&arg, clnt);
+    if (result == NULL) {
+        clnt_perror(clnt, "get_file_1 failed");
+        bytes = -1;
+        goto out;
+    }
+    if (result->success != 1) {
+        printf("Get error: %s\n", result->out_msg.out_msg_val);
+        bytes = -1;
+        goto out;
+    }
+    bytes = (int)result->buffer.buffer_len;
+    if (lease_valid(ls)) {
+        for (off = 0; off < bytes; off += CACHE_BLOCK) {
+            cache_block_t *b = cache_alloc(arg.file_name, off / CACHE_BLOCK);
+            int k = bytes - off < CACHE_BLOCK ? bytes - off : CACHE_BLOCK;
+            if (k > b->len) {
+                memcpy(b->data, result->buffer.buffer_val + off, k);
+                b->len = k;
+            }
+        }
+    }
+    if (bytes > max) bytes = max;
+    memcpy(buf, result->buffer.buffer_val, bytes);
+out:
+    pthread_mutex_unlock(&rpc_lock);
+    pthread_mutex_unlock(&lib_lock);
+    return bytes;
+}
+
+/* create or replace a whole file in one call; returns 1 or -1 */
+int Put(const char *name, const char *buf, int n) {
+    put_output    *result;
+    put_input      arg;
+    time_t         start = time(NULL);
+    lease_state_t *ls;
+    int            success, created;
+
+    get_login(arg.user_name);
+    strncpy(arg.file_name, name, FILE_NAME_SIZE - 1);
+    arg.file_name[FILE_NAME_SIZE - 1] = '\0';
+    /* Copy into a writable buffer; XDR will operate on this */
+    arg.buffer.buffer_len = n;
+    arg.buffer.buffer_val = malloc(n > 0 ? n : 1);
+    if (arg.buffer.buffer_val == NULL) {
+        printf("Put error: alloc failed\n");
+        return -1;
+    }
+    memcpy(arg.buffer.buffer_val, buf, n);
+
+    pthread_mutex_lock(&lib_lock);
+    pthread_mutex_lock(&rpc_lock);
+    for (;;) {
+        result = put_file_1(&arg, clnt);
+        if (result == NULL) {
+            clnt_perror(clnt, "put_file_1 failed");
+            pthread_mutex_unlock(&rpc_lock);
+            pthread_mutex_unlock(&lib_lock);
+            free(arg.buffer.buffer_val);
+            return -1;
+        }
+        if (result->success != RETRY_LATER || time(NULL) - start > RETRY_SECS)
+            break;
+        sleep(1);
+    }
+    free(arg.buffer.buffer_val);
+    printf("Put: %s\n", result->out_msg.out_msg_val);
+    success = result->success;
+    created = strncmp(result->out_msg.out_msg_val, "File created", 12) == 0;
+    pthread_mutex_unlock(&rpc_lock);
+    if (success == 1) {
+        /* the old contents are gone; a held lease stays valid for the new */
+        cache_drop(arg.file_name);
+        lease_changed(arg.file_name);
+        if ((ls = lease_find(arg.file_name)) != NULL)
+            ls->size = n;
+        if (created)
+            lease_changed("");
+    }
+    pthread_mutex_unlock(&lib_lock);
+    return success;
+}
+
+/* Replace a whole file as Put does, sending a delta against the server's
+   copy instead of all of it (sign_file, delta_make, patch_file).  A file
+   that is not there yet, or changes between the signature and the patch,
+   goes by Put.  1 or -1. */
+int PutDelta(const char *name, const char *buf, int n) {
+    sign_output   *sig;
+    sign_input     sarg;
+    patch_output  *result;
+    patch_input    arg;
+    time_t         start = time(NULL);
+    lease_state_t *ls;
+    int            success;
+
+    memset(&sarg, 0, sizeof(sarg));
+    memset(&arg, 0, sizeof(arg));
+    get_login(sarg.user_name);
+    strncpy(sarg.file_name, name, FILE_NAME_SIZE - 1);
+    memcpy(arg.user_name, sarg.user_name, USER_NAME_SIZE);
+    memcpy(arg.file_name, sarg.file_name, FILE_NAME_SIZE);
+
+    pthread_mutex_lock(&lib_lock);
+    pthread_mutex_lock(&rpc_lock);
+    sig = sign_file_1(&sarg, clnt);
+    if (sig == NULL) {
+        clnt_perror(clnt, "sign_file_1 failed");
+        pthread_mutex_unlock(&rpc_lock);
+        pthread_mutex_unlock(&lib_lock);
+        return -1;
+    }
+    if (sig->success != 1 ||
+        delta_make(sig, buf, n, &arg.ops.ops_val, &arg.ops.ops_len,
+                   &arg.data.data_val, &arg.data.data_len) < 0) {
+        pthread_mutex_unlock(&rpc_lock);
+        pthread_mutex_unlock(&lib_lock);
+        return Put(name, buf, n);
+    }
+    arg.file_version = sig->file_version;
+    for (;;) {
+        result = patch_file_1(&arg, clnt);
+        if (result == NULL) {
+            clnt_perror(clnt, "patch_file_1 failed");
+            success = -1;
+            break;
+        }
+        success = result->success;
+        if (success != RETRY_LATER || time(NULL) - start > RETRY_SECS)
+            break;
+        sleep(1);
+    }
+    free(arg.ops.ops_val);
+    free(arg.data.data_val);
+    if (result != NULL)
+        printf("PutDelta: %s\n", result->out_msg.out_msg_val);
+    pthread_mutex_unlock(&rpc_lock);
+    if (success == 1) {
+        cache_drop(arg.file_name);
+        lease_changed(arg.file_name);
+        if ((ls = lease_find(arg.file_name)) != NULL)
+            ls->size = n;
+    }
+    pthread_mutex_unlock(&lib_lock);
+    if (result != NULL && success != 1 && success != RETRY_LATER)
+        return Put(name, buf, n);
+    return success;
+}
+
+static double percent(unsigned long part, unsigned long whole) {
+    return whole ? 100.0 * part / whole : 0.0;
+}
+
+/* print the server's counters and this client's cache hit rates;
+   reset clears both afterwards */
+void Stats(int reset) {
+    stats_output *result;
+    stats_input   arg;
+
+    arg.reset = reset;
+    pthread_mutex_lock(&lib_lock);
+    pthread_mutex_lock(&rpc_lock);
+    result = stats_1(&arg, clnt);
+    if (result == NULL) {
+        clnt_perror(clnt, "stats_1 failed");
+    } else {
+        printf("%s", result->out_msg.out_msg_val);
+    }
+    pthread_mutex_unlock(&rpc_lock);
+    printf("client.cache blocks %lu hits %lu hit_rate %.1f%%\n",
+           cache_hits + cache_misses, cache_hits,
+           percent(cache_hits, cache_hits + cache_misses));
+    printf("client.readahead reads %lu hits %lu hit_rate %.1f%%\n",
+           ra_reads, ra_reads - ra_misses, percent(ra_reads - ra_misses, ra_reads));
+    if (reset)
+        cache_hits = cache_misses = ra_reads = ra_misses = 0;
+    pthread_mutex_unlock(&lib_lock);
+}
+
+/* print the server's free space report after acting on it: DEFRAG_START
+   the compactor at budget_kb KiB/s (0 unlimited), DEFRAG_STOP it, or just
+   DEFRAG_REPORT.  Returns 1, or -1 if the server refused. */
+int Defrag(int action, int budget_kb) {
+    defrag_output *result;
+    defrag_input   arg;
+    int success = -1;
+
+    arg.action = action;
+    arg.budget_kb = budget_kb;
+    pthread_mutex_lock(&rpc_lock);
+    result = defrag_1(&arg, clnt);
+    if (result == NULL) {
+        clnt_perror(clnt, "defrag_1 failed");
+    } else {
+        printf("%s", result->out_msg.out_msg_val);
+        if (result->success != 1)
+            printf("\n");
+        success = result->success;
+    }
+    pthread_mutex_unlock(&rpc_lock);
+    return success;
+}
+
+/* copy a file on the server without moving its data: the copy shares
+   the original's blocks until either is written.  1, -1 on failure. */
+int Clone(const char *name, const char *new_name) {
+    clone_output *result;
+    clone_input   arg;
+    time_t        start = time(NULL);
+    int           success;
+
+    FlushAll();
+    get_login(arg.user_name);
+    set_name(arg.file_name, name);
+    set_name(arg.new_name, new_name);
+
+    pthread_mutex_lock(&lib_lock);
+    pthread_mutex_lock(&rpc_lock);
+    for (;;) {
+        result = clone_file_1(&arg, clnt);
+        if (result == NULL) {
+            clnt_perror(clnt, "clone_file_1 failed");
+            pthread_mutex_unlock(&rpc_lock);
+            pthread_mutex_unlock(&lib_lock);
+            return -1;
+        }
+        if (result->success != RETRY_LATER || time(NULL) - start > RETRY_SECS)
+            break;
+        sleep(1);
+    }
+    printf("Clone: %s\n", result->out_msg.out_msg_val);
+    success = result->success;
+    pthread_mutex_unlock(&rpc_lock);
+    if (success == 1)
+        lease_changed("");
+    pthread_mutex_unlock(&lib_lock);
+    return success;
+}
+
+/* copy len bytes at src_pos of open file src_fd to dst_fd at dst_pos on
+   the server, the data never crossing the network; the descriptors'
+   positions do not move.  Returns the bytes copied (fewer at the end of
+   the source or the file), or -1. */
+long long CopyRange(int src_fd, long long src_pos, int dst_fd, long long dst_pos, long long len) {
+    copy_output *result;
+    copy_input   arg;
+    client_fd_t *c;
+    time_t       start = time(NULL);
+    long long    done = 0;
+
+    FlushAll();
+    memset(&arg, 0, sizeof(arg));
+    get_login(arg.user_name);
+    arg.src_fd = src_fd;
+    arg.dst_fd = dst_fd;
+
+    pthread_mutex_lock(&lib_lock);
+    pthread_mutex_lock(&rpc_lock);
+    /* the server moves at most 64 MB a call */
+    while (done < len) {
+        arg.src_pos = src_pos + done;
+        arg.dst_pos = dst_pos + done;
+        arg.length = len - done;
+        result = copy_range_1(&arg, clnt);
+        if (result == NULL) {
+            clnt_perror(clnt, "copy_range_1 failed");
+            done = -1;
+            break;
+        }
+        if (result->success == RETRY_LATER && time(NULL) - start <= RETRY_SECS) {
+            sleep(1);
+            continue;
+        }
+        if (result->success != 1) {
+            printf("CopyRange: %s\n", result->out_msg.out_msg_val);
+            done = -1;
+            break;
+        }
+        if (result->copied == 0)
+            break;
+        done += result->copied;
+    }
+    pthread_mutex_unlock(&rpc_lock);
+    if (done != 0 && (c = cfd_find(dst_fd)) != NULL) {
+        /* what this client holds of the destination is stale */
+        ra_drop(c);
+        cache_drop(c->file_name);
+        lease_changed(c->file_name);
+    }
+    if (done >= 0)
+        printf("CopyRange: %lld bytes\n", done);
+    pthread_mutex_unlock(&lib_lock);
+    return done;
+}
+
+/* where pattern occurs in the home directory's files, found on the
+   server; at most max matches (0 for the server's limit) are printed.
+   Returns the number printed, or -1. */
+int Search(const char *pattern, int max) {
+    search_output *result;
+    search_input   arg;
+    u_int          i;
+    int            n;
+
+    FlushAll();
+    memset(&arg, 0, sizeof(arg));
+    get_login(arg.user_name);
+    arg.pattern.pattern_len = strlen(pattern);
+    arg.pattern.pattern_val = (char *)pattern;
+    arg.max_matches = max;
+
+    pthread_mutex_lock(&lib_lock);
+    pthread_mutex_lock(&rpc_lock);
+    result = search_files_1(&arg, clnt);
+    if (result == NULL) {
+        clnt_perror(clnt, "search_files_1 failed");
+        n = -1;
+    } else {
+        printf("Search: %s\n", result->out_msg.out_msg_val);
+        for (i = 0; i < result->matches.matches_len; i++)
+            printf("  %s %lld\n", result->matches.matches_val[i].file_name,
+                   (long long)result->matches.matches_val[i].offset);
+        n = result->success == 1 ? (int)result->matches.matches_len : -1;
+    }
+    pthread_mutex_unlock(&rpc_lock);
+    pthread_mutex_unlock(&lib_lock);
+    return n;
+}
+
+/* the server's digest of length bytes of file_name at offset, length -1
+   for the rest of the file, into digest if not NULL, and printed.  A
+   whole file's digest is kept by the server until the file changes,
+   which makes comparing two digests a cheap test for changed contents.
+   1, -1 on failure. */
+int Hash(const char *file_name, long long offset, long long length,
+         unsigned char digest[HASH_SIZE]) {
+    hash_output *result;
+    hash_input   arg;
+    int          success, i;
+
+    FlushAll();
+    memset(&arg, 0, sizeof(arg));
+    get_login(arg.user_name);
+    strncpy(arg.file_name, file_name, FILE_NAME_SIZE - 1);
+    arg.offset = offset;
+    arg.length = length;
+
+    pthread_mutex_lock(&lib_lock);
+    pthread_mutex_lock(&rpc_lock);
+    result = hash_file_1(&arg, clnt);
+    if (result == NULL) {
+        clnt_perror(clnt, "hash_file_1 failed");
+        success = -1;
+    } else {
+        success = result->success;
+        printf("Hash: ");
+        for (i = 0; success == 1 && i < HASH_SIZE; i++)
+            printf("%02x", (unsigned char)result->digest[i]);
+        printf("%s%s\n", success == 1 ? " " : "", result->out_msg.out_msg_val);
+        if (success == 1 && digest != NULL)
+            memcpy(digest, result->digest, HASH_SIZE);
+    }
+    pthread_mutex_unlock(&rpc_lock);
+    pthread_mutex_unlock(&lib_lock);
+    return success == 1 ? 1 : -1;
+}
+
+/* SNAP_CREATE, SNAP_DELETE or SNAP_RESTORE the snapshot called name of
+   the home directory, or SNAP_LIST them (name unused).  A snapshot's
+   files are read through user "login@name".  1, -1 on failure. */
+int Snapshot(int action, const char *name) {
+    snapshot_output *result;
+    snapshot_input   arg;
+    time_t           start = time(NULL);
+    int              success, i;
+
+    FlushAll();
+    memset(&arg, 0, sizeof(arg));
+    get_login(arg.user_name);
+    strncpy(arg.snap_name, name ? name : "", USER_NAME_SIZE - 1);
+    arg.action = action;
+
+    pthread_mutex_lock(&lib_lock);
+    pthread_mutex_lock(&rpc_lock);
+    for (;;) {
+        result = snapshot_1(&arg, clnt);
+        if (result == NULL) {
+            clnt_perror(clnt, "snapshot_1 failed");
+            pthread_mutex_unlock(&rpc_lock);
+            pthread_mutex_unlock(&lib_lock);
+            return -1;
+        }
+        if (result->success != RETRY_LATER || time(NULL) - start > RETRY_SECS)
+            break;
+        sleep(1);
+    }
+    if (action == SNAP_LIST && result->success == 1)
+        printf("%s", result->out_msg.out_msg_val);
+    else
+        printf("Snapshot: %s\n", result->out_msg.out_msg_val);
+    success = result->success;
+    pthread_mutex_unlock(&rpc_lock);
+    /* a restore replaced every file: nothing cached is current */
+    if (success == 1 && action == SNAP_RESTORE)
+        for (i = 0; i < CACHE_LEASES; i++)
+            if (lease_state[i].in_use)
+                lease_forget(&lease_state[i]);
+    pthread_mutex_unlock(&lib_lock);
+    return success;
+}
+
+/* the home directory's export stream (ssnfs.x) into the local file path,
+   started again if the directory changes meanwhile.  The number of files,
+   -1 on failure. */
+int Export(const char *path) {
+    export_output *result = NULL;
+    export_input   arg;
+    FILE          *f;
+    int            tries, files = -1;
+
+    FlushAll();
+    if ((f = fopen(path, "wb")) == NULL) {
+        printf("Export: cannot write %s\n", path);
+        return -1;
+    }
+    memset(&arg, 0, sizeof(arg));
+    get_login(arg.user_name);
+    arg.max_bytes = ARC_CHUNK;
+
+    pthread_mutex_lock(&lib_lock);
+    pthread_mutex_lock(&rpc_lock);
+    for (tries = 0; tries < EXPORT_TRIES && files < 0; tries++) {
+        arg.offset = 0;
+        rewind(f);
+        for (;;) {
+            result = export_home_1(&arg, clnt);
+            if (result == NULL) {
+                clnt_perror(clnt, "export_home_1 failed");
+                break;
+            }
+            if (result->success != 1)
+                break;
+            if (fwrite(result->data.data_val, 1, result->data.data_len, f) != result->data.data_len) {
+                printf("Export: write error on %s\n", path);
+                result = NULL;
+                break;
+            }
+            if (result->next == result->total) {
+                files = result->files;
+                break;
+            }
+            arg.offset = result->next;
+            arg.generation = result->generation;
+        }
+        if (result == NULL || (result->success != 1 &&
+                               strncmp(result->out_msg.out_msg_val, "Directory changed", 17) != 0))
+            break;
+    }
+    if (files >= 0)
+        printf("Export: %d files, %lld bytes to %s\n", files, (long long)result->total, path);
+    else if (result != NULL)
+        printf("Export: %s\n", result->out_msg.out_msg_val);
+    pthread_mutex_unlock(&rpc_lock);
+    pthread_mutex_unlock(&lib_lock);
+    if (fclose(f) != 0 && files >= 0) {
+        printf("Export: write error on %s\n", path);
+        files = -1;
+    }
+    return files;
+}
+
+/* Load an export stream from the local file path into the home
+   directory.  Files already there are replaced with replace set and
+   left alone otherwise.  The number of files stored, -1 on failure. */
+int Import(const char *path, int replace) {
+    import_output *result = NULL;
+    import_input   arg;
+    time_t         start;
+    FILE          *f;
+    size_t         n;
+    int            files = -1, i;
+
+    FlushAll();
+    if ((f = fopen(path, "rb")) == NULL) {
+        printf("Import: cannot read %s\n", path);
+        return -1;
+    }
+    memset(&arg, 0, sizeof(arg));
+    get_login(arg.user_name);
+    arg.replace = replace;
+    if ((arg.data.data_val = malloc(ARC_CHUNK)) == NULL) {
+        fclose(f);
+        printf("Import error: alloc failed\n");
+        return -1;
+    }
+
+    pthread_mutex_lock(&lib_lock);
+    pthread_mutex_lock(&rpc_lock);
+    while ((n = fread(arg.data.data_val, 1, ARC_CHUNK, f)) > 0) {
+        arg.data.data_len = (u_int)n;
+        start = time(NULL);
+        for (;;) {
+            result = import_home_1(&arg, clnt);
+            if (result == NULL || result->success != RETRY_LATER ||
+                time(NULL) - start > RETRY_SECS)
+                break;
+            sleep(1);
+        }
+        if (result == NULL) {
+            clnt_perror(clnt, "import_home_1 failed");
+            break;
+        }
+        if (result->success != 1 || result->done)
+            break;
+        arg.offset = result->next;
+    }
+    if (result != NULL) {
+        printf("Import: %s\n", result->out_msg.out_msg_val);
+        if (result->success == 1 && result->done)
+            files = result->files;
+        else if (result->success == 1)
+            printf("Import: %s ends before the end of the stream\n", path);
+    } else if (ferror(f) || arg.offset == 0) {
+        printf("Import: cannot read %s\n", path);
+    }
+    pthread_mutex_unlock(&rpc_lock);
+    /* files were replaced: nothing cached is current */
+    if (result != NULL && result->files > 0)
+        for (i = 0; i < CACHE_LEASES; i++)
+            if (lease_state[i].in_use)
+                lease_forget(&lease_state[i]);
+    pthread_mutex_unlock(&lib_lock);
+    free(arg.data.data_val);
+    fclose(f);
+    return files;
 }
 
 int main(int argc, char *argv[]) {
@@ -206,6 +1633,10 @@ int main(int argc, char *argv[]) {
     }
     host = argv[1];
     ssnfsprog_1(host);
+    if (getenv("SSNFS_CACHE") != NULL && atoi(getenv("SSNFS_CACHE")) != 0)
+        CacheEnable(1);
+    if (getenv("SSNFS_SYNC") != NULL && atoi(getenv("SSNFS_SYNC")) != 0)
+        BufferIO(0);
 
     /* instructor's sample main logic */
     if (Create("File1") == 1) {
@@ -315,5 +1746,89 @@ int main(int argc, char *argv[]) {
     Close(fd3);
     Close(fd4);
 
+    /* whole-file calls: one round trip each, no open file slot used */
+    const char *file4_msg = "Small object stored with a single Put";
+    if (Put("File4", file4_msg, (int)strlen(file4_msg)) == 1) {
+        n = Get("File4", buffer, (int)sizeof(buffer) - 1);
+        if (n >= 0) {
+            buffer[n] = '\0';
+            printf("Get: %s\n", buffer);
+        }
+        /* a server-side copy, no data sent */
+        if (Clone("File4", "File5") == 1 && (n = Get("File5", buffer, (int)sizeof(buffer) - 1)) >= 0) {
+            buffer[n] = '\0';
+            printf("Get clone: %s\n", buffer);
+        }
+        /* and a copy of the first 20 bytes of File4 to the end of File5 */
+        fd1 = Open("File4");
+        fd2 = Open("File5");
+        if (fd1 >= 0 && fd2 >= 0 && CopyRange(fd1, 0, fd2, (long long)strlen(file4_msg), 20) == 20 &&
+            (n = Get("File5", buffer, (int)sizeof(buffer) - 1)) >= 0) {
+            buffer[n] = '\0';
+            printf("Get copy: %s\n", buffer);
+        }
+        if (fd1 >= 0) Close(fd1);
+        if (fd2 >= 0) Close(fd2);
+    }
+
+    if (getenv("SSNFS_STATS") != NULL && atoi(getenv("SSNFS_STATS")) != 0) {
+        FlushAll();
+        Stats(0);
+    }
+    if (getenv("SSNFS_DEFRAG") != NULL) {
+        /* SSNFS_DEFRAG=kbps starts the compactor, -1 stops it, "" reports */
+        int kbps = atoi(getenv("SSNFS_DEFRAG"));
+        FlushAll();
+        if (*getenv("SSNFS_DEFRAG") == '\0')
+            Defrag(DEFRAG_REPORT, 0);
+        else
+            Defrag(kbps < 0 ? DEFRAG_STOP : DEFRAG_START, kbps < 0 ? 0 : kbps);
+    }
+    if (getenv("SSNFS_SNAPSHOT") != NULL) {
+        /* SSNFS_SNAPSHOT=name takes a snapshot of the home directory,
+           -name deletes it, "" lists them */
+        const char *snap = getenv("SSNFS_SNAPSHOT");
+        if (*snap == '-')
+            Snapshot(SNAP_DELETE, snap + 1);
+        else if (*snap != '\0')
+            Snapshot(SNAP_CREATE, snap);
+        Snapshot(SNAP_LIST, NULL);
+    }
+    if (getenv("SSNFS_SEARCH") != NULL && *getenv("SSNFS_SEARCH") != '\0') {
+        /* SSNFS_SEARCH=string lists where it occurs in the home directory */
+        Search(getenv("SSNFS_SEARCH"), 0);
+    }
+    if (getenv("SSNFS_HASH") != NULL && *getenv("SSNFS_HASH") != '\0') {
+        /* SSNFS_HASH=file prints the digest of a home directory file */
+        Hash(getenv("SSNFS_HASH"), 0, -1, NULL);
+    }
+    if (getenv("SSNFS_DELTA") != NULL && *getenv("SSNFS_DELTA") != '\0') {
+        /* SSNFS_DELTA=path sends a local file by PutDelta, under the
+           last part of its path */
+        const char *path = getenv("SSNFS_DELTA"), *base = strrchr(path, '/');
+        FILE *f = fopen(path, "rb");
+        char *data = NULL;
+        long size = -1;
+
+        if (f != NULL && fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) >= 0 &&
+            fseek(f, 0, SEEK_SET) == 0 && (data = malloc(size + 1)) != NULL &&
+            fread(data, 1, size, f) == (size_t)size)
+            PutDelta(base ? base + 1 : path, data, (int)size);
+        else
+            printf("PutDelta: cannot read %s\n", path);
+        free(data);
+        if (f != NULL)
+            fclose(f);
+    }
+    if (getenv("SSNFS_EXPORT") != NULL && *getenv("SSNFS_EXPORT") != '\0') {
+        /* SSNFS_EXPORT=path writes the home directory's export stream */
+        Export(getenv("SSNFS_EXPORT"));
+    }
+    if (getenv("SSNFS_IMPORT") != NULL && *getenv("SSNFS_IMPORT") != '\0') {
+        /* SSNFS_IMPORT=path loads one, keeping files already there;
+           +path replaces them */
+        const char *path = getenv("SSNFS_IMPORT");
+        Import(*path == '+' ? path + 1 : path, *path == '+');
+    }
     return 0;
 }
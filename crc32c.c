@@ -0,0 +1,184 @@
+/*
+ * CRC-32C, see crc32c.h.
+ *
+ * The hardware path follows Mark Adler's: a crc32 instruction has a
+ * latency of three cycles but a throughput of one, so long buffers are
+ * cut into three lanes computed side by side, and the lanes' CRCs are
+ * joined by shifting one over the length of the next with a table of
+ * that shift (crc32c_zeros).
+ */
+
+#include <string.h>
+#include <pthread.h>
+#include "crc32c.h"
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#define CRC32C_HW       __attribute__((target("sse4.2")))
+#define crc32c_u8(c, b)  _mm_crc32_u8((unsigned int)(c), (b))
+#define crc32c_u64(c, v) _mm_crc32_u64((c), (v))
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC32C_HW
+#define crc32c_u8(c, b)  __crc32cb((unsigned int)(c), (b))
+#define crc32c_u64(c, v) __crc32cd((unsigned int)(c), (v))
+#endif
+
+#define CRC32C_POLY  0x82f63b78     /* reflected */
+#define CRC32C_LONG  8192           /* lane lengths, powers of two */
+#define CRC32C_SHORT 256
+
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+static int          crc32c_hw_ok;
+static unsigned int crc32c_table[8][256];
+#ifdef CRC32C_HW
+static unsigned int crc32c_long[4][256], crc32c_short[4][256];
+
+/* the GF(2) matrix mat (32 columns) times vec */
+static unsigned int gf2_times(const unsigned int *mat, unsigned int vec) {
+    unsigned int sum = 0;
+    for (; vec; vec >>= 1, mat++)
+        if (vec & 1)
+            sum ^= *mat;
+    return sum;
+}
+
+static void gf2_square(unsigned int *square, const unsigned int *mat) {
+    int n;
+    for (n = 0; n < 32; n++)
+        square[n] = gf2_times(mat, mat[n]);
+}
+
+/* Tables that take a CRC to the CRC of the same data followed by len zero
+   bytes (len a power of two), a byte of the CRC at a time. */
+static void crc32c_zeros(unsigned int zeros[4][256], size_t len) {
+    unsigned int even[32], odd[32], row = 1, *op;
+    int n;
+
+    odd[0] = CRC32C_POLY;           /* one zero bit */
+    for (n = 1; n < 32; n++, row <<= 1)
+        odd[n] = row;
+    gf2_square(even, odd);          /* two */
+    gf2_square(odd, even);          /* four */
+    for (;;) {                      /* eight, then doubling */
+        gf2_square(even, odd);
+        op = even;
+        if ((len >>= 1) == 0)
+            break;
+        gf2_square(odd, even);
+        op = odd;
+        if ((len >>= 1) == 0)
+            break;
+    }
+    for (n = 0; n < 256; n++) {
+        zeros[0][n] = gf2_times(op, n);
+        zeros[1][n] = gf2_times(op, n << 8);
+        zeros[2][n] = gf2_times(op, n << 16);
+        zeros[3][n] = gf2_times(op, (unsigned int)n << 24);
+    }
+}
+
+static unsigned int crc32c_shift(unsigned int zeros[4][256], unsigned int crc) {
+    return zeros[0][crc & 0xff] ^ zeros[1][crc >> 8 & 0xff] ^
+           zeros[2][crc >> 16 & 0xff] ^ zeros[3][crc >> 24];
+}
+#endif
+
+static void crc32c_init(void) {
+    unsigned int c;
+    int n, k;
+
+    for (n = 0; n < 256; n++) {
+        for (c = n, k = 0; k < 8; k++)
+            c = c & 1 ? c >> 1 ^ CRC32C_POLY : c >> 1;
+        crc32c_table[0][n] = c;
+    }
+    for (n = 0; n < 256; n++)
+        for (c = crc32c_table[0][n], k = 1; k < 8; k++)
+            crc32c_table[k][n] = c = crc32c_table[0][c & 0xff] ^ c >> 8;
+#ifdef CRC32C_HW
+    crc32c_zeros(crc32c_long, CRC32C_LONG);
+    crc32c_zeros(crc32c_short, CRC32C_SHORT);
+#if defined(__x86_64__)
+    crc32c_hw_ok = __builtin_cpu_supports("sse4.2");
+#else
+    crc32c_hw_ok = 1;
+#endif
+#endif
+}
+
+/* eight bytes at a time through eight tables */
+unsigned int crc32c_sw(unsigned int crc, const void *buf, size_t len) {
+    const unsigned char *p = buf;
+
+    pthread_once(&crc32c_once, crc32c_init);
+    crc = ~crc;
+    for (; len >= 8; len -= 8, p += 8) {
+        crc ^= p[0] | p[1] << 8 | p[2] << 16 | (unsigned int)p[3] << 24;
+        crc = crc32c_table[7][crc & 0xff] ^ crc32c_table[6][crc >> 8 & 0xff] ^
+              crc32c_table[5][crc >> 16 & 0xff] ^ crc32c_table[4][crc >> 24] ^
+              crc32c_table[3][p[4]] ^ crc32c_table[2][p[5]] ^
+              crc32c_table[1][p[6]] ^ crc32c_table[0][p[7]];
+    }
+    for (; len > 0; len--)
+        crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ crc >> 8;
+    return ~crc;
+}
+
+#ifdef CRC32C_HW
+static unsigned long long crc32c_load(const unsigned char *p) {
+    unsigned long long v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* lanes of lane bytes, three at a time, while there are three left */
+#define CRC32C_LANES(lane, zeros)                                           \
+    while (len >= 3 * (lane)) {                                             \
+        crc1 = crc2 = 0;                                                    \
+        for (end = p + (lane); p < end; p += 8) {                           \
+            crc0 = crc32c_u64(crc0, crc32c_load(p));                        \
+            crc1 = crc32c_u64(crc1, crc32c_load(p + (lane)));               \
+            crc2 = crc32c_u64(crc2, crc32c_load(p + 2 * (lane)));           \
+        }                                                                   \
+        crc0 = crc32c_shift(zeros, (unsigned int)crc0) ^ crc1;              \
+        crc0 = crc32c_shift(zeros, (unsigned int)crc0) ^ crc2;              \
+        p += 2 * (lane);                                                    \
+        len -= 3 * (lane);                                                  \
+    }
+
+static CRC32C_HW unsigned int crc32c_hw(unsigned int crc, const void *buf, size_t len) {
+    const unsigned char *p = buf, *end;
+    unsigned long long crc0 = ~crc, crc1, crc2;
+
+    for (; len > 0 && ((size_t)p & 7) != 0; len--)
+        crc0 = crc32c_u8(crc0, *p++);
+    CRC32C_LANES(CRC32C_LONG, crc32c_long)
+    CRC32C_LANES(CRC32C_SHORT, crc32c_short)
+    for (; len >= 8; len -= 8, p += 8)
+        crc0 = crc32c_u64(crc0, crc32c_load(p));
+    for (; len > 0; len--)
+        crc0 = crc32c_u8(crc0, *p++);
+    return ~(unsigned int)crc0;
+}
+#endif
+
+unsigned int crc32c(unsigned int crc, const void *buf, size_t len) {
+    pthread_once(&crc32c_once, crc32c_init);
+#ifdef CRC32C_HW
+    if (crc32c_hw_ok)
+        return crc32c_hw(crc, buf, len);
+#endif
+    return crc32c_sw(crc, buf, len);
+}
+
+const char *crc32c_impl(void) {
+    pthread_once(&crc32c_once, crc32c_init);
+    if (!crc32c_hw_ok)
+        return "software";
+#if defined(__x86_64__)
+    return "sse4.2";
+#else
+    return "armv8";
+#endif
+}
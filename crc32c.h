@@ -0,0 +1,22 @@
+/*
+ * CRC-32C (Castagnoli polynomial, as in iSCSI and ext4) for block and
+ * metadata checksums.  Uses the CPU's crc32 instructions where there are
+ * any (SSE4.2 on x86-64, checked at run time; the CRC extension on
+ * ARMv8), running three streams at once, and tables otherwise.
+ */
+
+#ifndef SSNFS_CRC32C_H
+#define SSNFS_CRC32C_H
+
+#include <stddef.h>
+
+/* CRC of len bytes at buf, continuing from crc (0 to start) */
+unsigned int crc32c(unsigned int crc, const void *buf, size_t len);
+
+/* the same without the crc32 instructions */
+unsigned int crc32c_sw(unsigned int crc, const void *buf, size_t len);
+
+/* "sse4.2", "armv8" or "software", whichever crc32c() uses */
+const char *crc32c_impl(void);
+
+#endif /* SSNFS_CRC32C_H */
@@ -0,0 +1,174 @@
+/*
+ * Delta transfer, see delta.h.
+ *
+ * delta_make keeps the signature's full-length blocks in a hash table by
+ * weak sum and rolls the weak sum of a block-long window over the new
+ * version a byte at a time.  Where the window's weak sum is in the table
+ * the strong sum is taken, once per position, and a block whose strong
+ * sum matches too is copied, the window jumping past it.  Of equal
+ * blocks the one after the block copied last is tried first, so that
+ * unchanged stretches come out as a single copy.  The signed file's last
+ * block, when shorter, can only match at the end of the new version.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "delta.h"
+#include "blake2.h"
+
+typedef struct {
+    delta_op *ops;
+    u_int     nops, cap;
+    char     *data;
+    u_int     ndata, dcap;
+} delta_t;
+
+u_int delta_weak(const unsigned char *p, size_t len) {
+    u_int s1 = 0, s2 = 0;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        s1 += p[i];
+        s2 += s1;
+    }
+    return (s1 & 0xffff) | (s2 & 0xffff) << 16;
+}
+
+void delta_strong(char out[SIGN_STRONG], const void *p, size_t len) {
+    blake2b((unsigned char *)out, SIGN_STRONG, p, len);
+}
+
+/* offset -1 for literal bytes; runs that carry on from the last op join it */
+static int delta_add(delta_t *d, int64_t offset, int64_t length) {
+    delta_op *op = d->nops > 0 ? &d->ops[d->nops - 1] : NULL, *grown;
+
+    if (length == 0)
+        return 0;
+    if (op != NULL && (offset < 0 ? op->offset < 0 : op->offset >= 0 && op->offset + op->length == offset)) {
+        op->length += length;
+        return 0;
+    }
+    if (d->nops == d->cap) {
+        grown = realloc(d->ops, (d->cap ? d->cap * 2 : 16) * sizeof(delta_op));
+        if (grown == NULL)
+            return -1;
+        d->ops = grown;
+        d->cap = d->cap ? d->cap * 2 : 16;
+    }
+    d->ops[d->nops].offset = offset;
+    d->ops[d->nops].length = length;
+    d->nops++;
+    return 0;
+}
+
+static int delta_literal(delta_t *d, const char *p, int64_t n) {
+    char *grown;
+    u_int cap = d->dcap ? d->dcap : 4096;
+
+    if (n == 0)
+        return 0;
+    while (cap < d->ndata + n)
+        cap *= 2;
+    if (cap != d->dcap) {
+        if ((grown = realloc(d->data, cap)) == NULL)
+            return -1;
+        d->data = grown;
+        d->dcap = cap;
+    }
+    memcpy(d->data + d->ndata, p, n);
+    d->ndata += (u_int)n;
+    return delta_add(d, -1, n);
+}
+
+static u_int delta_slot(u_int weak, u_int mask) {
+    return (weak ^ weak >> 15) * 0x9e3779b1u >> 7 & mask;
+}
+
+int delta_make(const sign_output *sig, const char *buf, int64_t len,
+               delta_op **ops, u_int *nops, char **data, u_int *ndata) {
+    const sign_block *blocks = sig->blocks.blocks_val;
+    const unsigned char *p = (const unsigned char *)buf;
+    int64_t bl = sig->block_len, nfull = sig->block_len > 0 ? sig->size / sig->block_len : 0;
+    int64_t tail = sig->size - nfull * bl, i = 0, lit = 0, k, hint = -1;
+    int *bucket = NULL, *next = NULL, b, have;
+    char strong[SIGN_STRONG];
+    u_int mask = 1, weak = 0;
+    delta_t d;
+
+    memset(&d, 0, sizeof(d));
+    if (nfull > (int64_t)sig->blocks.blocks_len)
+        nfull = sig->blocks.blocks_len;
+    while (mask < 2 * nfull)
+        mask <<= 1;
+    bucket = calloc(mask, sizeof(int));
+    next = malloc((nfull > 0 ? nfull : 1) * sizeof(int));
+    if (bucket == NULL || next == NULL)
+        goto fail;
+    mask--;
+    for (k = nfull - 1; k >= 0; k--) {      /* chains in block order */
+        b = delta_slot(blocks[k].weak, mask);
+        next[k] = bucket[b];
+        bucket[b] = (int)k + 1;
+    }
+
+    if (nfull > 0 && len >= bl)
+        weak = delta_weak(p, bl);
+    while (nfull > 0 && i + bl <= len) {
+        have = 0;
+        k = hint >= 0 && hint < nfull && blocks[hint].weak == weak ? hint : -1;
+        if (k >= 0) {
+            delta_strong(strong, p + i, bl);
+            have = 1;
+            if (memcmp(strong, blocks[k].strong, SIGN_STRONG) != 0)
+                k = -1;
+        }
+        for (b = bucket[delta_slot(weak, mask)]; k < 0 && b != 0; b = next[b - 1]) {
+            if (blocks[b - 1].weak != weak)
+                continue;
+            if (!have)
+                delta_strong(strong, p + i, bl);
+            have = 1;
+            if (memcmp(strong, blocks[b - 1].strong, SIGN_STRONG) == 0)
+                k = b - 1;
+        }
+        if (k >= 0) {
+            if (delta_literal(&d, buf + lit, i - lit) < 0 || delta_add(&d, k * bl, bl) < 0)
+                goto fail;
+            i += bl;
+            lit = i;
+            hint = k + 1;
+            if (i + bl <= len)
+                weak = delta_weak(p + i, bl);
+            continue;
+        }
+        if (i + bl < len)
+            weak = delta_roll(weak, p[i], p[i + bl], bl);
+        i++;
+    }
+    /* the signed file's short last block, if the new version ends with it */
+    if (tail > 0 && nfull < (int64_t)sig->blocks.blocks_len && len - lit >= tail &&
+        delta_weak(p + len - tail, tail) == blocks[nfull].weak) {
+        delta_strong(strong, p + len - tail, tail);
+        if (memcmp(strong, blocks[nfull].strong, SIGN_STRONG) == 0) {
+            if (delta_literal(&d, buf + lit, len - tail - lit) < 0 || delta_add(&d, nfull * bl, tail) < 0)
+                goto fail;
+            lit = len;
+        }
+    }
+    if (delta_literal(&d, buf + lit, len - lit) < 0)
+        goto fail;
+    free(bucket);
+    free(next);
+    *ops = d.ops;
+    *nops = d.nops;
+    *data = d.data;
+    *ndata = d.ndata;
+    return 0;
+
+fail:
+    free(bucket);
+    free(next);
+    free(d.ops);
+    free(d.data);
+    return -1;
+}
@@ -0,0 +1,39 @@
+/*
+ * Delta transfer in the manner of rsync, for sign_file and patch_file.
+ * The receiver of a new version of a file cuts its copy into blocks and
+ * sends a signature, a weak rolling sum and a strong sum per block; the
+ * sender slides a window over the new version, finds the blocks it still
+ * contains by their weak sums (confirmed by the strong ones) and sends
+ * copy instructions for those and literal bytes for the rest.
+ */
+
+#ifndef SSNFS_DELTA_H
+#define SSNFS_DELTA_H
+
+#include <stddef.h>
+#include "ssnfs.h"
+
+/* the weak sum of len bytes at p: a 16-bit byte sum and a 16-bit sum of
+   the running byte sums, as rsync's */
+u_int delta_weak(const unsigned char *p, size_t len);
+
+/* the weak sum of a len-byte window moved one byte on, out leaving and
+   in entering it */
+static inline u_int delta_roll(u_int weak, unsigned char out, unsigned char in, size_t len) {
+    u_int s1 = (weak & 0xffff) - out + in;
+    u_int s2 = (weak >> 16) - (u_int)len * out + s1;
+    return (s1 & 0xffff) | (s2 & 0xffff) << 16;
+}
+
+/* the strong sum of len bytes at p: BLAKE2b with a SIGN_STRONG-byte
+   digest (blake2.h) */
+void delta_strong(char out[SIGN_STRONG], const void *p, size_t len);
+
+/* The instructions that make the len bytes at buf out of the file sig
+   describes: runs of its blocks copied, merged where they follow one
+   another, and literal bytes between them, the bytes gathered in data.
+   The arrays are malloc'd; 0, or -1 if out of memory. */
+int delta_make(const sign_output *sig, const char *buf, int64_t len,
+               delta_op **ops, u_int *nops, char **data, u_int *ndata);
+
+#endif /* SSNFS_DELTA_H */
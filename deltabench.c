@@ -0,0 +1,288 @@
+/*
+ * deltabench: bytes on the wire and wall time to bring a server's copy
+ * of a file up to date after a small edit, by put_file against
+ * sign_file, delta_make and patch_file (delta.h).
+ *
+ *   deltabench [-s size] [-e percent] [-c edits] [-b block_len] [-n rounds]
+ *              [-l mbit] [-p port] host
+ *
+ * Each round puts a file of pseudo-random bytes, edits percent of it in
+ * edits places (overwrites, insertions and deletions in turn, so that
+ * blocks move), and sends the new version both ways, the old one put
+ * back in between; the delta's result is read back and compared.  The
+ * bytes are those of the XDR encoded arguments and results, without RPC
+ * and TCP headers.  Wall time is measured on the link to host and also
+ * given as it would be on an mbit Mbit/s link (the bytes at that rate
+ * added to it).  The server must allow files of the size (mkdisk -f).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <netdb.h>
+#include <rpc/rpc.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "ssnfs.h"
+#include "delta.h"
+
+#define BENCH_USER  "deltabench"
+#define BENCH_FILE  "deltabench.dat"
+
+static long   size = 1 << 20, rounds = 5;
+static double percent = 1.0, mbit = 100.0;
+static int    edits = 8, block_len, port;
+static const char *host;
+static CLIENT *clnt;
+static u_int64_t rng = 88172645463325252ULL;
+
+typedef struct {
+    double sent, received, secs;
+} cost_t;
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-s size] [-e percent] [-c edits] [-b block_len] [-n rounds]\n"
+                    "                  [-l mbit] [-p port] host\n", prog);
+    exit(1);
+}
+
+/* "4096", "64K", "2M" */
+static long parse_size(const char *s, const char *prog) {
+    char *end;
+    long v = strtol(s, &end, 10);
+    switch (*end) {
+    case 'k': case 'K': v <<= 10; end++; break;
+    case 'm': case 'M': v <<= 20; end++; break;
+    }
+    if (end == s || *end != '\0' || v <= 0)
+        usage(prog);
+    return v;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* xorshift: a congruential generator's low bytes repeat too soon, and
+   repeats in the data would match as blocks */
+static unsigned next_rand(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (unsigned)(rng >> 32);
+}
+
+static void fail(const char *what, const char *msg) {
+    fprintf(stderr, "%s: %s\n", what, msg);
+    exit(1);
+}
+
+static CLIENT *connect_server(void) {
+    struct sockaddr_in sin;
+    struct hostent *he;
+    int sock = RPC_ANYSOCK;
+
+    if (port == 0)
+        return clnt_create(host, SSNFSPROG, SSNFSVER, "tcp");
+    he = gethostbyname(host);
+    if (he == NULL || he->h_addrtype != AF_INET)
+        return NULL;
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(port);
+    memcpy(&sin.sin_addr, he->h_addr_list[0], sizeof(sin.sin_addr));
+    return clnttcp_create(&sin, SSNFSPROG, SSNFSVER, &sock, 0, 0);
+}
+
+/* Edit percent of old (len bytes) into new, in edits places: each edit
+   overwrites, inserts or deletes a run of random bytes.  The new length. */
+static long edit(const char *old, long len, char *new) {
+    long run = (long)(len * percent / 100 / edits), at = 0, to = 0, next;
+    int i;
+
+    if (run < 1)
+        run = 1;
+    for (i = 0; i < edits; i++) {
+        next = len / edits * i + next_rand() % (len / edits - run);
+        memcpy(new + to, old + at, next - at);
+        to += next - at;
+        at = next;
+        switch (i % 3) {
+        case 0:                                         /* overwrite */
+            for (next = 0; next < run; next++)
+                new[to++] = (char)next_rand();
+            at += run;
+            break;
+        case 1:                                         /* insert */
+            for (next = 0; next < run; next++)
+                new[to++] = (char)next_rand();
+            break;
+        case 2:                                         /* delete */
+            at += run;
+            break;
+        }
+    }
+    memcpy(new + to, old + at, len - at);
+    return to + len - at;
+}
+
+static void put(const char *buf, long len, cost_t *c) {
+    put_input arg;
+    put_output *res;
+    double t0 = now();
+
+    memset(&arg, 0, sizeof(arg));
+    strcpy(arg.user_name, BENCH_USER);
+    strcpy(arg.file_name, BENCH_FILE);
+    arg.buffer.buffer_len = (u_int)len;
+    arg.buffer.buffer_val = (char *)buf;
+    res = put_file_1(&arg, clnt);
+    if (res == NULL)
+        fail("put_file", clnt_sperror(clnt, host));
+    if (res->success != 1)
+        fail("put_file", res->out_msg.out_msg_val);
+    if (c != NULL) {
+        c->secs += now() - t0;
+        c->sent += xdr_sizeof((xdrproc_t)xdr_put_input, &arg);
+        c->received += xdr_sizeof((xdrproc_t)xdr_put_output, res);
+    }
+}
+
+/* sign, delta_make and patch_file; the ops and literal bytes counted */
+static void put_delta(const char *buf, long len, cost_t *c, double *ops, double *literal,
+                      double *written, int *used) {
+    sign_input sarg;
+    sign_output *sig;
+    patch_input arg;
+    patch_output *res;
+    double t0 = now();
+
+    memset(&sarg, 0, sizeof(sarg));
+    strcpy(sarg.user_name, BENCH_USER);
+    strcpy(sarg.file_name, BENCH_FILE);
+    sarg.block_len = block_len;
+    sig = sign_file_1(&sarg, clnt);
+    if (sig == NULL)
+        fail("sign_file", clnt_sperror(clnt, host));
+    if (sig->success != 1)
+        fail("sign_file", sig->out_msg.out_msg_val);
+    c->sent += xdr_sizeof((xdrproc_t)xdr_sign_input, &sarg);
+    c->received += xdr_sizeof((xdrproc_t)xdr_sign_output, sig);
+
+    memset(&arg, 0, sizeof(arg));
+    strcpy(arg.user_name, BENCH_USER);
+    strcpy(arg.file_name, BENCH_FILE);
+    arg.file_version = sig->file_version;
+    *used = sig->block_len;
+    if (delta_make(sig, buf, len, &arg.ops.ops_val, &arg.ops.ops_len,
+                   &arg.data.data_val, &arg.data.data_len) < 0)
+        fail("delta_make", "out of memory");
+    res = patch_file_1(&arg, clnt);
+    if (res == NULL)
+        fail("patch_file", clnt_sperror(clnt, host));
+    if (res->success != 1)
+        fail("patch_file", res->out_msg.out_msg_val);
+    c->secs += now() - t0;
+    c->sent += xdr_sizeof((xdrproc_t)xdr_patch_input, &arg);
+    c->received += xdr_sizeof((xdrproc_t)xdr_patch_output, res);
+    *ops += arg.ops.ops_len;
+    *literal += arg.data.data_len;
+    *written += res->written;
+    free(arg.ops.ops_val);
+    free(arg.data.data_val);
+    xdr_free((xdrproc_t)xdr_sign_output, (char *)sig);
+}
+
+static void check(const char *buf, long len) {
+    get_input arg;
+    get_output *res;
+
+    memset(&arg, 0, sizeof(arg));
+    strcpy(arg.user_name, BENCH_USER);
+    strcpy(arg.file_name, BENCH_FILE);
+    res = get_file_1(&arg, clnt);
+    if (res == NULL)
+        fail("get_file", clnt_sperror(clnt, host));
+    if (res->success != 1)
+        fail("get_file", res->out_msg.out_msg_val);
+    if ((long)res->buffer.buffer_len != len || memcmp(res->buffer.buffer_val, buf, len) != 0)
+        fail("patch_file", "contents differ from the new version");
+    xdr_free((xdrproc_t)xdr_get_output, (char *)res);
+}
+
+static void print(const char *name, const cost_t *c) {
+    double wire = (c->sent + c->received) / rounds;
+
+    printf("%-8s %12.0f %12.0f %10.2f %14.2f\n", name, c->sent / rounds, c->received / rounds,
+           c->secs / rounds * 1e3, (c->secs / rounds + wire * 8 / (mbit * 1e6)) * 1e3);
+}
+
+int main(int argc, char *argv[]) {
+    cost_t full, delta;
+    delete_input del;
+    double ops = 0, literal = 0, written = 0;
+    char *old, *new;
+    long r, len;
+    int c, used = 0;
+
+    while ((c = getopt(argc, argv, "s:e:c:b:n:l:p:")) != -1) {
+        switch (c) {
+        case 's': size = parse_size(optarg, argv[0]); break;
+        case 'e': percent = atof(optarg); break;
+        case 'c': edits = atoi(optarg); break;
+        case 'b': block_len = atoi(optarg); break;
+        case 'n': rounds = atol(optarg); break;
+        case 'l': mbit = atof(optarg); break;
+        case 'p': port = atoi(optarg); break;
+        default: usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1 || percent <= 0 || percent > 50 || edits < 1 || block_len < 0 ||
+        rounds < 1 || mbit <= 0 || size < 4L * edits)
+        usage(argv[0]);
+    host = argv[optind];
+    clnt = connect_server();
+    if (clnt == NULL) {
+        clnt_pcreateerror(host);
+        exit(1);
+    }
+
+    old = malloc(size);
+    new = malloc(size + size / 2);
+    if (old == NULL || new == NULL)
+        fail("malloc", "out of memory");
+    memset(&full, 0, sizeof(full));
+    memset(&delta, 0, sizeof(delta));
+    for (r = 0; r < rounds; r++) {
+        for (len = 0; len < size; len++)
+            old[len] = (char)next_rand();
+        len = edit(old, size, new);
+        put(old, size, NULL);
+        put(new, len, &full);
+        put(old, size, NULL);
+        put_delta(new, len, &delta, &ops, &literal, &written, &used);
+        check(new, len);
+    }
+
+    printf("file %ld bytes, %.1f%% edited in %d places, %ld rounds, block %d bytes, "
+           "link %.0f Mbit/s\n", size, percent, edits, rounds, used, mbit);
+    printf("delta ops %.0f literal %.0f bytes, server wrote %.0f bytes\n",
+           ops / rounds, literal / rounds, written / rounds);
+    printf("%-8s %12s %12s %10s %14s\n", "method", "bytes sent", "bytes recv", "ms",
+           "ms at link");
+    print("put", &full);
+    print("delta", &delta);
+
+    memset(&del, 0, sizeof(del));
+    strcpy(del.user_name, BENCH_USER);
+    strcpy(del.file_name, BENCH_FILE);
+    delete_file_1(&del, clnt);
+    clnt_destroy(clnt);
+    free(old);
+    free(new);
+    return 0;
+}
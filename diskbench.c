@@ -0,0 +1,278 @@
+/*
+ * diskbench: bandwidth of the virtual disk layer with the image striped
+ * over 1, 2 and 4 member files, and optionally mirrored.
+ *
+ *   diskbench [-d dir[,dir...]] [-s disk_size] [-i io_size] [-S stripe_unit]
+ *             [-t threads] [-m members[,members...]] [-c copies[,copies...]]
+ *
+ * For each member and copy count a scratch image is formatted, its files
+ * placed round-robin over the directories, and three passes run over its
+ * data area through vdisk_pread/vdisk_pwrite:
+ *
+ *   write   sequential io_size writes, then vdisk_sync (to every copy)
+ *   read    sequential io_size reads, page cache dropped first
+ *   rand    io_size reads at random aligned offsets from several
+ *           threads at once, as concurrent clients would issue them;
+ *           mirrors share these out
+ *
+ * Put the directories on different disks to see striping pay off; on one
+ * disk the numbers mostly show the cost of the fan-out.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "vdisk.h"
+
+#define MAX_DIRS 16
+
+static char *dirs[MAX_DIRS];
+static int ndirs;
+static unsigned long long disk_size = 256ULL << 20;
+static unsigned long long io_size = 1 << 20;
+static unsigned long long stripe = (unsigned long long)VDISK_STRIPE_BLOCKS * VDISK_BLOCK_SIZE;
+static int nthreads = 4;
+
+static vdisk_t disk;
+static superblock_t sb;
+static u_int64_t data_off, data_len;
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-d dir[,dir...]] [-s disk_size] [-i io_size] [-S stripe_unit]\n"
+                    "                 [-t threads] [-m members[,members...]] [-c copies[,copies...]]\n", prog);
+    exit(1);
+}
+
+/* "4096", "64K", "2G" */
+static unsigned long long parse_size(const char *s, const char *prog) {
+    char *end;
+    unsigned long long v = strtoull(s, &end, 10);
+    switch (*end) {
+    case 'k': case 'K': v <<= 10; end++; break;
+    case 'm': case 'M': v <<= 20; end++; break;
+    case 'g': case 'G': v <<= 30; end++; break;
+    }
+    if (end == s || *end != '\0' || v == 0)
+        usage(prog);
+    return v;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fail(const char *what) {
+    perror(what);
+    exit(1);
+}
+
+/* file i of the scratch image, copy i / members member i % members */
+static void member_path(char *buf, size_t len, int i) {
+    snprintf(buf, len, "%s/diskbench.%d.%d.img", dirs[i % ndirs], (int)getpid(), i);
+}
+
+/* the comma-separated members of copy c */
+static void copy_paths(char *paths, size_t len, int n, int c) {
+    size_t at = 0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (i > 0) paths[at++] = ',';
+        member_path(paths + at, len - at, c * n + i);
+        at += strlen(paths + at);
+    }
+}
+
+/* open copies of the scratch image, n members each */
+static void open_image(int n, int copies, int flags) {
+    char paths[VDISK_MAX_MEMBERS * 256], err[256];
+    int c;
+
+    copy_paths(paths, sizeof(paths), n, 0);
+    if (vdisk_open(&disk, paths, flags, err, sizeof(err)) != 0) {
+        fprintf(stderr, "%s\n", err);
+        exit(1);
+    }
+    for (c = 1; c < copies; c++) {
+        copy_paths(paths, sizeof(paths), n, c);
+        if (vdisk_mirror(&disk, paths, flags, err, sizeof(err)) != 0) {
+            fprintf(stderr, "%s\n", err);
+            exit(1);
+        }
+    }
+}
+
+static void make_image(int n, int copies) {
+    char err[256];
+
+    memset(&sb, 0, sizeof(sb));
+    sb.block_size = VDISK_BLOCK_SIZE;
+    sb.disk_size = disk_size;
+    sb.blocks_per_file = VDISK_BLOCKS_PER_FILE;
+    sb.max_users = 1;
+    sb.max_files_user = 1;
+    sb.members = (u_int)n;
+    sb.stripe_blocks = (u_int)(stripe / VDISK_BLOCK_SIZE);
+    sb.image_id = vdisk_new_id();
+    if (vdisk_layout(&sb, err, sizeof(err)) != 0) {
+        fprintf(stderr, "%s\n", err);
+        exit(1);
+    }
+    open_image(n, copies, O_CREAT | O_TRUNC);
+    if (vdisk_format(&disk, &sb) < 0)
+        fail("format");
+    vdisk_close(&disk);
+    open_image(n, copies, 0);
+    if (vdisk_attach(&disk, &sb, err, sizeof(err)) != 0) {
+        fprintf(stderr, "%s\n", err);
+        exit(1);
+    }
+    data_off = (u_int64_t)sb.data_block * sb.block_size;
+    data_len = (sb.disk_size - data_off) / io_size * io_size;
+    if (data_len == 0) {
+        fprintf(stderr, "disk size too small for %llu byte I/Os\n", io_size);
+        exit(1);
+    }
+}
+
+static void remove_image(int files) {
+    char path[256];
+    int i;
+
+    vdisk_close(&disk);
+    for (i = 0; i < files; i++) {
+        member_path(path, sizeof(path), i);
+        unlink(path);
+    }
+}
+
+static void drop_cache(void) {
+    int f;
+    for (f = 0; f < disk.members * disk.copies; f++)
+        posix_fadvise(disk.fd[f], 0, 0, POSIX_FADV_DONTNEED);
+}
+
+static double seq_write(char *buf) {
+    u_int64_t off;
+    double t = now();
+
+    for (off = 0; off < data_len; off += io_size)
+        if (vdisk_pwrite(&disk, buf, io_size, (off_t)(data_off + off)) < 0)
+            fail("write");
+    if (vdisk_sync(&disk) < 0)
+        fail("sync");
+    return data_len / (now() - t) / 1e6;
+}
+
+static double seq_read(char *buf) {
+    u_int64_t off;
+    double t;
+
+    drop_cache();
+    t = now();
+    for (off = 0; off < data_len; off += io_size)
+        if (vdisk_pread(&disk, buf, io_size, (off_t)(data_off + off)) < 0)
+            fail("read");
+    return data_len / (now() - t) / 1e6;
+}
+
+static void *rand_reader(void *arg) {
+    unsigned int seed = (unsigned int)(size_t)arg * 2654435761u;
+    u_int64_t slots = data_len / io_size, i, n = slots / nthreads;
+    char *buf = malloc(io_size);
+
+    if (buf == NULL)
+        fail("malloc");
+    for (i = 0; i < n; i++) {
+        u_int64_t slot = ((u_int64_t)rand_r(&seed) << 16 ^ rand_r(&seed)) % slots;
+        if (vdisk_pread(&disk, buf, io_size, (off_t)(data_off + slot * io_size)) < 0)
+            fail("read");
+    }
+    free(buf);
+    return NULL;
+}
+
+static double rand_read(void) {
+    pthread_t th[64];
+    u_int64_t bytes = data_len / io_size / nthreads * nthreads * io_size;
+    double t;
+    int i;
+
+    drop_cache();
+    t = now();
+    for (i = 0; i < nthreads; i++)
+        pthread_create(&th[i], NULL, rand_reader, (void *)(size_t)(i + 1));
+    for (i = 0; i < nthreads; i++)
+        pthread_join(th[i], NULL);
+    return bytes / (now() - t) / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+    char default_members[] = "1,2,4", default_copies[] = "1", default_dirs[] = ".";
+    char *members = default_members, *copylist = default_copies, *dirlist = default_dirs;
+    char *p, *buf;
+    int c, i, copies[VDISK_MAX_COPIES], ncopies = 0;
+
+    while ((c = getopt(argc, argv, "d:s:i:S:t:m:c:")) != -1) {
+        switch (c) {
+        case 'd': dirlist = optarg; break;
+        case 's': disk_size = parse_size(optarg, argv[0]); break;
+        case 'i': io_size = parse_size(optarg, argv[0]); break;
+        case 'S': stripe = parse_size(optarg, argv[0]); break;
+        case 't': nthreads = atoi(optarg); break;
+        case 'm': members = optarg; break;
+        case 'c': copylist = optarg; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (optind != argc || nthreads < 1 || nthreads > 64 || stripe % VDISK_BLOCK_SIZE != 0)
+        usage(argv[0]);
+    for (p = strtok(dirlist, ","); p != NULL && ndirs < MAX_DIRS; p = strtok(NULL, ","))
+        dirs[ndirs++] = p;
+    if (ndirs == 0)
+        usage(argv[0]);
+    for (p = strtok(copylist, ","); p != NULL; p = strtok(NULL, ",")) {
+        if (ncopies == VDISK_MAX_COPIES || (copies[ncopies] = atoi(p)) < 1 ||
+            copies[ncopies] > VDISK_MAX_COPIES) {
+            fprintf(stderr, "bad copy count %s\n", p);
+            exit(1);
+        }
+        ncopies++;
+    }
+
+    buf = malloc(io_size);
+    if (buf == NULL)
+        fail("malloc");
+    for (i = 0; i < (int)io_size; i++)
+        buf[i] = (char)(i * 31 + 7);
+
+    printf("disk %llu MiB, %llu KiB I/Os, %llu KiB stripe unit, %d random readers\n",
+           disk_size >> 20, io_size >> 10, stripe >> 10, nthreads);
+    printf("%-8s %-8s %12s %12s %12s\n", "members", "copies", "write MB/s", "read MB/s", "rand MB/s");
+    for (p = strtok(members, ","); p != NULL; p = strtok(NULL, ",")) {
+        for (i = 0; i < ncopies; i++) {
+            int n = atoi(p);
+            double w, r, x;
+            if (n < 1 || n > VDISK_MAX_MEMBERS) {
+                fprintf(stderr, "bad member count %s\n", p);
+                exit(1);
+            }
+            make_image(n, copies[i]);
+            w = seq_write(buf);
+            r = seq_read(buf);
+            x = rand_read();
+            remove_image(n * copies[i]);
+            printf("%-8d %-8d %12.1f %12.1f %12.1f\n", n, copies[i], w, r, x);
+            fflush(stdout);
+        }
+    }
+    free(buf);
+    return 0;
+}
@@ -0,0 +1,64 @@
+/*
+ * Log-linear latency histogram, see hist.h.
+ */
+
+#include <string.h>
+#include "hist.h"
+
+static int hist_index(unsigned long long v) {
+    int e = 0;
+    if (v < HIST_SUB)
+        return (int)v;
+    while ((v >> e) >= 2 * HIST_SUB)
+        e++;
+    /* v >> e is in [HIST_SUB, 2 * HIST_SUB) */
+    return (e + 1) * HIST_SUB + (int)((v >> e) - HIST_SUB);
+}
+
+/* largest value that falls into bucket i */
+static unsigned long long hist_upper(int i) {
+    int e;
+    if (i < HIST_SUB)
+        return (unsigned long long)i;
+    e = i / HIST_SUB - 1;
+    return (((unsigned long long)(i % HIST_SUB + HIST_SUB) + 1) << e) - 1;
+}
+
+void hist_reset(hist_t *h) {
+    memset(h, 0, sizeof(*h));
+}
+
+void hist_record(hist_t *h, unsigned long long v) {
+    if (h->count == 0 || v < h->min) h->min = v;
+    if (v > h->max) h->max = v;
+    h->count++;
+    h->sum += v;
+    h->buckets[hist_index(v)]++;
+}
+
+void hist_merge(hist_t *dst, const hist_t *src) {
+    int i;
+    if (src->count == 0) return;
+    if (dst->count == 0 || src->min < dst->min) dst->min = src->min;
+    if (src->max > dst->max) dst->max = src->max;
+    dst->count += src->count;
+    dst->sum += src->sum;
+    for (i = 0; i < HIST_BUCKETS; i++)
+        dst->buckets[i] += src->buckets[i];
+}
+
+unsigned long long hist_percentile(const hist_t *h, double p) {
+    unsigned long long want, seen = 0, v;
+    int i;
+    if (h->count == 0) return 0;
+    want = (unsigned long long)(p * (double)h->count + 0.999999);
+    if (want < 1) want = 1;
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= want) {
+            v = hist_upper(i);
+            return v > h->max ? h->max : v;
+        }
+    }
+    return h->max;
+}
@@ -0,0 +1,29 @@
+/*
+ * Latency histogram with HDR-style log-linear buckets: exact below 16,
+ * then 16 sub-buckets per power of two (under 6.25% error) up to 2^64.
+ * Values are plain counts, the callers use nanoseconds.
+ */
+
+#ifndef SSNFS_HIST_H
+#define SSNFS_HIST_H
+
+#define HIST_SUB_BITS 4
+#define HIST_SUB      (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS  (61 * HIST_SUB)
+
+typedef struct {
+    unsigned long long count;
+    unsigned long long sum;
+    unsigned long long min;
+    unsigned long long max;
+    unsigned long long buckets[HIST_BUCKETS];
+} hist_t;
+
+void hist_reset(hist_t *h);
+void hist_record(hist_t *h, unsigned long long v);
+void hist_merge(hist_t *dst, const hist_t *src);
+/* smallest recorded value v with at least p (0..1) of the samples <= v,
+   accurate to the bucket width */
+unsigned long long hist_percentile(const hist_t *h, double p);
+
+#endif /* SSNFS_HIST_H */
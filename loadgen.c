@@ -0,0 +1,607 @@
+/*
+ * SSNFS load generator: worker threads issue a configurable mix of
+ * operations against a server over one or more connections and report
+ * throughput and latency percentiles per operation as JSON.
+ *
+ *   loadgen [-t threads] [-c connections] [-d seconds | -n ops]
+ *           [-m mix] [-b io_size] [-r] [-f files] [-u users]
+ *           [-s span] [-p port] [-o out.json] [-k] host
+ *
+ * The RPC stubs in ssnfs_clnt.c return a static result, so the workers
+ * call clnt_call() directly with their own result structures.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <rpc/rpc.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "ssnfs.h"
+#include "hist.h"
+
+#define MAX_WORKERS   64
+#define MAX_FILES     10      /* per worker */
+#define MAX_TEMPS     8
+#define DEFAULT_SPAN  32768   /* file size of a default image */
+#define SERVER_FILES  10      /* server limits: files per user, */
+#define SERVER_OPEN   20      /* open files */
+
+enum { OP_CREATE, OP_OPEN, OP_CLOSE, OP_READ, OP_WRITE, OP_SEEK, OP_LIST,
+       OP_DELETE, NOPS };
+
+static const char *op_names[NOPS] = {
+    "create", "open", "close", "read", "write", "seek", "list", "delete"
+};
+
+typedef struct {
+    CLIENT         *clnt;
+    pthread_mutex_t lock;
+} conn_t;
+
+typedef struct {
+    unsigned long long ops, errors, bytes;
+    hist_t lat;
+} op_stats_t;
+
+typedef struct {
+    int        id;
+    pthread_t  tid;
+    conn_t    *conn;
+    char       user[USER_NAME_SIZE];
+    int        fd[MAX_FILES];
+    int        pos[MAX_FILES];
+    int        cur;                   /* file of the sequential stream */
+    int        temps, temp_seq;       /* create/delete scratch files */
+    int        temp_first;
+    unsigned   rng;
+    char      *buf;
+    op_stats_t st[NOPS];
+} worker_t;
+
+/* options */
+static int   nthreads = 4, nconns = 1, duration = 10, files = 2, nusers;
+static long  nops = 0;                 /* per worker; 0: run for duration */
+static int   io_size = 4096, span = DEFAULT_SPAN, random_io, keep, port;
+static int   mix[NOPS] = { 2, 5, 0, 50, 30, 5, 5, 2 };
+static int   max_temps;               /* scratch files a worker may hold */
+static const char *host, *out_name;
+
+static conn_t   conns[MAX_WORKERS];
+static worker_t workers[MAX_WORKERS];
+static volatile int stop;
+static int          started;
+static pthread_mutex_t start_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  start_cond = PTHREAD_COND_INITIALIZER;
+static struct timeval  rpc_timeout = { 25, 0 };
+
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned next_rand(worker_t *w) {
+    w->rng = w->rng * 1103515245u + 12345u;
+    return w->rng >> 8;
+}
+
+static CLIENT *connect_server(void) {
+    struct sockaddr_in sin;
+    struct hostent *he;
+    int sock = RPC_ANYSOCK;
+
+    if (port == 0)
+        return clnt_create(host, SSNFSPROG, SSNFSVER, "tcp");
+    he = gethostbyname(host);
+    if (he == NULL || he->h_addrtype != AF_INET)
+        return NULL;
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(port);
+    memcpy(&sin.sin_addr, he->h_addr_list[0], sizeof(sin.sin_addr));
+    return clnttcp_create(&sin, SSNFSPROG, SSNFSVER, &sock, 0, 0);
+}
+
+/* One timed call; on success the caller checks res and frees it. */
+static int call(worker_t *w, int op, rpcproc_t proc, xdrproc_t xargs, void *arg,
+                xdrproc_t xres, void *res, unsigned long long *ns) {
+    enum clnt_stat st;
+    unsigned long long t0;
+
+    pthread_mutex_lock(&w->conn->lock);
+    t0 = now_ns();
+    st = clnt_call(w->conn->clnt, proc, xargs, (caddr_t)arg, xres, (caddr_t)res,
+                   rpc_timeout);
+    *ns = now_ns() - t0;
+    pthread_mutex_unlock(&w->conn->lock);
+    if (st != RPC_SUCCESS) {
+        fprintf(stderr, "worker %d: %s: %s\n", w->id, op_names[op], clnt_sperrno(st));
+        return -1;
+    }
+    return 0;
+}
+
+static void account(worker_t *w, int op, int ok, unsigned long long ns, int bytes) {
+    op_stats_t *s = &w->st[op];
+    s->ops++;
+    if (!ok) s->errors++;
+    else s->bytes += bytes;
+    hist_record(&s->lat, ns);
+}
+
+static void set_name(char *dst, int size, const char *fmt, int a, int b) {
+    memset(dst, 0, size);
+    snprintf(dst, size, fmt, a, b);
+}
+
+static int do_create(worker_t *w, const char *name) {
+    create_input  arg;
+    create_output res;
+    unsigned long long ns;
+    int ok = 0;
+
+    memcpy(arg.user_name, w->user, USER_NAME_SIZE);
+    memset(arg.file_name, 0, FILE_NAME_SIZE);
+    strncpy(arg.file_name, name, FILE_NAME_SIZE - 1);
+    memset(&res, 0, sizeof(res));
+    if (call(w, OP_CREATE, create_file, (xdrproc_t)xdr_create_input, &arg,
+             (xdrproc_t)xdr_create_output, &res, &ns) == 0) {
+        ok = res.success == 1;
+        clnt_freeres(w->conn->clnt, (xdrproc_t)xdr_create_output, (caddr_t)&res);
+    }
+    account(w, OP_CREATE, ok, ns, 0);
+    return ok;
+}
+
+static int do_delete(worker_t *w, const char *name) {
+    delete_input  arg;
+    delete_output res;
+    unsigned long long ns;
+    int ok = 0;
+
+    memcpy(arg.user_name, w->user, USER_NAME_SIZE);
+    memset(arg.file_name, 0, FILE_NAME_SIZE);
+    strncpy(arg.file_name, name, FILE_NAME_SIZE - 1);
+    memset(&res, 0, sizeof(res));
+    if (call(w, OP_DELETE, delete_file, (xdrproc_t)xdr_delete_input, &arg,
+             (xdrproc_t)xdr_delete_output, &res, &ns) == 0) {
+        ok = res.success == 1;
+        clnt_freeres(w->conn->clnt, (xdrproc_t)xdr_delete_output, (caddr_t)&res);
+    }
+    account(w, OP_DELETE, ok, ns, 0);
+    return ok;
+}
+
+static int do_open(worker_t *w, int i) {
+    open_input  arg;
+    open_output res;
+    unsigned long long ns;
+    int fd = -1;
+
+    memcpy(arg.user_name, w->user, USER_NAME_SIZE);
+    set_name(arg.file_name, FILE_NAME_SIZE, "lg%d_%d", w->id, i);
+    memset(&res, 0, sizeof(res));
+    if (call(w, OP_OPEN, open_file, (xdrproc_t)xdr_open_input, &arg,
+             (xdrproc_t)xdr_open_output, &res, &ns) == 0) {
+        fd = res.fd;
+        clnt_freeres(w->conn->clnt, (xdrproc_t)xdr_open_output, (caddr_t)&res);
+    }
+    account(w, OP_OPEN, fd >= 0, ns, 0);
+    w->fd[i] = fd;
+    w->pos[i] = 0;
+    return fd;
+}
+
+static int do_close(worker_t *w, int i) {
+    close_input  arg;
+    close_output res;
+    unsigned long long ns;
+    int ok = 0;
+
+    if (w->fd[i] < 0) return 0;
+    memcpy(arg.user_name, w->user, USER_NAME_SIZE);
+    arg.fd = w->fd[i];
+    memset(&res, 0, sizeof(res));
+    if (call(w, OP_CLOSE, close_file, (xdrproc_t)xdr_close_input, &arg,
+             (xdrproc_t)xdr_close_output, &res, &ns) == 0) {
+        ok = res.out_msg.out_msg_val != NULL &&
+             strcmp(res.out_msg.out_msg_val, "File closed") == 0;
+        clnt_freeres(w->conn->clnt, (xdrproc_t)xdr_close_output, (caddr_t)&res);
+    }
+    account(w, OP_CLOSE, ok, ns, 0);
+    w->fd[i] = -1;
+    return ok;
+}
+
+static int do_seek(worker_t *w, int i, int position) {
+    seek_input  arg;
+    seek_output res;
+    unsigned long long ns;
+    int ok = 0;
+
+    memcpy(arg.user_name, w->user, USER_NAME_SIZE);
+    arg.fd = w->fd[i];
+    arg.position = position;
+    memset(&res, 0, sizeof(res));
+    if (call(w, OP_SEEK, seek_position, (xdrproc_t)xdr_seek_input, &arg,
+             (xdrproc_t)xdr_seek_output, &res, &ns) == 0) {
+        ok = res.success == 1;
+        clnt_freeres(w->conn->clnt, (xdrproc_t)xdr_seek_output, (caddr_t)&res);
+    }
+    account(w, OP_SEEK, ok, ns, 0);
+    if (ok) w->pos[i] = position;
+    return ok;
+}
+
+static int do_read(worker_t *w, int i, int n) {
+    read_input  arg;
+    read_output res;
+    unsigned long long ns;
+    int got = -1;
+
+    memcpy(arg.user_name, w->user, USER_NAME_SIZE);
+    arg.fd = w->fd[i];
+    arg.numbytes = n;
+    memset(&res, 0, sizeof(res));
+    if (call(w, OP_READ, read_file, (xdrproc_t)xdr_read_input, &arg,
+             (xdrproc_t)xdr_read_output, &res, &ns) == 0) {
+        if (res.success == 1) got = (int)res.buffer.buffer_len;
+        clnt_freeres(w->conn->clnt, (xdrproc_t)xdr_read_output, (caddr_t)&res);
+    }
+    account(w, OP_READ, got >= 0, ns, got);
+    if (got > 0) w->pos[i] += got;
+    return got;
+}
+
+static int do_write(worker_t *w, int i, int n) {
+    write_input  arg;
+    write_output res;
+    unsigned long long ns;
+    int ok = 0;
+
+    memcpy(arg.user_name, w->user, USER_NAME_SIZE);
+    arg.fd = w->fd[i];
+    arg.numbytes = n;
+    arg.buffer.buffer_len = n;
+    arg.buffer.buffer_val = w->buf;
+    memset(&res, 0, sizeof(res));
+    if (call(w, OP_WRITE, write_file, (xdrproc_t)xdr_write_input, &arg,
+             (xdrproc_t)xdr_write_output, &res, &ns) == 0) {
+        ok = res.success == 1;
+        clnt_freeres(w->conn->clnt, (xdrproc_t)xdr_write_output, (caddr_t)&res);
+    }
+    account(w, OP_WRITE, ok, ns, n);
+    if (ok) w->pos[i] += n;
+    return ok;
+}
+
+static int do_list(worker_t *w) {
+    list_input  arg;
+    list_output res;
+    unsigned long long ns;
+    int ok = 0;
+
+    memcpy(arg.user_name, w->user, USER_NAME_SIZE);
+    memset(&res, 0, sizeof(res));
+    if (call(w, OP_LIST, list_files, (xdrproc_t)xdr_list_input, &arg,
+             (xdrproc_t)xdr_list_output, &res, &ns) == 0) {
+        ok = res.out_msg.out_msg_val != NULL;
+        clnt_freeres(w->conn->clnt, (xdrproc_t)xdr_list_output, (caddr_t)&res);
+    }
+    account(w, OP_LIST, ok, ns, 0);
+    return ok;
+}
+
+/* Position file i for the next transfer: sequential streams wrap at the
+   end of the span, random access seeks to an io_size-aligned offset. */
+static void place(worker_t *w, int i) {
+    int slots = span / io_size;
+    if (random_io && slots > 1)
+        do_seek(w, i, (int)(next_rand(w) % slots) * io_size);
+    else if (w->pos[i] + io_size > span)
+        do_seek(w, i, 0);
+}
+
+static int pick_op(worker_t *w) {
+    int total = 0, r, op;
+    for (op = 0; op < NOPS; op++) total += mix[op];
+    r = (int)(next_rand(w) % total);
+    for (op = 0; op < NOPS; op++) {
+        if (r < mix[op]) return op;
+        r -= mix[op];
+    }
+    return OP_READ;
+}
+
+static int pick_file(worker_t *w) {
+    if (random_io) return (int)(next_rand(w) % files);
+    return w->cur;
+}
+
+static void one_op(worker_t *w) {
+    char name[FILE_NAME_SIZE];
+    int  i = pick_file(w);
+
+    switch (pick_op(w)) {
+    case OP_CREATE:
+        if (w->temps >= max_temps) break;
+        set_name(name, sizeof(name), "lt%d_%d", w->id, w->temp_seq++);
+        if (do_create(w, name)) w->temps++;
+        break;
+    case OP_DELETE:
+        if (w->temps == 0) break;
+        set_name(name, sizeof(name), "lt%d_%d", w->id, w->temp_first++);
+        do_delete(w, name);
+        w->temps--;
+        break;
+    case OP_OPEN:
+    case OP_CLOSE:
+        do_close(w, i);
+        do_open(w, i);
+        break;
+    case OP_READ:
+        if (w->fd[i] < 0) break;
+        place(w, i);
+        if (do_read(w, i, io_size) <= 0)
+            w->pos[i] = span;        /* wrap next time */
+        if (!random_io && w->pos[i] + io_size > span)
+            w->cur = (w->cur + 1) % files;
+        break;
+    case OP_WRITE:
+        if (w->fd[i] < 0) break;
+        place(w, i);
+        if (!do_write(w, i, io_size))
+            w->pos[i] = span;
+        if (!random_io && w->pos[i] + io_size > span)
+            w->cur = (w->cur + 1) % files;
+        break;
+    case OP_SEEK:
+        if (w->fd[i] < 0) break;
+        do_seek(w, i, (int)(next_rand(w) % (span / io_size)) * io_size);
+        break;
+    case OP_LIST:
+        do_list(w);
+        break;
+    }
+}
+
+static void *worker_main(void *arg) {
+    worker_t *w = arg;
+    long done;
+
+    pthread_mutex_lock(&start_lock);
+    while (!started)
+        pthread_cond_wait(&start_cond, &start_lock);
+    pthread_mutex_unlock(&start_lock);
+
+    for (done = 0; !stop && (nops == 0 || done < nops); done++)
+        one_op(w);
+    return NULL;
+}
+
+/* create, fill and open the worker's files; not timed */
+static int setup_worker(worker_t *w) {
+    char name[FILE_NAME_SIZE];
+    int i, pos;
+
+    for (i = 0; i < files; i++) {
+        set_name(name, sizeof(name), "lg%d_%d", w->id, i);
+        do_create(w, name);           /* may exist from an earlier -k run */
+        if (do_open(w, i) < 0) {
+            fprintf(stderr, "worker %d: cannot open %s\n", w->id, name);
+            return -1;
+        }
+        for (pos = 0; pos + io_size <= span; pos += io_size)
+            if (!do_write(w, i, io_size)) break;
+        do_seek(w, i, 0);
+    }
+    memset(w->st, 0, sizeof(w->st));
+    return 0;
+}
+
+static void cleanup_worker(worker_t *w) {
+    char name[FILE_NAME_SIZE];
+    int i;
+    for (i = 0; i < files; i++) {
+        do_close(w, i);
+        if (!keep) {
+            set_name(name, sizeof(name), "lg%d_%d", w->id, i);
+            do_delete(w, name);
+        }
+    }
+    while (w->temps > 0) {
+        set_name(name, sizeof(name), "lt%d_%d", w->id, w->temp_first++);
+        do_delete(w, name);
+        w->temps--;
+    }
+}
+
+static int parse_mix(const char *spec) {
+    char buf[256], *tok, *save = NULL, *eq;
+    int op;
+
+    memset(mix, 0, sizeof(mix));
+    strncpy(buf, spec, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+    for (tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        eq = strchr(tok, '=');
+        if (eq == NULL) return -1;
+        *eq = '\0';
+        for (op = 0; op < NOPS; op++)
+            if (strcmp(tok, op_names[op]) == 0) break;
+        if (op == NOPS || atoi(eq + 1) < 0) return -1;
+        mix[op] = atoi(eq + 1);
+    }
+    for (op = 0; op < NOPS; op++)
+        if (mix[op] > 0) return 0;
+    return -1;
+}
+
+static void report(FILE *f, double secs) {
+    op_stats_t total[NOPS];
+    unsigned long long all_ops = 0, all_err = 0;
+    int op, i, first = 1;
+
+    memset(total, 0, sizeof(total));
+    for (i = 0; i < nthreads; i++) {
+        for (op = 0; op < NOPS; op++) {
+            total[op].ops += workers[i].st[op].ops;
+            total[op].errors += workers[i].st[op].errors;
+            total[op].bytes += workers[i].st[op].bytes;
+            hist_merge(&total[op].lat, &workers[i].st[op].lat);
+        }
+    }
+    for (op = 0; op < NOPS; op++) {
+        all_ops += total[op].ops;
+        all_err += total[op].errors;
+    }
+
+    fprintf(f, "{\n  \"config\": {\"host\": \"%s\", \"threads\": %d, \"connections\": %d, "
+               "\"files\": %d, \"users\": %d, \"io_size\": %d, \"span\": %d, "
+               "\"access\": \"%s\", \"mix\": {",
+            host, nthreads, nconns, files, nusers, io_size, span,
+            random_io ? "random" : "sequential");
+    for (op = 0; op < NOPS; op++) {
+        if (mix[op] == 0) continue;
+        fprintf(f, "%s\"%s\": %d", first ? "" : ", ", op_names[op], mix[op]);
+        first = 0;
+    }
+    fprintf(f, "}},\n  \"seconds\": %.3f,\n  \"ops\": %llu,\n  \"errors\": %llu,\n"
+               "  \"ops_per_sec\": %.1f,\n  \"per_op\": {\n",
+            secs, all_ops, all_err, secs > 0 ? all_ops / secs : 0.0);
+    first = 1;
+    for (op = 0; op < NOPS; op++) {
+        hist_t *h = &total[op].lat;
+        if (total[op].ops == 0) continue;
+        fprintf(f, "%s    \"%s\": {\"ops\": %llu, \"errors\": %llu, \"ops_per_sec\": %.1f, "
+                   "\"mb_per_sec\": %.3f, \"mean_us\": %.1f, \"p50_us\": %.1f, "
+                   "\"p99_us\": %.1f, \"p999_us\": %.1f, \"max_us\": %.1f}",
+                first ? "" : ",\n", op_names[op], total[op].ops, total[op].errors,
+                total[op].ops / secs, total[op].bytes / secs / 1e6,
+                (double)h->sum / h->count / 1000.0,
+                hist_percentile(h, 0.50) / 1000.0, hist_percentile(h, 0.99) / 1000.0,
+                hist_percentile(h, 0.999) / 1000.0, h->max / 1000.0);
+        first = 0;
+    }
+    fprintf(f, "\n  }\n}\n");
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "usage: %s [-t threads] [-c connections] [-d seconds | -n ops] [-m mix]\n"
+        "       [-b io_size] [-r] [-f files] [-u users] [-s span] [-p port]\n"
+        "       [-o out.json] [-k] host\n"
+        "  mix: op=weight,... with ops create open read write seek list delete\n"
+        "       (default create=2,open=5,read=50,write=30,seek=5,list=5,delete=2)\n"
+        "  -r random instead of sequential access, -k keep the files\n"
+        "  each worker uses its own user unless -u is given, and holds -f files\n"
+        "  (default 2) open; the server allows 10 files per user, 20 open\n", prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned long long t0, t1;
+    FILE *out = stdout;
+    int c, i;
+
+    while ((c = getopt(argc, argv, "t:c:d:n:m:b:rf:u:s:p:o:k")) != -1) {
+        switch (c) {
+        case 't': nthreads = atoi(optarg); break;
+        case 'c': nconns = atoi(optarg); break;
+        case 'd': duration = atoi(optarg); break;
+        case 'n': nops = atol(optarg); break;
+        case 'm': if (parse_mix(optarg) < 0) usage(argv[0]); break;
+        case 'b': io_size = atoi(optarg); break;
+        case 'r': random_io = 1; break;
+        case 'f': files = atoi(optarg); break;
+        case 'u': nusers = atoi(optarg); break;
+        case 's': span = atoi(optarg); break;
+        case 'p': port = atoi(optarg); break;
+        case 'o': out_name = optarg; break;
+        case 'k': keep = 1; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1)
+        usage(argv[0]);
+    host = argv[optind];
+    if (nusers == 0)
+        nusers = nthreads;
+    if (nthreads < 1 || nthreads > MAX_WORKERS || nconns < 1 || nconns > nthreads ||
+        files < 1 || files > MAX_FILES || nusers < 1 || nusers > nthreads ||
+        io_size < 1 || span < io_size || duration < 1 || nops < 0)
+        usage(argv[0]);
+
+    /* stay inside the server's per-user and open-table limits */
+    i = (nthreads + nusers - 1) / nusers;          /* workers per user */
+    if (i * files > SERVER_FILES || nthreads * files > SERVER_OPEN) {
+        fprintf(stderr, "%d workers x %d files exceed the server limits "
+                "(%d files per user, %d open)\n", nthreads, files, SERVER_FILES, SERVER_OPEN);
+        exit(1);
+    }
+    max_temps = (SERVER_FILES - i * files) / i;
+    if (max_temps > MAX_TEMPS) max_temps = MAX_TEMPS;
+
+    for (i = 0; i < nconns; i++) {
+        conns[i].clnt = connect_server();
+        if (conns[i].clnt == NULL) {
+            clnt_pcreateerror(host);
+            exit(1);
+        }
+        pthread_mutex_init(&conns[i].lock, NULL);
+    }
+    for (i = 0; i < nthreads; i++) {
+        worker_t *w = &workers[i];
+        int k;
+        w->id = i;
+        w->conn = &conns[i % nconns];
+        memset(w->user, 0, USER_NAME_SIZE);
+        snprintf(w->user, USER_NAME_SIZE, "lguser%hd", (short)(i % nusers));
+        w->rng = 2463534242u + 7919u * i;
+        w->buf = malloc(io_size);
+        if (w->buf == NULL) {
+            perror("malloc");
+            exit(1);
+        }
+        for (k = 0; k < io_size; k++)
+            w->buf[k] = 'a' + (k + i) % 26;
+        for (k = 0; k < MAX_FILES; k++)
+            w->fd[k] = -1;
+        if (setup_worker(w) < 0)
+            exit(1);
+        if (pthread_create(&w->tid, NULL, worker_main, w) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+
+    pthread_mutex_lock(&start_lock);
+    started = 1;
+    t0 = now_ns();
+    pthread_cond_broadcast(&start_cond);
+    pthread_mutex_unlock(&start_lock);
+    if (nops == 0) {
+        sleep(duration);
+        stop = 1;
+    }
+    for (i = 0; i < nthreads; i++)
+        pthread_join(workers[i].tid, NULL);
+    t1 = now_ns();
+
+    if (out_name != NULL && (out = fopen(out_name, "w")) == NULL) {
+        perror(out_name);
+        out = stdout;
+    }
+    report(out, (t1 - t0) / 1e9);
+    if (out != stdout)
+        fclose(out);
+
+    for (i = 0; i < nthreads; i++)
+        cleanup_worker(&workers[i]);
+    return 0;
+}
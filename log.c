@@ -0,0 +1,314 @@
+/*
+ * Asynchronous ring-buffer logging, see log.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include "log.h"
+
+#define LOG_SLOTS  1024          /* per thread, power of two */
+#define LOG_ARGS   8
+#define LOG_STR    160           /* copied %s bytes per record */
+#define LOG_IDLE_NS 5000000      /* writer poll interval when idle */
+
+typedef union {
+    long long i;
+    double    d;
+    void     *p;
+} log_arg_t;
+
+typedef struct {
+    struct timespec ts;
+    const char     *fmt;
+    int             level;
+    int             nargs;       /* conversions packed, the rest is cut */
+    log_arg_t       arg[LOG_ARGS];
+    char            str[LOG_STR];
+} log_rec_t;
+
+/* Single producer (the owning thread), single consumer (whoever holds
+   drain_lock).  head and tail only grow; slot = index % LOG_SLOTS. */
+typedef struct log_ring {
+    unsigned long    head;
+    unsigned long    tail;
+    unsigned long    dropped;
+    struct log_ring *next;
+    log_rec_t        slot[LOG_SLOTS];
+} log_ring_t;
+
+volatile int log_level = LL_INFO;
+
+static __thread log_ring_t *my_ring;
+static log_ring_t     *rings;
+static pthread_mutex_t reg_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE           *log_out;
+static int             running;
+static unsigned long long dropped_total;
+static const char     *level_names[] = { "ERROR", "WARN", "INFO", "DEBUG" };
+
+static log_ring_t *ring_new(void) {
+    log_ring_t *r = calloc(1, sizeof(*r));
+    if (r == NULL) return NULL;
+    pthread_mutex_lock(&reg_lock);
+    r->next = rings;
+    __atomic_store_n(&rings, r, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&reg_lock);
+    return r;
+}
+
+/* One conversion spec of fmt starting after '%': flags, width, precision
+   and length.  Returns the conversion character and sets *end past it,
+   *len to 'H' (char/short), 'l', 'L' (long long), 'z', 'j' or 0. */
+static char spec_parse(const char *p, const char **end, char *len, int *stars) {
+    *len = 0;
+    *stars = 0;
+    while (*p && strchr("-+ #0", *p)) p++;
+    if (*p == '*') { (*stars)++; p++; }
+    while (*p >= '0' && *p <= '9') p++;
+    if (*p == '.') {
+        p++;
+        if (*p == '*') { (*stars)++; p++; }
+        while (*p >= '0' && *p <= '9') p++;
+    }
+    if (*p == 'h') { *len = 'H'; p++; if (*p == 'h') p++; }
+    else if (*p == 'l') { *len = 'l'; p++; if (*p == 'l') { *len = 'L'; p++; } }
+    else if (*p == 'z' || *p == 'j' || *p == 't') { *len = *p; p++; }
+    *end = *p ? p + 1 : p;
+    return *p;
+}
+
+/* copy the arguments described by fmt out of ap into rec */
+static void pack_args(log_rec_t *rec, const char *fmt, va_list ap) {
+    const char *p = fmt, *end;
+    char conv, len;
+    int stars, s, used = 0;
+
+    rec->nargs = 0;
+    while ((p = strchr(p, '%')) != NULL) {
+        if (p[1] == '%') { p += 2; continue; }
+        conv = spec_parse(p + 1, &end, &len, &stars);
+        if (rec->nargs + stars + 1 > LOG_ARGS) break;
+        for (s = 0; s < stars; s++)
+            rec->arg[rec->nargs++].i = va_arg(ap, int);
+        switch (conv) {
+        case 'd': case 'i': case 'c':
+            if (len == 'l') rec->arg[rec->nargs].i = va_arg(ap, long);
+            else if (len == 'L') rec->arg[rec->nargs].i = va_arg(ap, long long);
+            else if (len == 'z' || len == 't') rec->arg[rec->nargs].i = va_arg(ap, ptrdiff_t);
+            else if (len == 'j') rec->arg[rec->nargs].i = va_arg(ap, intmax_t);
+            else rec->arg[rec->nargs].i = va_arg(ap, int);
+            break;
+        case 'u': case 'x': case 'X': case 'o':
+            if (len == 'l') rec->arg[rec->nargs].i = (long long)va_arg(ap, unsigned long);
+            else if (len == 'L') rec->arg[rec->nargs].i = (long long)va_arg(ap, unsigned long long);
+            else if (len == 'z' || len == 't') rec->arg[rec->nargs].i = (long long)va_arg(ap, size_t);
+            else if (len == 'j') rec->arg[rec->nargs].i = (long long)va_arg(ap, uintmax_t);
+            else rec->arg[rec->nargs].i = va_arg(ap, unsigned int);
+            break;
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G':
+            rec->arg[rec->nargs].d = va_arg(ap, double);
+            break;
+        case 'p':
+            rec->arg[rec->nargs].p = va_arg(ap, void *);
+            break;
+        case 's': {
+            const char *str = va_arg(ap, const char *);
+            size_t n;
+            if (str == NULL) str = "(null)";
+            n = strlen(str);
+            if (n > LOG_STR - 1 - used) n = LOG_STR - 1 - used;
+            memcpy(rec->str + used, str, n);
+            rec->str[used + n] = '\0';
+            rec->arg[rec->nargs].i = used;
+            used += n + (used + n < LOG_STR - 1);
+            break;
+        }
+        default:
+            return;           /* unknown conversion: stop, print the rest raw */
+        }
+        rec->nargs++;
+        p = end;
+    }
+}
+
+/* format rec like printf would have, into buf */
+static int format_rec(const log_rec_t *rec, char *buf, int size) {
+    const char *p = rec->fmt, *pct, *end;
+    char spec[32], conv, len;
+    int stars, at, k, a = 0, n;
+    struct tm tm;
+    time_t sec = rec->ts.tv_sec;
+
+    localtime_r(&sec, &tm);
+    at = (int)strftime(buf, size, "%Y-%m-%d %H:%M:%S", &tm);
+    at += snprintf(buf + at, size - at, ".%06ld %-5s ", rec->ts.tv_nsec / 1000,
+                   level_names[rec->level]);
+
+    while (at < size - 1 && (pct = strchr(p, '%')) != NULL) {
+        k = (int)(pct - p);
+        if (k > size - 1 - at) k = size - 1 - at;
+        memcpy(buf + at, p, k);
+        at += k;
+        if (pct[1] == '%') {
+            if (at < size - 1) buf[at++] = '%';
+            p = pct + 2;
+            continue;
+        }
+        conv = spec_parse(pct + 1, &end, &len, &stars);
+        if (a + stars + 1 > rec->nargs) { p = pct; break; }
+        /* rebuild the spec with '*' resolved and a 64-bit length */
+        n = 0;
+        for (k = 0; pct + k < end - 1 && n < (int)sizeof(spec) - 16; k++) {
+            char ch = pct[k];
+            if (ch == '*')
+                n += snprintf(spec + n, sizeof(spec) - n, "%d", (int)rec->arg[a++].i);
+            else if (ch != 'h' && ch != 'l' && ch != 'z' && ch != 'j' && ch != 't')
+                spec[n++] = ch;
+        }
+        spec[n] = '\0';
+        switch (conv) {
+        case 'd': case 'i': case 'u': case 'x': case 'X': case 'o':
+            snprintf(spec + n, sizeof(spec) - n, "ll%c", conv);
+            k = snprintf(buf + at, size - at, spec, rec->arg[a].i);
+            break;
+        case 'c':
+            snprintf(spec + n, sizeof(spec) - n, "c");
+            k = snprintf(buf + at, size - at, spec, (int)rec->arg[a].i);
+            break;
+        case 's':
+            snprintf(spec + n, sizeof(spec) - n, "s");
+            k = snprintf(buf + at, size - at, spec, rec->str + rec->arg[a].i);
+            break;
+        case 'p':
+            snprintf(spec + n, sizeof(spec) - n, "p");
+            k = snprintf(buf + at, size - at, spec, rec->arg[a].p);
+            break;
+        default:
+            snprintf(spec + n, sizeof(spec) - n, "%c", conv);
+            k = snprintf(buf + at, size - at, spec, rec->arg[a].d);
+            break;
+        }
+        a++;
+        if (k > 0) at += k < size - at ? k : size - 1 - at;
+        p = end;
+    }
+    if (at < size - 1)
+        at += snprintf(buf + at, size - at, "%s", p);
+    if (at > size - 2) at = size - 2;
+    /* formats may or may not end in a newline */
+    if (at == 0 || buf[at - 1] != '\n')
+        buf[at++] = '\n';
+    buf[at] = '\0';
+    return at;
+}
+
+/* move queued records to log_out; drain_lock held */
+static int drain(void) {
+    log_ring_t *r;
+    char line[512];
+    unsigned long head, tail, lost;
+    int n = 0;
+
+    for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+        head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        for (tail = r->tail; tail != head; tail++, n++) {
+            format_rec(&r->slot[tail % LOG_SLOTS], line, sizeof(line));
+            fputs(line, log_out);
+        }
+        __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+        lost = __atomic_exchange_n(&r->dropped, 0, __ATOMIC_RELAXED);
+        if (lost) {
+            __atomic_add_fetch(&dropped_total, lost, __ATOMIC_RELAXED);
+            fprintf(log_out, "log: %lu records dropped, ring full\n", lost);
+        }
+    }
+    if (n) fflush(log_out);
+    return n;
+}
+
+static void *log_writer(void *unused) {
+    struct timespec idle = { 0, LOG_IDLE_NS };
+    int n;
+    for (;;) {
+        pthread_mutex_lock(&drain_lock);
+        n = drain();
+        pthread_mutex_unlock(&drain_lock);
+        if (n == 0)
+            nanosleep(&idle, NULL);
+    }
+    return NULL;
+}
+
+void log_flush(void) {
+    if (!running) return;
+    pthread_mutex_lock(&drain_lock);
+    drain();
+    pthread_mutex_unlock(&drain_lock);
+}
+
+int log_start(FILE *out) {
+    pthread_t tid;
+    if (running) return 0;
+    log_out = out;
+    if (pthread_create(&tid, NULL, log_writer, NULL) != 0)
+        return -1;
+    pthread_detach(tid);
+    __atomic_store_n(&running, 1, __ATOMIC_RELEASE);
+    atexit(log_flush);
+    return 0;
+}
+
+unsigned long long log_dropped(void) {
+    unsigned long long n = __atomic_load_n(&dropped_total, __ATOMIC_RELAXED);
+    log_ring_t *r;
+    for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next)
+        n += __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+    return n;
+}
+
+void log_emit(int level, const char *fmt, ...) {
+    log_ring_t *r = my_ring;
+    log_rec_t  *rec;
+    va_list     ap;
+    unsigned long head;
+
+    if (level < LL_ERROR || level > LL_DEBUG)
+        level = LL_DEBUG;
+    if (!__atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+        /* no writer yet: format in place */
+        log_rec_t tmp;
+        char line[512];
+        clock_gettime(CLOCK_REALTIME, &tmp.ts);
+        tmp.fmt = fmt;
+        tmp.level = level;
+        va_start(ap, fmt);
+        pack_args(&tmp, fmt, ap);
+        va_end(ap);
+        format_rec(&tmp, line, sizeof(line));
+        fputs(line, stderr);
+        return;
+    }
+    if (r == NULL && (r = my_ring = ring_new()) == NULL)
+        return;
+
+    head = r->head;
+    if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= LOG_SLOTS) {
+        __atomic_add_fetch(&r->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    rec = &r->slot[head % LOG_SLOTS];
+    clock_gettime(CLOCK_REALTIME, &rec->ts);
+    rec->fmt = fmt;
+    rec->level = level;
+    va_start(ap, fmt);
+    pack_args(rec, fmt, ap);
+    va_end(ap);
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
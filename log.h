@@ -0,0 +1,51 @@
+/*
+ * Asynchronous logging.  log_*() packs the format pointer and the argument
+ * values into a slot of a per-thread ring buffer; a background thread
+ * formats and writes them.  The calling thread never blocks: when its
+ * ring is full the record is dropped and counted.
+ *
+ * Levels below SSNFS_LOG_LEVEL are compiled out; the rest cost one
+ * compare against log_level when disabled at run time.  Formats must be
+ * string literals (the pointer is kept) and take at most LOG_ARGS
+ * arguments; %s arguments are copied, up to LOG_STR bytes per record.
+ */
+
+#ifndef SSNFS_LOG_H
+#define SSNFS_LOG_H
+
+#include <stdio.h>
+
+#define LL_ERROR 0
+#define LL_WARN  1
+#define LL_INFO  2
+#define LL_DEBUG 3
+
+#ifndef SSNFS_LOG_LEVEL
+#define SSNFS_LOG_LEVEL LL_DEBUG
+#endif
+
+extern volatile int log_level;     /* records above this are skipped */
+
+#define log_at(lvl, ...) do { \
+        if ((lvl) <= SSNFS_LOG_LEVEL && (lvl) <= log_level) \
+            log_emit((lvl), __VA_ARGS__); \
+    } while (0)
+#define log_error(...) log_at(LL_ERROR, __VA_ARGS__)
+#define log_warn(...)  log_at(LL_WARN, __VA_ARGS__)
+#define log_info(...)  log_at(LL_INFO, __VA_ARGS__)
+#define log_debug(...) log_at(LL_DEBUG, __VA_ARGS__)
+
+/* Start the writer thread, writing to out.  Until then records are
+   formatted and written by the caller, to stderr. */
+int  log_start(FILE *out);
+/* write out everything queued so far; also run at exit */
+void log_flush(void);
+unsigned long long log_dropped(void);
+
+void log_emit(int level, const char *fmt, ...)
+#ifdef __GNUC__
+    __attribute__((format(printf, 2, 3)))
+#endif
+    ;
+
+#endif /* SSNFS_LOG_H */
@@ -0,0 +1,138 @@
+/*
+ * LZ77 codec for compressed file chunks, see lz.h.
+ */
+
+#include <string.h>
+#include "lz.h"
+
+#define LZ_HASH_BITS 12
+
+static unsigned int lz_read32(const unsigned char *p) {
+    unsigned int v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static unsigned int lz_hash(unsigned int v) {
+    return v * 2654435761u >> (32 - LZ_HASH_BITS);
+}
+
+/* the length bytes of a count past 15 */
+static unsigned char *lz_put_len(unsigned char *op, int n) {
+    for (; n >= 255; n -= 255)
+        *op++ = 255;
+    *op++ = (unsigned char)n;
+    return op;
+}
+
+/* One sequence: nlit literals from lit, then a match of mlen bytes at
+   offset back (none if mlen is 0).  NULL if it does not fit before end. */
+static unsigned char *lz_emit(unsigned char *op, unsigned char *end, const unsigned char *lit,
+                              int nlit, int offset, int mlen) {
+    unsigned char *token = op;
+
+    if (1 + nlit / 255 + 1 + nlit + (mlen ? 2 + mlen / 255 + 1 : 0) > end - op)
+        return NULL;
+    op++;
+    *token = (unsigned char)((nlit < 15 ? nlit : 15) << 4);
+    if (nlit >= 15)
+        op = lz_put_len(op, nlit - 15);
+    memcpy(op, lit, nlit);
+    op += nlit;
+    if (mlen) {
+        mlen -= LZ_MIN_MATCH;
+        *token |= mlen < 15 ? mlen : 15;
+        *op++ = (unsigned char)(offset & 0xff);
+        *op++ = (unsigned char)(offset >> 8);
+        if (mlen >= 15)
+            op = lz_put_len(op, mlen - 15);
+    }
+    return op;
+}
+
+/* Greedy: the position last seen with the same four-byte hash is the only
+   candidate.  Runs without matches are stepped through faster and faster,
+   so incompressible data costs little. */
+int lz_compress(const void *src, int len, void *dst, int cap) {
+    const unsigned char *in = src, *ip = in, *anchor = in, *end = in + len;
+    unsigned char *op = dst, *oend = op + cap;
+    int table[1 << LZ_HASH_BITS];     /* position + 1, 0 for none */
+    int misses = 0, ref, mlen;
+    unsigned int h;
+
+    memset(table, 0, sizeof(table));
+    while (end - ip >= LZ_MIN_MATCH) {
+        h = lz_hash(lz_read32(ip));
+        ref = table[h] - 1;
+        table[h] = (int)(ip - in) + 1;
+        if (ref < 0 || ip - in - ref > LZ_MAX_OFFSET || lz_read32(in + ref) != lz_read32(ip)) {
+            ip += 1 + (misses++ >> 6);
+            continue;
+        }
+        misses = 0;
+        for (mlen = LZ_MIN_MATCH; ip + mlen < end && in[ref + mlen] == ip[mlen]; mlen++)
+            ;
+        op = lz_emit(op, oend, anchor, (int)(ip - anchor), (int)(ip - in - ref), mlen);
+        if (op == NULL)
+            return 0;
+        ip += mlen;
+        anchor = ip;
+    }
+    if (anchor < end || op == (unsigned char *)dst) {
+        op = lz_emit(op, oend, anchor, (int)(end - anchor), 0, 0);
+        if (op == NULL)
+            return 0;
+    }
+    return (int)(op - (unsigned char *)dst);
+}
+
+/* a length past 15, -1 if the input runs out */
+static int lz_get_len(const unsigned char **ip, const unsigned char *end, int n) {
+    unsigned char b;
+    do {
+        if (*ip >= end)
+            return -1;
+        b = *(*ip)++;
+        n += b;
+    } while (b == 255);
+    return n;
+}
+
+int lz_decompress(const void *src, int len, void *dst, int cap) {
+    const unsigned char *ip = src, *iend = ip + len;
+    unsigned char *out = dst, *op = out, *oend = out + cap;
+    unsigned char token;
+    int n, offset;
+
+    while (ip < iend) {
+        token = *ip++;
+        n = token >> 4;
+        if (n == 15 && (n = lz_get_len(&ip, iend, n)) < 0)
+            return -1;
+        if (n > iend - ip || n > oend - op)
+            return -1;
+        memcpy(op, ip, n);
+        op += n;
+        ip += n;
+        if (ip == iend)
+            break;
+        if (iend - ip < 2)
+            return -1;
+        offset = ip[0] | ip[1] << 8;
+        ip += 2;
+        n = token & 15;
+        if (n == 15 && (n = lz_get_len(&ip, iend, n)) < 0)
+            return -1;
+        n += LZ_MIN_MATCH;
+        if (offset == 0 || offset > op - out || n > oend - op)
+            return -1;
+        if (offset >= n) {
+            memcpy(op, op - offset, n);
+            op += n;
+        } else {
+            for (; n > 0; n--, op++)
+                *op = op[-offset];
+        }
+    }
+    return (int)(op - out);
+}
@@ -0,0 +1,27 @@
+/*
+ * A small LZ77 codec in the LZ4 block style, for compressed file chunks:
+ * byte-aligned sequences of literals and back references, one hash probe
+ * per position, no entropy coding.  Fast rather than tight.
+ *
+ * A sequence is a token byte (literal count in the high four bits, match
+ * length minus LZ_MIN_MATCH in the low four, 15 meaning more length bytes
+ * follow, each adding up to 255), the literals, then a two-byte
+ * little-endian offset back into the output and the match's extra length
+ * bytes.  The last sequence may stop after its literals.
+ */
+
+#ifndef SSNFS_LZ_H
+#define SSNFS_LZ_H
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+
+/* Compress len bytes at src into dst, at most cap bytes.  Returns the
+   compressed length, or 0 if it does not fit in cap. */
+int lz_compress(const void *src, int len, void *dst, int cap);
+
+/* Decompress the len bytes at src into dst, at most cap bytes.  Returns
+   the decompressed length, or -1 if src is corrupt or does not fit. */
+int lz_decompress(const void *src, int len, void *dst, int cap);
+
+#endif /* SSNFS_LZ_H */
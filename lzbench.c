@@ -0,0 +1,234 @@
+/*
+ * lzbench: ratio and speed of the chunk codec (lz.c) at several chunk
+ * sizes, on generated data or on the files given.
+ *
+ *   lzbench [-c chunk[,chunk...]] [-s size] [file...]
+ *
+ * Without files two inputs of -s bytes (default 8M) are generated: text,
+ * words and line breaks about as compressible as source or logs, and
+ * random bytes, which do not compress at all.  Each input is cut into
+ * chunks and every chunk stored the way the server stores it with -z:
+ * compressed with its length in front and rounded up to a map unit if
+ * that saves a unit, as is otherwise.
+ *
+ *   ratio   input bytes over stored bytes
+ *   packed  chunks stored compressed
+ *   comp    MB/s of input compressed
+ *   decomp  MB/s of output decompressed, compressed chunks only
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "vdisk.h"
+#include "lz.h"
+
+#define MAX_CHUNKS 16
+#define MIN_TIME   0.2      /* seconds each timing runs for at least */
+
+static unsigned long long chunks[MAX_CHUNKS] = { 4096, 16384, 65536, 262144 };
+static int nchunks = 4;
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-c chunk[,chunk...]] [-s size] [file...]\n", prog);
+    exit(1);
+}
+
+/* "4096", "64K", "2G" */
+static unsigned long long parse_size(const char *s, const char *prog) {
+    char *end;
+    unsigned long long v = strtoull(s, &end, 10);
+    switch (*end) {
+    case 'k': case 'K': v <<= 10; end++; break;
+    case 'm': case 'M': v <<= 20; end++; break;
+    case 'g': case 'G': v <<= 30; end++; break;
+    }
+    if (end == s || *end != '\0' || v == 0)
+        usage(prog);
+    return v;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fail(const char *what) {
+    perror(what);
+    exit(1);
+}
+
+static void fill_text(char *buf, size_t len) {
+    static const char *words[] = {
+        "the ", "server ", "file ", "block ", "read ", "write ", "user ", "of ",
+        "to ", "and ", "return ", "size ", "0x1f ", "= ", "if ", "error\n"
+    };
+    unsigned int seed = 1;
+    const char *w;
+    size_t i = 0;
+
+    while (i < len) {
+        seed = seed * 1103515245 + 12345;
+        for (w = words[seed >> 16 & 15]; *w && i < len; w++)
+            buf[i++] = *w;
+    }
+}
+
+static void fill_random(char *buf, size_t len) {
+    unsigned long long x = 88172645463325252ULL;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        buf[i] = (char)(x >> 32);
+    }
+}
+
+/* the whole of a file */
+static char *load(const char *name, size_t *len) {
+    FILE *f = fopen(name, "rb");
+    char *buf;
+    long n;
+
+    if (f == NULL || fseek(f, 0, SEEK_END) < 0 || (n = ftell(f)) < 0)
+        fail(name);
+    rewind(f);
+    if ((buf = malloc(n > 0 ? n : 1)) == NULL)
+        fail("malloc");
+    if (fread(buf, 1, n, f) != (size_t)n)
+        fail(name);
+    fclose(f);
+    *len = n;
+    return buf;
+}
+
+/* Store every chunk of buf in zbuf (one chunk's worth per chunk), as the
+   server would.  Bytes stored; *packed counts the compressed chunks. */
+static unsigned long long store_all(const char *buf, size_t len, size_t chunk, char *zbuf,
+                                    int *zlens, int *packed) {
+    unsigned long long stored = 0;
+    size_t at, n, k;
+    int z;
+
+    *packed = 0;
+    for (at = 0, k = 0; at < len; at += n, k++) {
+        n = len - at < chunk ? len - at : chunk;
+        z = lz_compress(buf + at, (int)n, zbuf + k * chunk + 4, (int)n - 4 - VDISK_CHUNK_UNIT);
+        zlens[k] = z;
+        if (z > 0) {
+            memcpy(zbuf + k * chunk, &z, 4);
+            stored += (4 + z + VDISK_CHUNK_UNIT - 1) / VDISK_CHUNK_UNIT * VDISK_CHUNK_UNIT;
+            (*packed)++;
+        } else {
+            stored += n;
+        }
+    }
+    return stored;
+}
+
+/* the compressed chunks back into out; bytes produced */
+static unsigned long long load_all(size_t len, size_t chunk, const char *zbuf, const int *zlens,
+                                   char *out) {
+    unsigned long long bytes = 0;
+    size_t at, n, k;
+    int r;
+
+    for (at = 0, k = 0; at < len; at += n, k++) {
+        n = len - at < chunk ? len - at : chunk;
+        if (zlens[k] == 0)
+            continue;
+        r = lz_decompress(zbuf + k * chunk + 4, zlens[k], out + at, (int)n);
+        if (r != (int)n) {
+            fprintf(stderr, "chunk %zu does not decompress\n", k);
+            exit(1);
+        }
+        bytes += r;
+    }
+    return bytes;
+}
+
+static void bench(const char *name, const char *buf, size_t len) {
+    size_t nk, chunk, k, at;
+    char *zbuf, *out;
+    int *zlens, packed, c;
+    unsigned long long stored, bytes;
+    double t0, t, comp, decomp;
+    long reps;
+
+    for (c = 0; c < nchunks; c++) {
+        chunk = chunks[c];
+        nk = (len + chunk - 1) / chunk;
+        zbuf = malloc(nk * chunk + 1);
+        out = malloc(len + 1);
+        zlens = malloc((nk + 1) * sizeof(int));
+        if (zbuf == NULL || out == NULL || zlens == NULL)
+            fail("malloc");
+
+        t0 = now();
+        for (reps = 0; (t = now() - t0) < MIN_TIME || reps == 0; reps++)
+            stored = store_all(buf, len, chunk, zbuf, zlens, &packed);
+        comp = (double)len * reps / t / 1e6;
+
+        bytes = 0;
+        t0 = now();
+        for (reps = 0; (t = now() - t0) < MIN_TIME || reps == 0; reps++)
+            bytes = load_all(len, chunk, zbuf, zlens, out);
+        decomp = bytes ? (double)bytes * reps / t / 1e6 : 0;
+        for (k = 0, at = 0; k < nk; k++, at += chunk)
+            if (zlens[k] != 0 && memcmp(out + at, buf + at, len - at < chunk ? len - at : chunk)) {
+                fprintf(stderr, "%s: chunk %zu differs after a round trip\n", name, k);
+                exit(1);
+            }
+
+        printf("%-16s %7lluK %7.2f %6d/%-6zu %9.1f %9.1f\n", name, (unsigned long long)chunk >> 10,
+               stored ? (double)len / stored : 1.0, packed, nk, comp, decomp);
+        free(zbuf);
+        free(out);
+        free(zlens);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    unsigned long long size = 8ULL << 20;
+    char *buf, *s, *tok;
+    size_t len;
+    int c, i;
+
+    while ((c = getopt(argc, argv, "c:s:")) != -1) {
+        switch (c) {
+        case 'c':
+            nchunks = 0;
+            for (s = optarg; (tok = strtok(s, ",")) != NULL; s = NULL) {
+                if (nchunks == MAX_CHUNKS)
+                    usage(argv[0]);
+                chunks[nchunks++] = parse_size(tok, argv[0]);
+            }
+            break;
+        case 's': size = parse_size(optarg, argv[0]); break;
+        default: usage(argv[0]);
+        }
+    }
+
+    printf("%-16s %8s %7s %13s %9s %9s\n", "input", "chunk", "ratio", "packed", "comp", "decomp");
+    if (optind == argc) {
+        if ((buf = malloc(size)) == NULL)
+            fail("malloc");
+        fill_text(buf, size);
+        bench("text", buf, size);
+        fill_random(buf, size);
+        bench("random", buf, size);
+        free(buf);
+    }
+    for (i = optind; i < argc; i++) {
+        buf = load(argv[i], &len);
+        if (len > 0)
+            bench(argv[i], buf, len);
+        free(buf);
+    }
+    return 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * Substring search, see memfind.h.
+ *
+ * The vector paths follow Wojciech Muła's: at each of 16 or 32 positions
+ * at once, compare the byte there with the pattern's first byte and the
+ * byte m - 1 further on with its last, and only where both agree compare
+ * the bytes between.  The rare candidate costs a memcmp, every other
+ * position a share of two loads and three vector operations, where
+ * memchr-and-compare stops on every occurrence of the first byte.
+ */
+
+#include <string.h>
+#include <pthread.h>
+#include "memfind.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define MEMFIND_AVX2 __attribute__((target("avx2")))
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+static pthread_once_t memfind_once = PTHREAD_ONCE_INIT;
+static int memfind_avx2_ok;
+
+static void memfind_init(void) {
+#if defined(__x86_64__)
+    memfind_avx2_ok = __builtin_cpu_supports("avx2");
+#endif
+}
+
+/* memchr for the first byte, then compare the rest */
+const char *memfind_sw(const char *buf, size_t n, const char *pat, size_t m) {
+    const char *p = buf, *end;
+
+    if (m == 0 || n < m)
+        return m == 0 ? buf : NULL;
+    for (end = buf + n - m + 1; (p = memchr(p, pat[0], end - p)) != NULL; p++)
+        if (memcmp(p + 1, pat + 1, m - 1) == 0)
+            return p;
+    return NULL;
+}
+
+#if defined(__x86_64__)
+static const char *memfind_sse2(const char *buf, size_t n, const char *pat, size_t m) {
+    const __m128i first = _mm_set1_epi8(pat[0]), last = _mm_set1_epi8(pat[m - 1]);
+    __m128i a, b;
+    unsigned int mask;
+    size_t i;
+    int bit;
+
+    for (i = 0; i + m - 1 + 16 <= n; i += 16) {
+        a = _mm_loadu_si128((const __m128i *)(buf + i));
+        b = _mm_loadu_si128((const __m128i *)(buf + i + m - 1));
+        mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first),
+                                                             _mm_cmpeq_epi8(b, last)));
+        for (; mask != 0; mask &= mask - 1) {
+            bit = __builtin_ctz(mask);
+            if (buf[i + bit + 1] == pat[1] && memcmp(buf + i + bit + 2, pat + 2, m - 2) == 0)
+                return buf + i + bit;
+        }
+    }
+    return memfind_sw(buf + i, n - i, pat, m);
+}
+
+/* the candidates among the 32 positions at p */
+#define MEMFIND_EQ32(p)                                                       \
+    _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p)), first), \
+                     _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)((p) + m - 1)), last))
+
+/* 64 positions a round, tested for no candidate at all in one go */
+static MEMFIND_AVX2 const char *memfind_avx2(const char *buf, size_t n, const char *pat, size_t m) {
+    const __m256i first = _mm256_set1_epi8(pat[0]), last = _mm256_set1_epi8(pat[m - 1]);
+    __m256i lo, hi;
+    unsigned long long mask;
+    size_t i;
+    int bit;
+
+    for (i = 0; i + m - 1 + 64 <= n; i += 64) {
+        lo = MEMFIND_EQ32(buf + i);
+        hi = MEMFIND_EQ32(buf + i + 32);
+        if (_mm256_testz_si256(_mm256_or_si256(lo, hi), _mm256_or_si256(lo, hi)))
+            continue;
+        mask = (unsigned int)_mm256_movemask_epi8(lo) |
+               (unsigned long long)(unsigned int)_mm256_movemask_epi8(hi) << 32;
+        for (; mask != 0; mask &= mask - 1) {
+            bit = __builtin_ctzll(mask);
+            if (buf[i + bit + 1] == pat[1] && memcmp(buf + i + bit + 2, pat + 2, m - 2) == 0)
+                return buf + i + bit;
+        }
+    }
+    return memfind_sse2(buf + i, n - i, pat, m);
+}
+#elif defined(__aarch64__)
+/* NEON has no movemask: narrowing the compare result by four bits a byte
+   leaves a nibble per position in 64 bits */
+static const char *memfind_neon(const char *buf, size_t n, const char *pat, size_t m) {
+    const uint8x16_t first = vdupq_n_u8((unsigned char)pat[0]), last = vdupq_n_u8((unsigned char)pat[m - 1]);
+    uint8x16_t eq;
+    unsigned long long mask;
+    size_t i;
+    int bit;
+
+    for (i = 0; i + m - 1 + 16 <= n; i += 16) {
+        eq = vandq_u8(vceqq_u8(vld1q_u8((const unsigned char *)buf + i), first),
+                      vceqq_u8(vld1q_u8((const unsigned char *)buf + i + m - 1), last));
+        mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+        for (; mask != 0; mask &= ~(0xfULL << bit * 4)) {
+            bit = __builtin_ctzll(mask) / 4;
+            if (buf[i + bit + 1] == pat[1] && memcmp(buf + i + bit + 2, pat + 2, m - 2) == 0)
+                return buf + i + bit;
+        }
+    }
+    return memfind_sw(buf + i, n - i, pat, m);
+}
+#endif
+
+const char *memfind(const char *buf, size_t n, const char *pat, size_t m) {
+    if (m < 2)
+        return m == 0 ? buf : memchr(buf, pat[0], n);
+    pthread_once(&memfind_once, memfind_init);
+#if defined(__x86_64__)
+    if (memfind_avx2_ok)
+        return memfind_avx2(buf, n, pat, m);
+    return memfind_sse2(buf, n, pat, m);
+#elif defined(__aarch64__)
+    return memfind_neon(buf, n, pat, m);
+#else
+    return memfind_sw(buf, n, pat, m);
+#endif
+}
+
+const char *memfind_impl(void) {
+    pthread_once(&memfind_once, memfind_init);
+#if defined(__x86_64__)
+    return memfind_avx2_ok ? "avx2" : "sse2";
+#elif defined(__aarch64__)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,22 @@
+/*
+ * Substring search for the search RPC.  Uses vector compares where the
+ * CPU has them (AVX2, checked at run time, or SSE2 on x86-64; NEON on
+ * ARMv8) to test 16 or 32 positions at once for the pattern's first and
+ * last bytes, and memchr otherwise.
+ */
+
+#ifndef SSNFS_MEMFIND_H
+#define SSNFS_MEMFIND_H
+
+#include <stddef.h>
+
+/* the first place pat (m bytes, m > 0) occurs in the n bytes at buf, or NULL */
+const char *memfind(const char *buf, size_t n, const char *pat, size_t m);
+
+/* the same without vector instructions */
+const char *memfind_sw(const char *buf, size_t n, const char *pat, size_t m);
+
+/* "avx2", "sse2", "neon" or "scalar", whichever memfind() uses */
+const char *memfind_impl(void);
+
+#endif /* SSNFS_MEMFIND_H */
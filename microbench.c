@@ -0,0 +1,874 @@
+/*
+ * Microbenchmarks of server internals, without RPC.  server.c is
+ * included so its static functions and tables can be called directly.
+ *
+ *   microbench [-o results] [-b baseline [-t percent]] [-f filter]
+ *
+ * Each benchmark is run until one pass takes at least 20 ms, then five
+ * passes are timed and the fastest is reported, in ns per operation.
+ * With -b the results are compared against a baseline written by an
+ * earlier run; anything slower by more than -t percent (default 25) is a
+ * regression and makes the exit status 1.
+ */
+
+#define SSNFS_NO_MAIN
+#include "server.c"
+
+#define BENCH_MIN_NS 20000000ULL
+#define BENCH_PASSES 5
+#define MAX_RESULTS  128
+#define XDR_BUF      (64 * 1024)
+#define BENCH_DISK   (64ULL << 30)
+#define BENCH_USERS  1000
+#define BENCH_FILES  100
+#define HOME_USERS   16
+#define HOME_FILES   8
+#define SAMPLE_MATCHES 16
+#define SAMPLE_BLOCKS  64
+
+typedef void (*bench_fn)(long iters);
+
+typedef struct {
+    char   name[64];
+    double ns;
+} result_t;
+
+static result_t results[MAX_RESULTS];
+static int      nresults;
+static const char *filter;
+static int      null_fd;      /* stands in for the disk where I/O is not measured */
+static int      real_fd;
+
+/* ---- block allocation ---- */
+
+static void bench_alloc_free(long iters) {
+    long i;
+    for (i = 0; i < iters; i++)
+        free_blocks(allocate_blocks(0), 0);
+}
+
+/* every free run is one block short of a file, except at the very end:
+   each allocation scans the whole map */
+static void fragment_blocks(void) {
+    u_int64_t b, per_file = sb.blocks_per_file;
+    memset(block_map, 0, VDISK_BITMAP_LEN(&sb));
+    index_metadata();
+    for (b = sb.data_block; b + per_file <= sb.total_blocks; b += per_file)
+        mark_blocks(b, 1, 1);
+}
+
+/* ---- lookups over full tables ---- */
+
+static char last_user[USER_NAME_SIZE], last_file[FILE_NAME_SIZE];
+
+static void fill_tables(void) {
+    int u, f, nfiles = sb.max_files_user;
+    file_meta_t *files;
+    snprintf(last_user, sizeof(last_user), "user%d", sb.max_users - 1);
+    snprintf(last_file, sizeof(last_file), "file%d", nfiles - 1);
+    for (u = 0; u < (int)sb.max_users; u++) {
+        users[u].in_use = 1;
+        snprintf(users[u].user_name, USER_NAME_SIZE, "user%d", u);
+        files = user_files(&users[u]);
+        for (f = 0; f < nfiles; f++) {
+            snprintf(files[f].file_name, FILE_NAME_SIZE, "file%d", f);
+            files[f].start_block = sb.data_block + (u * nfiles + f) * sb.blocks_per_file;
+        }
+    }
+    for (f = 0; f < MAX_OPEN_FILES; f++) {
+        open_table[f].in_use = 1;
+        open_table[f].fd = 100 + f;
+    }
+    index_metadata();
+}
+
+static volatile void *sink;
+
+static void bench_find_user(long iters) {
+    long i;
+    for (i = 0; i < iters; i++)
+        sink = find_user(last_user);
+}
+
+static void bench_find_user_miss(long iters) {
+    long i;
+    for (i = 0; i < iters; i++)
+        sink = find_user("nobody");
+}
+
+static void bench_find_file(long iters) {
+    user_meta_t *u = find_user(last_user);
+    long i;
+    for (i = 0; i < iters; i++)
+        sink = find_file(u, last_file);
+}
+
+static void bench_find_file_miss(long iters) {
+    user_meta_t *u = find_user(last_user);
+    long i;
+    for (i = 0; i < iters; i++)
+        sink = find_file(u, "missing");
+}
+
+static void bench_find_open(long iters) {
+    long i;
+    for (i = 0; i < iters; i++)
+        sink = find_open_by_fd(100 + MAX_OPEN_FILES - 1);
+}
+
+static void bench_find_open_miss(long iters) {
+    long i;
+    for (i = 0; i < iters; i++)
+        sink = find_open_by_fd(-1);
+}
+
+/* ---- metadata I/O against a real file ---- */
+
+/* the common case: one file record changed */
+static void bench_save_metadata(long iters) {
+    long i;
+    for (i = 0; i < iters; i++) {
+        file_touch(&file_table[i % (sb.max_users * sb.max_files_user)]);
+        save_metadata();
+    }
+}
+
+static void bench_load_metadata(long iters) {
+    long i;
+    for (i = 0; i < iters; i++)
+        load_metadata();
+}
+
+/* ---- read_file, 4 KB from written data and from the unwritten tail,
+        and a small file on blocks and inline ---- */
+
+#define SMALL_FILE VDISK_INLINE_MAX
+
+static read_input bench_read_in[3] = {
+    { "user0", 100, 4096 }, { "user1", 101, 4096 }, { "user2", 102, 4096 }
+};
+
+static void bench_read_entry(long iters, int e, int64_t pos) {
+    read_output *r;
+    long i;
+    for (i = 0; i < iters; i++) {
+        open_table[e].current_pos = pos;
+        r = read_file_1_svc(&bench_read_in[e], NULL);
+        free(r->buffer.buffer_val);
+        r->buffer.buffer_val = NULL;
+    }
+}
+
+static void bench_read_data(long iters) {
+    bench_read_entry(iters, 0, 0);
+}
+
+static void bench_read_hole(long iters) {
+    bench_read_entry(iters, 0, file_max_size() - 4096);
+}
+
+static void bench_read_small(long iters) {
+    bench_read_entry(iters, 1, 0);
+}
+
+static void bench_read_inline(long iters) {
+    bench_read_entry(iters, 2, 0);
+}
+
+/* the same with the block sums neither checked nor kept */
+static void bench_read_unchecked(long iters) {
+    checksums = 0;
+    bench_read_entry(iters, 0, 0);
+    checksums = 1;
+}
+
+/* file0 of user u open on fd 100 + u */
+static file_meta_t *bench_open(int u) {
+    file_meta_t *fm = &file_table[u * sb.max_files_user];
+    snprintf(open_table[u].user_name, USER_NAME_SIZE, "user%d", u);
+    snprintf(open_table[u].file_name, FILE_NAME_SIZE, "file0");
+    open_table[u].start_block = fm->start_block;
+    return fm;
+}
+
+/* ---- reading a user's whole home directory, page cache dropped ---- */
+
+static char home_buf[VDISK_BLOCKS_PER_FILE * VDISK_BLOCK_SIZE];   /* a whole file */
+
+/* HOME_USERS users create HOME_FILES full files each, taking turns, as
+   concurrent clients would; with one allocation group they interleave */
+static void make_homes(u_int groups) {
+    char name[USER_NAME_SIZE];
+    user_meta_t *u;
+    file_meta_t *fm;
+    int i, f, err;
+
+    memset(meta + sb.bitmap_off, 0, (size_t)sb.data_block * sb.block_size - sb.bitmap_off);
+    group_count = groups;
+    group_setup();
+    index_metadata();
+    for (f = 0; f < HOME_FILES; f++) {
+        for (i = 0; i < HOME_USERS; i++) {
+            snprintf(name, sizeof(name), "home%d", i);
+            u = find_or_create_user(name);
+            snprintf(name, sizeof(name), "file%d", f);
+            fm = create_file_meta(u, name, &err);
+            if (fm == NULL || file_assign(fm) != 0) {
+                fprintf(stderr, "make_homes: no room\n");
+                exit(1);
+            }
+            disk_write(home_buf, sizeof(home_buf), block_offset(fm->start_block, 0));
+            fm->size = sizeof(home_buf);
+        }
+    }
+    save_metadata();
+}
+
+static void bench_read_home(long iters) {
+    static int next;
+    file_meta_t *files;
+    long i;
+    int f;
+
+    for (i = 0; i < iters; i++) {
+        files = user_files(&users[next++ % HOME_USERS]);
+        posix_fadvise(disk.fd[0], 0, 0, POSIX_FADV_DONTNEED);
+        for (f = 0; f < HOME_FILES; f++)
+            disk_read(home_buf, sizeof(home_buf), block_offset(files[f].start_block, 0));
+    }
+}
+
+/* ---- dedup: what a put of a whole file pays before it writes ---- */
+
+static file_meta_t *dedup_fm;
+
+static void bench_fingerprint(long iters) {
+    long i;
+    for (i = 0; i < iters; i++)
+        sink = (void *)(size_t)fingerprint(home_buf, sizeof(home_buf));
+}
+
+/* fingerprint, lookup and the comparison with the match on disk */
+static void bench_dedup_hit(long iters) {
+    long i;
+    for (i = 0; i < iters; i++)
+        sink = dedup_find(dedup_fm, fingerprint(home_buf, sizeof(home_buf)),
+                          home_buf, sizeof(home_buf));
+}
+
+/* ---- compression: the codec on a chunk of text, and a 4 KB read
+        that decompresses the chunk it falls in ---- */
+
+static char lz_buf[VDISK_CHUNK_MIN];
+static int  lz_len;
+
+/* words, spaces and line breaks, about as compressible as source or logs */
+static void fill_text(char *buf, size_t len) {
+    static const char *words[] = {
+        "the ", "server ", "file ", "block ", "read ", "write ", "user ", "of ",
+        "to ", "and ", "return ", "size ", "0x1f ", "= ", "if ", "error\n"
+    };
+    unsigned int seed = 1;
+    const char *w;
+    size_t i = 0;
+
+    while (i < len) {
+        seed = seed * 1103515245 + 12345;
+        for (w = words[seed >> 16 & 15]; *w && i < len; w++)
+            buf[i++] = *w;
+    }
+}
+
+static void bench_lz_compress(long iters) {
+    long i;
+    for (i = 0; i < iters; i++)
+        lz_len = lz_compress(home_buf, VDISK_CHUNK_MIN, lz_buf, sizeof(lz_buf));
+}
+
+static void bench_lz_decompress(long iters) {
+    long i;
+    for (i = 0; i < iters; i++)
+        sink = (void *)(size_t)lz_decompress(lz_buf, lz_len, home_buf, VDISK_CHUNK_MIN);
+}
+
+static void bench_read_compressed(long iters) {
+    bench_read_entry(iters, 0, 4096);
+}
+
+/* ---- checksums: a block's CRC-32C with and without the crc32
+        instructions ---- */
+
+static void bench_crc32c(long iters) {
+    long i;
+    for (i = 0; i < iters; i++)
+        sink = (void *)(size_t)crc32c(0, home_buf, 4096);
+}
+
+static void bench_crc32c_soft(long iters) {
+    long i;
+    for (i = 0; i < iters; i++)
+        sink = (void *)(size_t)crc32c_sw(0, home_buf, 4096);
+}
+
+/* ---- copy_range: a home file's 32 KB into another's, whole blocks
+        inside the image and, one byte off, through memory ---- */
+
+static file_meta_t *copy_src, *copy_dst;
+
+static void bench_copy_range(long iters) {
+    long i;
+    for (i = 0; i < iters; i++)
+        file_copy(copy_src, 0, copy_dst, 0, sizeof(home_buf));
+}
+
+static void bench_copy_range_unaligned(long iters) {
+    long i;
+    for (i = 0; i < iters; i++)
+        file_copy(copy_src, 1, copy_dst, 0, sizeof(home_buf) - 1);
+}
+
+/* ---- search: a word that is not there (its letters are), through
+        32 KB of text and through a home directory on the workers ---- */
+
+static char search_pat[] = "servers";
+static search_input bench_search_in = { "home6", { sizeof(search_pat) - 1, search_pat }, 0 };
+
+static void bench_memfind(long iters) {
+    long i;
+    for (i = 0; i < iters; i++)
+        sink = (void *)memfind(home_buf, sizeof(home_buf), search_pat, sizeof(search_pat) - 1);
+}
+
+static void bench_memfind_soft(long iters) {
+    long i;
+    for (i = 0; i < iters; i++)
+        sink = (void *)memfind_sw(home_buf, sizeof(home_buf), search_pat, sizeof(search_pat) - 1);
+}
+
+static void bench_search_home(long iters) {
+    long i;
+    for (i = 0; i < iters; i++)
+        search_files_1_svc(&bench_search_in, NULL);
+}
+
+/* ---- hash_file: 32 KB through BLAKE2bp, and a home file's digest
+        computed over a range and kept for the whole file ---- */
+
+static hash_input bench_hash_in = { "home7", "file0", 0, -1 };
+static hash_input bench_hash_range_in = { "home7", "file0", 1, -1 };
+static unsigned char bench_digest[BLAKE2_LEN];
+
+static void bench_blake2bp(long iters) {
+    long i;
+    for (i = 0; i < iters; i++)
+        blake2bp(bench_digest, home_buf, sizeof(home_buf));
+}
+
+static void bench_blake2bp_soft(long iters) {
+    long i;
+    for (i = 0; i < iters; i++)
+        blake2bp_sw(bench_digest, home_buf, sizeof(home_buf));
+}
+
+static void bench_hash_range(long iters) {
+    long i;
+    for (i = 0; i < iters; i++)
+        hash_file_1_svc(&bench_hash_range_in, NULL);
+}
+
+static void bench_hash_kept(long iters) {
+    long i;
+    for (i = 0; i < iters; i++)
+        hash_file_1_svc(&bench_hash_in, NULL);
+}
+
+/* ---- delta: a home file's signature, and a delta of 32 KB against
+        one for a 1% edit that moves the blocks after it ---- */
+
+static sign_input bench_sign_in = { "home7", "file0", SIGN_BLOCK_MIN };
+static sign_block bench_blocks[sizeof(home_buf) / SIGN_BLOCK_MIN];
+static sign_output bench_sig;
+static char delta_buf[sizeof(home_buf)];
+
+static void bench_sign_home(long iters) {
+    long i;
+    for (i = 0; i < iters; i++)
+        sign_file_1_svc(&bench_sign_in, NULL);
+}
+
+static void bench_delta_make(long iters) {
+    delta_op *ops;
+    char *data;
+    u_int nops, ndata;
+    long i;
+
+    for (i = 0; i < iters; i++) {
+        if (delta_make(&bench_sig, delta_buf, sizeof(delta_buf), &ops, &nops, &data, &ndata) < 0)
+            return;
+        free(ops);
+        free(data);
+    }
+}
+
+/* bench_sig for home_buf in SIGN_BLOCK_MIN blocks, delta_buf the same
+   with 1% of it deleted at a third and as much inserted at two thirds */
+static void make_delta(void) {
+    int i, n = sizeof(home_buf) / 100, a = sizeof(home_buf) / 3, b = 2 * sizeof(home_buf) / 3;
+
+    for (i = 0; i < (int)(sizeof(home_buf) / SIGN_BLOCK_MIN); i++) {
+        bench_blocks[i].weak = delta_weak((unsigned char *)home_buf + i * SIGN_BLOCK_MIN,
+                                          SIGN_BLOCK_MIN);
+        delta_strong(bench_blocks[i].strong, home_buf + i * SIGN_BLOCK_MIN, SIGN_BLOCK_MIN);
+    }
+    bench_sig.block_len = SIGN_BLOCK_MIN;
+    bench_sig.size = sizeof(home_buf);
+    bench_sig.blocks.blocks_len = sizeof(home_buf) / SIGN_BLOCK_MIN;
+    bench_sig.blocks.blocks_val = bench_blocks;
+    memcpy(delta_buf, home_buf, a);
+    memcpy(delta_buf + a, home_buf + a + n, b - a - n);
+    memset(delta_buf + b - n, '#', n);
+    memcpy(delta_buf + b, home_buf + b, sizeof(home_buf) - b);
+}
+
+/* ---- export and import: home2's files as one stream, and the stream
+        loaded into home8 in place of its files ---- */
+
+static export_input bench_export_in = { "home2", 0, 0, EXPORT_MAX };
+static import_input bench_import_in = { "home8", 0, 1 };
+
+static void bench_export_home(long iters) {
+    long i;
+    for (i = 0; i < iters; i++)
+        export_home_1_svc(&bench_export_in, NULL);
+}
+
+static void bench_import_home(long iters) {
+    long i;
+    for (i = 0; i < iters; i++)
+        import_home_1_svc(&bench_import_in, NULL);
+}
+
+/* bench_import_in's data: what export_home makes of home2 */
+static void make_import(void) {
+    export_output *res = export_home_1_svc(&bench_export_in, NULL);
+
+    bench_import_in.data.data_len = res->data.data_len;
+    bench_import_in.data.data_val = malloc(res->data.data_len + 1);
+    if (res->success != 1 || bench_import_in.data.data_val == NULL) {
+        fprintf(stderr, "make_import: %s\n", res->out_msg.out_msg_val);
+        exit(1);
+    }
+    memcpy(bench_import_in.data.data_val, res->data.data_val, res->data.data_len);
+}
+
+/* ---- XDR, one sample of every argument and result type ---- */
+
+static char payload[4096];
+static char sample_msg[] = "Read ok";
+static search_match sample_matches[SAMPLE_MATCHES];   /* a search with a few hits */
+static sign_block   sample_blocks[SAMPLE_BLOCKS];     /* a 32 KB file's signature */
+static delta_op     sample_ops[3] = { { 0, 8192 }, { -1, sizeof(payload) }, { 8192, 20480 } };
+
+static void sample(int proc, int res, void *obj) {
+    size_t size = res ? ssnfs_procs[proc].res_size : ssnfs_procs[proc].arg_size;
+    memset(obj, 0, size);
+    if (!res) {
+        if (proc == stats || proc == defrag)
+            return;
+        /* every argument starts with the user name; most have a file name next */
+        strcpy((char *)obj, "user9");
+        switch (proc) {
+        case open_file: case delete_file: case create_file: case get_file:
+        case lease_file: case clone_file: case hash_file: case sign_file: case patch_file:
+            strcpy((char *)obj + USER_NAME_SIZE, "file9");
+            break;
+        }
+        switch (proc) {
+        case read_file: ((read_input *)obj)->numbytes = sizeof(payload); break;
+        case write_file:
+            ((write_input *)obj)->numbytes = sizeof(payload);
+            ((write_input *)obj)->buffer.buffer_len = sizeof(payload);
+            ((write_input *)obj)->buffer.buffer_val = payload;
+            break;
+        case put_file:
+            strcpy(((put_input *)obj)->file_name, "file9");
+            ((put_input *)obj)->buffer.buffer_len = sizeof(payload);
+            ((put_input *)obj)->buffer.buffer_val = payload;
+            break;
+        case clone_file: strcpy(((clone_input *)obj)->new_name, "file10"); break;
+        case snapshot:   strcpy(((snapshot_input *)obj)->snap_name, "snap9"); break;
+        case copy_range: ((copy_input *)obj)->length = 32768; break;
+        case search_files:
+            ((search_input *)obj)->pattern.pattern_len = sizeof(sample_msg) - 1;
+            ((search_input *)obj)->pattern.pattern_val = sample_msg;
+            break;
+        case patch_file:
+            ((patch_input *)obj)->ops.ops_len = 3;
+            ((patch_input *)obj)->ops.ops_val = sample_ops;
+            ((patch_input *)obj)->data.data_len = sizeof(payload);
+            ((patch_input *)obj)->data.data_val = payload;
+            break;
+        case import_home:
+            ((import_input *)obj)->data.data_len = sizeof(payload);
+            ((import_input *)obj)->data.data_val = payload;
+            break;
+        }
+        return;
+    }
+    /* every result ends in out_msg; data-carrying ones have a buffer too */
+    switch (proc) {
+    case read_file:
+        ((read_output *)obj)->buffer.buffer_len = sizeof(payload);
+        ((read_output *)obj)->buffer.buffer_val = payload;
+        break;
+    case get_file:
+        ((get_output *)obj)->buffer.buffer_len = sizeof(payload);
+        ((get_output *)obj)->buffer.buffer_val = payload;
+        break;
+    case search_files:
+        ((search_output *)obj)->matches.matches_len = SAMPLE_MATCHES;
+        ((search_output *)obj)->matches.matches_val = sample_matches;
+        break;
+    case sign_file:
+        ((sign_output *)obj)->blocks.blocks_len = SAMPLE_BLOCKS;
+        ((sign_output *)obj)->blocks.blocks_val = sample_blocks;
+        break;
+    case export_home:
+        ((export_output *)obj)->data.data_len = sizeof(payload);
+        ((export_output *)obj)->data.data_val = payload;
+        break;
+    }
+    switch (proc) {
+    case open_file:   ((open_output *)obj)->out_msg.out_msg_val = sample_msg;
+                      ((open_output *)obj)->out_msg.out_msg_len = sizeof(sample_msg); break;
+    case read_file:   ((read_output *)obj)->out_msg.out_msg_val = sample_msg;
+                      ((read_output *)obj)->out_msg.out_msg_len = sizeof(sample_msg); break;
+    case write_file:  ((write_output *)obj)->out_msg.out_msg_val = sample_msg;
+                      ((write_output *)obj)->out_msg.out_msg_len = sizeof(sample_msg); break;
+    case list_files:  ((list_output *)obj)->out_msg.out_msg_val = sample_msg;
+                      ((list_output *)obj)->out_msg.out_msg_len = sizeof(sample_msg); break;
+    case delete_file: ((delete_output *)obj)->out_msg.out_msg_val = sample_msg;
+                      ((delete_output *)obj)->out_msg.out_msg_len = sizeof(sample_msg); break;
+    case close_file:  ((close_output *)obj)->out_msg.out_msg_val = sample_msg;
+                      ((close_output *)obj)->out_msg.out_msg_len = sizeof(sample_msg); break;
+    case seek_position: ((seek_output *)obj)->out_msg.out_msg_val = sample_msg;
+                      ((seek_output *)obj)->out_msg.out_msg_len = sizeof(sample_msg); break;
+    case create_file: ((create_output *)obj)->out_msg.out_msg_val = sample_msg;
+                      ((create_output *)obj)->out_msg.out_msg_len = sizeof(sample_msg); break;
+    case get_file:    ((get_output *)obj)->out_msg.out_msg_val = sample_msg;
+                      ((get_output *)obj)->out_msg.out_msg_len = sizeof(sample_msg); break;
+    case put_file:    ((put_output *)obj)->out_msg.out_msg_val = sample_msg;
+                      ((put_output *)obj)->out_msg.out_msg_len = sizeof(sample_msg); break;
+    case lease_file:  ((lease_output *)obj)->out_msg.out_msg_val = sample_msg;
+                      ((lease_output *)obj)->out_msg.out_msg_len = sizeof(sample_msg); break;
+    case stats:       ((stats_output *)obj)->out_msg.out_msg_val = sample_msg;
+                      ((stats_output *)obj)->out_msg.out_msg_len = sizeof(sample_msg); break;
+    case defrag:      ((defrag_output *)obj)->out_msg.out_msg_val = sample_msg;
+                      ((defrag_output *)obj)->out_msg.out_msg_len = sizeof(sample_msg); break;
+    case clone_file:  ((clone_output *)obj)->out_msg.out_msg_val = sample_msg;
+                      ((clone_output *)obj)->out_msg.out_msg_len = sizeof(sample_msg); break;
+    case snapshot:    ((snapshot_output *)obj)->out_msg.out_msg_val = sample_msg;
+                      ((snapshot_output *)obj)->out_msg.out_msg_len = sizeof(sample_msg); break;
+    case copy_range:  ((copy_output *)obj)->out_msg.out_msg_val = sample_msg;
+                      ((copy_output *)obj)->out_msg.out_msg_len = sizeof(sample_msg); break;
+    case search_files: ((search_output *)obj)->out_msg.out_msg_val = sample_msg;
+                      ((search_output *)obj)->out_msg.out_msg_len = sizeof(sample_msg); break;
+    case hash_file:   ((hash_output *)obj)->out_msg.out_msg_val = sample_msg;
+                      ((hash_output *)obj)->out_msg.out_msg_len = sizeof(sample_msg); break;
+    case sign_file:   ((sign_output *)obj)->out_msg.out_msg_val = sample_msg;
+                      ((sign_output *)obj)->out_msg.out_msg_len = sizeof(sample_msg); break;
+    case patch_file:  ((patch_output *)obj)->out_msg.out_msg_val = sample_msg;
+                      ((patch_output *)obj)->out_msg.out_msg_len = sizeof(sample_msg); break;
+    case export_home: ((export_output *)obj)->out_msg.out_msg_val = sample_msg;
+                      ((export_output *)obj)->out_msg.out_msg_len = sizeof(sample_msg); break;
+    case import_home: ((import_output *)obj)->out_msg.out_msg_val = sample_msg;
+                      ((import_output *)obj)->out_msg.out_msg_len = sizeof(sample_msg); break;
+    }
+}
+
+static xdrproc_t xdr_cur;
+static long long obj[128], dec[128];   /* any argument/result struct */
+static char      xdr_buf[XDR_BUF];
+static u_int     xdr_len;
+
+static void bench_encode(long iters) {
+    XDR  xdrs;
+    long i;
+    for (i = 0; i < iters; i++) {
+        xdrmem_create(&xdrs, xdr_buf, XDR_BUF, XDR_ENCODE);
+        (*xdr_cur)(&xdrs, obj);
+        xdr_destroy(&xdrs);
+    }
+}
+
+/* decodes into preallocated storage where XDR allows it: buffers left
+   from the first pass are reused, as svc_getargs would allocate anyway */
+static void bench_decode(long iters) {
+    XDR  xdrs;
+    long i;
+    for (i = 0; i < iters; i++) {
+        xdrmem_create(&xdrs, xdr_buf, xdr_len, XDR_DECODE);
+        (*xdr_cur)(&xdrs, dec);
+        xdr_destroy(&xdrs);
+    }
+}
+
+/* A large sparse image, so allocation and lookups run at scale:
+   BENCH_DISK with 4 KiB blocks, BENCH_USERS x BENCH_FILES files. */
+static void make_disk(void) {
+    char err[256];
+
+    memset(&sb, 0, sizeof(sb));
+    sb.block_size = VDISK_BLOCK_SIZE;
+    sb.disk_size = BENCH_DISK;
+    sb.blocks_per_file = VDISK_BLOCKS_PER_FILE;
+    sb.max_users = BENCH_USERS;
+    sb.max_files_user = BENCH_FILES;
+    sb.members = 1;
+    sb.stripe_blocks = VDISK_STRIPE_BLOCKS;
+    if (vdisk_layout(&sb, err, sizeof(err)) != 0 ||
+        vdisk_open(&disk, VDISK_NAME, O_CREAT, err, sizeof(err)) != 0) {
+        fprintf(stderr, "bench disk: %s\n", err);
+        exit(1);
+    }
+    if (vdisk_format(&disk, &sb) < 0) {
+        perror("bench disk");
+        exit(1);
+    }
+    vdisk_close(&disk);
+}
+
+/* ---- harness ---- */
+
+static unsigned long long time_pass(bench_fn fn, long iters) {
+    unsigned long long t0 = now_ns();
+    fn(iters);
+    return now_ns() - t0;
+}
+
+static void run(const char *name, bench_fn fn) {
+    unsigned long long t, best = ~0ULL;
+    long iters = 1;
+    int  pass;
+
+    if (filter != NULL && strstr(name, filter) == NULL)
+        return;
+    while ((t = time_pass(fn, iters)) < BENCH_MIN_NS && iters < (1L << 40))
+        iters *= t < BENCH_MIN_NS / 16 ? 8 : 2;
+    for (pass = 0; pass < BENCH_PASSES; pass++) {
+        t = time_pass(fn, iters);
+        if (t < best) best = t;
+    }
+    if (nresults < MAX_RESULTS) {
+        snprintf(results[nresults].name, sizeof(results[0].name), "%s", name);
+        results[nresults].ns = (double)best / iters;
+        printf("%-32s %12.1f ns/op\n", name, results[nresults].ns);
+        fflush(stdout);
+        nresults++;
+    }
+}
+
+static void run_xdr(void) {
+    char name[64];
+    XDR  xdrs;
+    int  proc, res;
+
+    for (proc = 1; proc < NPROCS; proc++) {
+        for (res = 0; res < 2; res++) {
+            xdr_cur = res ? ssnfs_procs[proc].xdr_res : ssnfs_procs[proc].xdr_arg;
+            sample(proc, res, obj);
+            xdrmem_create(&xdrs, xdr_buf, XDR_BUF, XDR_ENCODE);
+            (*xdr_cur)(&xdrs, obj);
+            xdr_len = xdr_getpos(&xdrs);
+            xdr_destroy(&xdrs);
+
+            snprintf(name, sizeof(name), "xdr_%s_%s_encode", ssnfs_procs[proc].name,
+                     res ? "res" : "arg");
+            run(name, bench_encode);
+            memset(dec, 0, sizeof(dec));
+            snprintf(name, sizeof(name), "xdr_%s_%s_decode", ssnfs_procs[proc].name,
+                     res ? "res" : "arg");
+            run(name, bench_decode);
+            xdr_free(xdr_cur, (char *)dec);
+        }
+    }
+}
+
+static int compare(const char *baseline, int threshold) {
+    FILE  *f = fopen(baseline, "r");
+    char   line[256], name[64];
+    double base, change;
+    int    i, regressions = 0;
+
+    if (f == NULL) {
+        printf("no baseline %s yet; save one with make bench-baseline\n", baseline);
+        return 0;
+    }
+    printf("\n%-32s %12s %12s %8s\n", "benchmark", "baseline", "now", "change");
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (line[0] == '#' || sscanf(line, "%63s %lf", name, &base) != 2 || base <= 0)
+            continue;
+        for (i = 0; i < nresults; i++)
+            if (strcmp(results[i].name, name) == 0) break;
+        if (i == nresults) continue;
+        change = 100.0 * (results[i].ns - base) / base;
+        printf("%-32s %12.1f %12.1f %+7.1f%%%s\n", name, base, results[i].ns, change,
+               change > threshold ? "  REGRESSION" : "");
+        if (change > threshold) regressions++;
+    }
+    fclose(f);
+    printf("%d regression%s over %d%%\n", regressions, regressions == 1 ? "" : "s", threshold);
+    return regressions;
+}
+
+int main(int argc, char *argv[]) {
+    const char *out_name = NULL, *baseline = NULL;
+    char  dir[] = "/tmp/ssnfs-bench-XXXXXX", cwd[4096];
+    FILE *out = NULL;
+    file_meta_t *fm;
+    int   c, i, threshold = 25, regressions = 0;
+    time_t now;
+
+    while ((c = getopt(argc, argv, "o:b:t:f:")) != -1) {
+        switch (c) {
+        case 'o': out_name = optarg; break;
+        case 'b': baseline = optarg; break;
+        case 't': threshold = atoi(optarg); break;
+        case 'f': filter = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-o results] [-b baseline [-t percent]] [-f filter]\n",
+                    argv[0]);
+            exit(1);
+        }
+    }
+    if (getcwd(cwd, sizeof(cwd)) == NULL || mkdtemp(dir) == NULL || chdir(dir) < 0) {
+        perror("bench directory");
+        exit(1);
+    }
+    make_disk();
+    init_disk();
+    real_fd = disk.fd[0];
+    null_fd = open("/dev/null", O_RDWR);
+    memset(payload, 'x', sizeof(payload));
+
+    /* allocation and lookups write metadata on every change; measure the
+       in-memory work and let the writes go to /dev/null */
+    disk.fd[0] = null_fd;
+    memset(block_map, 0, VDISK_BITMAP_LEN(&sb));
+    index_metadata();
+    run("alloc_free_empty", bench_alloc_free);
+    fragment_blocks();
+    run("alloc_free_fragmented", bench_alloc_free);
+    fill_tables();
+    run("find_user", bench_find_user);
+    run("find_user_miss", bench_find_user_miss);
+    run("find_file", bench_find_file);
+    run("find_file_miss", bench_find_file_miss);
+    run("find_open_by_fd", bench_find_open);
+    run("find_open_by_fd_miss", bench_find_open_miss);
+
+    disk.fd[0] = real_fd;
+    run("save_metadata", bench_save_metadata);
+    run("load_metadata", bench_load_metadata);
+
+    /* file0 of user0 holds 8 KB, of user1 SMALL_FILE bytes on blocks, of
+       user2 the same inline */
+    fm = bench_open(0);
+    fm->size = 2 * sizeof(payload);
+    disk_write(payload, sizeof(payload), block_offset(fm->start_block, 0));
+    disk_write(payload, sizeof(payload), block_offset(fm->start_block, sizeof(payload)));
+    fm = bench_open(1);
+    fm->size = SMALL_FILE;
+    disk_write(payload, SMALL_FILE, block_offset(fm->start_block, 0));
+    fm = &file_table[2 * sb.max_files_user];
+    fm->start_block = -1;
+    fm->flags = FILE_INLINE;
+    fm->size = SMALL_FILE;
+    memcpy(fm->data, payload, SMALL_FILE);
+    bench_open(2);
+    run("read_file_data", bench_read_data);
+    run("read_file_hole", bench_read_hole);
+    run("read_file_small", bench_read_small);
+    run("read_file_inline", bench_read_inline);
+    run("read_file_unchecked", bench_read_unchecked);
+    run("crc32c_4k", bench_crc32c);
+    run("crc32c_4k_soft", bench_crc32c_soft);
+
+    /* the same home directories laid out without and with groups */
+    make_homes(1);
+    run("read_home_flat", bench_read_home);
+    make_homes(0);
+    run("read_home_groups", bench_read_home);
+
+    /* the home files all hold the same data: one is known by its
+       fingerprint, another is put again */
+    fm = user_files(find_user("home0"));
+    fp_set(fm, fingerprint(home_buf, sizeof(home_buf)));
+    dedup_fm = user_files(find_user("home1"));
+    run("fingerprint_32k", bench_fingerprint);
+    run("dedup_hit_32k", bench_dedup_hit);
+
+    /* file0 of home0 rewritten as text, compressed, and open on fd 100 */
+    fill_text(home_buf, sizeof(home_buf));
+    run("lz_compress_16k", bench_lz_compress);
+    run("lz_decompress_16k", bench_lz_decompress);
+    compress = 1;
+    fp_set(fm, 0);
+    file_pwrite(fm, home_buf, sizeof(home_buf), 0);
+    snprintf(open_table[0].user_name, USER_NAME_SIZE, "home0");
+    open_table[0].start_block = fm->start_block;
+    run("read_file_compressed", bench_read_compressed);
+    compress = 0;
+
+    /* two home files no other is sharing */
+    copy_src = user_files(find_user("home4"));
+    copy_dst = user_files(find_user("home5"));
+    run("copy_range_32k", bench_copy_range);
+    run("copy_range_32k_unaligned", bench_copy_range_unaligned);
+
+    /* home_buf still holds text; home6's files hold what make_homes wrote */
+    run("memfind_32k", bench_memfind);
+    run("memfind_32k_soft", bench_memfind_soft);
+    run("search_home", bench_search_home);
+
+    /* home7's file0 as make_homes wrote it; the first call keeps its digest */
+    run("blake2bp_32k", bench_blake2bp);
+    run("blake2bp_32k_soft", bench_blake2bp_soft);
+    run("hash_file_range", bench_hash_range);
+    hash_file_1_svc(&bench_hash_in, NULL);
+    run("hash_file_kept", bench_hash_kept);
+
+    /* home_buf still holds text */
+    make_delta();
+    run("sign_file_home", bench_sign_home);
+    run("delta_make_32k_1pct", bench_delta_make);
+
+    /* home2 and home8 still as make_homes wrote them */
+    make_import();
+    run("export_home", bench_export_home);
+    run("import_home", bench_import_home);
+
+    run_xdr();
+
+    vdisk_close(&disk);
+    close(null_fd);
+    unlink(VDISK_NAME);
+    if (chdir(cwd) < 0 || rmdir(dir) < 0)
+        perror(dir);
+
+    if (out_name != NULL) {
+        out = fopen(out_name, "w");
+        if (out == NULL) {
+            perror(out_name);
+            exit(1);
+        }
+        now = time(NULL);
+        fprintf(out, "# ssnfs microbench, ns per operation, %s", ctime(&now));
+        for (i = 0; i < nresults; i++)
+            fprintf(out, "%s %.1f\n", results[i].name, results[i].ns);
+        fclose(out);
+    }
+    if (baseline != NULL)
+        regressions = compare(baseline, threshold);
+    return regressions ? 1 : 0;
+}
@@ -0,0 +1,167 @@
+/*
+ * mkdisk: create (format) a virtual disk image for the server, or show
+ * the geometry of an existing one.
+ *
+ *   mkdisk [-b block_size] [-s disk_size] [-f file_size] [-u users]
+ *          [-n files_per_user] [-S stripe_unit] [-M mirror]... [-F] image
+ *   mkdisk -i [-M mirror]... image
+ *   mkdisk -R [-F] -M mirror... image
+ *
+ * Sizes take a K, M or G suffix.  An image or mirror may be several
+ * comma-separated files: blocks are striped over them stripe_unit at a
+ * time.  An existing image is only overwritten with -F.  -R brings stale
+ * or new mirrors up to date from a current copy, -R -F all mirrors from
+ * the image.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "vdisk.h"
+#include "crc32c.h"
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-b block_size] [-s disk_size] [-f file_size] [-u users]\n"
+                    "              [-n files_per_user] [-S stripe_unit] [-M mirror]... [-F] image\n"
+                    "       %s -i [-M mirror]... image\n"
+                    "       %s -R [-F] -M mirror... image\n"
+                    "  image and mirrors: file[,member...]\n", prog, prog, prog);
+    exit(1);
+}
+
+/* "4096", "64K", "2G" */
+static unsigned long long parse_size(const char *s, const char *prog) {
+    char *end;
+    unsigned long long v = strtoull(s, &end, 10);
+    switch (*end) {
+    case 'k': case 'K': v <<= 10; end++; break;
+    case 'm': case 'M': v <<= 20; end++; break;
+    case 'g': case 'G': v <<= 30; end++; break;
+    }
+    if (end == s || *end != '\0')
+        usage(prog);
+    return v;
+}
+
+static void show(const char *name, const superblock_t *sb, const vdisk_t *vd) {
+    printf("%s: format version %u\n", name, sb->version);
+    printf("  block size       %u\n", sb->block_size);
+    printf("  disk size        %llu (%llu blocks)\n", (unsigned long long)sb->disk_size,
+           (unsigned long long)sb->total_blocks);
+    printf("  file size        %llu (%u blocks)\n",
+           (unsigned long long)sb->blocks_per_file * sb->block_size, sb->blocks_per_file);
+    printf("  users            %u, %u files each\n", sb->max_users, sb->max_files_user);
+    printf("  inline files     up to %d bytes\n", VDISK_INLINE_MAX);
+    if (vdisk_chunk_size(sb) != 0)
+        printf("  compression      %llu-byte chunks\n", (unsigned long long)vdisk_chunk_size(sb));
+    else
+        printf("  compression      none, files too large\n");
+    printf("  checksums        crc32c per block and record (%s)\n", crc32c_impl());
+    printf("  members          %u, stripe unit %u blocks\n", sb->members, sb->stripe_blocks);
+    printf("  copies           %d, %d current\n", vd->copies, vd->copies - __builtin_popcount(vd->down));
+    printf("  host usage       %llu\n", (unsigned long long)vdisk_usage((vdisk_t *)vd));
+    printf("  metadata blocks  %llu\n", (unsigned long long)sb->data_block);
+    printf("  file capacity    %llu\n", (unsigned long long)((sb->total_blocks - sb->data_block) / sb->blocks_per_file));
+}
+
+/* open the image and its mirrors */
+static void open_all(vdisk_t *disk, const char *image, const char **mirrors, int nmirrors,
+                     int flags, int mirror_flags) {
+    char err[256];
+    int i;
+
+    if (vdisk_open(disk, image, flags, err, sizeof(err)) != 0) {
+        fprintf(stderr, "%s%s\n", err, errno == EEXIST ? " (use -F to overwrite)" : "");
+        exit(1);
+    }
+    for (i = 0; i < nmirrors; i++)
+        if (vdisk_mirror(disk, mirrors[i], mirror_flags, err, sizeof(err)) != 0) {
+            fprintf(stderr, "%s%s\n", err, errno == EEXIST ? " (use -F to overwrite)" : "");
+            exit(1);
+        }
+}
+
+int main(int argc, char *argv[]) {
+    superblock_t sb;
+    vdisk_t disk;
+    unsigned long long file_size = (unsigned long long)VDISK_BLOCKS_PER_FILE * VDISK_BLOCK_SIZE;
+    unsigned long long stripe = (unsigned long long)VDISK_STRIPE_BLOCKS * VDISK_BLOCK_SIZE;
+    const char *mirrors[VDISK_MAX_COPIES];
+    char err[256];
+    int c, force = 0, info = 0, resync = 0, nmirrors = 0, excl;
+
+    memset(&sb, 0, sizeof(sb));
+    sb.block_size = VDISK_BLOCK_SIZE;
+    sb.disk_size = VDISK_SIZE;
+    sb.max_users = VDISK_MAX_USERS;
+    sb.max_files_user = VDISK_MAX_FILES_USER;
+    while ((c = getopt(argc, argv, "b:s:f:u:n:S:M:FiR")) != -1) {
+        switch (c) {
+        case 'b': sb.block_size = (u_int)parse_size(optarg, argv[0]); break;
+        case 's': sb.disk_size = parse_size(optarg, argv[0]); break;
+        case 'f': file_size = parse_size(optarg, argv[0]); break;
+        case 'u': sb.max_users = (u_int)atoi(optarg); break;
+        case 'n': sb.max_files_user = (u_int)atoi(optarg); break;
+        case 'S': stripe = parse_size(optarg, argv[0]); break;
+        case 'M':
+            if (nmirrors == VDISK_MAX_COPIES - 1)
+                usage(argv[0]);
+            mirrors[nmirrors++] = optarg;
+            break;
+        case 'F': force = 1; break;
+        case 'i': info = 1; break;
+        case 'R': resync = 1; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1 || info + resync > 1 || (resync && nmirrors == 0))
+        usage(argv[0]);
+
+    if (info || resync) {
+        /* -R creates mirrors that are not there yet */
+        open_all(&disk, argv[optind], mirrors, nmirrors, 0, resync ? O_CREAT : 0);
+        if (vdisk_attach(&disk, &sb, err, sizeof(err)) != 0) {
+            fprintf(stderr, "%s: %s\n", argv[optind], err);
+            exit(1);
+        }
+        /* -F: copy the image over all mirrors, current or not */
+        if (resync && force && !(disk.down & 1))
+            disk.down = ((1u << disk.copies) - 1) & ~1u;
+        if (resync && disk.down != 0) {
+            printf("%s: copying to %d copies\n", argv[optind], __builtin_popcount(disk.down));
+            if (vdisk_resync(&disk, err, sizeof(err)) != 0) {
+                fprintf(stderr, "%s\n", err);
+                exit(1);
+            }
+        }
+        show(argv[optind], &sb, &disk);
+        vdisk_close(&disk);
+        return 0;
+    }
+
+    if (sb.block_size == 0 || file_size % sb.block_size != 0 || stripe % sb.block_size != 0) {
+        fprintf(stderr, "file size %llu and stripe unit %llu must be multiples of the block size %u\n",
+                file_size, stripe, sb.block_size);
+        exit(1);
+    }
+    sb.blocks_per_file = (u_int)(file_size / sb.block_size);
+    sb.stripe_blocks = (u_int)(stripe / sb.block_size);
+    sb.image_id = vdisk_new_id();
+    excl = O_CREAT | (force ? 0 : O_EXCL);
+    open_all(&disk, argv[optind], mirrors, nmirrors, excl, excl);
+    sb.members = disk.members;
+    if (vdisk_layout(&sb, err, sizeof(err)) != 0) {
+        fprintf(stderr, "%s\n", err);
+        exit(1);
+    }
+    if (vdisk_format(&disk, &sb) < 0) {
+        perror(argv[optind]);
+        exit(1);
+    }
+    show(argv[optind], &sb, &disk);
+    vdisk_close(&disk);
+    return 0;
+}
@@ -0,0 +1,381 @@
+/*
+ * Replay an RPC trace recorded with server -T against a server.
+ *
+ *   replay [-s speed | -a] [-p port] trace_file host
+ *
+ * Each connection in the trace gets its own connection and thread, which
+ * issues that connection's calls in their original order.  By default a
+ * call is sent at its original offset from the start of the trace; -s 2
+ * replays twice as fast, -a as fast as the server answers.  File
+ * descriptors returned by open_file are mapped to the ones the target
+ * server hands out, and write/put data and patch literals left out of the
+ * trace are replaced by filler of the original length.  import_home's
+ * stream is left out too but cannot be made up: import calls replay only
+ * from a trace taken with -P.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <rpc/rpc.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "ssnfs.h"
+#include "hist.h"
+#include "trace.h"
+
+#define MAX_CONNS 256
+#define MAX_FDS   64       /* open descriptors tracked per connection */
+
+typedef struct {
+    unsigned long long conn;
+    trace_rec_t *recs;
+    int          nrecs, cap;
+    pthread_t    tid;
+    CLIENT      *clnt;
+    int          fd_from[MAX_FDS], fd_to[MAX_FDS], nfds;
+    char        *filler;
+    u_int        filler_len;
+    unsigned long long errors, open_failed, max_lag;
+    hist_t       lat[NPROCS];
+} stream_t;
+
+static stream_t  streams[MAX_CONNS];
+static int       nstreams;
+static const char *host;
+static int       port, asap;
+static double    speed = 1.0;
+static unsigned long long start_ns, first_arrival;
+static struct timeval rpc_timeout = { 25, 0 };
+static pthread_mutex_t start_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  start_cond = PTHREAD_COND_INITIALIZER;
+static int       started;
+
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static CLIENT *connect_server(void) {
+    struct sockaddr_in sin;
+    struct hostent *he;
+    int sock = RPC_ANYSOCK;
+
+    if (port == 0)
+        return clnt_create(host, SSNFSPROG, SSNFSVER, "tcp");
+    he = gethostbyname(host);
+    if (he == NULL || he->h_addrtype != AF_INET)
+        return NULL;
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(port);
+    memcpy(&sin.sin_addr, he->h_addr_list[0], sizeof(sin.sin_addr));
+    return clnttcp_create(&sin, SSNFSPROG, SSNFSVER, &sock, 0, 0);
+}
+
+static stream_t *stream_for(unsigned long long conn) {
+    int i;
+    for (i = 0; i < nstreams; i++)
+        if (streams[i].conn == conn)
+            return &streams[i];
+    if (nstreams == MAX_CONNS) {
+        fprintf(stderr, "more than %d connections in the trace\n", MAX_CONNS);
+        exit(1);
+    }
+    streams[nstreams].conn = conn;
+    return &streams[nstreams++];
+}
+
+/* read the whole trace, split into per-connection streams */
+static int load_trace(const char *name, trace_hdr_t *hdr) {
+    FILE *f = fopen(name, "r");
+    XDR   xdrs;
+    trace_rec_t rec;
+    stream_t *s;
+    int n = 0;
+
+    if (f == NULL) {
+        perror(name);
+        exit(1);
+    }
+    xdrstdio_create(&xdrs, f, XDR_DECODE);
+    memset(hdr, 0, sizeof(*hdr));
+    if (!xdr_trace_hdr(&xdrs, hdr) || hdr->magic != TRACE_MAGIC ||
+        hdr->version != TRACE_VERSION) {
+        fprintf(stderr, "%s: not an ssnfs trace\n", name);
+        exit(1);
+    }
+    for (;;) {
+        memset(&rec, 0, sizeof(rec));
+        if (!xdr_trace_rec(&xdrs, &rec))
+            break;                    /* end of file, or a cut-off record */
+        if (rec.proc >= NPROCS) {
+            xdr_free((xdrproc_t)xdr_trace_rec, (char *)&rec);
+            continue;
+        }
+        s = stream_for(rec.conn);
+        if (s->nrecs == s->cap) {
+            s->cap = s->cap ? 2 * s->cap : 256;
+            s->recs = realloc(s->recs, s->cap * sizeof(trace_rec_t));
+            if (s->recs == NULL) {
+                perror("realloc");
+                exit(1);
+            }
+        }
+        s->recs[s->nrecs++] = rec;
+        n++;
+    }
+    xdr_destroy(&xdrs);
+    fclose(f);
+    return n;
+}
+
+static int map_fd(stream_t *s, int fd) {
+    int i;
+    for (i = 0; i < s->nfds; i++)
+        if (s->fd_from[i] == fd)
+            return s->fd_to[i];
+    return fd;
+}
+
+static void remember_fd(stream_t *s, int from, int to) {
+    int i;
+    for (i = 0; i < s->nfds; i++)
+        if (s->fd_from[i] == from) break;
+    if (i == MAX_FDS) i = 0;         /* table full: forget the oldest */
+    if (i == s->nfds && s->nfds < MAX_FDS) s->nfds++;
+    s->fd_from[i] = from;
+    s->fd_to[i] = to;
+}
+
+/* writable filler for write/put/patch data that was not recorded */
+static char *filler(stream_t *s, u_int len) {
+    if (len > s->filler_len) {
+        char *nb = realloc(s->filler, len);
+        if (nb == NULL) return NULL;
+        memset(nb, 'r', len);
+        s->filler = nb;
+        s->filler_len = len;
+    }
+    return s->filler;
+}
+
+/* Decode the recorded arguments and patch them for this server.  Returns
+   the filler pointer that was put into the arguments, if any. */
+static char *prepare(stream_t *s, trace_rec_t *r, void *arg) {
+    const proc_info_t *pi = &ssnfs_procs[r->proc];
+    XDR   xdrs;
+    char *fill = NULL;
+
+    xdrmem_create(&xdrs, r->args.args_val, r->args.args_len, XDR_DECODE);
+    if (!(*pi->xdr_arg)(&xdrs, arg)) {
+        xdr_destroy(&xdrs);
+        return (char *)-1;
+    }
+    xdr_destroy(&xdrs);
+
+    switch (r->proc) {
+    case read_file:  ((read_input *)arg)->fd = map_fd(s, ((read_input *)arg)->fd); break;
+    case seek_position: ((seek_input *)arg)->fd = map_fd(s, ((seek_input *)arg)->fd); break;
+    case close_file: ((close_input *)arg)->fd = map_fd(s, ((close_input *)arg)->fd); break;
+    case copy_range:
+        ((copy_input *)arg)->src_fd = map_fd(s, ((copy_input *)arg)->src_fd);
+        ((copy_input *)arg)->dst_fd = map_fd(s, ((copy_input *)arg)->dst_fd);
+        break;
+    case write_file: {
+        write_input *w = arg;
+        w->fd = map_fd(s, w->fd);
+        if (w->buffer.buffer_len < r->data_len && (fill = filler(s, r->data_len))) {
+            free(w->buffer.buffer_val);
+            w->buffer.buffer_val = fill;
+            w->buffer.buffer_len = r->data_len;
+        }
+        break;
+    }
+    case put_file: {
+        put_input *p = arg;
+        if (p->buffer.buffer_len < r->data_len && (fill = filler(s, r->data_len))) {
+            free(p->buffer.buffer_val);
+            p->buffer.buffer_val = fill;
+            p->buffer.buffer_len = r->data_len;
+        }
+        break;
+    }
+    case patch_file: {
+        patch_input *d = arg;
+        if (d->data.data_len < r->data_len && (fill = filler(s, r->data_len))) {
+            free(d->data.data_val);
+            d->data.data_val = fill;
+            d->data.data_len = r->data_len;
+        }
+        break;
+    }
+    }
+    return fill;
+}
+
+static void forget_filler(trace_rec_t *r, void *arg, char *fill) {
+    if (fill == NULL) return;
+    if (r->proc == write_file) ((write_input *)arg)->buffer.buffer_val = NULL;
+    if (r->proc == put_file) ((put_input *)arg)->buffer.buffer_val = NULL;
+    if (r->proc == patch_file) ((patch_input *)arg)->data.data_val = NULL;
+}
+
+static void pace(unsigned long long arrival, stream_t *s) {
+    unsigned long long due, now;
+    struct timespec ts;
+
+    due = start_ns + (unsigned long long)((arrival - first_arrival) / speed);
+    now = now_ns();
+    if (now < due) {
+        ts.tv_sec = (due - now) / 1000000000ULL;
+        ts.tv_nsec = (due - now) % 1000000000ULL;
+        nanosleep(&ts, NULL);
+    } else if (now - due > s->max_lag) {
+        s->max_lag = now - due;       /* the server (or we) fell behind */
+    }
+}
+
+static void *stream_main(void *arg) {
+    stream_t *s = arg;
+    long long argbuf[128], resbuf[128];   /* any argument/result struct */
+    int   i;
+
+    pthread_mutex_lock(&start_lock);
+    while (!started)
+        pthread_cond_wait(&start_cond, &start_lock);
+    pthread_mutex_unlock(&start_lock);
+
+    for (i = 0; i < s->nrecs; i++) {
+        trace_rec_t *r = &s->recs[i];
+        const proc_info_t *pi = &ssnfs_procs[r->proc];
+        unsigned long long t0;
+        enum clnt_stat st;
+        char *fill;
+
+        memset(argbuf, 0, sizeof(argbuf));
+        memset(resbuf, 0, sizeof(resbuf));
+        fill = prepare(s, r, argbuf);
+        if (fill == (char *)-1) {
+            s->errors++;
+            continue;
+        }
+        if (!asap)
+            pace(r->arrival, s);
+        t0 = now_ns();
+        st = clnt_call(s->clnt, r->proc, pi->xdr_arg, (caddr_t)argbuf,
+                       pi->xdr_res, (caddr_t)resbuf, rpc_timeout);
+        hist_record(&s->lat[r->proc], now_ns() - t0);
+        forget_filler(r, argbuf, fill);
+        xdr_free(pi->xdr_arg, (char *)argbuf);
+        if (st != RPC_SUCCESS) {
+            s->errors++;
+            continue;
+        }
+        if (r->proc == open_file && r->ret >= 0) {
+            int fd = ((open_output *)resbuf)->fd;
+            if (fd >= 0) remember_fd(s, r->ret, fd);
+            else s->open_failed++;
+        }
+        clnt_freeres(s->clnt, pi->xdr_res, (caddr_t)resbuf);
+    }
+    return NULL;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-s speed | -a] [-p port] trace_file host\n", prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    trace_hdr_t hdr;
+    hist_t lat[NPROCS], orig[NPROCS];
+    unsigned long long errors = 0, open_failed = 0, max_lag = 0, span = 0, t1;
+    int c, i, j, n;
+
+    while ((c = getopt(argc, argv, "s:ap:")) != -1) {
+        switch (c) {
+        case 's': speed = atof(optarg); break;
+        case 'a': asap = 1; break;
+        case 'p': port = atoi(optarg); break;
+        default: usage(argv[0]);
+        }
+    }
+    if (optind != argc - 2 || speed <= 0)
+        usage(argv[0]);
+    host = argv[optind + 1];
+
+    n = load_trace(argv[optind], &hdr);
+    if (n == 0) {
+        fprintf(stderr, "%s: no calls in trace\n", argv[optind]);
+        exit(1);
+    }
+    /* the trace may start long before the first call; replay from there */
+    first_arrival = streams[0].recs[0].arrival;
+    for (i = 0; i < nstreams; i++)
+        if (streams[i].recs[0].arrival < first_arrival)
+            first_arrival = streams[i].recs[0].arrival;
+    for (i = 0; i < nstreams; i++) {
+        stream_t *s = &streams[i];
+        if (s->recs[s->nrecs - 1].arrival - first_arrival > span)
+            span = s->recs[s->nrecs - 1].arrival - first_arrival;
+        s->clnt = connect_server();
+        if (s->clnt == NULL) {
+            clnt_pcreateerror(host);
+            exit(1);
+        }
+        if (pthread_create(&s->tid, NULL, stream_main, s) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+
+    pthread_mutex_lock(&start_lock);
+    start_ns = now_ns();
+    started = 1;
+    pthread_cond_broadcast(&start_cond);
+    pthread_mutex_unlock(&start_lock);
+    for (i = 0; i < nstreams; i++)
+        pthread_join(streams[i].tid, NULL);
+    t1 = now_ns();
+
+    memset(lat, 0, sizeof(lat));
+    memset(orig, 0, sizeof(orig));
+    for (i = 0; i < nstreams; i++) {
+        stream_t *s = &streams[i];
+        errors += s->errors;
+        open_failed += s->open_failed;
+        if (s->max_lag > max_lag) max_lag = s->max_lag;
+        for (j = 0; j < NPROCS; j++)
+            hist_merge(&lat[j], &s->lat[j]);
+        for (j = 0; j < s->nrecs; j++)
+            hist_record(&orig[s->recs[j].proc], s->recs[j].service);
+    }
+
+    printf("trace calls %d connections %d span_s %.3f payload %s\n", n, nstreams,
+           span / 1e9, (hdr.flags & TRACE_PAYLOAD) ? "yes" : "no");
+    if (asap)
+        printf("replay mode asap");
+    else
+        printf("replay mode timed speed %.2f max_lag_ms %.3f", speed, max_lag / 1e6);
+    printf(" elapsed_s %.3f rpc_errors %llu open_failed %llu\n",
+           (t1 - start_ns) / 1e9, errors, open_failed);
+    for (j = 0; j < NPROCS; j++) {
+        hist_t *h = &lat[j];
+        if (h->count == 0) continue;
+        /* latency seen here vs. service time the server recorded */
+        printf("%s calls %llu mean_us %.1f p50_us %.1f p99_us %.1f p999_us %.1f "
+               "max_us %.1f traced_p50_us %.1f traced_p99_us %.1f\n",
+               ssnfs_procs[j].name, h->count, (double)h->sum / h->count / 1000.0,
+               hist_percentile(h, 0.50) / 1000.0, hist_percentile(h, 0.99) / 1000.0,
+               hist_percentile(h, 0.999) / 1000.0, h->max / 1000.0,
+               hist_percentile(&orig[j], 0.50) / 1000.0,
+               hist_percentile(&orig[j], 0.99) / 1000.0);
+    }
+    return errors ? 1 : 0;
+}
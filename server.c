@@ -4,116 +4,745 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
 #include <rpc/rpc.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <time.h>
+#include <limits.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <rpc/pmap_clnt.h>
 #include "ssnfs.h"
+#include "hist.h"
+#include "log.h"
+#include "trace.h"
+#include "vdisk.h"
+#include "lz.h"
+#include "crc32c.h"
+#include "memfind.h"
+#include "blake2.h"
+#include "delta.h"
 
-#define BLOCK_SIZE      512
-#define DISK_SIZE       (16 * 1024 * 1024)
-#define TOTAL_BLOCKS    (DISK_SIZE / BLOCK_SIZE)
-#define BLOCKS_PER_FILE 64
-#define MAX_USERS       10
-#define MAX_FILES_USER  10
 #define MAX_OPEN_FILES  20
+#define MAX_LEASES      64
+#define LEASE_SECS      10
 #define VDISK_NAME      "virtual_disk.bin"
-static int file_max_size(void) { return BLOCKS_PER_FILE * BLOCK_SIZE; }
-
-typedef struct {
-    char file_name[FILE_NAME_SIZE];
-    int  start_block;          /* -1 if unused */
-} file_meta_t;
-
-typedef struct {
-    char       user_name[USER_NAME_SIZE];
-    int        in_use;
-    file_meta_t files[MAX_FILES_USER];
-} user_meta_t;
+#define STATS_REPORT    16384
+#define COMPACT_CHUNK   (256 * 1024)   /* bytes copied per fs_lock hold */
+#define COMPACT_IDLE    1              /* seconds between looks when packed */
+#define SUM_BOUNCE      (256 * 1024)   /* unaligned checked reads go through this */
+#define SCRUB_CHUNK     (256 * 1024)   /* bytes checked per fs_lock hold */
+#define SCRUB_IDLE      1              /* seconds between passes */
+#define COPY_MAX        (64 << 20)     /* bytes one copy_range call moves at most */
+#define SEARCH_PIECE    (256 * 1024)   /* bytes a search reads at a time */
+#define SEARCH_MATCHES  1000           /* matches one search returns at most */
+#define SEARCH_THREADS  16             /* most workers a search starts */
+#define HASH_PIECE      (256 * 1024)   /* bytes hash_file reads at a time */
+#define SIGN_PIECE      (256 * 1024)   /* bytes sign_file reads at a time */
+#define SIGN_BLOCK_MIN  512            /* block lengths sign_file picks */
+#define SIGN_BLOCK_MAX  (128 * 1024)
+#define SIGN_BLOCKS     65536          /* blocks one signature has at most */
+#define EXPORT_CHUNK    (1 << 20)      /* default bytes per export_home */
+#define EXPORT_PIECE    (256 * 1024)   /* bytes read at a time to take a CRC again */
+#define MAX_IMPORTS     4              /* imports in progress at once */
+#define IMPORT_IDLE     60             /* seconds before an import may be dropped */
 
 typedef struct {
     int  in_use;
     int  fd;
     char user_name[USER_NAME_SIZE];
     char file_name[FILE_NAME_SIZE];
-    int  start_block;
-    int  current_pos;
+    int64_t start_block;
+    int64_t current_pos;
+    unsigned long long owner;  /* caller that opened it, see caller_id() */
+    int  wrote;                /* written through this fd, blocks new leases */
 } open_entry_t;
 
-static int          disk_fd = -1;
-static user_meta_t  users[MAX_USERS];
+/* Read lease held by a client cache.  file_name "" covers the directory
+   listing.  A recalled lease is not renewed; the entry lingers until
+   recall_until so the conflicting writer gets in before new readers. */
+typedef struct {
+    int    in_use;
+    unsigned long long holder;
+    char   user_name[USER_NAME_SIZE];
+    char   file_name[FILE_NAME_SIZE];
+    time_t expires;
+    int    recalled;
+    time_t recall_until;
+} lease_t;
+
+/* Geometry comes from the image's superblock; the tables below are
+   sized from it in init_disk. */
+static const char  *disk_name = VDISK_NAME;   /* members, comma-separated */
+static const char  *mirror_names[VDISK_MAX_COPIES];  /* -M, copies 1 and up */
+static int          mirror_count;
+static u_int        disk_down_seen;           /* copies reported out of use */
+static vdisk_t      disk;
+static superblock_t sb;
+static char        *meta;                     /* blocks 0 .. sb.data_block - 1 */
+static unsigned char *meta_dirty_blocks;      /* per block of meta, unsaved changes */
+static u_int64_t   *block_map;                /* in meta, bit set: block used */
+static user_meta_t *users;                    /* in meta, sb.max_users */
+static file_meta_t *file_table;               /* in meta, sb.max_files_user per user */
+static u_int32_t   *block_sums;               /* in meta, per block, see vdisk.h */
+static u_int64_t    free_count;               /* free data blocks */
+static u_int        group_count;              /* -G, 0: one per user as room allows */
+static u_int        ngroups;                  /* allocation groups, see group_setup */
+static u_int64_t    group_blocks;             /* per group; the last takes the rest */
+static u_int64_t   *group_free;               /* free blocks per group */
+static u_int64_t   *group_hint;               /* block after the group's last allocation */
+static int64_t     *group_lowest;             /* compactor scratch */
+
+/* Name lookups go through chained hash tables over users[] and
+   file_table[], rebuilt at load and kept current as names come and go.
+   Chains hold slot index + 1, 0 ends a chain. */
+static int         *user_bucket, *user_next;
+static int         *file_bucket, *file_next;
+static u_int        user_mask, file_mask;
+static int         *fp_bucket, *fp_next;      /* file records by fingerprint */
+static u_int       *slot_refs;                /* files on each slot, see slot_ref */
+static int          dedup;                    /* -u: equal files share a slot */
+static unsigned long long dedup_hits, dedup_misses, dedup_ns, cow_copies;
+static unsigned long long clones, snapshots_taken, snapshots_restored;
+static unsigned long long copy_calls, copy_bytes, copy_kernel_bytes;
+static int          search_threads;           /* -j, 0: one per CPU */
+static unsigned long long search_calls, search_bytes, search_matches, search_redone;
+static unsigned long long hash_calls, hash_bytes, hash_cached;
+static unsigned long long sign_calls, sign_bytes, patch_calls, patch_literal, patch_written,
+                          patch_in_place;
+static unsigned long long export_calls, export_bytes, export_recrc, import_calls, import_bytes,
+                          import_files, import_skipped;
+static int          compress;                 /* -z: store chunks compressed */
+static u_int64_t    chunk_size;               /* 0: none, see vdisk_chunk_size */
+static char        *chunk_buf, *chunk_zbuf;   /* a chunk, plain and stored */
+static unsigned long long z_chunks, z_packed, z_in, z_out, z_ns;  /* chunks stored */
+static unsigned long long unz_chunks, unz_bytes, unz_ns;          /* decompressed */
+static int          checksums = 1;            /* block sums kept and checked (microbench) */
+static char        *sum_buf;                  /* SUM_BOUNCE bytes */
+static unsigned long long sum_blocks, sum_errors, sum_repairs;     /* summed, bad on read */
+static unsigned long long meta_errors, meta_repairs;               /* records bad at load */
 static open_entry_t open_table[MAX_OPEN_FILES];
 static int          next_fd = 3;
-static int          block_used[TOTAL_BLOCKS]; /* 0 free, 1 used */
+static lease_t      leases[MAX_LEASES];
+static int          meta_dirty;               /* file sizes changed since last save */
+
+/* Per-procedure counters.  A call's time is split at the points where the
+   handler is entered and left: before is argument decoding, after is reply
+   encoding (plus freeing the arguments); disk I/O is taken out of the
+   handler time and kept separately. */
+typedef struct {
+    unsigned long long calls;
+    unsigned long long errors;     /* failed, RETRY_LATER, or undecodable */
+    unsigned long long bytes_in;   /* file data received */
+    unsigned long long bytes_out;  /* file data sent */
+    hist_t total, decode, handler, io, encode;
+} proc_stats_t;
+
+/* the call being served, filled in by call_enter/call_leave and disk I/O */
+typedef struct {
+    unsigned long      proc;
+    unsigned long long conn;
+    unsigned long long t_start, t_enter, t_leave, io_ns;
+    unsigned long long bytes_in, bytes_out;
+    int ok;
+    int ret;                       /* open_file: the fd handed out */
+    u_int data_len;                /* file data in the arguments */
+    u_int args_len;                /* encoded arguments in trace_buf */
+} call_t;
+
+static pthread_mutex_t fs_lock = PTHREAD_MUTEX_INITIALIZER; /* held per call */
+static proc_stats_t proc_stats[NPROCS];
+static call_t       cur_call;
+static time_t       stats_since;
+static unsigned long long lease_grants, lease_denials;
+static const char  *stats_file;     /* -s: periodic dump target */
+static int          stats_interval = 60;
+
+/* -T: every call is appended to trace_fp, see trace.h */
+static FILE        *trace_fp;
+static XDR          trace_xdr;
+static int          trace_payload;  /* -P: keep write/put/patch/import data */
+static unsigned long long trace_t0, trace_flushed;
+static char        *trace_buf;
+static u_int        trace_cap;
+
+/* -D or the defrag call: the compactor thread, see compact_move() */
+static int          compact_running, compact_stop, compact_idle;
+static u_int64_t    compact_budget;         /* bytes per second, 0 unlimited */
+static int64_t      compact_dest = -1;      /* slot being filled, or -1 */
+static int64_t      compact_copied;         /* bytes of it written so far */
+static unsigned long long compact_moves, compact_bytes, compact_aborts;
+static unsigned long long compact_due;      /* see io_throttle */
+
+/* -C: the scrubber thread, see scrub_step() */
+static u_int64_t    scrub_budget;           /* bytes per second, 0 if not running */
+static u_int64_t    scrub_next;             /* block to check next */
+static unsigned long long scrub_passes, scrub_bytes, scrub_errors, scrub_repairs, scrub_due;
 
+static int64_t file_max_size(void) { return (int64_t)sb.blocks_per_file * sb.block_size; }
+
+/* Reference count of the slot starting at start_block: the files whose
+   data is there.  More than one only with dedup or clones; derived from
+   the file table at load, not stored. */
+static u_int *slot_ref(int64_t start_block) {
+    return &slot_refs[(start_block - sb.data_block) / sb.blocks_per_file];
+}
+
+/* byte offset of a position in the file starting at start_block */
+static off_t block_offset(int64_t start_block, int64_t pos) {
+    return (off_t)start_block * sb.block_size + pos;
+}
+
+static file_meta_t *user_files(user_meta_t *u) {
+    return &file_table[(u - users) * sb.max_files_user];
+}
+
+/* a slot holding a file, on blocks or inline */
+static int file_live(const file_meta_t *fm) {
+    return fm->file_name[0] != '\0' && (fm->start_block >= 0 || (fm->flags & FILE_INLINE));
+}
+
+
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
 
 /* forward declarations */
 static void init_disk(void);
+static int  group_setup(void);
 static void load_metadata(void);
 static void save_metadata(void);
 static user_meta_t *find_or_create_user(const char *user);
 static user_meta_t *find_user(const char *user);
 static file_meta_t *find_file(user_meta_t *u, const char *fname);
 static file_meta_t *create_file_meta(user_meta_t *u, const char *fname, int *err);
-static int  allocate_blocks(void);
-static void free_blocks(int start_block);
+static int64_t allocate_blocks(int owner);
+static void free_blocks(int64_t start_block, int64_t used);
 static open_entry_t *find_open_by_fd(int fd);
 static open_entry_t *alloc_open_entry(void);
+static file_meta_t *open_entry_file(open_entry_t *oe);
+static unsigned long long caller_id(struct svc_req *rqstp);
+static int  lease_recall(const char *user, const char *fname, unsigned long long me);
+static void lease_clear_recalls(const char *user, const char *fname);
+static ssize_t disk_read(void *buf, size_t len, off_t offset);
+static ssize_t disk_write(const void *buf, size_t len, off_t offset);
+static void disk_punch(off_t offset, u_int64_t len);
+static void disk_check_copies(void);
+static void call_enter(void *argp);
+static void call_leave(int ok, int bytes_in, int bytes_out);
+static int  search_nthreads(void);
+
+void ssnfsprog_1(struct svc_req *rqstp, SVCXPRT *transp); /* rpcgen -m */
 
-/* called from RPCs when disk_fd < 0 */
+/* name of copy c of the image */
+static const char *copy_name(int c) {
+    return c == 0 ? disk_name : mirror_names[c];
+}
+
+/* Called from RPCs when no image is open.  A missing image is created
+   with the default geometry, striped over as many members as -d names
+   and mirrored to each -M; an existing one must carry a valid superblock
+   and member trailers.  Stale mirrors stay out of use. */
 static void init_disk(void) {
-    int i, exists = 0;
-    if (access(VDISK_NAME, F_OK) == 0)
-        exists = 1;
+    char err[256], first[4096];
+    int i, create;
 
-    disk_fd = open(VDISK_NAME, O_RDWR | O_CREAT, 0666);
-    if (disk_fd < 0) {
-        perror("open virtual_disk.bin");
+    snprintf(first, sizeof(first), "%.*s", (int)strcspn(disk_name, ","), disk_name);
+    create = access(first, F_OK) < 0 && errno == ENOENT;
+    if (vdisk_open(&disk, disk_name, create ? O_CREAT | O_EXCL : 0, err, sizeof(err)) != 0) {
+        log_error("%s%s", create ? "create " : "", err);
         exit(1);
     }
-    if (!exists) {
-        if (ftruncate(disk_fd, DISK_SIZE) < 0) {
-            perror("ftruncate");
+    for (i = 1; i <= mirror_count; i++) {
+        if (vdisk_mirror(&disk, mirror_names[i], create ? O_CREAT | O_EXCL : 0, err, sizeof(err)) != 0) {
+            log_error("%s%s", create ? "create " : "", err);
             exit(1);
         }
-        memset(block_used, 0, sizeof(block_used));
-        memset(users, 0, sizeof(users));
-        save_metadata();
-    } else {
-        load_metadata();
     }
+    if (create) {
+        memset(&sb, 0, sizeof(sb));
+        sb.block_size = VDISK_BLOCK_SIZE;
+        sb.disk_size = VDISK_SIZE;
+        sb.blocks_per_file = VDISK_BLOCKS_PER_FILE;
+        sb.max_users = VDISK_MAX_USERS;
+        sb.max_files_user = VDISK_MAX_FILES_USER;
+        sb.stripe_blocks = VDISK_STRIPE_BLOCKS;
+        sb.image_id = vdisk_new_id();
+        sb.members = disk.members;
+        if (vdisk_layout(&sb, err, sizeof(err)) != 0) {
+            log_error("%s: %s", disk_name, err);
+            exit(1);
+        }
+        if (vdisk_format(&disk, &sb) < 0) {
+            log_error("create %s: %s", disk_name, strerror(errno));
+            exit(1);
+        }
+        log_info("created %s", disk_name);
+    } else if (vdisk_attach(&disk, &sb, err, sizeof(err)) != 0) {
+        log_error("%s: %s", disk_name, err);
+        exit(1);
+    }
+    for (i = 0; i < disk.copies; i++)
+        if (disk.down & 1u << i)
+            log_warn("%s is stale or blank and not in use, bring it up to date with mkdisk -R",
+                     copy_name(i));
+    disk_down_seen = disk.down;
+    log_info("%s: %llu blocks of %u bytes, %u per file, %u users x %u files, "
+             "%u members with %u-block stripes",
+             disk_name, (unsigned long long)sb.total_blocks, sb.block_size,
+             sb.blocks_per_file, sb.max_users, sb.max_files_user,
+             sb.members, sb.stripe_blocks);
+    if (disk.copies > 1)
+        log_info("%s: %d of %d copies in use", disk_name,
+                 disk.copies - __builtin_popcount(disk.down), disk.copies);
+
+    /* all metadata lives in one block-aligned image of the start of the
+       disk, so changes are written back as whole blocks */
+    meta = calloc(sb.data_block, sb.block_size);
+    meta_dirty_blocks = calloc(sb.data_block, 1);
+    user_mask = file_mask = 1;
+    while (user_mask < sb.max_users) user_mask <<= 1;
+    while (file_mask < sb.max_users * sb.max_files_user) file_mask <<= 1;
+    user_bucket = calloc(user_mask--, sizeof(int));
+    user_next = calloc(sb.max_users, sizeof(int));
+    file_bucket = calloc(file_mask--, sizeof(int));
+    file_next = calloc((size_t)sb.max_users * sb.max_files_user, sizeof(int));
+    fp_bucket = calloc(file_mask + 1, sizeof(int));
+    fp_next = calloc((size_t)sb.max_users * sb.max_files_user, sizeof(int));
+    slot_refs = calloc((sb.total_blocks - sb.data_block) / sb.blocks_per_file + 1, sizeof(u_int));
+    chunk_size = vdisk_chunk_size(&sb);
+    if (chunk_size != 0) {
+        chunk_buf = malloc(chunk_size);
+        chunk_zbuf = malloc(chunk_size);
+    }
+    sum_buf = malloc(SUM_BOUNCE);
+    if (meta == NULL || meta_dirty_blocks == NULL || user_bucket == NULL || sum_buf == NULL ||
+        user_next == NULL || file_bucket == NULL || file_next == NULL ||
+        fp_bucket == NULL || fp_next == NULL || slot_refs == NULL || group_setup() != 0 ||
+        (chunk_size != 0 && (chunk_buf == NULL || chunk_zbuf == NULL))) {
+        log_error("metadata alloc failed");
+        exit(1);
+    }
+    if (compress && chunk_size == 0) {
+        log_warn("%s: files too large to compress, -z ignored", disk_name);
+        compress = 0;
+    }
+    block_map = (u_int64_t *)(meta + sb.bitmap_off);
+    users = (user_meta_t *)(meta + sb.users_off);
+    file_table = (file_meta_t *)(meta + sb.files_off);
+    block_sums = (u_int32_t *)(meta + sb.sums_off);
+    load_metadata();
+    log_info("%s: %u allocation groups of %llu blocks, crc32c checksums (%s)", disk_name,
+             ngroups, (unsigned long long)group_blocks, crc32c_impl());
     for (i = 0; i < MAX_OPEN_FILES; i++)
         open_table[i].in_use = 0;
 }
 
-/* simple metadata layout: block 0 reserved for block_used[],
-   block 1..N for users/files */
+/* Allocation groups: the data area is cut into ngroups runs of whole
+   file slots, and each user's files are placed in the user's home group,
+   so a home directory sits together on disk.  Users are spread evenly
+   over the groups; by default there is a group per user where each can
+   hold max_files_user files.  The groups are the server's placement
+   policy, not part of the image: -G may change between runs.  0, or -1
+   if the tables could not be allocated. */
+static int group_setup(void) {
+    u_int64_t slots = (sb.total_blocks - sb.data_block) / sb.blocks_per_file;
+
+    ngroups = group_count ? group_count : sb.max_users;
+    if (group_count == 0 && ngroups > slots / sb.max_files_user)
+        ngroups = (u_int)(slots / sb.max_files_user);
+    if (ngroups > slots)
+        ngroups = (u_int)slots;
+    if (ngroups == 0)
+        ngroups = 1;
+    group_blocks = slots / ngroups * sb.blocks_per_file;
+    free(group_free);
+    free(group_hint);
+    free(group_lowest);
+    group_free = calloc(ngroups, sizeof(u_int64_t));
+    group_hint = calloc(ngroups, sizeof(u_int64_t));
+    group_lowest = calloc(ngroups, sizeof(int64_t));
+    return group_free && group_hint && group_lowest ? 0 : -1;
+}
+
+static u_int64_t group_start(u_int g) {
+    return sb.data_block + g * group_blocks;
+}
+
+static u_int64_t group_end(u_int g) {
+    return g == ngroups - 1 ? sb.total_blocks : group_start(g + 1);
+}
+
+static u_int block_group(u_int64_t b) {
+    u_int64_t g = group_blocks ? (b - sb.data_block) / group_blocks : 0;
+    return g < ngroups ? (u_int)g : ngroups - 1;
+}
+
+/* owner: a user's index in the user table */
+static u_int home_group(int owner) {
+    return (u_int)((u_int64_t)owner * ngroups / sb.max_users);
+}
+
+/* Mark the metadata blocks holding off .. off + len - 1 for the next
+   save_metadata. */
+static void meta_touch(u_int64_t off, size_t len) {
+    u_int64_t b;
+    for (b = off / sb.block_size; b <= (off + len - 1) / sb.block_size; b++)
+        meta_dirty_blocks[b] = 1;
+}
+
+static void user_touch(user_meta_t *u) {
+    meta_touch((char *)u - meta, sizeof(*u));
+}
+
+static void file_touch(file_meta_t *fm) {
+    meta_touch((char *)fm - meta, sizeof(*fm));
+}
+
+static u_int name_hash(u_int h, const char *name, int len) {
+    int i;
+    for (i = 0; i < len && name[i] != '\0'; i++)
+        h = (h ^ (unsigned char)name[i]) * 16777619u;   /* FNV-1a */
+    return h;
+}
+
+static u_int user_hash(const char *user) {
+    return name_hash(2166136261u, user, USER_NAME_SIZE) & user_mask;
+}
+
+/* files hash on owner and name, the owner is the user's slot */
+static u_int file_hash(int owner, const char *fname) {
+    return name_hash(2166136261u ^ (u_int)owner, fname, FILE_NAME_SIZE) & file_mask;
+}
+
+static void user_index_add(user_meta_t *u) {
+    int slot = u - users;
+    u_int h = user_hash(u->user_name);
+    user_next[slot] = user_bucket[h];
+    user_bucket[h] = slot + 1;
+}
+
+static void user_index_del(user_meta_t *u) {
+    int slot = u - users;
+    int *link = &user_bucket[user_hash(u->user_name)];
+    while (*link != 0 && *link != slot + 1)
+        link = &user_next[*link - 1];
+    if (*link != 0)
+        *link = user_next[slot];
+}
+
+static void file_index_add(file_meta_t *fm) {
+    int slot = fm - file_table;
+    u_int h = file_hash(slot / sb.max_files_user, fm->file_name);
+    file_next[slot] = file_bucket[h];
+    file_bucket[h] = slot + 1;
+}
+
+static void file_index_del(file_meta_t *fm) {
+    int slot = fm - file_table;
+    int *link = &file_bucket[file_hash(slot / sb.max_files_user, fm->file_name)];
+    while (*link != 0 && *link != slot + 1)
+        link = &file_next[*link - 1];
+    if (*link != 0)
+        *link = file_next[slot];
+}
+
+/* Content fingerprint for dedup, xxHash64: four independent 64-bit lanes
+   over 32-byte stripes, so a superscalar (or vectorising) CPU keeps them
+   in flight together.  0 is kept for "none". */
+#define FP_P1 0x9E3779B185EBCA87ULL
+#define FP_P2 0xC2B2AE3D27D4EB4FULL
+#define FP_P3 0x165667B19E3779F9ULL
+#define FP_P4 0x85EBCA77C2B2AE63ULL
+#define FP_P5 0x27D4EB2F165667C5ULL
+
+static u_int64_t fp_rotl(u_int64_t x, int r) { return x << r | x >> (64 - r); }
+
+static u_int64_t fp_round(u_int64_t acc, u_int64_t in) {
+    return fp_rotl(acc + in * FP_P2, 31) * FP_P1;
+}
+
+static u_int64_t fp_merge(u_int64_t h, u_int64_t v) {
+    return (h ^ fp_round(0, v)) * FP_P1 + FP_P4;
+}
+
+static u_int64_t fingerprint(const void *buf, size_t len) {
+    const unsigned char *p = buf, *end = p + len;
+    u_int64_t h, v[4], w;
+    u_int32_t x;
+    int i;
+
+    if (len >= 32) {
+        v[0] = FP_P1 + FP_P2;
+        v[1] = FP_P2;
+        v[2] = 0;
+        v[3] = -FP_P1;
+        for (; p + 32 <= end; p += 32)
+            for (i = 0; i < 4; i++) {
+                memcpy(&w, p + 8 * i, 8);
+                v[i] = fp_round(v[i], w);
+            }
+        h = fp_rotl(v[0], 1) + fp_rotl(v[1], 7) + fp_rotl(v[2], 12) + fp_rotl(v[3], 18);
+        for (i = 0; i < 4; i++)
+            h = fp_merge(h, v[i]);
+    } else {
+        h = FP_P5;
+    }
+    h += len;
+    for (; p + 8 <= end; p += 8) {
+        memcpy(&w, p, 8);
+        h = fp_rotl(h ^ fp_round(0, w), 27) * FP_P1 + FP_P4;
+    }
+    if (p + 4 <= end) {
+        memcpy(&x, p, 4);
+        h = fp_rotl(h ^ x * FP_P1, 23) * FP_P2 + FP_P3;
+        p += 4;
+    }
+    for (; p < end; p++)
+        h = fp_rotl(h ^ *p * FP_P5, 11) * FP_P1;
+    h ^= h >> 33;
+    h *= FP_P2;
+    h ^= h >> 29;
+    h *= FP_P3;
+    h ^= h >> 32;
+    return h ? h : 1;
+}
+
+static void fp_index_add(file_meta_t *fm) {
+    int slot = fm - file_table, *b = &fp_bucket[fm->fingerprint & file_mask];
+    fp_next[slot] = *b;
+    *b = slot + 1;
+}
+
+static void fp_index_del(file_meta_t *fm) {
+    int slot = fm - file_table;
+    int *link = &fp_bucket[fm->fingerprint & file_mask];
+    while (*link != 0 && *link != slot + 1)
+        link = &fp_next[*link - 1];
+    if (*link != 0)
+        *link = fp_next[slot];
+}
+
+/* record a file's fingerprint, 0 once its contents are no longer known */
+static void fp_set(file_meta_t *fm, u_int64_t fp) {
+    if (fm->fingerprint == fp)
+        return;
+    if (fm->fingerprint != 0)
+        fp_index_del(fm);
+    fm->fingerprint = fp;
+    if (fp != 0)
+        fp_index_add(fm);
+    file_touch(fm);
+}
+
+/* used blocks in [from, to) */
+static u_int64_t count_used(u_int64_t from, u_int64_t to) {
+    u_int64_t n = 0, wi, base, m;
+
+    for (wi = from >> 6; (base = wi << 6) < to; wi++) {
+        m = ~0ULL;
+        if (base < from) m &= ~0ULL << (from - base);
+        if (to - base < 64) m &= (1ULL << (to - base)) - 1;
+        n += __builtin_popcountll(block_map[wi] & m);
+    }
+    return n;
+}
+
+/* hash chains, slot reference counts and the free block counts from
+   the tables */
+static void index_metadata(void) {
+    u_int64_t w, used = 0;
+    int i, nfiles = sb.max_users * sb.max_files_user;
+    u_int g;
+
+    memset(user_bucket, 0, (user_mask + 1) * sizeof(int));
+    memset(file_bucket, 0, (file_mask + 1) * sizeof(int));
+    memset(fp_bucket, 0, (file_mask + 1) * sizeof(int));
+    memset(slot_refs, 0, ((sb.total_blocks - sb.data_block) / sb.blocks_per_file + 1) * sizeof(u_int));
+    for (i = 0; i < (int)sb.max_users; i++)
+        if (users[i].in_use)
+            user_index_add(&users[i]);
+    for (i = 0; i < nfiles; i++) {
+        if (!file_live(&file_table[i]))
+            continue;
+        file_index_add(&file_table[i]);
+        if (file_table[i].fingerprint != 0)
+            fp_index_add(&file_table[i]);
+        if (file_table[i].start_block >= 0)
+            (*slot_ref(file_table[i].start_block))++;
+    }
+    for (w = 0; w < (sb.total_blocks + 63) / 64; w++)
+        used += __builtin_popcountll(block_map[w]);
+    free_count = sb.total_blocks - sb.data_block - used;
+    for (g = 0; g < ngroups; g++) {
+        group_free[g] = group_end(g) - group_start(g) - count_used(group_start(g), group_end(g));
+        group_hint[g] = group_start(g);
+    }
+}
+
+/* CRC-32C of a user or file record of len bytes, taken with its sum
+   field (at sum) 0 */
+static u_int record_sum(const void *rec, size_t len, const u_int *sum) {
+    size_t at = (const char *)sum - (const char *)rec;
+    u_int zero = 0, c;
+
+    c = crc32c(0, rec, at);
+    c = crc32c(c, &zero, sizeof(zero));
+    c = crc32c(c, (const char *)rec + at + sizeof(zero), len - at - sizeof(zero));
+    return c ? c : 1;
+}
+
+/* A record that fails its sum at load is taken from the first copy of
+   the image that has it right, and written back to all.  0 if one did. */
+static int record_fix(void *rec, size_t len, u_int *sum, const char *what, int i) {
+    char good[sizeof(file_meta_t) > sizeof(user_meta_t) ? sizeof(file_meta_t) : sizeof(user_meta_t)];
+    off_t at = (char *)rec - meta;
+    u_int *good_sum = (u_int *)(good + ((char *)sum - (char *)rec));
+    int c;
+
+    meta_errors++;
+    for (c = 0; c < disk.copies; c++) {
+        if ((disk.down & 1u << c) || vdisk_pread_copy(&disk, c, good, len, at) != (ssize_t)len ||
+            *good_sum != record_sum(good, len, good_sum))
+            continue;
+        memcpy(rec, good, len);
+        meta_touch(at, len);
+        meta_repairs++;
+        log_warn("%s record %d failed its checksum, taken from %s", what, i, copy_name(c));
+        return 0;
+    }
+    return -1;
+}
+
+/* Check the sums of the user and file records.  A record no copy has
+   right is dropped, a user with its files; the blocks of dropped files
+   stay allocated, so what they hold is not overwritten.  Returns the
+   records replaced or dropped. */
+static int check_records(void) {
+    int i, f, bad = 0, nfiles = sb.max_users * sb.max_files_user;
+    user_meta_t *u;
+    file_meta_t *fm;
+
+    for (i = 0; i < (int)sb.max_users; i++) {
+        u = &users[i];
+        if (u->sum == 0 || u->sum == record_sum(u, sizeof(*u), &u->sum))
+            continue;
+        bad++;
+        if (record_fix(u, sizeof(*u), &u->sum, "user", i) == 0)
+            continue;
+        log_error("user record %d failed its checksum on every copy, dropped with its files", i);
+        memset(u, 0, sizeof(*u));
+        user_touch(u);
+        for (f = 0, fm = user_files(u); f < (int)sb.max_files_user; f++, fm++) {
+            memset(fm, 0, sizeof(*fm));
+            fm->start_block = -1;
+            file_touch(fm);
+        }
+    }
+    for (i = 0; i < nfiles; i++) {
+        fm = &file_table[i];
+        if (fm->sum == 0 || fm->sum == record_sum(fm, sizeof(*fm), &fm->sum))
+            continue;
+        bad++;
+        if (record_fix(fm, sizeof(*fm), &fm->sum, "file", i) == 0)
+            continue;
+        log_error("file record %d failed its checksum on every copy, dropped", i);
+        memset(fm, 0, sizeof(*fm));
+        fm->start_block = -1;
+        file_touch(fm);
+    }
+    return bad;
+}
+
+/* the tables sit between the superblock and sb.data_block, see vdisk.h */
 static void load_metadata(void) {
-    ssize_t sz;
-    lseek(disk_fd, 0, SEEK_SET);
-    sz = read(disk_fd, block_used, sizeof(block_used));
-    if (sz != sizeof(block_used)) {
-        memset(block_used, 0, sizeof(block_used));
+    size_t len = (size_t)sb.data_block * sb.block_size;
+    int bad;
+
+    memset(meta_dirty_blocks, 0, sb.data_block);
+    if (disk_read(meta, len, 0) != (ssize_t)len) {
+        log_error("%s: cannot read the metadata: %s", disk_name, strerror(errno));
+        exit(1);
     }
-    sz = read(disk_fd, users, sizeof(users));
-    if (sz != sizeof(users)) {
-        memset(users, 0, sizeof(users));
+    memcpy(meta, &sb, sizeof(sb));
+    bad = check_records();
+    index_metadata();
+    if (bad > 0)
+        save_metadata();
+}
+
+/* records of size bytes in a table at off overlapping metadata block b:
+   indexes *first .. *end - 1 of count */
+static void records_in(u_int64_t b, u_int64_t off, size_t size, u_int64_t count,
+                       u_int64_t *first, u_int64_t *end) {
+    u_int64_t from = b * sb.block_size, to = from + sb.block_size;
+
+    *first = from <= off ? 0 : (from - off) / size;
+    *end = to <= off ? 0 : (to - off + size - 1) / size;
+    if (*end > count)
+        *end = count;
+}
+
+/* the sums of the records in dirty blocks, before they are written */
+static void seal_records(void) {
+    u_int64_t b, i, end, nfiles = (u_int64_t)sb.max_users * sb.max_files_user;
+    u_int s;
+
+    for (b = sb.users_off / sb.block_size; b < sb.sums_off / sb.block_size; b++) {
+        if (!meta_dirty_blocks[b])
+            continue;
+        for (records_in(b, sb.users_off, sizeof(user_meta_t), sb.max_users, &i, &end); i < end; i++)
+            if ((s = record_sum(&users[i], sizeof(user_meta_t), &users[i].sum)) != users[i].sum) {
+                users[i].sum = s;
+                user_touch(&users[i]);
+            }
+        for (records_in(b, sb.files_off, sizeof(file_meta_t), nfiles, &i, &end); i < end; i++)
+            if ((s = record_sum(&file_table[i], sizeof(file_meta_t), &file_table[i].sum)) !=
+                file_table[i].sum) {
+                file_table[i].sum = s;
+                file_touch(&file_table[i]);
+            }
     }
 }
 
+/* writes back the dirty metadata blocks, adjacent ones in one go */
 static void save_metadata(void) {
-    lseek(disk_fd, 0, SEEK_SET);
-    write(disk_fd, block_used, sizeof(block_used));
-    write(disk_fd, users, sizeof(users));
-    fsync(disk_fd);
+    unsigned long long t0;
+    u_int64_t b, run;
+    int wrote = 0;
+
+    seal_records();
+    for (b = 0; b < sb.data_block; b += run) {
+        for (run = 0; b + run < sb.data_block && meta_dirty_blocks[b + run]; run++)
+            meta_dirty_blocks[b + run] = 0;
+        if (run == 0) {
+            run = 1;
+            continue;
+        }
+        disk_write(meta + b * sb.block_size, run * sb.block_size, b * sb.block_size);
+        wrote = 1;
+    }
+    if (wrote) {
+        t0 = now_ns();
+        vdisk_sync(&disk);
+        cur_call.io_ns += now_ns() - t0;
+        disk_check_copies();
+    }
+    meta_dirty = 0;
 }
 
 static user_meta_t *find_user(const char *user) {
     int i;
-    for (i = 0; i < MAX_USERS; i++) {
-        if (users[i].in_use &&
-            strncmp(users[i].user_name, user, USER_NAME_SIZE) == 0)
-            return &users[i];
+    for (i = user_bucket[user_hash(user)]; i != 0; i = user_next[i - 1]) {
+        if (strncmp(users[i - 1].user_name, user, USER_NAME_SIZE) == 0)
+            return &users[i - 1];
     }
     return NULL;
 }
@@ -122,12 +751,15 @@ static user_meta_t *find_or_create_user(const char *user) {
     user_meta_t *u = find_user(user);
     int i;
     if (u) return u;
-    for (i = 0; i < MAX_USERS; i++) {
+    for (i = 0; i < (int)sb.max_users; i++) {
         if (!users[i].in_use) {
             users[i].in_use = 1;
             strncpy(users[i].user_name, user, USER_NAME_SIZE - 1);
             users[i].user_name[USER_NAME_SIZE - 1] = '\0';
-            memset(users[i].files, 0, sizeof(users[i].files));
+            memset(user_files(&users[i]), 0, sb.max_files_user * sizeof(file_meta_t));
+            user_index_add(&users[i]);
+            user_touch(&users[i]);
+            meta_touch((char *)user_files(&users[i]) - meta, sb.max_files_user * sizeof(file_meta_t));
             save_metadata();
             return &users[i];
         }
@@ -136,333 +768,3119 @@ static user_meta_t *find_or_create_user(const char *user) {
 }
 
 static file_meta_t *find_file(user_meta_t *u, const char *fname) {
-    int i;
-    for (i = 0; i < MAX_FILES_USER; i++) {
-        if (u->files[i].start_block >= 0 &&
-            strncmp(u->files[i].file_name, fname, FILE_NAME_SIZE) == 0)
-            return &u->files[i];
+    int owner = u - users, i;
+    for (i = file_bucket[file_hash(owner, fname)]; i != 0; i = file_next[i - 1]) {
+        file_meta_t *fm = &file_table[i - 1];
+        if ((i - 1) / (int)sb.max_files_user == owner && file_live(fm) &&
+            strncmp(fm->file_name, fname, FILE_NAME_SIZE) == 0)
+            return fm;
     }
     return NULL;
 }
 
+/* Returns a named slot without blocks; it enters the name index when
+   blocks or inline data are assigned, see file_assign(). */
 static file_meta_t *create_file_meta(user_meta_t *u, const char *fname, int *err) {
+    file_meta_t *files = user_files(u);
     int i;
     if (find_file(u, fname) != NULL) {
         *err = 1; /* already exists */
         return NULL;
     }
-    for (i = 0; i < MAX_FILES_USER; i++) {
-        if (u->files[i].start_block < 0 || u->files[i].file_name[0] == '\0') {
-            strncpy(u->files[i].file_name, fname, FILE_NAME_SIZE - 1);
-            u->files[i].file_name[FILE_NAME_SIZE - 1] = '\0';
-            u->files[i].start_block = -1;
+    for (i = 0; i < (int)sb.max_files_user; i++) {
+        if (!file_live(&files[i])) {
+            strncpy(files[i].file_name, fname, FILE_NAME_SIZE - 1);
+            files[i].file_name[FILE_NAME_SIZE - 1] = '\0';
+            files[i].start_block = -1;
+            files[i].size = 0;
+            files[i].flags = 0;
+            memset(files[i].data, 0, VDISK_INLINE_MAX);
+            file_touch(&files[i]);
             *err = 0;
-            return &u->files[i];
+            return &files[i];
         }
     }
     *err = 2; /* too many files */
     return NULL;
 }
 
-static int allocate_blocks(void) {
-    int i, run = 0, start = -1;
-    for (i = 2; i < TOTAL_BLOCKS; i++) { /* 0/1 reserved for metadata */
-        if (!block_used[i]) {
-            if (run == 0) start = i;
-            run++;
-            if (run == BLOCKS_PER_FILE) {
-                int j;
-                for (j = start; j < start + BLOCKS_PER_FILE; j++)
-                    block_used[j] = 1;
-                save_metadata();
-                return start;
-            }
-        } else {
-            run = 0;
-            start = -1;
-        }
-    }
-    return -1;
+/* give a slot from create_file_meta its blocks; 0, or -1 if the disk is full */
+static int file_assign(file_meta_t *fm) {
+    fm->start_block = allocate_blocks((int)((fm - file_table) / sb.max_files_user));
+    if (fm->start_block < 0)
+        return -1;
+    file_index_add(fm);
+    file_touch(fm);
+    return 0;
 }
 
-static void free_blocks(int start_block) {
-    int i;
-    if (start_block < 0) return;
-    for (i = start_block; i < start_block + BLOCKS_PER_FILE && i < TOTAL_BLOCKS; i++)
-        block_used[i] = 0;
-    save_metadata();
+/* or inline data, empty: new files start out in their record */
+static void file_assign_inline(file_meta_t *fm) {
+    fm->flags = FILE_INLINE;
+    file_index_add(fm);
+    file_touch(fm);
 }
 
-static open_entry_t *find_open_by_fd(int fd) {
+/* open entries follow a file whose data moved from block old to block
+   new, -1 standing for inline */
+static void file_moved(file_meta_t *fm, int64_t old, int64_t new) {
+    open_entry_t *oe;
     int i;
+
     for (i = 0; i < MAX_OPEN_FILES; i++) {
-        if (open_table[i].in_use && open_table[i].fd == fd)
-            return &open_table[i];
+        oe = &open_table[i];
+        if (oe->in_use && oe->start_block == old && open_entry_file(oe) == fm)
+            oe->start_block = new;
     }
-    return NULL;
 }
 
-static open_entry_t *alloc_open_entry(void) {
-    int i;
-    for (i = 0; i < MAX_OPEN_FILES; i++) {
-        if (!open_table[i].in_use)
-            return &open_table[i];
+/* Give an inline file blocks of its own and copy its data there, when it
+   grows past VDISK_INLINE_MAX.  0, or -1 with errno set (ENOSPC when the
+   disk is full). */
+static int file_promote(file_meta_t *fm) {
+    int64_t start = allocate_blocks((int)((fm - file_table) / sb.max_files_user));
+
+    if (start < 0) {
+        errno = ENOSPC;
+        return -1;
     }
-    return NULL;
+    if (fm->size > 0 && disk_write(fm->data, fm->size, block_offset(start, 0)) != fm->size) {
+        free_blocks(start, fm->size);
+        return -1;
+    }
+    fm->flags &= ~FILE_INLINE;
+    memset(fm->data, 0, VDISK_INLINE_MAX);
+    fm->start_block = start;
+    file_touch(fm);
+    file_moved(fm, -1, start);
+    return 0;
 }
 
-/* RPC implementations */
+/* Compression: a compressed file's chunks are stored on their own, so a
+   read decompresses only the chunks it touches and a write rewrites only
+   those; see vdisk.h for the layout. */
+static u_int16_t *chunk_map(file_meta_t *fm) { return (u_int16_t *)fm->data; }
 
-open_output *open_file_1_svc(open_input *argp, struct svc_req *rqstp) {
-    static open_output result;
-    user_meta_t *u;
-    file_meta_t *fm;
-    open_entry_t *oe;
-    char msg[128];
-    fprintf(stderr, "DEBUG: open_file_1_svc user=%s file=%s\n",argp->user_name, argp->file_name);
-    memset(&result, 0, sizeof(result));
-    if (disk_fd < 0) {
-        init_disk();
-    }
-    result.fd = -1;
+/* bytes of chunk k in a file of size bytes */
+static int64_t chunk_len(int64_t k, int64_t size) {
+    int64_t n = size - k * (int64_t)chunk_size;
+    return n <= 0 ? 0 : n < (int64_t)chunk_size ? n : (int64_t)chunk_size;
+}
 
-    u = find_user(argp->user_name);
-    if (!u) {
-        snprintf(msg, sizeof(msg), "User directory not found");
-        goto ret_err;
+/* bytes chunk k of fm takes on disk */
+static int64_t chunk_stored(file_meta_t *fm, int64_t k) {
+    u_int16_t units = fm->flags & FILE_COMPRESSED ? chunk_map(fm)[k] : 0;
+    return units ? (int64_t)units * VDISK_CHUNK_UNIT : chunk_len(k, fm->size);
+}
+
+/* Chunk k of fm into chunk_buf, zeros past its data.  0, or -1 with errno
+   set (EIO for a stream that does not decompress). */
+static int chunk_load(file_meta_t *fm, int64_t k) {
+    int64_t stored = chunk_stored(fm, k);
+    off_t at = block_offset(fm->start_block, k * chunk_size);
+    unsigned long long t0;
+    u_int32_t zlen;
+    int n = (int)stored;
+
+    if (!(fm->flags & FILE_COMPRESSED) || chunk_map(fm)[k] == 0) {
+        if (n > 0 && disk_read(chunk_buf, n, at) != n)
+            return -1;
+    } else {
+        if (disk_read(chunk_zbuf, stored, at) != stored)
+            return -1;
+        memcpy(&zlen, chunk_zbuf, sizeof(zlen));
+        t0 = now_ns();
+        n = zlen <= stored - sizeof(zlen) ?
+            lz_decompress(chunk_zbuf + sizeof(zlen), (int)zlen, chunk_buf, (int)chunk_size) : -1;
+        unz_ns += now_ns() - t0;
+        if (n < 0) {
+            log_error("chunk %lld at block %lld does not decompress", (long long)k,
+                      (long long)fm->start_block);
+            errno = EIO;
+            return -1;
+        }
+        unz_chunks++;
+        unz_bytes += n;
     }
-    fm = find_file(u, argp->file_name);
-    if (!fm || fm->start_block < 0) {
-        snprintf(msg, sizeof(msg), "File not found");
-        goto ret_err;
+    memset(chunk_buf + n, 0, chunk_size - n);
+    return 0;
+}
+
+/* Store the first len bytes of chunk_buf as chunk k of fm: compressed if
+   that saves at least a map unit, with the rest of the chunk punched out,
+   else as is.  Call before fm->size takes in the new data.  0, or -1 with
+   errno set. */
+static int chunk_store(file_meta_t *fm, int64_t k, int64_t len) {
+    int64_t old = chunk_stored(fm, k), stored = len;
+    off_t at = block_offset(fm->start_block, k * chunk_size);
+    unsigned long long t0;
+    u_int32_t zlen = 0;
+
+    if (compress && len > 0) {
+        t0 = now_ns();
+        zlen = lz_compress(chunk_buf, (int)len, chunk_zbuf + sizeof(zlen),
+                           (int)len - (int)sizeof(zlen) - VDISK_CHUNK_UNIT);
+        z_ns += now_ns() - t0;
     }
-    oe = alloc_open_entry();
-    if (!oe) {
-        snprintf(msg, sizeof(msg), "Open file table full");
-        goto ret_err;
+    if (zlen > 0) {
+        memcpy(chunk_zbuf, &zlen, sizeof(zlen));
+        stored = (sizeof(zlen) + zlen + VDISK_CHUNK_UNIT - 1) / VDISK_CHUNK_UNIT * VDISK_CHUNK_UNIT;
+        memset(chunk_zbuf + sizeof(zlen) + zlen, 0, stored - sizeof(zlen) - zlen);
+        if (disk_write(chunk_zbuf, stored, at) != stored)
+            return -1;
+        fm->flags |= FILE_COMPRESSED;
+        chunk_map(fm)[k] = (u_int16_t)(stored / VDISK_CHUNK_UNIT);
+        z_packed++;
+    } else {
+        if (len > 0 && disk_write(chunk_buf, len, at) != len)
+            return -1;
+        if (fm->flags & FILE_COMPRESSED)
+            chunk_map(fm)[k] = 0;
     }
-    oe->in_use = 1;
-    oe->fd = next_fd++;
-    strncpy(oe->user_name, argp->user_name, USER_NAME_SIZE);
-    strncpy(oe->file_name, argp->file_name, FILE_NAME_SIZE);
-    oe->start_block = fm->start_block;
-    oe->current_pos = 0;
+    z_chunks++;
+    z_in += len;
+    z_out += stored;
+    if (old > stored)
+        disk_punch(at + stored, old - stored);
+    file_touch(fm);
+    return 0;
+}
 
-    result.fd = oe->fd;
-    snprintf(msg, sizeof(msg), "File opened");
+/* Whether writes to fm go through chunk_store() */
+static int file_chunked(file_meta_t *fm) {
+    return chunk_size != 0 && !(fm->flags & FILE_INLINE) &&
+           (compress || (fm->flags & FILE_COMPRESSED));
+}
 
-ret_err:
-    if (result.out_msg.out_msg_val != NULL) {
-        free(result.out_msg.out_msg_val);
+/* len bytes at pos of fm, a file on blocks; a compressed file's chunks
+   are read through the map.  len, or -1 with errno set. */
+static ssize_t file_pread(file_meta_t *fm, char *buf, int64_t len, int64_t pos) {
+    int64_t at, k, off, n;
+
+    if (!(fm->flags & FILE_COMPRESSED))
+        return disk_read(buf, len, block_offset(fm->start_block, pos));
+    for (at = pos; at < pos + len; at += n) {
+        k = at / chunk_size;
+        off = at % chunk_size;
+        n = (int64_t)chunk_size - off < pos + len - at ? (int64_t)chunk_size - off : pos + len - at;
+        if (chunk_map(fm)[k] == 0) {
+            if (disk_read(buf + (at - pos), n, block_offset(fm->start_block, at)) != n)
+                return -1;
+        } else {
+            if (chunk_load(fm, k) < 0)
+                return -1;
+            memcpy(buf + (at - pos), chunk_buf + off, n);
+        }
     }
-    result.out_msg.out_msg_len = strlen(msg) + 1;
-    result.out_msg.out_msg_val = strdup(msg);
-    return &result;
+    return len;
 }
 
-read_output *read_file_1_svc(read_input *argp, struct svc_req *rqstp) {
-    static read_output result;
-    open_entry_t *oe;
-    char msg[128];
-    int maxsize = file_max_size();
-    int to_read, offset;
-    ssize_t r;
-    fprintf(stderr, "DEBUG: read_file_1_svc user=%s fd=%d numbytes=%d\n",
-        argp->user_name, argp->fd, argp->numbytes);
-    memset(&result, 0, sizeof(result));
-    if (disk_fd < 0) {
-        init_disk();
-    }
-    result.success = -1;
+/* len bytes at pos into fm, chunked (file_chunked()): each chunk the
+   write only partly covers is read in first, and every chunk touched is
+   stored again.  fm->size is left to the caller.  len, or -1 with errno
+   set. */
+static ssize_t file_pwrite(file_meta_t *fm, const char *buf, int64_t len, int64_t pos) {
+    int64_t at, k, off, n, was;
 
-    oe = find_open_by_fd(argp->fd);
-    if (!oe) {
-        snprintf(msg, sizeof(msg), "Invalid file descriptor");
-        goto ret_msg;
-    }
-    if (argp->numbytes <= 0) {
-        snprintf(msg, sizeof(msg), "Nothing to read");
-        goto ret_msg;
-    }
-    if (oe->current_pos >= maxsize) {
-        snprintf(msg, sizeof(msg), "End of file");
-        goto ret_msg;
+    for (at = pos; at < pos + len; at += n) {
+        k = at / chunk_size;
+        off = at % chunk_size;
+        n = (int64_t)chunk_size - off < pos + len - at ? (int64_t)chunk_size - off : pos + len - at;
+        was = chunk_len(k, fm->size);
+        if (!compress && chunk_map(fm)[k] == 0) {
+            /* a plain chunk stays plain */
+            if (disk_write(buf + (at - pos), n, block_offset(fm->start_block, at)) != n)
+                return -1;
+            continue;
+        }
+        if ((off > 0 || n < was) && chunk_load(fm, k) < 0)
+            return -1;
+        memcpy(chunk_buf + off, buf + (at - pos), n);
+        if (chunk_store(fm, k, off + n > was ? off + n : was) < 0)
+            return -1;
     }
+    return len;
+}
 
-    if (oe->current_pos + argp->numbytes > maxsize)
-        to_read = maxsize - oe->current_pos;
-    else
-        to_read = argp->numbytes;
+/* Copy on write: give a file that shares its slot (dedup, clones) a slot
+   of its own before it is changed, with the first copy_len bytes copied
+   over.  0, or -1 with errno set (ENOSPC when the disk is full). */
+static int file_unshare(file_meta_t *fm, int64_t copy_len) {
+    int64_t old = fm->start_block, start, at = 0, n;
+    char *buf = NULL;
 
-    offset = oe->start_block * BLOCK_SIZE + oe->current_pos;
-    if (offset < 0 || offset + to_read > DISK_SIZE) {
-      snprintf(msg, sizeof(msg), "Read offset out of range");
-      goto ret_msg;
+    start = allocate_blocks((int)((fm - file_table) / sb.max_files_user));
+    if (start < 0) {
+        errno = ENOSPC;
+        return -1;
     }
-    if (lseek(disk_fd, offset, SEEK_SET) < 0) {
-        perror("lseek read");
-        snprintf(msg, sizeof(msg), "Seek error");
-        goto ret_msg;
+    if (copy_len > 0 && (buf = malloc(COMPACT_CHUNK)) == NULL)
+        goto fail;
+    for (at = 0; at < copy_len; at += n) {
+        n = copy_len - at < COMPACT_CHUNK ? copy_len - at : COMPACT_CHUNK;
+        if (disk_read(buf, n, block_offset(old, at)) != n ||
+            disk_write(buf, n, block_offset(start, at)) != n)
+            goto fail;
     }
+    free(buf);
+    (*slot_ref(old))--;
+    fm->start_block = start;
+    file_touch(fm);
+    file_moved(fm, old, start);
+    cow_copies++;
+    return 0;
 
-    result.buffer.buffer_val = malloc(to_read);
-    if (result.buffer.buffer_val == NULL) {
-        snprintf(msg, sizeof(msg), "Read alloc failed");
-        goto ret_msg;
-    }
+fail:
+    free(buf);
+    free_blocks(start, at);
+    return -1;
+}
 
-    r = read(disk_fd, result.buffer.buffer_val, to_read);
-    if (r < 0) {
-        perror("read");
-        free(result.buffer.buffer_val);
+/* Another file with the same contents as buf (len bytes, fingerprint
+   fp) that fm (NULL for a new file) could share a slot with, or NULL.
+   Equal fingerprints are only a hint: the contents are compared before a
+   slot is shared. */
+static file_meta_t *dedup_find(file_meta_t *fm, u_int64_t fp, const char *buf, int len) {
+    file_meta_t *r;
+    char *cmp = NULL;
+    int i;
+
+    for (i = fp_bucket[fp & file_mask]; i != 0; i = fp_next[i - 1]) {
+        r = &file_table[i - 1];
+        if (r == fm || r->fingerprint != fp || r->size != len || r->start_block < 0)
+            continue;
+        if (fm && r->start_block == fm->start_block)
+            break;
+        if (cmp == NULL && (cmp = malloc(len)) == NULL)
+            return NULL;
+        if (file_pread(r, cmp, len, 0) == len &&
+            memcmp(cmp, buf, len) == 0)
+            break;
+    }
+    free(cmp);
+    return i != 0 ? &file_table[i - 1] : NULL;
+}
+
+/* drop a file: blocks, name index entry and slot */
+static void file_remove(file_meta_t *fm) {
+    file_index_del(fm);
+    fp_set(fm, 0);
+    free_blocks(fm->start_block, fm->size);
+    fm->start_block = -1;
+    fm->file_name[0] = '\0';
+    fm->flags = 0;
+    memset(fm->data, 0, VDISK_INLINE_MAX);
+    file_touch(fm);
+}
+
+/* Make fm, which has no data of its own, a clone of src: the record is
+   copied and the slot shared, so the first write to either file copies
+   it (file_unshare).  Inline data, the chunk map and a current digest
+   come with the record. */
+static void file_clone(file_meta_t *fm, const file_meta_t *src) {
+    fm->start_block = src->start_block;
+    fm->size = src->size;
+    fm->flags = src->flags & ~FILE_HASHED;
+    memcpy(fm->data, src->data, VDISK_INLINE_MAX);
+    if (fm->start_block >= 0)
+        (*slot_ref(fm->start_block))++;
+    fm->version++;
+    if ((src->flags & FILE_HASHED) && src->hash_version == src->version) {
+        memcpy(fm->hash, src->hash, HASH_SIZE);
+        fm->hash_version = fm->version;
+        fm->flags |= FILE_HASHED;
+    }
+    fp_set(fm, src->fingerprint);
+    file_touch(fm);
+}
+
+/* Snapshots are users named "user@snap" holding clones of the user's
+   files; no call changes them. */
+static int snap_user(const char *user) {
+    return memchr(user, '@', strnlen(user, USER_NAME_SIZE)) != NULL;
+}
+
+/* Make to's files clones of from's, taking or restoring a snapshot:
+   files from lacks are dropped, the others replaced. */
+static void user_clone(user_meta_t *to, user_meta_t *from) {
+    file_meta_t *files = user_files(to), *src = user_files(from), *fm;
+    int f, err;
+
+    for (f = 0; f < (int)sb.max_files_user; f++)
+        if (file_live(&files[f]) && find_file(from, files[f].file_name) == NULL)
+            file_remove(&files[f]);
+    for (f = 0; f < (int)sb.max_files_user; f++) {
+        if (!file_live(&src[f]))
+            continue;
+        if ((fm = find_file(to, src[f].file_name)) != NULL) {
+            fp_set(fm, 0);
+            free_blocks(fm->start_block, fm->size);
+        } else {
+            fm = create_file_meta(to, src[f].file_name, &err);
+            file_index_add(fm);
+        }
+        file_clone(fm, &src[f]);
+    }
+    to->dir_version++;
+    user_touch(to);
+}
+
+/* drop a user (a snapshot) with its files */
+static void user_remove(user_meta_t *u) {
+    file_meta_t *files = user_files(u);
+    int f;
+
+    for (f = 0; f < (int)sb.max_files_user; f++)
+        if (file_live(&files[f]))
+            file_remove(&files[f]);
+    user_index_del(u);
+    memset(u, 0, sizeof(*u));
+    user_touch(u);
+}
+
+/* a file of the user is open */
+static int user_busy(const user_meta_t *u) {
+    int i;
+    for (i = 0; i < MAX_OPEN_FILES; i++)
+        if (open_table[i].in_use &&
+            strncmp(open_table[i].user_name, u->user_name, USER_NAME_SIZE) == 0)
+            return 1;
+    return 0;
+}
+
+static void mark_blocks(u_int64_t start, u_int64_t n, int used) {
+    u_int64_t b, end;
+    u_int g;
+    for (b = start; b < start + n; b++) {
+        if (used)
+            block_map[b >> 6] |= 1ULL << (b & 63);
+        else
+            block_map[b >> 6] &= ~(1ULL << (b & 63));
+    }
+    if (used) free_count -= n;
+    else free_count += n;
+    for (g = block_group(start), b = start; b < start + n; g++, b = end) {
+        end = group_end(g) < start + n ? group_end(g) : start + n;
+        if (used) group_free[g] -= end - b;
+        else group_free[g] += end - b;
+    }
+    meta_touch(sb.bitmap_off + (start >> 6) * sizeof(u_int64_t),
+               (((start + n - 1) >> 6) - (start >> 6) + 1) * sizeof(u_int64_t));
+}
+
+/* First run of sb.blocks_per_file free blocks in [from, to), -1 if none.
+   Works a map word at a time: a run carried over from earlier words is
+   extended by the word's low free bits, runs inside a word are found by
+   and-ing the free bits with themselves shifted, and the word's high free
+   bits carry on into the next. */
+static int64_t find_free_run(u_int64_t from, u_int64_t to) {
+    u_int64_t need = sb.blocks_per_file, run = 0, wi, base, used, x, s;
+
+    for (wi = from >> 6; (base = wi << 6) < to; wi++) {
+        used = block_map[wi];
+        if (base < from) used |= (1ULL << (from - base)) - 1;
+        if (to - base < 64) used |= ~0ULL << (to - base);
+        if (used == ~0ULL) {
+            run = 0;
+            continue;
+        }
+        if (run + (used ? (u_int64_t)__builtin_ctzll(used) : 64) >= need)
+            return base - run;
+        if (need <= 64) {
+            x = ~used;
+            for (s = 1; s < need && x != 0; s++)
+                x &= x >> 1;
+            if (x != 0)
+                return base + __builtin_ctzll(x);
+        }
+        run = used ? (u_int64_t)__builtin_clzll(used) : run + 64;
+    }
+    return -1;
+}
+
+/* next fit within group g: search on from hint, then wrap around to the
+   group's start */
+static int64_t group_find(u_int g, u_int64_t hint) {
+    u_int64_t need = sb.blocks_per_file, from = group_start(g), to = group_end(g), wrap_end;
+    int64_t start;
+
+    if (group_free[g] < need) return -1;
+    if (hint < from || hint >= to) hint = from;
+    start = find_free_run(hint, to);
+    if (start < 0) {
+        wrap_end = hint + need - 1 < to ? hint + need - 1 : to;
+        start = find_free_run(from, wrap_end);
+    }
+    return start;
+}
+
+/* A slot for a file of user owner: in the owner's home group, after the
+   owner's last file there if there is room, else next fit in the group.
+   A full home group spills into the following groups; groups whose free
+   count is short of a slot are passed over without a look at the map. */
+static int64_t allocate_blocks(int owner) {
+    u_int64_t need = sb.blocks_per_file;
+    file_meta_t *files = file_table + (size_t)owner * sb.max_files_user;
+    u_int home = home_group(owner), g, i;
+    int64_t start = -1, near = -1;
+
+    if (free_count < need) return -1;
+    for (i = 0; i < sb.max_files_user; i++)
+        if (files[i].start_block > near && files[i].file_name[0] != '\0' &&
+            block_group(files[i].start_block) == home)
+            near = files[i].start_block;
+    for (i = 0; i < ngroups && start < 0; i++) {
+        g = (home + i) % ngroups;
+        start = group_find(g, i == 0 && near >= 0 ? near + need : group_hint[g]);
+    }
+    if (start < 0) return -1;
+    if (compact_dest >= 0 && start < compact_dest + (int64_t)need && compact_dest < start + (int64_t)need) {
+        /* the compactor was filling this slot: the move is given up and
+           the new owner gets the slot as it would any other, zeroed */
+        if (compact_copied > 0)
+            disk_punch(block_offset(compact_dest, 0), compact_copied);
+        compact_dest = -1;
+    }
+    mark_blocks(start, need, 1);
+    *slot_ref(start) = 1;
+    group_hint[block_group(start)] = start + need;
+    save_metadata();
+    return start;
+}
+
+/* Free a file's blocks.  The used bytes (its size, everything ever
+   written) are punched out, so the host storage goes and the next owner
+   of the blocks starts from zeros.  A slot other files still share only
+   loses a reference. */
+static void free_blocks(int64_t start_block, int64_t used) {
+    u_int64_t n = sb.blocks_per_file;
+    if (start_block < 0) return;
+    if (*slot_ref(start_block) > 1) {
+        (*slot_ref(start_block))--;
+        return;
+    }
+    *slot_ref(start_block) = 0;
+    if ((u_int64_t)start_block + n > sb.total_blocks)
+        n = sb.total_blocks - start_block;
+    if (used > 0)
+        disk_punch(block_offset(start_block, 0), used);
+    mark_blocks(start_block, n, 0);
+    save_metadata();
+}
+
+static open_entry_t *find_open_by_fd(int fd) {
+    int i;
+    for (i = 0; i < MAX_OPEN_FILES; i++) {
+        if (open_table[i].in_use && open_table[i].fd == fd)
+            return &open_table[i];
+    }
+    return NULL;
+}
+
+static open_entry_t *alloc_open_entry(void) {
+    int i;
+    for (i = 0; i < MAX_OPEN_FILES; i++) {
+        if (!open_table[i].in_use)
+            return &open_table[i];
+    }
+    return NULL;
+}
+
+/* metadata record of the file behind an open entry */
+static file_meta_t *open_entry_file(open_entry_t *oe) {
+    user_meta_t *u = find_user(oe->user_name);
+    if (!u) return NULL;
+    return find_file(u, oe->file_name);
+}
+
+/* clients are told apart by the address and port of their connection */
+static unsigned long long caller_id(struct svc_req *rqstp) {
+    struct sockaddr_in *sin;
+    if (rqstp == NULL || rqstp->rq_xprt == NULL) return 0;
+    sin = (struct sockaddr_in *)svc_getcaller(rqstp->rq_xprt);
+    if (sin == NULL) return 0;
+    return ((unsigned long long)ntohl(sin->sin_addr.s_addr) << 16) | ntohs(sin->sin_port);
+}
+
+static int lease_match(lease_t *l, const char *user, const char *fname) {
+    return strncmp(l->user_name, user, USER_NAME_SIZE) == 0 &&
+           strncmp(l->file_name, fname, FILE_NAME_SIZE) == 0;
+}
+
+/* Recall every lease on user/fname not held by me.  Returns the seconds
+   until the last of them expires, 0 when nothing conflicts. */
+static int lease_recall(const char *user, const char *fname, unsigned long long me) {
+    time_t now = time(NULL);
+    int i, left = 0;
+    for (i = 0; i < MAX_LEASES; i++) {
+        lease_t *l = &leases[i];
+        if (!l->in_use || l->holder == me || !lease_match(l, user, fname))
+            continue;
+        if (l->expires <= now) {
+            if (!l->recalled) l->in_use = 0;
+            continue;
+        }
+        if (!l->recalled) {
+            l->recalled = 1;
+            l->recall_until = l->expires + LEASE_SECS;
+        }
+        if ((int)(l->expires - now) > left)
+            left = (int)(l->expires - now);
+    }
+    return left;
+}
+
+/* the conflicting change went through, readers may lease again */
+static void lease_clear_recalls(const char *user, const char *fname) {
+    int i;
+    for (i = 0; i < MAX_LEASES; i++) {
+        if (leases[i].in_use && leases[i].recalled &&
+            lease_match(&leases[i], user, fname))
+            leases[i].in_use = 0;
+    }
+}
+
+/* lease_recall and lease_clear_recalls over all of a user's leases, on
+   the directory and every file */
+static int lease_recall_user(const char *user, unsigned long long me) {
+    int i, n, left = 0;
+    for (i = 0; i < MAX_LEASES; i++)
+        if (leases[i].in_use && strncmp(leases[i].user_name, user, USER_NAME_SIZE) == 0 &&
+            (n = lease_recall(user, leases[i].file_name, me)) > left)
+            left = n;
+    return left;
+}
+
+static void lease_clear_user(const char *user) {
+    int i;
+    for (i = 0; i < MAX_LEASES; i++)
+        if (leases[i].in_use && leases[i].recalled &&
+            strncmp(leases[i].user_name, user, USER_NAME_SIZE) == 0)
+            leases[i].in_use = 0;
+}
+
+/* report copies that dropped out of use since the last call */
+static void disk_check_copies(void) {
+    int c;
+
+    if (disk.down == disk_down_seen)
+        return;
+    for (c = 0; c < disk.copies; c++)
+        if ((disk.down & ~disk_down_seen) & 1u << c)
+            log_error("%s failed, continuing on %d of %d copies", copy_name(c),
+                      disk.copies - __builtin_popcount(disk.down), disk.copies);
+    disk_down_seen = disk.down;
+}
+
+/* Block sums: a write to the data area sums the blocks it touches,
+   reading back those it covers only in part, and writes the sum table's
+   blocks for them at once rather than at the next save_metadata, so a
+   crash of the server does not leave new data with old sums.  Reads of
+   the data area are checked a block at a time. */
+static int in_data(off_t offset) {
+    return checksums && offset >= (off_t)(sb.data_block * sb.block_size);
+}
+
+static u_int32_t block_sum(const char *block) {
+    u_int32_t c = crc32c(0, block, sb.block_size);
+    sum_blocks++;
+    return c ? c : 1;
+}
+
+/* "user/file" holding block b, for reports */
+static void block_owner(u_int64_t b, char *buf, int len) {
+    int64_t start = sb.data_block + (b - sb.data_block) / sb.blocks_per_file * sb.blocks_per_file;
+    int i, nfiles = sb.max_users * sb.max_files_user;
+
+    for (i = 0; i < nfiles; i++)
+        if (file_table[i].start_block == start && file_live(&file_table[i])) {
+            snprintf(buf, len, "%.*s/%.*s", USER_NAME_SIZE,
+                     users[i / sb.max_files_user].user_name, FILE_NAME_SIZE,
+                     file_table[i].file_name);
+            return;
+        }
+    snprintf(buf, len, "no file");
+}
+
+/* Block b read as data failed its sum: put the first copy that has it
+   right in data and on every copy.  0, or -1 with errno EIO. */
+static int sum_fix(u_int64_t b, char *data) {
+    char *good = malloc(sb.block_size), owner[64];
+    int c;
+
+    block_owner(b, owner, sizeof(owner));
+    for (c = 0; good != NULL && c < disk.copies; c++) {
+        if ((disk.down & 1u << c) ||
+            vdisk_pread_copy(&disk, c, good, sb.block_size, b * sb.block_size) != sb.block_size ||
+            block_sum(good) != block_sums[b])
+            continue;
+        memcpy(data, good, sb.block_size);
+        if (vdisk_pwrite(&disk, good, sb.block_size, b * sb.block_size) < 0)
+            log_error("rewrite block %llu: %s", (unsigned long long)b, strerror(errno));
+        log_warn("block %llu (%s) failed its checksum, repaired from %s",
+                 (unsigned long long)b, owner, copy_name(c));
+        free(good);
+        return 0;
+    }
+    log_error("block %llu (%s) failed its checksum on every copy", (unsigned long long)b, owner);
+    free(good);
+    errno = EIO;
+    return -1;
+}
+
+/* check n blocks from block b read into buf */
+static int sum_check(char *buf, u_int64_t b, u_int64_t n) {
+    u_int64_t i;
+
+    for (i = 0; i < n; i++) {
+        if (block_sums[b + i] == 0 || block_sum(buf + i * sb.block_size) == block_sums[b + i])
+            continue;
+        sum_errors++;
+        if (sum_fix(b + i, buf + i * sb.block_size) < 0)
+            return -1;
+        sum_repairs++;
+    }
+    return 0;
+}
+
+/* A checked read: block-aligned ones land in buf, others go through
+   sum_buf a piece at a time.  len, or -1 with errno set. */
+static ssize_t sum_read(char *buf, size_t len, off_t offset) {
+    off_t bs = sb.block_size, at, from, to, end = offset + len;
+    size_t n;
+
+    if (offset % bs == 0 && len % bs == 0)
+        return vdisk_pread(&disk, buf, len, offset) == (ssize_t)len &&
+               sum_check(buf, offset / bs, len / bs) == 0 ? (ssize_t)len : -1;
+    for (at = offset; at < end; at += n) {
+        from = at / bs * bs;
+        to = (end + bs - 1) / bs * bs;
+        if (to - from > SUM_BOUNCE)
+            to = from + SUM_BOUNCE;
+        n = (to < end ? to : end) - at;
+        if (vdisk_pread(&disk, sum_buf, to - from, from) != to - from ||
+            sum_check(sum_buf, from / bs, (to - from) / bs) < 0)
+            return -1;
+        memcpy(buf + (at - offset), sum_buf + (at - from), n);
+    }
+    return len;
+}
+
+/* write through the part of the sum table for blocks first..last */
+static void sum_write(u_int64_t first, u_int64_t last) {
+    u_int64_t bs = sb.block_size, from, to;
+
+    from = (sb.sums_off + first * sizeof(u_int32_t)) / bs;
+    to = (sb.sums_off + last * sizeof(u_int32_t)) / bs + 1;
+    if (disk_write(meta + from * bs, (to - from) * bs, from * bs) < 0)
+        log_error("write block sums: %s", strerror(errno));
+    memset(meta_dirty_blocks + from, 0, to - from);
+}
+
+/* After len bytes at offset were written from buf, or punched out if buf
+   is NULL: new sums for the blocks touched, written through. */
+static void sum_update(const char *buf, size_t len, off_t offset) {
+    u_int64_t bs = sb.block_size, b, first = offset / bs, last = (offset + len - 1) / bs;
+    off_t at;
+
+    for (b = first; b <= last; b++) {
+        at = b * bs;
+        if (at >= offset && at + bs <= offset + len)
+            block_sums[b] = buf ? block_sum(buf + (at - offset)) : 0;
+        else if (vdisk_pread(&disk, sum_buf, bs, at) == (ssize_t)bs)
+            block_sums[b] = block_sum(sum_buf);
+        else
+            block_sums[b] = 0;
+    }
+    sum_write(first, last);
+}
+
+/* Disk I/O goes through these so its time is charged to the current call. */
+static ssize_t disk_read(void *buf, size_t len, off_t offset) {
+    unsigned long long t0 = now_ns();
+    ssize_t r = in_data(offset) ? sum_read(buf, len, offset) : vdisk_pread(&disk, buf, len, offset);
+    cur_call.io_ns += now_ns() - t0;
+    disk_check_copies();
+    return r;
+}
+
+static ssize_t disk_write(const void *buf, size_t len, off_t offset) {
+    unsigned long long t0 = now_ns();
+    ssize_t w = vdisk_pwrite(&disk, buf, len, offset);
+    cur_call.io_ns += now_ns() - t0;
+    disk_check_copies();
+    if (w == (ssize_t)len && len > 0 && in_data(offset))
+        sum_update(buf, len, offset);
+    return w;
+}
+
+/* Copy whole blocks of the data area inside the image, from and to
+   block aligned.  The blocks take their sums along unchecked, so a bad
+   block is still caught (and repaired) wherever it was copied to. */
+static ssize_t disk_copy(off_t from, off_t to, size_t len) {
+    unsigned long long t0 = now_ns();
+    ssize_t w = vdisk_copy(&disk, from, to, len);
+    u_int64_t bs = sb.block_size;
+
+    cur_call.io_ns += now_ns() - t0;
+    disk_check_copies();
+    if (w == (ssize_t)len && len > 0 && in_data(to)) {
+        memmove(&block_sums[to / bs], &block_sums[from / bs], len / bs * sizeof(u_int32_t));
+        sum_write(to / bs, (to + len - 1) / bs);
+    }
+    return w;
+}
+
+static void disk_punch(off_t offset, u_int64_t len) {
+    unsigned long long t0 = now_ns();
+    if (vdisk_punch(&disk, offset, len) < 0)
+        log_warn("punch %llu bytes at %lld: %s", (unsigned long long)len, (long long)offset,
+                 strerror(errno));
+    cur_call.io_ns += now_ns() - t0;
+    if (len > 0 && in_data(offset))
+        sum_update(NULL, len, offset);
+}
+
+/* keep the encoded arguments of the current call for its trace record */
+static void trace_args(void *argp) {
+    const proc_info_t *pi = &ssnfs_procs[cur_call.proc];
+    write_input w;
+    put_input   p;
+    patch_input d;
+    import_input m;
+    u_int       need;
+    XDR         xdrs;
+
+    if (cur_call.proc == write_file) {
+        w = *(write_input *)argp;
+        cur_call.data_len = w.buffer.buffer_len;
+        if (!trace_payload) w.buffer.buffer_len = 0;
+        argp = &w;
+    } else if (cur_call.proc == put_file) {
+        p = *(put_input *)argp;
+        cur_call.data_len = p.buffer.buffer_len;
+        if (!trace_payload) p.buffer.buffer_len = 0;
+        argp = &p;
+    } else if (cur_call.proc == patch_file) {
+        d = *(patch_input *)argp;
+        cur_call.data_len = d.data.data_len;
+        if (!trace_payload) d.data.data_len = 0;
+        argp = &d;
+    } else if (cur_call.proc == import_home) {
+        m = *(import_input *)argp;
+        cur_call.data_len = m.data.data_len;
+        if (!trace_payload) m.data.data_len = 0;
+        argp = &m;
+    }
+    need = (u_int)xdr_sizeof(pi->xdr_arg, argp);
+    if (need > trace_cap) {
+        char *nb = realloc(trace_buf, need);
+        if (nb == NULL) return;
+        trace_buf = nb;
+        trace_cap = need;
+    }
+    xdrmem_create(&xdrs, trace_buf, need, XDR_ENCODE);
+    if ((*pi->xdr_arg)(&xdrs, argp))
+        cur_call.args_len = xdr_getpos(&xdrs);
+    xdr_destroy(&xdrs);
+}
+
+static void trace_call(unsigned long long t_end) {
+    trace_rec_t rec;
+
+    rec.proc = (u_int)cur_call.proc;
+    rec.conn = cur_call.conn;
+    rec.arrival = cur_call.t_start - trace_t0;
+    rec.service = t_end - cur_call.t_start;
+    rec.ret = cur_call.proc == open_file ? cur_call.ret : (cur_call.ok ? 1 : -1);
+    rec.data_len = cur_call.data_len;
+    rec.args.args_len = cur_call.args_len;
+    rec.args.args_val = trace_buf;
+    if (!xdr_trace_rec(&trace_xdr, &rec)) {
+        log_error("trace write failed, tracing stopped");
+        fclose(trace_fp);
+        trace_fp = NULL;
+        return;
+    }
+    /* buffered; at most 100 ms of calls are lost if the server is killed */
+    if (t_end - trace_flushed > 100000000ULL) {
+        fflush(trace_fp);
+        trace_flushed = t_end;
+    }
+}
+
+static void trace_open(const char *name) {
+    trace_hdr_t hdr;
+    struct timespec ts;
+
+    trace_fp = fopen(name, "w");
+    if (trace_fp == NULL) {
+        perror(name);
+        exit(1);
+    }
+    setvbuf(trace_fp, NULL, _IOFBF, 1 << 20);
+    xdrstdio_create(&trace_xdr, trace_fp, XDR_ENCODE);
+    clock_gettime(CLOCK_REALTIME, &ts);
+    hdr.magic = TRACE_MAGIC;
+    hdr.version = TRACE_VERSION;
+    hdr.flags = trace_payload ? TRACE_PAYLOAD : 0;
+    hdr.start = (u_int64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    trace_t0 = trace_flushed = now_ns();
+    if (!xdr_trace_hdr(&trace_xdr, &hdr) || fflush(trace_fp) != 0) {
+        perror(name);
+        exit(1);
+    }
+}
+
+/* every handler calls these first and last thing */
+static void call_enter(void *argp) {
+    cur_call.t_enter = now_ns();
+    if (trace_fp != NULL)
+        trace_args(argp);
+}
+
+static void call_leave(int ok, int bytes_in, int bytes_out) {
+    cur_call.t_leave = now_ns();
+    cur_call.ok = ok;
+    cur_call.bytes_in = bytes_in > 0 ? bytes_in : 0;
+    cur_call.bytes_out = bytes_out > 0 ? bytes_out : 0;
+}
+
+static void call_account(proc_stats_t *ps, unsigned long long t_end) {
+    call_t *c = &cur_call;
+    unsigned long long busy;
+
+    ps->calls++;
+    hist_record(&ps->total, t_end - c->t_start);
+    if (c->t_enter == 0) {
+        /* NULLPROC, or the arguments did not decode */
+        if (ps != &proc_stats[NULLPROC])
+            ps->errors++;
+        return;
+    }
+    if (c->t_leave == 0)
+        c->t_leave = t_end;
+    if (!c->ok)
+        ps->errors++;
+    ps->bytes_in += c->bytes_in;
+    ps->bytes_out += c->bytes_out;
+    busy = c->t_leave - c->t_enter;
+    hist_record(&ps->decode, c->t_enter - c->t_start);
+    hist_record(&ps->handler, busy > c->io_ns ? busy - c->io_ns : 0);
+    hist_record(&ps->io, c->io_ns);
+    hist_record(&ps->encode, t_end - c->t_leave);
+}
+
+/* Registered with svc_register() in place of the rpcgen dispatcher: one
+   call at a time, timed end to end. */
+static void ssnfs_dispatch(struct svc_req *rqstp, SVCXPRT *transp) {
+    unsigned long proc = (unsigned long)rqstp->rq_proc;
+
+    pthread_mutex_lock(&fs_lock);
+    memset(&cur_call, 0, sizeof(cur_call));
+    cur_call.t_start = now_ns();
+    cur_call.proc = proc;
+    if (trace_fp != NULL)
+        cur_call.conn = caller_id(rqstp);
+    ssnfsprog_1(rqstp, transp);
+    if (proc < NPROCS) {
+        unsigned long long t_end = now_ns();
+        call_account(&proc_stats[proc], t_end);
+        if (trace_fp != NULL && cur_call.t_enter != 0)
+            trace_call(t_end);
+    }
+    pthread_mutex_unlock(&fs_lock);
+}
+
+static int report_add(char *buf, int len, int at, const char *fmt, ...) {
+    va_list ap;
+    int n;
+    if (at >= len - 1) return at;
+    va_start(ap, fmt);
+    n = vsnprintf(buf + at, len - at, fmt, ap);
+    va_end(ap);
+    if (n < 0) return at;
+    return at + n < len ? at + n : len - 1;
+}
+
+static int report_hist(char *buf, int len, int at, const char *proc,
+                       const char *phase, const hist_t *h) {
+    if (h->count == 0) return at;
+    return report_add(buf, len, at,
+        "%s.%s_us mean %.1f p50 %.1f p90 %.1f p99 %.1f p999 %.1f max %.1f\n",
+        proc, phase, (double)h->sum / h->count / 1000.0,
+        hist_percentile(h, 0.50) / 1000.0, hist_percentile(h, 0.90) / 1000.0,
+        hist_percentile(h, 0.99) / 1000.0, hist_percentile(h, 0.999) / 1000.0,
+        h->max / 1000.0);
+}
+
+/* Text report of all counters; fs_lock must be held.  Returns its length. */
+static int stats_report(char *buf, int len) {
+    int i, at = 0, open_files = 0, held = 0, nfiles = sb.max_users * sb.max_files_user;
+    unsigned long long logical = 0;
+    double stored = 0;
+
+    for (i = 0; i < MAX_OPEN_FILES; i++)
+        if (open_table[i].in_use) open_files++;
+    for (i = 0; i < MAX_LEASES; i++)
+        if (leases[i].in_use) held++;
+    /* files sharing a slot are the same size, so each stores its share */
+    for (i = 0; i < nfiles; i++)
+        if (file_table[i].start_block >= 0 && file_table[i].file_name[0] != '\0') {
+            logical += file_table[i].size;
+            stored += (double)file_table[i].size / *slot_ref(file_table[i].start_block);
+        }
+
+    buf[0] = '\0';
+    at = report_add(buf, len, at, "uptime_s %ld\n", (long)(time(NULL) - stats_since));
+    at = report_add(buf, len, at, "open_files %d of %d\n", open_files, MAX_OPEN_FILES);
+    at = report_add(buf, len, at, "free_blocks %llu of %llu\n", (unsigned long long)free_count,
+                    (unsigned long long)(sb.total_blocks - sb.data_block));
+    at = report_add(buf, len, at, "leases %d of %d\n", held, MAX_LEASES);
+    at = report_add(buf, len, at, "host_bytes %llu\n", (unsigned long long)vdisk_usage(&disk));
+    at = report_add(buf, len, at, "disk_copies %d of %d reads", disk.copies - __builtin_popcount(disk.down),
+                    disk.copies);
+    for (i = 0; i < disk.copies; i++)
+        at = report_add(buf, len, at, " %llu", (unsigned long long)disk.reads[i]);
+    at = report_add(buf, len, at, "\n");
+    /* the server keeps no data cache; lease grants are what lets client
+       caches answer without asking */
+    at = report_add(buf, len, at, "lease_grants %llu denials %llu\n", lease_grants, lease_denials);
+    at = report_add(buf, len, at, "log_dropped %llu\n", log_dropped());
+    at = report_add(buf, len, at, "compact_moves %llu bytes %llu aborts %llu\n",
+                    compact_moves, compact_bytes, compact_aborts);
+    at = report_add(buf, len, at, "dedup %s hits %llu misses %llu cow_copies %llu avg_us %.1f\n",
+                    dedup ? "on" : "off", dedup_hits, dedup_misses, cow_copies,
+                    dedup_hits + dedup_misses ? dedup_ns / 1e3 / (dedup_hits + dedup_misses) : 0.0);
+    at = report_add(buf, len, at, "dedup_bytes logical %llu stored %.0f ratio %.2f\n",
+                    logical, stored, stored > 0 ? logical / stored : 1.0);
+    at = report_add(buf, len, at, "clones %llu snapshots taken %llu restored %llu\n",
+                    clones, snapshots_taken, snapshots_restored);
+    at = report_add(buf, len, at, "copy_range calls %llu bytes %llu in_image %llu\n",
+                    copy_calls, copy_bytes, copy_kernel_bytes);
+    at = report_add(buf, len, at, "search calls %llu bytes %llu matches %llu redone %llu "
+                    "threads %d memfind %s\n", search_calls, search_bytes, search_matches,
+                    search_redone, search_nthreads(), memfind_impl());
+    at = report_add(buf, len, at, "hash calls %llu bytes %llu cached %llu blake2bp %s\n",
+                    hash_calls, hash_bytes, hash_cached, blake2bp_impl());
+    at = report_add(buf, len, at, "delta signs %llu signed_bytes %llu patches %llu literal %llu "
+                    "written %llu in_place %llu\n", sign_calls, sign_bytes, patch_calls,
+                    patch_literal, patch_written, patch_in_place);
+    at = report_add(buf, len, at, "export calls %llu bytes %llu crc_redone %llu import calls %llu "
+                    "bytes %llu files %llu skipped %llu\n", export_calls, export_bytes, export_recrc,
+                    import_calls, import_bytes, import_files, import_skipped);
+    at = report_add(buf, len, at, "compress %s chunk_kb %llu stored %llu packed %llu "
+                    "bytes_in %llu bytes_out %llu ratio %.2f mb_per_sec %.1f\n",
+                    compress ? "on" : "off", (unsigned long long)(chunk_size >> 10), z_chunks,
+                    z_packed, z_in, z_out, z_out ? (double)z_in / z_out : 1.0,
+                    z_ns ? z_in * 1e3 / z_ns : 0.0);
+    at = report_add(buf, len, at, "decompress chunks %llu bytes %llu mb_per_sec %.1f\n",
+                    unz_chunks, unz_bytes, unz_ns ? unz_bytes * 1e3 / unz_ns : 0.0);
+    at = report_add(buf, len, at, "checksums crc32c %s blocks %llu errors %llu repaired %llu "
+                    "meta_errors %llu meta_repaired %llu\n", crc32c_impl(), sum_blocks,
+                    sum_errors, sum_repairs, meta_errors, meta_repairs);
+    at = report_add(buf, len, at, "scrub %s budget_kbps %llu passes %llu bytes %llu errors %llu "
+                    "repaired %llu\n", scrub_budget ? "on" : "off",
+                    (unsigned long long)(scrub_budget >> 10), scrub_passes, scrub_bytes,
+                    scrub_errors, scrub_repairs);
+    for (i = 0; i < NPROCS; i++) {
+        proc_stats_t *ps = &proc_stats[i];
+        const char *name = ssnfs_procs[i].name;
+        if (ps->calls == 0) continue;
+        at = report_add(buf, len, at, "%s calls %llu errors %llu bytes_in %llu bytes_out %llu\n",
+                        name, ps->calls, ps->errors, ps->bytes_in, ps->bytes_out);
+        at = report_hist(buf, len, at, name, "total", &ps->total);
+        at = report_hist(buf, len, at, name, "decode", &ps->decode);
+        at = report_hist(buf, len, at, name, "handler", &ps->handler);
+        at = report_hist(buf, len, at, name, "io", &ps->io);
+        at = report_hist(buf, len, at, name, "encode", &ps->encode);
+    }
+    return at;
+}
+
+static void stats_reset(void) {
+    memset(proc_stats, 0, sizeof(proc_stats));
+    lease_grants = lease_denials = 0;
+    compact_moves = compact_bytes = compact_aborts = 0;
+    dedup_hits = dedup_misses = dedup_ns = cow_copies = 0;
+    clones = snapshots_taken = snapshots_restored = 0;
+    copy_calls = copy_bytes = copy_kernel_bytes = 0;
+    search_calls = search_bytes = search_matches = search_redone = 0;
+    hash_calls = hash_bytes = hash_cached = 0;
+    sign_calls = sign_bytes = patch_calls = patch_literal = patch_written = patch_in_place = 0;
+    export_calls = export_bytes = export_recrc = 0;
+    import_calls = import_bytes = import_files = import_skipped = 0;
+    z_chunks = z_packed = z_in = z_out = z_ns = 0;
+    unz_chunks = unz_bytes = unz_ns = 0;
+    sum_blocks = sum_errors = sum_repairs = 0;
+    scrub_passes = scrub_bytes = scrub_errors = scrub_repairs = 0;
+    memset(disk.reads, 0, sizeof(disk.reads));
+    stats_since = time(NULL);
+}
+
+/* -s FILE: append a report every stats_interval seconds */
+static void *stats_dumper(void *unused) {
+    char  *buf = malloc(STATS_REPORT);
+    FILE  *f;
+    time_t now;
+
+    if (buf == NULL) return NULL;
+    for (;;) {
+        sleep(stats_interval);
+        pthread_mutex_lock(&fs_lock);
+        stats_report(buf, STATS_REPORT);
+        pthread_mutex_unlock(&fs_lock);
+        f = fopen(stats_file, "a");
+        if (f == NULL) {
+            log_error("%s: %s", stats_file, strerror(errno));
+            continue;
+        }
+        now = time(NULL);
+        fprintf(f, "# %s%s\n", ctime(&now), buf);
+        fclose(f);
+    }
+    return NULL;
+}
+
+/* the lowest free slot of every group, for compact_target() */
+static void compact_scan(void) {
+    u_int g;
+    for (g = 0; g < ngroups; g++)
+        group_lowest[g] = group_free[g] < sb.blocks_per_file ? -1 :
+                          find_free_run(group_start(g), group_end(g));
+}
+
+/* Where the compactor moves file fm, -1 if it stays: into its owner's
+   home group if it spilled out of it and there is room there now, else
+   down into the lowest free slot of its group.  A slot shared by several
+   owners (dedup) has no one home and stays in its group. */
+static int64_t compact_target(file_meta_t *fm) {
+    u_int home = home_group((int)((fm - file_table) / sb.max_files_user));
+    u_int g = block_group(fm->start_block);
+
+    if (g != home && group_lowest[home] >= 0 && *slot_ref(fm->start_block) == 1)
+        return group_lowest[home];
+    if (group_lowest[g] >= 0 && group_lowest[g] < fm->start_block)
+        return group_lowest[g];
+    return -1;
+}
+
+/* Free space report for the defrag call; fs_lock must be held.  Files
+   only ever take whole slots of sb.blocks_per_file blocks, so free space
+   is lost to fragmentation only in runs shorter than a slot (stranded);
+   what compaction buys is every file in its home group, packed at the
+   group's start, and each group's free space in one run after its files.
+   Returns the report's length. */
+static int compact_report(char *buf, int len) {
+    u_int64_t b, w, run = 0, runs = 0, largest = 0, slots = 0;
+    int i, at = 0, files = 0, inlined = 0, away = 0, above = 0;
+    int nfiles = sb.max_users * sb.max_files_user;
+
+    /* free runs, a map word at a time where it is all free or all used */
+    for (b = sb.data_block; b <= sb.total_blocks; b++) {
+        w = b < sb.total_blocks ? block_map[b >> 6] : ~0ULL;
+        if ((b & 63) == 0 && b + 64 <= sb.total_blocks && w == 0) {
+            run += 64;
+            b += 63;
+            continue;
+        }
+        if (b < sb.total_blocks && !(w >> (b & 63) & 1)) {
+            run++;
+            continue;
+        }
+        if (run > 0) {
+            runs++;
+            slots += run / sb.blocks_per_file;
+            if (run > largest) largest = run;
+            run = 0;
+        }
+        if ((b & 63) == 0 && b + 64 <= sb.total_blocks && w == ~0ULL)
+            b += 63;
+    }
+    compact_scan();
+    for (i = 0; i < nfiles; i++) {
+        if (file_live(&file_table[i]) && file_table[i].start_block < 0)
+            inlined++;
+        if (file_table[i].start_block < 0 || file_table[i].file_name[0] == '\0')
+            continue;
+        files++;
+        if (block_group(file_table[i].start_block) != home_group(i / (int)sb.max_files_user))
+            away++;
+        if (compact_target(&file_table[i]) >= 0)
+            above++;
+    }
+
+    buf[0] = '\0';
+    at = report_add(buf, len, at, "free_blocks %llu of %llu\n", (unsigned long long)free_count,
+                    (unsigned long long)(sb.total_blocks - sb.data_block));
+    at = report_add(buf, len, at, "free_runs %llu largest %llu\n", runs, largest);
+    at = report_add(buf, len, at, "file_slots %llu stranded_blocks %llu\n", slots,
+                    (unsigned long long)free_count - slots * sb.blocks_per_file);
+    at = report_add(buf, len, at, "groups %u of %llu blocks\n", ngroups,
+                    (unsigned long long)group_blocks);
+    at = report_add(buf, len, at, "files %d away_from_home %d misplaced %d%s\n", files, away,
+                    above, above == 0 ? " packed" : "");
+    at = report_add(buf, len, at, "inline_files %d\n", inlined);
+    at = report_add(buf, len, at, "compactor %s budget_kbps %llu\n",
+                    !compact_running ? "stopped" : compact_stop ? "stopping" :
+                    compact_idle ? "idle" : "running",
+                    (unsigned long long)(compact_budget >> 10));
+    at = report_add(buf, len, at, "compact_moves %llu bytes %llu aborts %llu\n",
+                    compact_moves, compact_bytes, compact_aborts);
+    return at;
+}
+
+/* sleep off n bytes of I/O at budget bytes per second; *due is the
+   caller's, the time its I/O so far is paid off */
+static void io_throttle(int64_t n, u_int64_t budget, unsigned long long *due) {
+    unsigned long long now = now_ns();
+    struct timespec ts;
+
+    if (budget == 0)
+        return;
+    if (*due < now)
+        *due = now;
+    *due += (unsigned long long)n * 1000000000ULL / budget;
+    if (*due > now) {
+        ts.tv_sec = (*due - now) / 1000000000ULL;
+        ts.tv_nsec = (*due - now) % 1000000000ULL;
+        nanosleep(&ts, NULL);
+    }
+}
+
+/* Move the file placed highest on the disk of those compact_target()
+   finds a better slot for.  Its used bytes are copied COMPACT_CHUNK at a
+   time, fs_lock dropped in between so calls go on meanwhile; the move is
+   given up if the file changes or the slot is allocated before it
+   completes.  The copy is synced before the file table points at it, and
+   the old blocks are freed only once that is saved.  Open entries follow
+   the file.  Called and returns with fs_lock held: 1 if a file moved, 0
+   if there was nothing to move, -1 if the move was given up. */
+static int compact_move(char *buf) {
+    file_meta_t *fm = NULL;
+    char name[FILE_NAME_SIZE];
+    int64_t s = -1, dest, size, n;
+    u_int version;
+    int i, nfiles = sb.max_users * sb.max_files_user;
+
+    compact_scan();
+    for (i = 0; i < nfiles; i++)
+        if (file_table[i].start_block > s && file_table[i].file_name[0] != '\0' &&
+            compact_target(&file_table[i]) >= 0) {
+            fm = &file_table[i];
+            s = fm->start_block;
+        }
+    if (fm == NULL)
+        return 0;
+    dest = compact_target(fm);
+
+    memcpy(name, fm->file_name, FILE_NAME_SIZE);
+    version = fm->version;
+    size = fm->size;
+    compact_dest = dest;
+    compact_copied = 0;
+    while (compact_copied < size) {
+        u_int64_t budget = compact_budget;
+        n = size - compact_copied < COMPACT_CHUNK ? size - compact_copied : COMPACT_CHUNK;
+        if (disk_read(buf, n, block_offset(s, compact_copied)) != n ||
+            disk_write(buf, n, block_offset(dest, compact_copied)) != n) {
+            log_error("compact: copy block %lld to %lld: %s", (long long)s, (long long)dest,
+                      strerror(errno));
+            goto give_up;
+        }
+        compact_copied += n;
+        compact_bytes += n;
+        pthread_mutex_unlock(&fs_lock);
+        io_throttle(n, budget, &compact_due);
+        pthread_mutex_lock(&fs_lock);
+        if (compact_dest != dest || fm->start_block != s || fm->version != version ||
+            strncmp(fm->file_name, name, FILE_NAME_SIZE) != 0)
+            goto give_up;
+        if (compact_stop)
+            goto give_up;
+    }
+    if (size > 0 && vdisk_sync(&disk) < 0) {
+        log_error("compact: sync: %s", strerror(errno));
+        goto give_up;
+    }
+
+    /* files sharing the slot (dedup) move with it */
+    mark_blocks(dest, sb.blocks_per_file, 1);
+    for (i = 0; i < nfiles; i++)
+        if (file_table[i].start_block == s) {
+            file_table[i].start_block = dest;
+            file_touch(&file_table[i]);
+            file_moved(&file_table[i], s, dest);
+        }
+    *slot_ref(dest) = *slot_ref(s);
+    *slot_ref(s) = 1;
+    save_metadata();
+    compact_dest = -1;
+    free_blocks(s, size);
+    compact_moves++;
+    log_debug("compact: %s from block %lld to %lld", name, (long long)s, (long long)dest);
+    return 1;
+
+give_up:
+    if (compact_dest == dest) {
+        if (compact_copied > 0)
+            disk_punch(block_offset(dest, 0), compact_copied);
+        compact_dest = -1;
+    }
+    if (!compact_stop)
+        compact_aborts++;
+    return -1;
+}
+
+/* the compactor: packs files until stopped, looking again every
+   COMPACT_IDLE seconds once there is nothing to move */
+static void *compactor(void *unused) {
+    char *buf = malloc(COMPACT_CHUNK);
+
+    pthread_mutex_lock(&fs_lock);
+    while (buf != NULL && !compact_stop) {
+        if (compact_move(buf) > 0)
+            continue;
+        compact_idle = 1;
+        pthread_mutex_unlock(&fs_lock);
+        sleep(COMPACT_IDLE);
+        pthread_mutex_lock(&fs_lock);
+        compact_idle = 0;
+    }
+    if (buf == NULL)
+        log_error("compact: alloc failed");
+    compact_running = 0;
+    pthread_mutex_unlock(&fs_lock);
+    free(buf);
+    return NULL;
+}
+
+/* start the compactor, or change the budget of the running one; fs_lock
+   must be held.  0, or -1 with errno set. */
+static int compact_start(u_int64_t budget) {
+    pthread_t th;
+    int err;
+
+    compact_budget = budget;
+    compact_stop = 0;
+    if (compact_running)
+        return 0;
+    if ((err = pthread_create(&th, NULL, compactor, NULL)) != 0) {
+        errno = err;
+        return -1;
+    }
+    pthread_detach(th);
+    compact_running = 1;
+    return 0;
+}
+
+/* Check the next stretch of the image, up to SCRUB_CHUNK bytes, on every
+   copy in use: metadata blocks against the tables in memory (those not
+   changed since the last save), data blocks against their sums, skipping
+   blocks that have none.  A bad metadata block is rewritten from memory,
+   a bad data block from a copy that has it right.  Called with fs_lock
+   held; returns the bytes read.  scrub_next wraps to 0 after a pass. */
+static u_int64_t scrub_step(char *buf) {
+    u_int64_t bs = sb.block_size, b = scrub_next, end, i, n, done = 0;
+    char *p;
+    int c, bad;
+
+    if (b >= sb.data_block)
+        while (b < sb.total_blocks && block_sums[b] == 0)
+            b++;
+    end = b + SCRUB_CHUNK / bs;
+    if (b < sb.data_block && end > sb.data_block)
+        end = sb.data_block;
+    if (end > sb.total_blocks)
+        end = sb.total_blocks;
+    n = (end - b) * bs;
+    for (c = 0; c < disk.copies && n > 0; c++) {
+        if (disk.down & 1u << c)
+            continue;
+        if (vdisk_pread_copy(&disk, c, buf, n, b * bs) != (ssize_t)n) {
+            log_error("scrub: read %llu bytes at block %llu of %s: %s", (unsigned long long)n,
+                      (unsigned long long)b, copy_name(c), strerror(errno));
+            continue;
+        }
+        done += n;
+        for (i = b; i < end; i++) {
+            p = buf + (i - b) * bs;
+            if (i < sb.data_block)
+                bad = !meta_dirty_blocks[i] && memcmp(p, meta + i * bs, bs) != 0;
+            else
+                bad = block_sums[i] != 0 && block_sum(p) != block_sums[i];
+            if (!bad)
+                continue;
+            scrub_errors++;
+            if (i < sb.data_block) {
+                log_warn("scrub: metadata block %llu differs on %s, rewritten",
+                         (unsigned long long)i, copy_name(c));
+                if (disk_write(meta + i * bs, bs, i * bs) == (ssize_t)bs)
+                    scrub_repairs++;
+            } else if (sum_fix(i, p) == 0) {
+                scrub_repairs++;
+            }
+        }
+    }
+    scrub_bytes += done;
+    scrub_next = end;
+    if (end == sb.total_blocks) {
+        scrub_passes++;
+        scrub_next = 0;
+    }
+    return done;
+}
+
+static void *scrubber(void *unused) {
+    char *buf = malloc(SCRUB_CHUNK);
+    u_int64_t n;
+    int wrapped;
+
+    if (buf == NULL) {
+        log_error("scrub: alloc failed");
+        return NULL;
+    }
+    for (;;) {
+        pthread_mutex_lock(&fs_lock);
+        n = scrub_step(buf);
+        wrapped = scrub_next == 0;
+        pthread_mutex_unlock(&fs_lock);
+        io_throttle(n, scrub_budget, &scrub_due);
+        if (wrapped)
+            sleep(SCRUB_IDLE);
+    }
+    return NULL;
+}
+
+/* RPC implementations */
+
+open_output *open_file_1_svc(open_input *argp, struct svc_req *rqstp) {
+    static open_output result;
+    user_meta_t *u;
+    file_meta_t *fm;
+    open_entry_t *oe;
+    char msg[128];
+    call_enter(argp);
+    log_debug("open_file user=%s file=%s", argp->user_name, argp->file_name);
+    memset(&result, 0, sizeof(result));
+    if (disk.members == 0) {
+        init_disk();
+    }
+    result.fd = -1;
+
+    u = find_user(argp->user_name);
+    if (!u) {
+        snprintf(msg, sizeof(msg), "User directory not found");
+        goto ret_err;
+    }
+    fm = find_file(u, argp->file_name);
+    if (!fm || !file_live(fm)) {
+        snprintf(msg, sizeof(msg), "File not found");
+        goto ret_err;
+    }
+    oe = alloc_open_entry();
+    if (!oe) {
+        snprintf(msg, sizeof(msg), "Open file table full");
+        goto ret_err;
+    }
+    oe->in_use = 1;
+    oe->fd = next_fd++;
+    strncpy(oe->user_name, argp->user_name, USER_NAME_SIZE);
+    strncpy(oe->file_name, argp->file_name, FILE_NAME_SIZE);
+    oe->start_block = fm->start_block;
+    oe->current_pos = 0;
+    oe->owner = caller_id(rqstp);
+    oe->wrote = 0;
+
+    result.fd = oe->fd;
+    snprintf(msg, sizeof(msg), "File opened");
+
+ret_err:
+    if (result.out_msg.out_msg_val != NULL) {
+        free(result.out_msg.out_msg_val);
+    }
+    result.out_msg.out_msg_len = strlen(msg) + 1;
+    result.out_msg.out_msg_val = strdup(msg);
+    cur_call.ret = result.fd;
+    call_leave(result.fd >= 0, 0, 0);
+    return &result;
+}
+
+read_output *read_file_1_svc(read_input *argp, struct svc_req *rqstp) {
+    static read_output result;
+    open_entry_t *oe;
+    file_meta_t *fm;
+    char msg[128];
+    int64_t maxsize = file_max_size(), written;
+    int to_read, on_disk, in_record;
+    off_t offset;
+    ssize_t r;
+    call_enter(argp);
+    log_debug("read_file user=%s fd=%d numbytes=%d",
+              argp->user_name, argp->fd, argp->numbytes);
+    memset(&result, 0, sizeof(result));
+    if (disk.members == 0) {
+        init_disk();
+    }
+    result.success = -1;
+
+    oe = find_open_by_fd(argp->fd);
+    if (!oe) {
+        snprintf(msg, sizeof(msg), "Invalid file descriptor");
+        goto ret_msg;
+    }
+    if (argp->numbytes <= 0) {
+        snprintf(msg, sizeof(msg), "Nothing to read");
+        goto ret_msg;
+    }
+    if (oe->current_pos >= maxsize) {
+        snprintf(msg, sizeof(msg), "End of file");
+        goto ret_msg;
+    }
+
+    if (oe->current_pos + argp->numbytes > maxsize)
+        to_read = maxsize - oe->current_pos;
+    else
+        to_read = argp->numbytes;
+
+    in_record = oe->start_block < 0;
+    offset = in_record ? 0 : block_offset(oe->start_block, oe->current_pos);
+    if (offset < 0 || offset + to_read > (off_t)sb.disk_size) {
+      snprintf(msg, sizeof(msg), "Read offset out of range");
+      goto ret_msg;
+    }
+
+    result.buffer.buffer_val = malloc(to_read);
+    if (result.buffer.buffer_val == NULL) {
+        snprintf(msg, sizeof(msg), "Read alloc failed");
+        goto ret_msg;
+    }
+
+    /* Nothing past the file's size was ever written: it reads as zeros
+       without touching the disk.  A deleted file (the name gone or
+       reused) still reads from its old blocks.  An inline file is copied
+       out of its record, no disk I/O at all. */
+    fm = open_entry_file(oe);
+    if (in_record)
+        written = fm && (fm->flags & FILE_INLINE) ? fm->size : 0;
+    else
+        written = fm && fm->start_block == oe->start_block ? fm->size : maxsize;
+    on_disk = oe->current_pos >= written ? 0 :
+              written - oe->current_pos < to_read ? (int)(written - oe->current_pos) : to_read;
+    if (in_record) {
+        if (on_disk > 0)
+            memcpy(result.buffer.buffer_val, fm->data + oe->current_pos, on_disk);
+        r = on_disk;
+    } else if (on_disk > 0 && fm && fm->start_block == oe->start_block) {
+        r = file_pread(fm, result.buffer.buffer_val, on_disk, oe->current_pos);
+    } else {
+        r = on_disk > 0 ? disk_read(result.buffer.buffer_val, on_disk, offset) : 0;
+    }
+    if (r < 0) {
+        log_error("read: %s", strerror(errno));
+        free(result.buffer.buffer_val);
+        result.buffer.buffer_val = NULL;
+        snprintf(msg, sizeof(msg), "Read error");
+        goto ret_msg;
+    }
+    if (r < to_read) {
+        memset(result.buffer.buffer_val + r, 0, to_read - r);
+        r = to_read;
+    }
+
+    result.buffer.buffer_len = (u_int)r;
+    oe->current_pos += r;
+    result.success = 1;
+    snprintf(msg, sizeof(msg), "Read ok");
+
+ret_msg:
+    if (result.out_msg.out_msg_val != NULL) {
+        free(result.out_msg.out_msg_val);
+    }
+    result.out_msg.out_msg_len = strlen(msg) + 1;
+    result.out_msg.out_msg_val = strdup(msg);
+    call_leave(result.success == 1, 0, result.buffer.buffer_len);
+    return &result;
+}
+
+write_output *write_file_1_svc(write_input *argp, struct svc_req *rqstp) {
+    static write_output result;
+    open_entry_t *oe;
+    file_meta_t *fm;
+    char msg[128];
+    int64_t maxsize = file_max_size();
+    int to_write, left;
+    off_t offset;
+    ssize_t w;
+    call_enter(argp);
+    log_debug("write_file user=%s fd=%d numbytes=%d", argp->user_name, argp->fd, argp->numbytes);
+    memset(&result, 0, sizeof(result));
+    if (disk.members == 0) {
+        init_disk();
+    }
+    result.success = -1;
+    
+    oe = find_open_by_fd(argp->fd);
+    if (!oe) {
+        snprintf(msg, sizeof(msg), "Invalid file descriptor");
+        goto ret_err;
+    }
+    if (argp->numbytes <= 0 || argp->buffer.buffer_val == NULL) {
+        snprintf(msg, sizeof(msg), "Nothing to write");
+        goto ret_err;
+    }
+    if (snap_user(oe->user_name)) {
+        snprintf(msg, sizeof(msg), "Snapshots are read-only");
+        goto ret_err;
+    }
+
+    if (oe->current_pos + argp->numbytes > maxsize)
+        to_write = maxsize - oe->current_pos;
+    else
+        to_write = argp->numbytes;
+
+    if (to_write <= 0) {
+        snprintf(msg, sizeof(msg), "No space left in file");
+        goto ret_err;
+    }
+
+    left = lease_recall(oe->user_name, oe->file_name, caller_id(rqstp));
+    if (left > 0) {
+        result.success = RETRY_LATER;
+        snprintf(msg, sizeof(msg), "File leased by another client, retry in %d s", left);
+        goto ret_err;
+    }
+
+    /* an inline file takes the write in its record while it fits, and
+       moves to blocks of its own when it no longer does */
+    fm = open_entry_file(oe);
+    if (oe->start_block < 0 && fm && (fm->flags & FILE_INLINE)) {
+        if (oe->current_pos + to_write <= VDISK_INLINE_MAX) {
+            memcpy(fm->data + oe->current_pos, argp->buffer.buffer_val, to_write);
+            w = to_write;
+            goto written;
+        }
+        if (file_promote(fm) < 0) {
+            if (errno != ENOSPC)
+                log_error("write promote: %s", strerror(errno));
+            snprintf(msg, sizeof(msg), errno == ENOSPC ? "No space on disk" : "Write error");
+            goto ret_err;
+        }
+    } else if (fm && fm->start_block >= 0 && *slot_ref(fm->start_block) > 1 &&
+               file_unshare(fm, fm->size) < 0) {
+        if (errno != ENOSPC)
+            log_error("write unshare: %s", strerror(errno));
+        snprintf(msg, sizeof(msg), errno == ENOSPC ? "No space on disk" : "Write error");
+        goto ret_err;
+    }
+
+    offset = block_offset(oe->start_block, oe->current_pos);
+    log_debug("write_file offset=%lld to_write=%d", (long long)offset, to_write);
+    if (offset < 0 || offset + to_write > (off_t)sb.disk_size) {
+     snprintf(msg, sizeof(msg), "Write offset out of range");
+     goto ret_err;
+    }
+    if (fm && fm->start_block == oe->start_block && file_chunked(fm))
+        w = file_pwrite(fm, argp->buffer.buffer_val, to_write, oe->current_pos);
+    else
+        w = disk_write(argp->buffer.buffer_val, to_write, offset);
+    if (w < 0) {
+        log_error("write: %s", strerror(errno));
+        snprintf(msg, sizeof(msg), "Write error");
+        goto ret_err;
+    }
+
+written:
+    oe->current_pos += w;
+    if (!oe->wrote) {
+        oe->wrote = 1;
+        lease_clear_recalls(oe->user_name, oe->file_name);
+    }
+    if (fm) {
+        if (oe->current_pos > fm->size)
+            fm->size = oe->current_pos;
+        fp_set(fm, 0);
+        fm->version++;
+        file_touch(fm);
+        meta_dirty = 1;
+    }
+    result.success = 1;
+    snprintf(msg, sizeof(msg), "Write ok (%ld bytes)", (long)w);
+
+ret_err:
+    if (result.out_msg.out_msg_val != NULL) {
+        free(result.out_msg.out_msg_val);
+    }
+    result.out_msg.out_msg_len = strlen(msg) + 1;
+    result.out_msg.out_msg_val = strdup(msg);
+    call_leave(result.success == 1, result.success == 1 ? (int)w : 0, 0);
+    return &result;
+}
+
+list_output *list_files_1_svc(list_input *argp, struct svc_req *rqstp) {
+    static list_output result;
+    user_meta_t *u;
+    char *buf;
+    file_meta_t *files;
+    size_t sz;
+    int i;
+
+    call_enter(argp);
+    memset(&result, 0, sizeof(result));
+    if (disk.members == 0) {
+        init_disk();
+    }
+
+    u = find_user(argp->user_name);
+    if (!u) {
+        const char *msg = "User directory empty\n";
+        if (result.out_msg.out_msg_val != NULL) {
+            free(result.out_msg.out_msg_val);
+        }
+        result.out_msg.out_msg_len = strlen(msg) + 1;
+        result.out_msg.out_msg_val = strdup(msg);
+        call_leave(1, 0, 0);
+        return &result;
+    }
+
+    buf = malloc(sb.max_files_user * FILE_NAME_SIZE + 1);
+    if (buf == NULL) {
+        const char *msg = "List alloc failed\n";
+        if (result.out_msg.out_msg_val != NULL) {
+            free(result.out_msg.out_msg_val);
+        }
+        result.out_msg.out_msg_len = strlen(msg) + 1;
+        result.out_msg.out_msg_val = strdup(msg);
+        call_leave(0, 0, 0);
+        return &result;
+    }
+    buf[0] = '\0';
+
+    files = user_files(u);
+    for (i = 0; i < (int)sb.max_files_user; i++) {
+        if (file_live(&files[i])) {
+            strcat(buf, files[i].file_name);
+            strcat(buf, "\n");
+        }
+    }
+
+    sz = strlen(buf) + 1;
+    if (result.out_msg.out_msg_val != NULL) {
+        free(result.out_msg.out_msg_val);
+    }
+    result.out_msg.out_msg_len = sz;
+    result.out_msg.out_msg_val = buf;
+    call_leave(1, 0, 0);
+    return &result;
+}
+
+delete_output *delete_file_1_svc(delete_input *argp, struct svc_req *rqstp) {
+    static delete_output result;
+    user_meta_t *u;
+    file_meta_t *fm;
+    char msg[128];
+    int i, left;
+    unsigned long long me = caller_id(rqstp);
+
+    call_enter(argp);
+    if (result.out_msg.out_msg_val != NULL) {
+        free(result.out_msg.out_msg_val);
+    }
+    memset(&result, 0, sizeof(result));
+    if (disk.members == 0) {
+        init_disk();
+    }
+    result.success = -1;
+
+    if (snap_user(argp->user_name)) {
+        snprintf(msg, sizeof(msg), "Snapshots are read-only");
+        goto ret_done;
+    }
+    u = find_user(argp->user_name);
+    if (!u) {
+        snprintf(msg, sizeof(msg), "User directory not found");
+        goto ret_done;
+    }
+    fm = find_file(u, argp->file_name);
+    if (!fm) {
+        snprintf(msg, sizeof(msg), "File not found");
+        goto ret_done;
+    }
+
+    /* ensure not open */
+    for (i = 0; i < MAX_OPEN_FILES; i++) {
+        if (open_table[i].in_use &&
+            strncmp(open_table[i].user_name, argp->user_name, USER_NAME_SIZE) == 0 &&
+            strncmp(open_table[i].file_name, argp->file_name, FILE_NAME_SIZE) == 0) {
+            snprintf(msg, sizeof(msg), "Cannot delete open file");
+            goto ret_done;
+        }
+    }
+
+    left = lease_recall(argp->user_name, argp->file_name, me);
+    i = lease_recall(argp->user_name, "", me);
+    if (i > left) left = i;
+    if (left > 0) {
+        result.success = RETRY_LATER;
+        snprintf(msg, sizeof(msg), "File leased by another client, retry in %d s", left);
+        goto ret_done;
+    }
+    lease_clear_recalls(argp->user_name, argp->file_name);
+    lease_clear_recalls(argp->user_name, "");
+
+    file_remove(fm);
+    u->dir_version++;
+    user_touch(u);
+    save_metadata();
+    result.success = 1;
+    snprintf(msg, sizeof(msg), "File deleted");
+
+ret_done:
+    result.out_msg.out_msg_len = strlen(msg) + 1;
+    result.out_msg.out_msg_val = strdup(msg);
+    call_leave(result.success == 1, 0, 0);
+    return &result;
+}
+
+close_output *close_file_1_svc(close_input *argp, struct svc_req *rqstp) {
+    static close_output result;
+    open_entry_t *oe;
+    char msg[128];
+
+    call_enter(argp);
+    memset(&result, 0, sizeof(result));
+    if (disk.members == 0) {
+        init_disk();
+    }
+
+    oe = find_open_by_fd(argp->fd);
+    if (!oe) {
+        snprintf(msg, sizeof(msg), "Invalid file descriptor");
+    } else {
+        oe->in_use = 0;
+        if (meta_dirty)
+            save_metadata();
+        snprintf(msg, sizeof(msg), "File closed");
+    }
+    if (result.out_msg.out_msg_val != NULL) {
+        free(result.out_msg.out_msg_val);
+    }
+    result.out_msg.out_msg_len = strlen(msg) + 1;
+    result.out_msg.out_msg_val = strdup(msg);
+    call_leave(oe != NULL, 0, 0);
+    return &result;
+}
+
+seek_output *seek_position_1_svc(seek_input *argp, struct svc_req *rqstp) {
+    static seek_output result;
+    open_entry_t *oe;
+    char msg[128];
+    int64_t maxsize = file_max_size();
+
+    call_enter(argp);
+    memset(&result, 0, sizeof(result));
+    if (disk.members == 0) {
+        init_disk();
+    }
+    result.success = -1;
+
+    oe = find_open_by_fd(argp->fd);
+    if (!oe) {
+        snprintf(msg, sizeof(msg), "Invalid file descriptor");
+        goto ret_done;
+    }
+    if (argp->position < 0 || argp->position > maxsize) {
+        snprintf(msg, sizeof(msg), "Invalid position");
+        goto ret_done;
+    }
+    oe->current_pos = argp->position;
+    result.success = 1;
+    snprintf(msg, sizeof(msg), "Seek ok");
+
+ret_done:
+    if (result.out_msg.out_msg_val != NULL) {
+        free(result.out_msg.out_msg_val);
+    }
+    result.out_msg.out_msg_len = strlen(msg) + 1;
+    result.out_msg.out_msg_val = strdup(msg);
+    call_leave(result.success == 1, 0, 0);
+    return &result;
+}
+
+create_output *create_file_1_svc(create_input *argp, struct svc_req *rqstp) {
+    static create_output result;
+    user_meta_t *u;
+    file_meta_t *fm;
+    char msg[128];
+    int err = 0;
+    int left;
+
+    call_enter(argp);
+    memset(&result, 0, sizeof(result));
+    result.success = -1;
+
+    if (disk.members == 0) {
+        init_disk();
+    }
+
+    if (snap_user(argp->user_name)) {
+        snprintf(msg, sizeof(msg), "Snapshots are read-only");
+        goto ret_done;
+    }
+    u = find_or_create_user(argp->user_name);
+    if (!u) {
+        snprintf(msg, sizeof(msg), "Too many users");
+        goto ret_done;
+    }
+    left = lease_recall(argp->user_name, "", caller_id(rqstp));
+    if (left > 0) {
+        result.success = RETRY_LATER;
+        snprintf(msg, sizeof(msg), "Directory leased by another client, retry in %d s", left);
+        goto ret_done;
+    }
+    fm = create_file_meta(u, argp->file_name, &err);
+    if (!fm) {
+        if (err == 1)
+            snprintf(msg, sizeof(msg), "File already exists");
+        else
+            snprintf(msg, sizeof(msg), "Max files per user reached");
+        goto ret_done;
+    }
+
+    file_assign_inline(fm);
+    u->dir_version++;
+    user_touch(u);
+    lease_clear_recalls(argp->user_name, "");
+    save_metadata();
+    result.success = 1;
+    snprintf(msg, sizeof(msg), "File created");
+
+ret_done:
+    if (result.out_msg.out_msg_val != NULL) {
+        free(result.out_msg.out_msg_val);
+    }
+    result.out_msg.out_msg_len = strlen(msg) + 1;
+    result.out_msg.out_msg_val = strdup(msg);
+    call_leave(result.success == 1, 0, 0);
+    return &result;
+}
+
+/* Whole-file GET: stateless, never touches the open file table. */
+get_output *get_file_1_svc(get_input *argp, struct svc_req *rqstp) {
+    static get_output result;
+    user_meta_t *u;
+    file_meta_t *fm;
+    char msg[128];
+    ssize_t r;
+
+    call_enter(argp);
+    if (result.buffer.buffer_val != NULL) {
+        free(result.buffer.buffer_val);
+    }
+    memset(&result, 0, sizeof(result));
+    if (disk.members == 0) {
+        init_disk();
+    }
+    result.success = -1;
+
+    u = find_user(argp->user_name);
+    if (!u) {
+        snprintf(msg, sizeof(msg), "User directory not found");
+        goto ret_done;
+    }
+    fm = find_file(u, argp->file_name);
+    if (!fm || !file_live(fm)) {
+        snprintf(msg, sizeof(msg), "File not found");
+        goto ret_done;
+    }
+
+    if (fm->size > INT_MAX) {
+        snprintf(msg, sizeof(msg), "File too large for get_file, use read_file");
+        goto ret_done;
+    }
+    /* malloc(0) may return NULL, always ask for at least one byte */
+    result.buffer.buffer_val = malloc(fm->size > 0 ? fm->size : 1);
+    if (result.buffer.buffer_val == NULL) {
+        snprintf(msg, sizeof(msg), "Read alloc failed");
+        goto ret_done;
+    }
+    if (fm->flags & FILE_INLINE) {
+        memcpy(result.buffer.buffer_val, fm->data, fm->size);
+    } else if (fm->size > 0) {
+        r = file_pread(fm, result.buffer.buffer_val, fm->size, 0);
+        if (r != fm->size) {
+            log_error("read get: %s", strerror(errno));
+            snprintf(msg, sizeof(msg), "Read error");
+            goto ret_done;
+        }
+    }
+    result.buffer.buffer_len = (u_int)fm->size;
+    result.success = 1;
+    snprintf(msg, sizeof(msg), "Get ok (%lld bytes)", (long long)fm->size);
+
+ret_done:
+    if (result.success != 1 && result.buffer.buffer_val != NULL) {
+        free(result.buffer.buffer_val);
         result.buffer.buffer_val = NULL;
-        snprintf(msg, sizeof(msg), "Read error");
+    }
+    result.out_msg.out_msg_len = strlen(msg) + 1;
+    result.out_msg.out_msg_val = strdup(msg);
+    call_leave(result.success == 1, 0, result.buffer.buffer_len);
+    return &result;
+}
+
+/* Replace the contents of fm, which exists (inline if new), with the len
+   bytes at buf: into the record if they fit, onto the slot of twin (see
+   dedup_find) if one is given, and otherwise over the file's own blocks,
+   taking them out of the record or a shared slot first.  fp is the new
+   fingerprint, 0 if not taken.  The record is saved and the version moved
+   on.  0, or -1 with errno set (ENOSPC when no blocks are left). */
+static int file_store(file_meta_t *fm, const char *buf, int len, u_int64_t fp, file_meta_t *twin) {
+    int64_t old_block = -1, old_size = 0, was;
+    ssize_t w;
+
+    if (twin) {
+        /* the same contents are on disk already: share their slot, and
+           give back the file's own once the record is saved */
+        if (twin->start_block != fm->start_block) {
+            old_block = fm->start_block;
+            old_size = fm->size;
+            fm->start_block = twin->start_block;
+            (*slot_ref(fm->start_block))++;
+            fm->flags = twin->flags & FILE_COMPRESSED;
+            memcpy(fm->data, twin->data, VDISK_INLINE_MAX);
+            file_moved(fm, old_block, fm->start_block);
+        }
+    } else if (len <= VDISK_INLINE_MAX) {
+        /* small enough for the record; blocks the file had are given back
+           once the record is saved */
+        if (!(fm->flags & FILE_INLINE)) {
+            old_block = fm->start_block;
+            old_size = fm->size;
+            fm->start_block = -1;
+            fm->flags = FILE_INLINE;
+            file_moved(fm, old_block, -1);
+        }
+        if (len > 0)
+            memcpy(fm->data, buf, len);
+        memset(fm->data + len, 0, VDISK_INLINE_MAX - len);
+    } else {
+        if ((fm->flags & FILE_INLINE) && file_promote(fm) < 0) {
+            if (errno != ENOSPC)
+                log_error("store promote: %s", strerror(errno));
+            return -1;
+        }
+        /* a shared slot is left to the others; nothing needs copying as
+           all of it is replaced */
+        if (*slot_ref(fm->start_block) > 1 && file_unshare(fm, 0) < 0) {
+            if (errno != ENOSPC)
+                log_error("store unshare: %s", strerror(errno));
+            return -1;
+        }
+        if (compress && chunk_size != 0) {
+            /* the old contents are replaced, not read back: file_pwrite
+               sees at most len of them */
+            was = fm->size;
+            if (fm->size > len)
+                fm->size = len;
+            w = file_pwrite(fm, buf, len, 0);
+            fm->size = was;
+        } else {
+            w = disk_write(buf, len, block_offset(fm->start_block, 0));
+            fm->flags &= ~FILE_COMPRESSED;
+        }
+        if (w != len) {
+            log_error("write store: %s", strerror(errno));
+            errno = EIO;
+            return -1;
+        }
+        /* a shorter replacement gives back the old tail, and the map
+           entries of its chunks */
+        if (fm->size > len)
+            disk_punch(block_offset(fm->start_block, len), fm->size - len);
+        if (chunk_size != 0)
+            memset(chunk_map(fm) + (len + chunk_size - 1) / chunk_size, 0,
+                   VDISK_INLINE_MAX - (len + chunk_size - 1) / chunk_size * sizeof(u_int16_t));
+        if (!(fm->flags & FILE_COMPRESSED))
+            memset(fm->data, 0, VDISK_INLINE_MAX);
+    }
+    fm->size = len;
+    fp_set(fm, fp);
+    fm->version++;
+    file_touch(fm);
+    save_metadata();
+    if (old_block >= 0)
+        free_blocks(old_block, old_size);
+    return 0;
+}
+
+/* Create fname in u, or replace it (fm, NULL if there is none), with the
+   len bytes at buf, sharing the slot of a file with the same contents
+   under dedup.  0, or -1 with errno set: EMFILE when the directory is
+   full, ENOSPC when the disk is. */
+static int file_put(user_meta_t *u, file_meta_t *fm, const char *fname, const char *buf, int len) {
+    file_meta_t *twin = NULL;
+    u_int64_t fp = 0;
+    unsigned long long t0;
+    int err = 0;
+
+    if (dedup && len > VDISK_INLINE_MAX) {
+        t0 = now_ns();
+        fp = fingerprint(buf, len);
+        twin = dedup_find(fm, fp, buf, len);
+        dedup_ns += now_ns() - t0;
+        if (twin) dedup_hits++;
+        else dedup_misses++;
+    }
+    if (!fm) {
+        fm = create_file_meta(u, fname, &err);
+        if (!fm) {
+            errno = EMFILE;
+            return -1;
+        }
+        if (len <= VDISK_INLINE_MAX || twin) {
+            file_assign_inline(fm);
+        } else if (file_assign(fm) < 0) {
+            fm->file_name[0] = '\0';
+            errno = ENOSPC;
+            return -1;
+        }
+        u->dir_version++;
+        user_touch(u);
+        lease_clear_recalls(u->user_name, "");
+    }
+    if (file_store(fm, buf, len, fp, twin) < 0)
+        return -1;
+    lease_clear_recalls(u->user_name, fm->file_name);
+    return 0;
+}
+
+/* Whole-file PUT: creates the file if missing, otherwise replaces its
+   contents.  Stateless like GET. */
+put_output *put_file_1_svc(put_input *argp, struct svc_req *rqstp) {
+    static put_output result;
+    user_meta_t *u;
+    file_meta_t *fm;
+    char msg[128];
+    int created = 0, left;
+    int len = (int)argp->buffer.buffer_len;
+    unsigned long long me = caller_id(rqstp);
+
+    call_enter(argp);
+    memset(&result, 0, sizeof(result));
+    if (disk.members == 0) {
+        init_disk();
+    }
+    result.success = -1;
+
+    if (len > file_max_size()) {
+        snprintf(msg, sizeof(msg), "File too large");
+        goto ret_done;
+    }
+    if (snap_user(argp->user_name)) {
+        snprintf(msg, sizeof(msg), "Snapshots are read-only");
+        goto ret_done;
+    }
+    u = find_or_create_user(argp->user_name);
+    if (!u) {
+        snprintf(msg, sizeof(msg), "Too many users");
+        goto ret_done;
+    }
+    fm = find_file(u, argp->file_name);
+    left = lease_recall(argp->user_name, fm ? argp->file_name : "", me);
+    if (left > 0) {
+        result.success = RETRY_LATER;
+        snprintf(msg, sizeof(msg), "%s leased by another client, retry in %d s",
+                 fm ? "File" : "Directory", left);
+        goto ret_done;
+    }
+    created = fm == NULL;
+    if (file_put(u, fm, argp->file_name, argp->buffer.buffer_val, len) < 0) {
+        snprintf(msg, sizeof(msg), errno == EMFILE ? "Max files per user reached" :
+                 errno == ENOSPC ? "No space on disk" : "Write error");
+        goto ret_done;
+    }
+    result.success = 1;
+    snprintf(msg, sizeof(msg), "%s (%d bytes)", created ? "File created" : "File replaced", len);
+
+ret_done:
+    result.out_msg.out_msg_len = strlen(msg) + 1;
+    result.out_msg.out_msg_val = strdup(msg);
+    call_leave(result.success == 1, result.success == 1 ? len : 0, 0);
+    return &result;
+}
+
+/* Grant or release a read lease for a client-side cache.  While the lease
+   runs, no other client may change the file (or, for file_name "", the
+   directory); their writes get RETRY_LATER and recall the lease. */
+lease_output *lease_file_1_svc(lease_input *argp, struct svc_req *rqstp) {
+    static lease_output result;
+    user_meta_t *u;
+    file_meta_t *fm = NULL;
+    lease_t *l, *mine = NULL, *slot = NULL;
+    char msg[128];
+    unsigned long long me = caller_id(rqstp);
+    time_t now = time(NULL);
+    int i;
+
+    call_enter(argp);
+    memset(&result, 0, sizeof(result));
+    if (disk.members == 0) {
+        init_disk();
+    }
+    result.granted = -1;
+
+    for (i = 0; i < MAX_LEASES; i++) {
+        l = &leases[i];
+        if (l->in_use && l->expires <= now &&
+            (!l->recalled || l->recall_until <= now))
+            l->in_use = 0;
+        if (!l->in_use) {
+            if (!slot) slot = l;
+            continue;
+        }
+        if (!lease_match(l, argp->user_name, argp->file_name))
+            continue;
+        if (l->holder == me && !l->recalled)
+            mine = l;
+        else if (l->recalled && l->recall_until > now) {
+            snprintf(msg, sizeof(msg), "Lease recall in progress");
+            goto ret_done;
+        }
+    }
+
+    if (argp->op == LEASE_RELEASE) {
+        if (mine) mine->in_use = 0;
+        snprintf(msg, sizeof(msg), "Lease released");
+        goto ret_done;
+    }
+
+    u = find_user(argp->user_name);
+    if (!u) {
+        snprintf(msg, sizeof(msg), "User directory not found");
+        goto ret_done;
+    }
+    if (argp->file_name[0] != '\0') {
+        fm = find_file(u, argp->file_name);
+        if (!fm || !file_live(fm)) {
+            snprintf(msg, sizeof(msg), "File not found");
+            goto ret_done;
+        }
+        for (i = 0; i < MAX_OPEN_FILES; i++) {
+            open_entry_t *oe = &open_table[i];
+            if (oe->in_use && oe->wrote && oe->owner != me &&
+                strncmp(oe->user_name, argp->user_name, USER_NAME_SIZE) == 0 &&
+                strncmp(oe->file_name, argp->file_name, FILE_NAME_SIZE) == 0) {
+                snprintf(msg, sizeof(msg), "File is being written by another client");
+                goto ret_done;
+            }
+        }
+    }
+
+    if (!mine) {
+        if (!slot) {
+            snprintf(msg, sizeof(msg), "Lease table full");
+            goto ret_done;
+        }
+        mine = slot;
+        memset(mine, 0, sizeof(*mine));
+        mine->in_use = 1;
+        mine->holder = me;
+        strncpy(mine->user_name, argp->user_name, USER_NAME_SIZE - 1);
+        strncpy(mine->file_name, argp->file_name, FILE_NAME_SIZE - 1);
+    }
+    mine->expires = now + LEASE_SECS;
+
+    result.granted = 1;
+    result.seconds = LEASE_SECS;
+    result.file_version = fm ? fm->version : u->dir_version;
+    result.size = fm ? fm->size : 0;
+    result.max_size = file_max_size();
+    snprintf(msg, sizeof(msg), "Lease granted");
+
+ret_done:
+    if (argp->op != LEASE_RELEASE) {
+        if (result.granted == 1) lease_grants++;
+        else lease_denials++;
+    }
+    result.out_msg.out_msg_len = strlen(msg) + 1;
+    result.out_msg.out_msg_val = strdup(msg);
+    call_leave(result.granted == 1 || argp->op == LEASE_RELEASE, 0, 0);
+    return &result;
+}
+
+/* Counters and latency percentiles as text, see stats_report(). */
+stats_output *stats_1_svc(stats_input *argp, struct svc_req *rqstp) {
+    static stats_output result;
+    char *buf;
+
+    call_enter(argp);
+    if (result.out_msg.out_msg_val != NULL) {
+        free(result.out_msg.out_msg_val);
+    }
+    memset(&result, 0, sizeof(result));
+    result.success = -1;
+
+    buf = malloc(STATS_REPORT);
+    if (buf == NULL) {
+        result.out_msg.out_msg_val = strdup("Stats alloc failed");
+        result.out_msg.out_msg_len = strlen(result.out_msg.out_msg_val) + 1;
+        call_leave(0, 0, 0);
+        return &result;
+    }
+    result.out_msg.out_msg_len = stats_report(buf, STATS_REPORT) + 1;
+    result.out_msg.out_msg_val = buf;
+    if (argp->reset)
+        stats_reset();
+    result.success = 1;
+    call_leave(1, 0, 0);
+    return &result;
+}
+
+/* Free space report, after starting or stopping the compactor as asked;
+   see compact_report(). */
+defrag_output *defrag_1_svc(defrag_input *argp, struct svc_req *rqstp) {
+    static defrag_output result;
+    char msg[128], *buf;
+
+    call_enter(argp);
+    if (result.out_msg.out_msg_val != NULL) {
+        free(result.out_msg.out_msg_val);
+    }
+    memset(&result, 0, sizeof(result));
+    if (disk.members == 0) {
+        init_disk();
+    }
+    result.success = -1;
+
+    switch (argp->action) {
+    case DEFRAG_REPORT:
+        break;
+    case DEFRAG_START:
+        if (argp->budget_kb < 0) {
+            snprintf(msg, sizeof(msg), "Invalid budget");
+            goto ret_msg;
+        }
+        if (compact_start((u_int64_t)argp->budget_kb << 10) != 0) {
+            log_error("compact: %s", strerror(errno));
+            snprintf(msg, sizeof(msg), "Compactor start failed");
+            goto ret_msg;
+        }
+        log_info("compact: started, %d KiB/s", argp->budget_kb);
+        break;
+    case DEFRAG_STOP:
+        if (compact_running && !compact_stop)
+            log_info("compact: stopped");
+        compact_stop = 1;
+        break;
+    default:
+        snprintf(msg, sizeof(msg), "Invalid action");
         goto ret_msg;
     }
 
-    result.buffer.buffer_len = (u_int)r;
-    oe->current_pos += r;
+    buf = malloc(STATS_REPORT);
+    if (buf == NULL) {
+        snprintf(msg, sizeof(msg), "Defrag alloc failed");
+        goto ret_msg;
+    }
+    result.out_msg.out_msg_len = compact_report(buf, STATS_REPORT) + 1;
+    result.out_msg.out_msg_val = buf;
+    result.success = 1;
+    call_leave(1, 0, 0);
+    return &result;
+
+ret_msg:
+    result.out_msg.out_msg_len = strlen(msg) + 1;
+    result.out_msg.out_msg_val = strdup(msg);
+    call_leave(0, 0, 0);
+    return &result;
+}
+
+/* CLONE: a new file sharing the source's blocks until either is written */
+clone_output *clone_file_1_svc(clone_input *argp, struct svc_req *rqstp) {
+    static clone_output result;
+    user_meta_t *u;
+    file_meta_t *src, *fm;
+    char msg[128];
+    int err = 0, left;
+
+    call_enter(argp);
+    if (result.out_msg.out_msg_val != NULL) {
+        free(result.out_msg.out_msg_val);
+    }
+    memset(&result, 0, sizeof(result));
+    if (disk.members == 0) {
+        init_disk();
+    }
+    result.success = -1;
+
+    if (snap_user(argp->user_name)) {
+        snprintf(msg, sizeof(msg), "Snapshots are read-only");
+        goto ret_done;
+    }
+    u = find_user(argp->user_name);
+    if (!u) {
+        snprintf(msg, sizeof(msg), "User directory not found");
+        goto ret_done;
+    }
+    src = find_file(u, argp->file_name);
+    if (!src) {
+        snprintf(msg, sizeof(msg), "File not found");
+        goto ret_done;
+    }
+    left = lease_recall(argp->user_name, "", caller_id(rqstp));
+    if (left > 0) {
+        result.success = RETRY_LATER;
+        snprintf(msg, sizeof(msg), "Directory leased by another client, retry in %d s", left);
+        goto ret_done;
+    }
+    fm = create_file_meta(u, argp->new_name, &err);
+    if (!fm) {
+        if (err == 1)
+            snprintf(msg, sizeof(msg), "File already exists");
+        else
+            snprintf(msg, sizeof(msg), "Max files per user reached");
+        goto ret_done;
+    }
+
+    file_index_add(fm);
+    file_clone(fm, src);
+    u->dir_version++;
+    user_touch(u);
+    lease_clear_recalls(argp->user_name, "");
+    save_metadata();
+    clones++;
     result.success = 1;
-    snprintf(msg, sizeof(msg), "Read ok");
+    snprintf(msg, sizeof(msg), "File cloned");
 
-ret_msg:
+ret_done:
+    result.out_msg.out_msg_len = strlen(msg) + 1;
+    result.out_msg.out_msg_val = strdup(msg);
+    call_leave(result.success == 1, 0, 0);
+    return &result;
+}
+
+/* a user's snapshots, one line each */
+static int snapshot_report(char *buf, int len, const user_meta_t *u) {
+    int n = strnlen(u->user_name, USER_NAME_SIZE), at = 0, i, f, nf;
+    file_meta_t *files;
+    int64_t bytes;
+
+    buf[0] = '\0';
+    for (i = 0; i < (int)sb.max_users; i++) {
+        if (!users[i].in_use || strncmp(users[i].user_name, u->user_name, n) != 0 ||
+            users[i].user_name[n] != '@')
+            continue;
+        files = user_files(&users[i]);
+        for (f = nf = 0, bytes = 0; f < (int)sb.max_files_user; f++)
+            if (file_live(&files[f])) {
+                nf++;
+                bytes += files[f].size;
+            }
+        at = report_add(buf, len, at, "snapshot %s files %d bytes %lld\n",
+                        users[i].user_name + n + 1, nf, (long long)bytes);
+    }
+    return at;
+}
+
+/* SNAPSHOT: take, drop or roll back to a copy of a user's files, kept as
+   user "user@snap" (clones, so O(files)), or list them */
+snapshot_output *snapshot_1_svc(snapshot_input *argp, struct svc_req *rqstp) {
+    static snapshot_output result;
+    user_meta_t *u, *s;
+    char msg[128], name[USER_NAME_SIZE], *buf;
+    int ulen, slen, left = 0;
+
+    call_enter(argp);
     if (result.out_msg.out_msg_val != NULL) {
         free(result.out_msg.out_msg_val);
     }
+    memset(&result, 0, sizeof(result));
+    if (disk.members == 0) {
+        init_disk();
+    }
+    result.success = -1;
+
+    if (snap_user(argp->user_name)) {
+        snprintf(msg, sizeof(msg), "Snapshots are read-only");
+        goto ret_msg;
+    }
+    u = find_user(argp->user_name);
+    if (!u) {
+        snprintf(msg, sizeof(msg), "User directory not found");
+        goto ret_msg;
+    }
+    if (argp->action == SNAP_LIST) {
+        if ((buf = malloc(STATS_REPORT)) == NULL) {
+            snprintf(msg, sizeof(msg), "Snapshot alloc failed");
+            goto ret_msg;
+        }
+        result.out_msg.out_msg_len = snapshot_report(buf, STATS_REPORT, u) + 1;
+        result.out_msg.out_msg_val = buf;
+        result.success = 1;
+        call_leave(1, 0, 0);
+        return &result;
+    }
+
+    ulen = strnlen(argp->user_name, USER_NAME_SIZE);
+    slen = strnlen(argp->snap_name, USER_NAME_SIZE);
+    if (slen == 0 || memchr(argp->snap_name, '@', slen) != NULL) {
+        snprintf(msg, sizeof(msg), "Invalid snapshot name");
+        goto ret_msg;
+    }
+    if (ulen + 1 + slen >= USER_NAME_SIZE) {
+        snprintf(msg, sizeof(msg), "Snapshot name too long, user@snap must fit in %d",
+                 USER_NAME_SIZE - 1);
+        goto ret_msg;
+    }
+    snprintf(name, sizeof(name), "%.*s@%.*s", ulen, argp->user_name, slen, argp->snap_name);
+    s = find_user(name);
+
+    switch (argp->action) {
+    case SNAP_CREATE:
+        if (s) {
+            snprintf(msg, sizeof(msg), "Snapshot already exists");
+            goto ret_msg;
+        }
+        if ((s = find_or_create_user(name)) == NULL) {
+            snprintf(msg, sizeof(msg), "Too many users");
+            goto ret_msg;
+        }
+        user_clone(s, u);
+        snapshots_taken++;
+        snprintf(msg, sizeof(msg), "Snapshot created");
+        break;
+    case SNAP_DELETE:
+    case SNAP_RESTORE:
+        if (!s) {
+            snprintf(msg, sizeof(msg), "Snapshot not found");
+            goto ret_msg;
+        }
+        /* the files that go must not be open or leased */
+        if (user_busy(argp->action == SNAP_DELETE ? s : u)) {
+            snprintf(msg, sizeof(msg), "%s has open files",
+                     argp->action == SNAP_DELETE ? "Snapshot" : "Directory");
+            goto ret_msg;
+        }
+        left = lease_recall_user(argp->action == SNAP_DELETE ? name : u->user_name,
+                                 caller_id(rqstp));
+        if (left > 0) {
+            result.success = RETRY_LATER;
+            snprintf(msg, sizeof(msg), "Files leased by another client, retry in %d s", left);
+            goto ret_msg;
+        }
+        if (argp->action == SNAP_DELETE) {
+            user_remove(s);
+            lease_clear_user(name);
+            snprintf(msg, sizeof(msg), "Snapshot deleted");
+        } else {
+            user_clone(u, s);
+            lease_clear_user(u->user_name);
+            snapshots_restored++;
+            snprintf(msg, sizeof(msg), "Snapshot restored");
+        }
+        break;
+    default:
+        snprintf(msg, sizeof(msg), "Invalid action");
+        goto ret_msg;
+    }
+    save_metadata();
+    result.success = 1;
+
+ret_msg:
     result.out_msg.out_msg_len = strlen(msg) + 1;
     result.out_msg.out_msg_val = strdup(msg);
+    call_leave(result.success == 1, 0, 0);
     return &result;
 }
 
-write_output *write_file_1_svc(write_input *argp, struct svc_req *rqstp) {
-    static write_output result;
-    open_entry_t *oe;
-    char msg[128];
-    int maxsize = file_max_size();
-    int to_write, offset;
+/* len bytes at pos of any file, inline or on blocks */
+static ssize_t file_get(file_meta_t *fm, char *buf, int64_t len, int64_t pos) {
+    if (fm->flags & FILE_INLINE) {
+        memmove(buf, fm->data + pos, len);
+        return len;
+    }
+    return file_pread(fm, buf, len, pos);
+}
+
+/* len bytes from src at spos to dst at dpos through buf (COMPACT_CHUNK
+   bytes, allocated on first use), growing dst's size as they land */
+static int copy_through(file_meta_t *src, int64_t spos, file_meta_t *dst, int64_t dpos,
+                        int64_t len, char **buf) {
+    int64_t at, n;
     ssize_t w;
-    fprintf(stderr, "DEBUG: write_file_1_svc user=%s fd=%d numbytes=%d\n",argp->user_name, argp->fd, argp->numbytes);
+
+    for (at = 0; at < len; at += n) {
+        n = len - at < COMPACT_CHUNK ? len - at : COMPACT_CHUNK;
+        if (*buf == NULL && (*buf = malloc(COMPACT_CHUNK)) == NULL)
+            return -1;
+        if (file_get(src, *buf, n, spos + at) != n)
+            return -1;
+        if (file_chunked(dst))
+            w = file_pwrite(dst, *buf, n, dpos + at);
+        else
+            w = disk_write(*buf, n, block_offset(dst->start_block, dpos + at));
+        if (w != n)
+            return -1;
+        if (dpos + at + n > dst->size)
+            dst->size = dpos + at + n;
+    }
+    return 0;
+}
+
+/* Copy len bytes of src at spos to dst at dpos, the ranges not
+   overlapping.  Where both files are plain data on blocks and the two
+   positions are alike within a block, the whole blocks are copied inside
+   the image (disk_copy) and only the partial blocks at either end pass
+   through memory; otherwise it all goes through file_get and the write
+   path.  dst's size is updated, the rest of its record left to the
+   caller.  0, or -1 with errno set. */
+static int file_copy(file_meta_t *src, int64_t spos, file_meta_t *dst, int64_t dpos, int64_t len) {
+    int64_t bs = sb.block_size, head, mid;
+    char *buf = NULL;
+    int r = -1;
+
+    /* an inline file takes the copy in its record while it fits */
+    if ((dst->flags & FILE_INLINE) && dpos + len <= VDISK_INLINE_MAX) {
+        if (file_get(src, dst->data + dpos, len, spos) != len)
+            return -1;
+        if (dpos + len > dst->size)
+            dst->size = dpos + len;
+        return 0;
+    }
+    if (dst->flags & FILE_INLINE) {
+        if (file_promote(dst) < 0)
+            return -1;
+    } else if (*slot_ref(dst->start_block) > 1 && file_unshare(dst, dst->size) < 0) {
+        return -1;
+    }
+
+    head = (bs - dpos % bs) % bs;
+    if (head > len)
+        head = len;
+    mid = (len - head) / bs * bs;
+    if ((src->flags & FILE_INLINE) || file_chunked(src) || file_chunked(dst) ||
+        (spos - dpos) % bs != 0) {
+        head = len;             /* all of it through memory */
+        mid = 0;
+    }
+    if (copy_through(src, spos, dst, dpos, head, &buf) < 0)
+        goto done;
+    if (mid > 0) {
+        if (disk_copy(block_offset(src->start_block, spos + head),
+                      block_offset(dst->start_block, dpos + head), mid) != mid)
+            goto done;
+        copy_kernel_bytes += mid;
+        if (dpos + head + mid > dst->size)
+            dst->size = dpos + head + mid;
+    }
+    if (copy_through(src, spos + head + mid, dst, dpos + head + mid, len - head - mid, &buf) < 0)
+        goto done;
+    r = 0;
+done:
+    free(buf);
+    return r;
+}
+
+/* COPY_RANGE: bytes from one open file to another, of any user, without
+   passing them through the client */
+copy_output *copy_range_1_svc(copy_input *argp, struct svc_req *rqstp) {
+    static copy_output result;
+    open_entry_t *so, *doe;
+    file_meta_t *src, *dst;
+    int64_t len = argp->length, spos = argp->src_pos, dpos = argp->dst_pos;
+    char msg[128];
+    int left;
+
+    call_enter(argp);
+    if (result.out_msg.out_msg_val != NULL) {
+        free(result.out_msg.out_msg_val);
+    }
     memset(&result, 0, sizeof(result));
-    if (disk_fd < 0) {
+    if (disk.members == 0) {
         init_disk();
     }
     result.success = -1;
-    
-    oe = find_open_by_fd(argp->fd);
-    if (!oe) {
+
+    so = find_open_by_fd(argp->src_fd);
+    doe = find_open_by_fd(argp->dst_fd);
+    if (!so || !doe) {
         snprintf(msg, sizeof(msg), "Invalid file descriptor");
-        goto ret_err;
+        goto ret_done;
     }
-    if (argp->numbytes <= 0 || argp->buffer.buffer_val == NULL) {
-        snprintf(msg, sizeof(msg), "Nothing to write");
-        goto ret_err;
+    src = open_entry_file(so);
+    dst = open_entry_file(doe);
+    if (!src || !dst) {
+        snprintf(msg, sizeof(msg), "File not found");
+        goto ret_done;
+    }
+    if (spos < 0 || dpos < 0 || len < 0 || dpos > file_max_size()) {
+        snprintf(msg, sizeof(msg), "Invalid range");
+        goto ret_done;
+    }
+    if (snap_user(doe->user_name)) {
+        snprintf(msg, sizeof(msg), "Snapshots are read-only");
+        goto ret_done;
     }
 
-    if (oe->current_pos + argp->numbytes > maxsize)
-        to_write = maxsize - oe->current_pos;
-    else
-        to_write = argp->numbytes;
-
-    if (to_write <= 0) {
+    /* up to the source's end, the room in the file and COPY_MAX */
+    if (len > src->size - spos)
+        len = src->size > spos ? src->size - spos : 0;
+    if (len > file_max_size() - dpos)
+        len = file_max_size() - dpos;
+    if (len > COPY_MAX)
+        len = COPY_MAX;
+    if (len == 0 && argp->length > 0 && spos < src->size) {
         snprintf(msg, sizeof(msg), "No space left in file");
-        goto ret_err;
+        goto ret_done;
+    }
+    if (src == dst && spos < dpos + len && dpos < spos + len) {
+        snprintf(msg, sizeof(msg), "Ranges overlap");
+        goto ret_done;
     }
 
-    offset = oe->start_block * BLOCK_SIZE + oe->current_pos;
-    fprintf(stderr, "DEBUG: write_file_1_svc offset=%d to_write=%d\n", offset, to_write);
-    if (offset < 0 || offset + to_write > DISK_SIZE) {
-     snprintf(msg, sizeof(msg), "Write offset out of range");
-     goto ret_err;
+    left = lease_recall(doe->user_name, doe->file_name, caller_id(rqstp));
+    if (left > 0) {
+        result.success = RETRY_LATER;
+        snprintf(msg, sizeof(msg), "File leased by another client, retry in %d s", left);
+        goto ret_done;
+    }
+    if (len > 0) {
+        if (file_copy(src, spos, dst, dpos, len) < 0) {
+            if (errno != ENOSPC)
+                log_error("copy_range: %s", strerror(errno));
+            snprintf(msg, sizeof(msg), errno == ENOSPC ? "No space on disk" : "Copy error");
+            goto ret_done;
+        }
+        if (!doe->wrote) {
+            doe->wrote = 1;
+            lease_clear_recalls(doe->user_name, doe->file_name);
+        }
+        fp_set(dst, 0);
+        dst->version++;
+        file_touch(dst);
+        meta_dirty = 1;
     }
+    copy_calls++;
+    copy_bytes += len;
+    result.copied = len;
+    result.success = 1;
+    snprintf(msg, sizeof(msg), "Copied %lld bytes", (long long)len);
 
-    if (lseek(disk_fd, offset, SEEK_SET) < 0) {
-        perror("lseek write");
-        snprintf(msg, sizeof(msg), "Seek error");
-        goto ret_err;
+ret_done:
+    result.out_msg.out_msg_len = strlen(msg) + 1;
+    result.out_msg.out_msg_val = strdup(msg);
+    call_leave(result.success == 1, 0, 0);
+    return &result;
+}
+
+/* Search: the files of a directory are scanned by worker threads while
+   the call holds fs_lock, so nothing changes under them.  Workers read
+   the image directly, check block sums themselves and decompress into
+   buffers of their own; they touch no shared state but their own job.
+   A file a worker cannot read cleanly (a bad block, a read error) is
+   scanned again by the calling thread through file_get, after the bad
+   block, if that was it, is repaired on every copy with sum_fix. */
+
+/* one file of a search and what was found in it */
+typedef struct {
+    file_meta_t *fm;
+    int64_t     *offsets;      /* where matches start, in order */
+    int          count, cap;
+    int          more;         /* stopped at the limit with more to find */
+    int          done;         /* scanned by a worker */
+    u_int64_t    bad_block;    /* the block that failed its sum, 0 if none */
+} search_job_t;
+
+typedef struct {
+    search_job_t *jobs;
+    int           njobs;
+    int           next;        /* job to take next, taken atomically */
+    const char   *pat;
+    size_t        plen;
+    int           max;         /* matches kept per file */
+} search_t;
+
+typedef struct {
+    search_t *s;
+    int       copy;            /* the copy of the image this worker reads */
+} search_worker_t;
+
+static int search_nthreads(void) {
+    long n = search_threads ? search_threads : sysconf(_SC_NPROCESSORS_ONLN);
+    return n < 1 ? 1 : n > SEARCH_THREADS ? SEARCH_THREADS : (int)n;
+}
+
+/* a scan buffer: room for a piece, and for the bytes carried before it */
+static size_t search_room(void) {
+    return SEARCH_PATTERN_MAX + (SEARCH_PIECE > chunk_size ? SEARCH_PIECE : chunk_size);
+}
+
+/* len bytes of whole blocks at offset, from copy c, each block checked
+   against its sum; nothing is repaired or counted, a bad block is noted
+   in *bad.  0, or -1. */
+static int search_read(char *buf, size_t len, off_t offset, int c, u_int64_t *bad) {
+    u_int64_t bs = sb.block_size, b = offset / bs, i;
+    u_int32_t sum;
+
+    if (vdisk_pread_copy(&disk, c, buf, len, offset) != (ssize_t)len)
+        return -1;
+    if (!in_data(offset))
+        return 0;
+    for (i = 0; i < len / bs; i++) {
+        if (block_sums[b + i] == 0)
+            continue;
+        sum = crc32c(0, buf + i * bs, bs);
+        if ((sum ? sum : 1) != block_sums[b + i]) {
+            *bad = b + i;
+            return -1;
+        }
     }
-    w = write(disk_fd, argp->buffer.buffer_val, to_write);
-    if (w < 0) {
-        perror("write");
-        snprintf(msg, sizeof(msg), "Write error");
-        goto ret_err;
+    return 0;
+}
+
+/* Piece k of fm, piece bytes long (a compressed file's chunks), into buf
+   for a worker; zbuf takes a stored chunk.  Bytes of data, or -1. */
+static int64_t search_piece(file_meta_t *fm, int64_t k, int64_t piece, char *buf, char *zbuf,
+                            int c, u_int64_t *bad) {
+    int64_t n = fm->size - k * piece < piece ? fm->size - k * piece : piece;
+    int64_t bs = sb.block_size, stored;
+    off_t at = block_offset(fm->start_block, k * piece);
+    u_int32_t zlen;
+    int r;
+
+    if (fm->flags & FILE_INLINE) {
+        memcpy(buf, fm->data + k * piece, n);
+        return n;
     }
+    if (!(fm->flags & FILE_COMPRESSED) || chunk_map(fm)[k] == 0)
+        return search_read(buf, (n + bs - 1) / bs * bs, at, c, bad) < 0 ? -1 : n;
+    stored = chunk_stored(fm, k);
+    if (search_read(zbuf, (stored + bs - 1) / bs * bs, at, c, bad) < 0)
+        return -1;
+    memcpy(&zlen, zbuf, sizeof(zlen));
+    if (zlen > stored - sizeof(zlen) ||
+        (r = lz_decompress(zbuf + sizeof(zlen), (int)zlen, buf, (int)piece)) < 0)
+        return -1;
+    if (r < n)
+        memset(buf + r, 0, n - r);
+    return n;
+}
 
-    oe->current_pos += w;
-    result.success = 1;
-    snprintf(msg, sizeof(msg), "Write ok (%ld bytes)", (long)w);
+/* Find the pattern in job's file a piece at a time, the last plen - 1
+   bytes of each piece kept in front of the next so that matches across
+   pieces are found.  buf has SEARCH_PATTERN_MAX bytes for those before
+   room for a piece.  c >= 0: a worker reading copy c, else the calling
+   thread through file_get.  0, or -1 with the file unread. */
+static int search_scan(search_t *s, search_job_t *job, char *buf, char *zbuf, int c) {
+    file_meta_t *fm = job->fm;
+    int64_t piece = (fm->flags & FILE_COMPRESSED) ? (int64_t)chunk_size : SEARCH_PIECE;
+    int64_t k, n, carry = 0, keep;
+    char *data = buf + SEARCH_PATTERN_MAX, *end;
+    const char *p;
+    int64_t *grown;
 
-ret_err:
+    job->count = job->more = 0;
+    for (k = 0; k * piece < fm->size && !job->more; k++) {
+        n = fm->size - k * piece < piece ? fm->size - k * piece : piece;
+        n = c < 0 ? file_get(fm, data, n, k * piece) :
+                    search_piece(fm, k, piece, data, zbuf, c, &job->bad_block);
+        if (n < 0)
+            return -1;
+        end = data + n;
+        for (p = data - carry; (p = memfind(p, end - p, s->pat, s->plen)) != NULL; p++) {
+            if (job->count == s->max) {
+                job->more = 1;
+                break;
+            }
+            if (job->count == job->cap) {
+                job->cap = job->cap ? job->cap * 2 : 16;
+                if ((grown = realloc(job->offsets, job->cap * sizeof(int64_t))) == NULL)
+                    return -1;
+                job->offsets = grown;
+            }
+            job->offsets[job->count++] = k * piece + (p - data);
+        }
+        keep = carry + n < (int64_t)s->plen - 1 ? carry + n : (int64_t)s->plen - 1;
+        memmove(data - keep, end - keep, keep);
+        carry = keep;
+    }
+    return 0;
+}
+
+static void *search_worker(void *arg) {
+    search_worker_t *w = arg;
+    search_t *s = w->s;
+    char *buf = malloc(search_room()), *zbuf = chunk_size ? malloc(chunk_size) : NULL;
+    int i;
+
+    if (buf == NULL || (chunk_size && zbuf == NULL)) {
+        free(buf);
+        free(zbuf);
+        return NULL;            /* its jobs fall to the others or the caller */
+    }
+    while ((i = __atomic_fetch_add(&s->next, 1, __ATOMIC_RELAXED)) < s->njobs)
+        s->jobs[i].done = search_scan(s, &s->jobs[i], buf, zbuf, w->copy) == 0;
+    free(buf);
+    free(zbuf);
+    return NULL;
+}
+
+/* Run the jobs on up to search_nthreads() workers, spread over the copies
+   in use, then redo those left undone here.  Threads used, or -1 when a
+   file cannot be read at all. */
+static int search_run(search_t *s) {
+    search_worker_t w[SEARCH_THREADS];
+    pthread_t th[SEARCH_THREADS];
+    int live[VDISK_MAX_COPIES], nlive = 0, n = search_nthreads(), started = 0, i, r = 0;
+    char *buf = NULL;
+
+    for (i = 0; i < disk.copies; i++)
+        if (!(disk.down & 1u << i))
+            live[nlive++] = i;
+    if (n > s->njobs)
+        n = s->njobs;
+    for (i = 0; i < n; i++) {
+        w[i].s = s;
+        w[i].copy = live[i % nlive];
+        if (n > 1 && pthread_create(&th[started], NULL, search_worker, &w[i]) == 0)
+            started++;
+    }
+    if (n == 1)
+        search_worker(&w[0]);
+    for (i = 0; i < started; i++)
+        pthread_join(th[i], NULL);
+
+    for (i = 0; i < s->njobs; i++) {
+        if (s->jobs[i].done)
+            continue;
+        if (buf == NULL && (buf = malloc(search_room())) == NULL) {
+            r = -1;
+            break;
+        }
+        search_redone++;
+        if (s->jobs[i].bad_block != 0) {
+            sum_errors++;
+            if (sum_fix(s->jobs[i].bad_block, buf) == 0)
+                sum_repairs++;
+        }
+        if (search_scan(s, &s->jobs[i], buf, NULL, -1) < 0) {
+            log_error("search %s: %s", s->jobs[i].fm->file_name, strerror(errno));
+            r = -1;
+            break;
+        }
+    }
+    free(buf);
+    return r < 0 ? -1 : started > 0 ? started : 1;
+}
+
+/* SEARCH_FILES: where a byte string occurs in the files of a directory;
+   only the matches go back */
+search_output *search_files_1_svc(search_input *argp, struct svc_req *rqstp) {
+    static search_output result;
+    search_t s;
+    user_meta_t *u;
+    file_meta_t *files;
+    int64_t scanned = 0;
+    char msg[128];
+    int i, j, total = 0, more = 0, max = argp->max_matches, threads;
+
+    call_enter(argp);
     if (result.out_msg.out_msg_val != NULL) {
         free(result.out_msg.out_msg_val);
     }
+    free(result.matches.matches_val);
+    memset(&result, 0, sizeof(result));
+    if (disk.members == 0) {
+        init_disk();
+    }
+    result.success = -1;
+    memset(&s, 0, sizeof(s));
+
+    if (argp->pattern.pattern_len == 0 || argp->pattern.pattern_len > SEARCH_PATTERN_MAX) {
+        snprintf(msg, sizeof(msg), "Pattern must be 1 to %d bytes", SEARCH_PATTERN_MAX);
+        goto ret_done;
+    }
+    u = find_user(argp->user_name);
+    if (!u) {
+        snprintf(msg, sizeof(msg), "User directory not found");
+        goto ret_done;
+    }
+    if (max <= 0 || max > SEARCH_MATCHES)
+        max = SEARCH_MATCHES;
+
+    s.jobs = calloc(sb.max_files_user, sizeof(search_job_t));
+    if (s.jobs == NULL) {
+        snprintf(msg, sizeof(msg), "Search alloc failed");
+        goto ret_done;
+    }
+    files = user_files(u);
+    for (i = 0; i < (int)sb.max_files_user; i++) {
+        if (file_live(&files[i]) && files[i].size >= (int64_t)argp->pattern.pattern_len) {
+            s.jobs[s.njobs++].fm = &files[i];
+            scanned += files[i].size;
+        }
+    }
+    s.pat = argp->pattern.pattern_val;
+    s.plen = argp->pattern.pattern_len;
+    s.max = max;
+    threads = s.njobs > 0 ? search_run(&s) : 0;
+    if (threads < 0) {
+        snprintf(msg, sizeof(msg), "Read error");
+        goto ret_done;
+    }
+
+    /* in file table order, cut at max */
+    for (i = 0; i < s.njobs; i++) {
+        total += s.jobs[i].count;
+        more |= s.jobs[i].more;
+        result.files += s.jobs[i].count > 0;
+    }
+    result.matches.matches_val = malloc((total < max ? total : max) * sizeof(search_match) + 1);
+    if (result.matches.matches_val == NULL) {
+        snprintf(msg, sizeof(msg), "Search alloc failed");
+        goto ret_done;
+    }
+    for (i = 0; i < s.njobs; i++) {
+        for (j = 0; j < s.jobs[i].count && (int)result.matches.matches_len < max; j++) {
+            search_match *m = &result.matches.matches_val[result.matches.matches_len++];
+            memset(m->file_name, 0, FILE_NAME_SIZE);
+            strncpy(m->file_name, s.jobs[i].fm->file_name, FILE_NAME_SIZE - 1);
+            m->offset = s.jobs[i].offsets[j];
+        }
+    }
+    result.scanned = scanned;
+    result.success = 1;
+    search_calls++;
+    search_bytes += scanned;
+    search_matches += result.matches.matches_len;
+    if (total > max || more)
+        snprintf(msg, sizeof(msg), "More than %d matches in %d files, first %d returned "
+                 "(%d threads)", max, result.files, max, threads);
+    else
+        snprintf(msg, sizeof(msg), "%d matches in %d files (%d threads)", total, result.files,
+                 threads);
+
+ret_done:
+    if (s.jobs != NULL) {
+        for (i = 0; i < s.njobs; i++)
+            free(s.jobs[i].offsets);
+        free(s.jobs);
+    }
     result.out_msg.out_msg_len = strlen(msg) + 1;
     result.out_msg.out_msg_val = strdup(msg);
+    call_leave(result.success == 1, 0, 0);
     return &result;
 }
 
-list_output *list_files_1_svc(list_input *argp, struct svc_req *rqstp) {
-    static list_output result;
+/* Digest of a file or a range of it, BLAKE2bp-256.  A whole file's digest
+   is kept in its record with the version it was taken at, so it is only
+   computed again after the file changes; ranges are hashed every time. */
+hash_output *hash_file_1_svc(hash_input *argp, struct svc_req *rqstp) {
+    static hash_output result;
+    blake2bp_t S;
     user_meta_t *u;
-    char *buf;
-    size_t sz;
-    int i;
+    file_meta_t *fm;
+    char msg[128], *buf = NULL;
+    int64_t pos = argp->offset, len = argp->length, at, n;
 
+    call_enter(argp);
+    if (result.out_msg.out_msg_val != NULL) {
+        free(result.out_msg.out_msg_val);
+    }
     memset(&result, 0, sizeof(result));
-    if (disk_fd < 0) {
+    if (disk.members == 0) {
         init_disk();
     }
+    result.success = -1;
 
     u = find_user(argp->user_name);
     if (!u) {
-        const char *msg = "User directory empty\n";
-        if (result.out_msg.out_msg_val != NULL) {
-            free(result.out_msg.out_msg_val);
-        }
-        result.out_msg.out_msg_len = strlen(msg) + 1;
-        result.out_msg.out_msg_val = strdup(msg);
-        return &result;
+        snprintf(msg, sizeof(msg), "User directory not found");
+        goto ret_done;
     }
-
-    buf = malloc(1024);
-    if (buf == NULL) {
-        const char *msg = "List alloc failed\n";
-        if (result.out_msg.out_msg_val != NULL) {
-            free(result.out_msg.out_msg_val);
-        }
-        result.out_msg.out_msg_len = strlen(msg) + 1;
-        result.out_msg.out_msg_val = strdup(msg);
-        return &result;
+    fm = find_file(u, argp->file_name);
+    if (!fm || !file_live(fm)) {
+        snprintf(msg, sizeof(msg), "File not found");
+        goto ret_done;
     }
-    buf[0] = '\0';
+    if (pos < 0 || len < -1) {
+        snprintf(msg, sizeof(msg), "Invalid range");
+        goto ret_done;
+    }
+    if (pos > fm->size)
+        pos = fm->size;
+    if (len < 0 || len > fm->size - pos)
+        len = fm->size - pos;
+    result.size = fm->size;
+    result.file_version = fm->version;
 
-    for (i = 0; i < MAX_FILES_USER; i++) {
-        if (u->files[i].start_block >= 0 &&
-            u->files[i].file_name[0] != '\0') {
-            strcat(buf, u->files[i].file_name);
-            strcat(buf, "\n");
+    if (pos == 0 && len == fm->size && (fm->flags & FILE_HASHED) &&
+        fm->hash_version == fm->version) {
+        memcpy(result.digest, fm->hash, HASH_SIZE);
+        result.cached = 1;
+        hash_cached++;
+    } else {
+        blake2bp_init(&S);
+        for (at = 0; at < len; at += n) {
+            n = len - at < HASH_PIECE ? len - at : HASH_PIECE;
+            if (buf == NULL && (buf = malloc(HASH_PIECE)) == NULL) {
+                snprintf(msg, sizeof(msg), "Hash alloc failed");
+                goto ret_done;
+            }
+            if (file_get(fm, buf, n, pos + at) != n) {
+                log_error("hash_file: %s", strerror(errno));
+                snprintf(msg, sizeof(msg), "Read error");
+                goto ret_done;
+            }
+            blake2bp_update(&S, buf, n);
+        }
+        blake2bp_final(&S, (unsigned char *)result.digest);
+        hash_bytes += len;
+        if (pos == 0 && len == fm->size) {
+            memcpy(fm->hash, result.digest, HASH_SIZE);
+            fm->hash_version = fm->version;
+            fm->flags |= FILE_HASHED;
+            file_touch(fm);
+            meta_dirty = 1;
         }
     }
+    hash_calls++;
+    result.success = 1;
+    snprintf(msg, sizeof(msg), "%s digest of %lld bytes at %lld",
+             result.cached ? "Kept" : "Computed", (long long)len, (long long)pos);
 
-    sz = strlen(buf) + 1;
-    if (result.out_msg.out_msg_val != NULL) {
-        free(result.out_msg.out_msg_val);
-    }
-    result.out_msg.out_msg_len = sz;
-    result.out_msg.out_msg_val = buf;
+ret_done:
+    free(buf);
+    result.out_msg.out_msg_len = strlen(msg) + 1;
+    result.out_msg.out_msg_val = strdup(msg);
+    call_leave(result.success == 1, 0, 0);
     return &result;
 }
 
-delete_output *delete_file_1_svc(delete_input *argp, struct svc_req *rqstp) {
-    static delete_output result;
+/* Signature of a file for delta transfer (delta.h): the weak and strong
+   sums of each block of it, the last block short.  Without a block
+   length from the caller it is about the square root of the size, as
+   rsync's, and it is raised where the blocks would be too many for one
+   reply.  The version signed comes back for patch_file to check. */
+sign_output *sign_file_1_svc(sign_input *argp, struct svc_req *rqstp) {
+    static sign_output result;
     user_meta_t *u;
     file_meta_t *fm;
-    char msg[128];
-    int i;
+    sign_block *blk;
+    char msg[128], *buf = NULL;
+    int64_t bl = argp->block_len, at, n, k, m, piece;
 
+    call_enter(argp);
+    if (result.out_msg.out_msg_val != NULL) {
+        free(result.out_msg.out_msg_val);
+    }
+    free(result.blocks.blocks_val);
     memset(&result, 0, sizeof(result));
-    if (disk_fd < 0) {
+    if (disk.members == 0) {
         init_disk();
     }
+    result.success = -1;
 
     u = find_user(argp->user_name);
     if (!u) {
@@ -470,139 +3888,800 @@ delete_output *delete_file_1_svc(delete_input *argp, struct svc_req *rqstp) {
         goto ret_done;
     }
     fm = find_file(u, argp->file_name);
-    if (!fm) {
+    if (!fm || !file_live(fm)) {
         snprintf(msg, sizeof(msg), "File not found");
         goto ret_done;
     }
+    if (bl < 0 || bl > SIGN_BLOCK_MAX) {
+        snprintf(msg, sizeof(msg), "Block length must be 0 to %d", SIGN_BLOCK_MAX);
+        goto ret_done;
+    }
+    if (bl == 0)
+        for (bl = SIGN_BLOCK_MIN; bl < SIGN_BLOCK_MAX && bl * bl < fm->size; bl *= 2)
+            ;
+    if ((fm->size + bl - 1) / bl > SIGN_BLOCKS)
+        bl = (fm->size + SIGN_BLOCKS - 1) / SIGN_BLOCKS;
+    piece = bl < SIGN_PIECE ? SIGN_PIECE / bl * bl : bl;
 
-    /* ensure not open */
-    for (i = 0; i < MAX_OPEN_FILES; i++) {
-        if (open_table[i].in_use &&
-            strncmp(open_table[i].user_name, argp->user_name, USER_NAME_SIZE) == 0 &&
-            strncmp(open_table[i].file_name, argp->file_name, FILE_NAME_SIZE) == 0) {
-            snprintf(msg, sizeof(msg), "Cannot delete open file");
+    result.blocks.blocks_val = malloc((fm->size + bl - 1) / bl * sizeof(sign_block) + 1);
+    if (result.blocks.blocks_val == NULL || (buf = malloc(piece)) == NULL) {
+        snprintf(msg, sizeof(msg), "Sign alloc failed");
+        goto ret_done;
+    }
+    for (at = 0; at < fm->size; at += n) {
+        n = fm->size - at < piece ? fm->size - at : piece;
+        if (file_get(fm, buf, n, at) != n) {
+            log_error("sign_file: %s", strerror(errno));
+            snprintf(msg, sizeof(msg), "Read error");
             goto ret_done;
         }
+        for (k = 0; k < n; k += m) {
+            m = n - k < bl ? n - k : bl;
+            blk = &result.blocks.blocks_val[result.blocks.blocks_len++];
+            blk->weak = delta_weak((unsigned char *)buf + k, m);
+            delta_strong(blk->strong, buf + k, m);
+        }
     }
-
-    free_blocks(fm->start_block);
-    fm->start_block = -1;
-    fm->file_name[0] = '\0';
-    save_metadata();
-    snprintf(msg, sizeof(msg), "File deleted");
+    result.block_len = (int)bl;
+    result.size = fm->size;
+    result.file_version = fm->version;
+    result.success = 1;
+    sign_calls++;
+    sign_bytes += fm->size;
+    snprintf(msg, sizeof(msg), "%u blocks of %lld bytes", result.blocks.blocks_len, (long long)bl);
 
 ret_done:
-    if (result.out_msg.out_msg_val != NULL) {
-        free(result.out_msg.out_msg_val);
-    }
+    free(buf);
     result.out_msg.out_msg_len = strlen(msg) + 1;
     result.out_msg.out_msg_val = strdup(msg);
+    call_leave(result.success == 1, 0, 0);
     return &result;
 }
 
-close_output *close_file_1_svc(close_input *argp, struct svc_req *rqstp) {
-    static close_output result;
-    open_entry_t *oe;
-    char msg[128];
+/* Rebuild a file from a delta against the version sign_file described,
+   which it must still be at: copies of its ranges and literal bytes, in
+   order.  A file on blocks of its own is patched in place, where a copy
+   that lands where it was read from is there already and only the rest
+   is written (a compressed file's chunks it touches, as by write_file,
+   so not when it shrinks); any other is stored whole as by put_file. */
+patch_output *patch_file_1_svc(patch_input *argp, struct svc_req *rqstp) {
+    static patch_output result;
+    user_meta_t *u;
+    file_meta_t *fm, *twin = NULL;
+    delta_op *ops = argp->ops.ops_val;
+    char msg[128], *buf = NULL;
+    int64_t len = 0, lit = 0, at, run = -1, written = 0;
+    unsigned long long me = caller_id(rqstp), t0;
+    u_int64_t fp = 0;
+    ssize_t w;
+    u_int i;
+    int left;
 
+    call_enter(argp);
+    if (result.out_msg.out_msg_val != NULL) {
+        free(result.out_msg.out_msg_val);
+    }
     memset(&result, 0, sizeof(result));
-    if (disk_fd < 0) {
+    if (disk.members == 0) {
         init_disk();
     }
+    result.success = -1;
 
-    oe = find_open_by_fd(argp->fd);
-    if (!oe) {
-        snprintf(msg, sizeof(msg), "Invalid file descriptor");
-    } else {
-        oe->in_use = 0;
-        snprintf(msg, sizeof(msg), "File closed");
+    if (snap_user(argp->user_name)) {
+        snprintf(msg, sizeof(msg), "Snapshots are read-only");
+        goto ret_done;
     }
-    if (result.out_msg.out_msg_val != NULL) {
-        free(result.out_msg.out_msg_val);
+    u = find_user(argp->user_name);
+    if (!u) {
+        snprintf(msg, sizeof(msg), "User directory not found");
+        goto ret_done;
+    }
+    fm = find_file(u, argp->file_name);
+    if (!fm || !file_live(fm)) {
+        snprintf(msg, sizeof(msg), "File not found");
+        goto ret_done;
+    }
+    if (fm->version != argp->file_version) {
+        snprintf(msg, sizeof(msg), "File changed since it was signed");
+        goto ret_done;
+    }
+    left = lease_recall(argp->user_name, argp->file_name, me);
+    if (left > 0) {
+        result.success = RETRY_LATER;
+        snprintf(msg, sizeof(msg), "File leased by another client, retry in %d s", left);
+        goto ret_done;
+    }
+    for (i = 0; i < argp->ops.ops_len; i++) {
+        if (ops[i].length < 0 || ops[i].offset < -1 ||
+            (ops[i].offset >= 0 && ops[i].length > fm->size - ops[i].offset) ||
+            (ops[i].offset < 0 && ops[i].length > (int64_t)argp->data.data_len - lit)) {
+            snprintf(msg, sizeof(msg), "Invalid delta");
+            goto ret_done;
+        }
+        if (ops[i].length > file_max_size() - len || ops[i].length > INT_MAX - len) {
+            snprintf(msg, sizeof(msg), "File too large");
+            goto ret_done;
+        }
+        if (ops[i].offset < 0)
+            lit += ops[i].length;
+        len += ops[i].length;
+    }
+    if (lit != argp->data.data_len) {
+        snprintf(msg, sizeof(msg), "Invalid delta");
+        goto ret_done;
+    }
+
+    if ((buf = malloc(len + 1)) == NULL) {
+        snprintf(msg, sizeof(msg), "Patch alloc failed");
+        goto ret_done;
     }
+    for (i = 0, at = 0, lit = 0; i < argp->ops.ops_len; at += ops[i++].length) {
+        if (ops[i].offset < 0) {
+            memcpy(buf + at, argp->data.data_val + lit, ops[i].length);
+            lit += ops[i].length;
+        } else if (file_get(fm, buf + at, ops[i].length, ops[i].offset) != ops[i].length) {
+            log_error("patch read: %s", strerror(errno));
+            snprintf(msg, sizeof(msg), "Read error");
+            goto ret_done;
+        }
+    }
+    if (dedup && len > VDISK_INLINE_MAX) {
+        t0 = now_ns();
+        fp = fingerprint(buf, len);
+        twin = dedup_find(fm, fp, buf, len);
+        dedup_ns += now_ns() - t0;
+        if (twin) dedup_hits++;
+        else dedup_misses++;
+    }
+
+    if (!twin && len > VDISK_INLINE_MAX && !(fm->flags & FILE_INLINE) &&
+        *slot_ref(fm->start_block) == 1 && (!file_chunked(fm) || len >= fm->size)) {
+        /* runs of ops that are not where they were read from, written as
+           one; the last op is followed by a flush */
+        for (i = 0, at = 0; i <= argp->ops.ops_len; at += ops[i++].length) {
+            if (i < argp->ops.ops_len && ops[i].offset != at) {
+                if (run < 0)
+                    run = at;
+                continue;
+            }
+            if (run >= 0) {
+                if (file_chunked(fm))
+                    w = file_pwrite(fm, buf + run, at - run, run);
+                else
+                    w = disk_write(buf + run, at - run, block_offset(fm->start_block, run));
+                if (w != at - run) {
+                    log_error("write patch: %s", strerror(errno));
+                    snprintf(msg, sizeof(msg), "Write error");
+                    goto ret_done;
+                }
+                if (at > fm->size)
+                    fm->size = at;
+                written += at - run;
+            }
+            run = -1;
+            if (i == argp->ops.ops_len)
+                break;
+        }
+        if (fm->size > len)
+            disk_punch(block_offset(fm->start_block, len), fm->size - len);
+        fm->size = len;
+        fp_set(fm, fp);
+        fm->version++;
+        file_touch(fm);
+        save_metadata();
+        patch_in_place++;
+    } else {
+        if (file_store(fm, buf, (int)len, fp, twin) < 0) {
+            snprintf(msg, sizeof(msg), errno == ENOSPC ? "No space on disk" : "Write error");
+            goto ret_done;
+        }
+        written = twin ? 0 : len;
+    }
+    lease_clear_recalls(argp->user_name, argp->file_name);
+    result.success = 1;
+    result.size = len;
+    result.written = written;
+    result.file_version = fm->version;
+    patch_calls++;
+    patch_literal += argp->data.data_len;
+    patch_written += written;
+    snprintf(msg, sizeof(msg), "Patched (%lld bytes, %u literal, %lld written)", (long long)len,
+             argp->data.data_len, (long long)written);
+
+ret_done:
+    free(buf);
     result.out_msg.out_msg_len = strlen(msg) + 1;
     result.out_msg.out_msg_val = strdup(msg);
+    call_leave(result.success == 1, result.success == 1 ? (int)argp->data.data_len : 0, 0);
     return &result;
 }
 
-seek_output *seek_position_1_svc(seek_input *argp, struct svc_req *rqstp) {
-    static seek_output result;
-    open_entry_t *oe;
-    char msg[128];
-    int maxsize = file_max_size();
+/* Export and import: a home directory as one stream (see ssnfs.x), sent
+   in pieces of a megabyte or so, so that moving or backing up a user
+   takes a call per piece instead of a create, open, reads and a close
+   per file.  export_home keeps no state: each call says where in the
+   stream it goes on, and the directory's generation, taken over its
+   version and the files' versions and sizes, tells if anything changed
+   since the first call.  Only the CRC of the file a call stops in is
+   kept, for the next call to carry on with; otherwise it is taken again
+   from the file.  import_home keeps the entry being read per user and
+   stores each file whole, as put_file does, once its data and CRC are
+   in. */
+
+typedef struct {
+    int           in_use;
+    char          user_name[USER_NAME_SIZE];
+    int64_t       next;                /* stream offset the next call goes on from */
+    time_t        last;                /* of the last call */
+    int           replace;
+    unsigned char hdr[ARC_HEADER];     /* the entry header being read */
+    int           hdr_len;
+    char         *buf;                 /* the file being read, data and CRC */
+    int64_t       size, got;
+    int           files, skipped;
+} import_t;
+
+static import_t imports[MAX_IMPORTS];
+
+static struct {
+    char      user_name[USER_NAME_SIZE];
+    u_int     generation;
+    int64_t   offset;                  /* where the last export call stopped */
+    u_int     crc;                     /* of the file data before it */
+} export_resume;
+
+/* n-byte big-endian integers of the stream */
+static u_int64_t arc_get(const unsigned char *p, int n) {
+    u_int64_t v = 0;
+    int i;
+
+    for (i = 0; i < n; i++)
+        v = v << 8 | p[i];
+    return v;
+}
+
+static void arc_put(unsigned char *p, u_int64_t v, int n) {
+    int i;
+
+    for (i = n - 1; i >= 0; i--, v >>= 8)
+        p[i] = (unsigned char)v;
+}
 
+/* an entry header: the file's name and size, or for the end entry "" and
+   the number of files */
+static void arc_header(unsigned char hdr[ARC_HEADER], const char *name, u_int64_t size) {
+    arc_put(hdr, ARC_MAGIC, 4);
+    memset(hdr + 4, 0, FILE_NAME_SIZE);
+    strncpy((char *)hdr + 4, name, FILE_NAME_SIZE - 1);
+    arc_put(hdr + 4 + FILE_NAME_SIZE, size, 8);
+}
+
+/* the live files of u in the stream, their count, with the stream's
+   length and the directory's generation */
+static int export_layout(user_meta_t *u, int64_t *total, u_int *generation) {
+    file_meta_t *files = user_files(u);
+    u_int g = crc32c(0, &u->dir_version, sizeof(u->dir_version));
+    int i, n = 0;
+
+    *total = ARC_HEADER;
+    for (i = 0; i < (int)sb.max_files_user; i++) {
+        if (!file_live(&files[i]))
+            continue;
+        g = crc32c(g, &i, sizeof(i));
+        g = crc32c(g, &files[i].version, sizeof(files[i].version));
+        g = crc32c(g, &files[i].size, sizeof(files[i].size));
+        *total += ARC_HEADER + files[i].size + 4;
+        n++;
+    }
+    *generation = g;
+    return n;
+}
+
+/* the CRC of the first len bytes of fm into crc; 0, or -1 with errno set */
+static int export_crc(file_meta_t *fm, int64_t len, u_int *crc) {
+    char *buf = malloc(EXPORT_PIECE);
+    int64_t at, n;
+
+    if (buf == NULL)
+        return -1;
+    *crc = 0;
+    for (at = 0; at < len; at += n) {
+        n = len - at < EXPORT_PIECE ? len - at : EXPORT_PIECE;
+        if (file_get(fm, buf, n, at) != n) {
+            free(buf);
+            return -1;
+        }
+        *crc = crc32c(*crc, buf, n);
+    }
+    free(buf);
+    export_recrc++;
+    return 0;
+}
+
+/* A piece of the export stream of a home directory (or a snapshot) from
+   offset on. */
+export_output *export_home_1_svc(export_input *argp, struct svc_req *rqstp) {
+    static export_output result;
+    unsigned char hdr[ARC_HEADER], tail[4];
+    user_meta_t *u;
+    file_meta_t *files, *fm;
+    char msg[128], *out;
+    int64_t max = argp->max_bytes, pos = 0, at = argp->offset, end, entry, data, n;
+    u_int crc = 0;
+    int i;
+
+    call_enter(argp);
+    if (result.out_msg.out_msg_val != NULL) {
+        free(result.out_msg.out_msg_val);
+    }
+    free(result.data.data_val);
     memset(&result, 0, sizeof(result));
-    if (disk_fd < 0) {
+    if (disk.members == 0) {
         init_disk();
     }
     result.success = -1;
 
-    oe = find_open_by_fd(argp->fd);
-    if (!oe) {
-        snprintf(msg, sizeof(msg), "Invalid file descriptor");
+    u = find_user(argp->user_name);
+    if (!u) {
+        snprintf(msg, sizeof(msg), "User directory not found");
         goto ret_done;
     }
-    if (argp->position < 0 || argp->position > maxsize) {
-        snprintf(msg, sizeof(msg), "Invalid position");
+    if (max <= 0)
+        max = EXPORT_CHUNK;
+    if (max > EXPORT_MAX)
+        max = EXPORT_MAX;
+    result.files = export_layout(u, &result.total, &result.generation);
+    if (at < 0 || at > result.total) {
+        snprintf(msg, sizeof(msg), "Invalid offset");
         goto ret_done;
     }
-    oe->current_pos = argp->position;
+    if (at > 0 && argp->generation != result.generation) {
+        snprintf(msg, sizeof(msg), "Directory changed during export, start again");
+        goto ret_done;
+    }
+    end = result.total - at < max ? result.total : at + max;
+    if ((result.data.data_val = malloc(end - at + 1)) == NULL) {
+        snprintf(msg, sizeof(msg), "Export alloc failed");
+        goto ret_done;
+    }
+    out = result.data.data_val - at;   /* indexed by stream offset */
+
+    /* entries up to end, fm NULL for the end entry */
+    files = user_files(u);
+    for (i = 0; i <= (int)sb.max_files_user && at < end; i++, pos += entry) {
+        fm = i < (int)sb.max_files_user ? &files[i] : NULL;
+        if (fm && !file_live(fm)) {
+            entry = 0;
+            continue;
+        }
+        entry = ARC_HEADER + (fm ? fm->size + 4 : 0);
+        if (pos + entry <= at)
+            continue;
+        if (at < pos + ARC_HEADER) {
+            arc_header(hdr, fm ? fm->file_name : "", fm ? fm->size : result.files);
+            n = pos + ARC_HEADER < end ? pos + ARC_HEADER - at : end - at;
+            memcpy(out + at, hdr + (at - pos), n);
+            at += n;
+        }
+        if (fm == NULL || at == end)
+            break;
+
+        /* the data's CRC so far: none yet, from the last call, or taken again */
+        data = pos + ARC_HEADER;
+        n = at - data < fm->size ? at - data : fm->size;
+        if (n == 0) {
+            crc = 0;
+        } else if (strncmp(export_resume.user_name, argp->user_name, USER_NAME_SIZE) == 0 &&
+                   export_resume.generation == result.generation && export_resume.offset == at) {
+            crc = export_resume.crc;
+        } else if (export_crc(fm, n, &crc) < 0) {
+            log_error("export crc: %s", strerror(errno));
+            snprintf(msg, sizeof(msg), "Read error");
+            goto ret_done;
+        }
+        if (at < data + fm->size) {
+            n = data + fm->size < end ? data + fm->size - at : end - at;
+            if (file_get(fm, out + at, n, at - data) != n) {
+                log_error("export read: %s", strerror(errno));
+                snprintf(msg, sizeof(msg), "Read error");
+                goto ret_done;
+            }
+            crc = crc32c(crc, out + at, n);
+            at += n;
+        }
+        if (at < end) {
+            arc_put(tail, crc, 4);
+            n = pos + entry < end ? pos + entry - at : end - at;
+            memcpy(out + at, tail + (at - data - fm->size), n);
+            at += n;
+        }
+    }
+    memset(export_resume.user_name, 0, USER_NAME_SIZE);
+    strncpy(export_resume.user_name, argp->user_name, USER_NAME_SIZE - 1);
+    export_resume.generation = result.generation;
+    export_resume.offset = end;
+    export_resume.crc = crc;
+
+    result.data.data_len = (u_int)(end - argp->offset);
+    result.next = end;
     result.success = 1;
-    snprintf(msg, sizeof(msg), "Seek ok");
+    export_calls++;
+    export_bytes += result.data.data_len;
+    snprintf(msg, sizeof(msg), "%u bytes at %lld of %lld, %d files", result.data.data_len,
+             (long long)argp->offset, (long long)result.total, result.files);
 
 ret_done:
-    if (result.out_msg.out_msg_val != NULL) {
-        free(result.out_msg.out_msg_val);
+    if (result.success != 1) {
+        free(result.data.data_val);
+        result.data.data_val = NULL;
     }
     result.out_msg.out_msg_len = strlen(msg) + 1;
     result.out_msg.out_msg_val = strdup(msg);
+    call_leave(result.success == 1, 0, result.data.data_len);
     return &result;
 }
 
-create_output *create_file_1_svc(create_input *argp, struct svc_req *rqstp) {
-    static create_output result;
+static import_t *import_find(const char *user) {
+    int i;
+
+    for (i = 0; i < MAX_IMPORTS; i++)
+        if (imports[i].in_use && strncmp(imports[i].user_name, user, USER_NAME_SIZE) == 0)
+            return &imports[i];
+    return NULL;
+}
+
+static void import_drop(import_t *im) {
+    free(im->buf);
+    memset(im, 0, sizeof(*im));
+}
+
+/* a free entry, or one left idle too long, for an import into user */
+static import_t *import_start(const char *user, int replace) {
+    import_t *im = NULL;
+    int i;
+
+    for (i = 0; i < MAX_IMPORTS && im == NULL; i++)
+        if (!imports[i].in_use)
+            im = &imports[i];
+    for (i = 0; i < MAX_IMPORTS && im == NULL; i++)
+        if (time(NULL) - imports[i].last > IMPORT_IDLE) {
+            log_warn("import into %s dropped, idle %ld s", imports[i].user_name,
+                     (long)(time(NULL) - imports[i].last));
+            import_drop(&imports[i]);
+            im = &imports[i];
+        }
+    if (im == NULL)
+        return NULL;
+    im->in_use = 1;
+    strncpy(im->user_name, user, USER_NAME_SIZE - 1);
+    im->replace = replace;
+    return im;
+}
+
+/* The export stream of a home directory, a piece at a time from offset 0
+   on, into the caller's home directory.  Files already there are
+   replaced with replace set and left alone otherwise.  A call that
+   fails drops the import; the files stored before it stay. */
+import_output *import_home_1_svc(import_input *argp, struct svc_req *rqstp) {
+    static import_output result;
+    import_t *im = NULL;
     user_meta_t *u;
     file_meta_t *fm;
-    char msg[128];
-    int err = 0;
-    int start;
+    const unsigned char *p = (const unsigned char *)argp->data.data_val;
+    u_int at = 0, n = argp->data.data_len;
+    int64_t take;
+    u_int64_t size;
+    char msg[128], name[FILE_NAME_SIZE];
+    int left;
 
+    call_enter(argp);
+    if (result.out_msg.out_msg_val != NULL) {
+        free(result.out_msg.out_msg_val);
+    }
     memset(&result, 0, sizeof(result));
-    result.success = -1;
-
-    if (disk_fd < 0) {
+    if (disk.members == 0) {
         init_disk();
     }
+    result.success = -1;
 
+    if (snap_user(argp->user_name)) {
+        snprintf(msg, sizeof(msg), "Snapshots are read-only");
+        goto ret_done;
+    }
     u = find_or_create_user(argp->user_name);
     if (!u) {
         snprintf(msg, sizeof(msg), "Too many users");
         goto ret_done;
     }
-    fm = create_file_meta(u, argp->file_name, &err);
-    if (!fm) {
-        if (err == 1)
-            snprintf(msg, sizeof(msg), "File already exists");
+    left = lease_recall_user(u->user_name, caller_id(rqstp));
+    if (left > 0) {
+        result.success = RETRY_LATER;
+        snprintf(msg, sizeof(msg), "Files leased by another client, retry in %d s", left);
+        goto ret_done;
+    }
+    im = import_find(u->user_name);
+    if (argp->offset == 0) {
+        if (im != NULL)
+            import_drop(im);
+        if ((im = import_start(u->user_name, argp->replace)) == NULL) {
+            snprintf(msg, sizeof(msg), "Too many imports in progress");
+            goto ret_done;
+        }
+    } else if (im == NULL || im->next != argp->offset) {
+        if (im != NULL)
+            snprintf(msg, sizeof(msg), "Import is at offset %lld, not %lld", (long long)im->next,
+                     (long long)argp->offset);
         else
-            snprintf(msg, sizeof(msg), "Max files per user reached");
+            snprintf(msg, sizeof(msg), "No import in progress");
+        im = NULL;          /* one going on elsewhere is left to go on */
         goto ret_done;
     }
+    im->last = time(NULL);
 
-    start = allocate_blocks();
-    if (start < 0) {
-        snprintf(msg, sizeof(msg), "No space on disk");
-        goto ret_done;
+    while (at < n && !result.done) {
+        if (im->hdr_len < ARC_HEADER) {
+            take = ARC_HEADER - im->hdr_len < n - at ? ARC_HEADER - im->hdr_len : n - at;
+            memcpy(im->hdr + im->hdr_len, p + at, take);
+            im->hdr_len += take;
+            at += take;
+            if (im->hdr_len < ARC_HEADER)
+                break;
+            memcpy(name, im->hdr + 4, FILE_NAME_SIZE);
+            size = arc_get(im->hdr + 4 + FILE_NAME_SIZE, 8);
+            if (arc_get(im->hdr, 4) != ARC_MAGIC || name[FILE_NAME_SIZE - 1] != '\0') {
+                snprintf(msg, sizeof(msg), "Not an export stream at offset %lld",
+                         (long long)(argp->offset + at - ARC_HEADER));
+                goto ret_done;
+            }
+            if (name[0] == '\0') {
+                /* the end entry: the file count, and nothing after it */
+                if (size != (u_int64_t)(im->files + im->skipped) || at != n) {
+                    snprintf(msg, sizeof(msg), "Export stream damaged: %d files of %llu",
+                             im->files + im->skipped, (unsigned long long)size);
+                    goto ret_done;
+                }
+                result.done = 1;
+                break;
+            }
+            if (size > (u_int64_t)file_max_size() || size > INT_MAX) {
+                snprintf(msg, sizeof(msg), "%s: file too large", name);
+                goto ret_done;
+            }
+            if ((im->buf = malloc(size + 4)) == NULL) {
+                snprintf(msg, sizeof(msg), "Import alloc failed");
+                goto ret_done;
+            }
+            im->size = size;
+            im->got = 0;
+        }
+        take = im->size + 4 - im->got < n - at ? im->size + 4 - im->got : n - at;
+        memcpy(im->buf + im->got, p + at, take);
+        im->got += take;
+        at += take;
+        if (im->got < im->size + 4)
+            break;
+
+        memcpy(name, im->hdr + 4, FILE_NAME_SIZE);
+        if (arc_get((unsigned char *)im->buf + im->size, 4) != crc32c(0, im->buf, im->size)) {
+            snprintf(msg, sizeof(msg), "%s: CRC mismatch", name);
+            goto ret_done;
+        }
+        fm = find_file(u, name);
+        if (fm && !im->replace) {
+            im->skipped++;
+            import_skipped++;
+        } else if (file_put(u, fm, name, im->buf, (int)im->size) < 0) {
+            snprintf(msg, sizeof(msg), "%s: %s", name, errno == EMFILE ? "Max files per user reached" :
+                     errno == ENOSPC ? "No space on disk" : "Write error");
+            goto ret_done;
+        } else {
+            im->files++;
+            import_files++;
+        }
+        free(im->buf);
+        im->buf = NULL;
+        im->hdr_len = 0;
     }
-    fm->start_block = start;
-    save_metadata();
+    im->next = argp->offset + n;
+    result.next = im->next;
     result.success = 1;
-    snprintf(msg, sizeof(msg), "File created");
+    if (result.done)
+        snprintf(msg, sizeof(msg), "Imported %d files, %d left as they were", im->files,
+                 im->skipped);
+    else
+        snprintf(msg, sizeof(msg), "%d files so far", im->files);
 
 ret_done:
-    if (result.out_msg.out_msg_val != NULL) {
-        free(result.out_msg.out_msg_val);
+    if (im != NULL) {
+        result.files = im->files;
+        result.skipped = im->skipped;
+        if (result.success != 1 || result.done)
+            import_drop(im);
     }
+    import_calls++;
+    import_bytes += result.success == 1 ? n : 0;
     result.out_msg.out_msg_len = strlen(msg) + 1;
     result.out_msg.out_msg_val = strdup(msg);
+    call_leave(result.success == 1, result.success == 1 ? (int)n : 0, 0);
     return &result;
 }
+
+#ifndef SSNFS_NO_MAIN    /* microbench.c includes this file for its internals */
+
+/* socket bound to port on all addresses, or RPC_ANYSOCK for port 0 */
+static int bind_socket(int type, int port) {
+    struct sockaddr_in sin;
+    int s, on = 1;
+
+    if (port == 0)
+        return RPC_ANYSOCK;
+    s = socket(AF_INET, type, 0);
+    if (s < 0) {
+        perror("socket");
+        exit(1);
+    }
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_ANY);
+    sin.sin_port = htons(port);
+    if (bind(s, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+        perror("bind");
+        exit(1);
+    }
+    if (type == SOCK_STREAM && listen(s, 64) < 0) {
+        perror("listen");
+        exit(1);
+    }
+    return s;
+}
+
+/* With a fixed port the portmapper is optional; clients can be pointed
+   at the port directly. */
+static void register_service(SVCXPRT *transp, int proto, int port) {
+    if (svc_register(transp, SSNFSPROG, SSNFSVER, ssnfs_dispatch, proto))
+        return;
+    if (port == 0 || !svc_register(transp, SSNFSPROG, SSNFSVER, ssnfs_dispatch, 0)) {
+        fprintf(stderr, "unable to register (SSNFSPROG, SSNFSVER, %s).\n",
+                proto == IPPROTO_TCP ? "tcp" : "udp");
+        exit(1);
+    }
+    log_warn("portmapper unavailable, serving %s on port %d only",
+             proto == IPPROTO_TCP ? "tcp" : "udp", port);
+}
+
+/* same as the rpcgen-generated main used to do */
+static void daemonize(void) {
+    int pid, i;
+
+    pid = fork();
+    if (pid < 0) {
+        perror("cannot fork");
+        exit(1);
+    }
+    if (pid)
+        exit(0);
+    setsid();
+    for (i = 0; i < 3; i++)
+        (void) close(i);
+    i = open("/dev/console", 2);
+    (void) dup2(i, 1);
+    (void) dup2(i, 2);
+}
+
+/* SIGUSR1 switches debug logging on and off */
+static void toggle_debug(int sig) {
+    log_level = log_level == LL_DEBUG ? LL_INFO : LL_DEBUG;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-f] [-v] [-l log_file] [-p port] "
+                    "[-s stats_file [-i seconds]] [-T trace_file [-P]]\n"
+                    "       [-d disk_image] [-M mirror_image]... [-D compact_kbps] [-G groups] [-u] [-z]\n"
+                    "       [-C scrub_kbps] [-j search_threads]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    SVCXPRT *transp;
+    pthread_t dumper, scrub;
+    FILE *log_file = NULL;
+    const char *log_name = NULL, *trace_name = NULL;
+    int c, port = 0, foreground = 0, compact_kbps = -1;
+
+    while ((c = getopt(argc, argv, "fvl:p:s:i:T:Pd:M:D:G:uzC:j:")) != -1) {
+        switch (c) {
+        case 'f': foreground = 1; break;
+        case 'v': log_level = LL_DEBUG; break;
+        case 'l': log_name = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        case 's': stats_file = optarg; break;
+        case 'i': stats_interval = atoi(optarg); break;
+        case 'T': trace_name = optarg; break;
+        case 'P': trace_payload = 1; break;
+        case 'd': disk_name = optarg; break;
+        case 'M':
+            if (mirror_count == VDISK_MAX_COPIES - 1)
+                usage(argv[0]);
+            mirror_names[++mirror_count] = optarg;
+            break;
+        case 'D':
+            if ((compact_kbps = atoi(optarg)) < 0)
+                usage(argv[0]);
+            break;
+        case 'G':
+            if (atoi(optarg) < 0)
+                usage(argv[0]);
+            group_count = (u_int)atoi(optarg);
+            break;
+        case 'u': dedup = 1; break;
+        case 'z': compress = 1; break;
+        case 'C':
+            if (atoi(optarg) <= 0)
+                usage(argv[0]);
+            scrub_budget = (u_int64_t)atoi(optarg) << 10;
+            break;
+        case 'j':
+            if (atoi(optarg) <= 0)
+                usage(argv[0]);
+            search_threads = atoi(optarg);
+            break;
+        default: usage(argv[0]);
+        }
+    }
+    if (optind != argc || port < 0 || port > 65535 || stats_interval <= 0)
+        usage(argv[0]);
+
+    if (log_name != NULL && (log_file = fopen(log_name, "a")) == NULL) {
+        perror(log_name);
+        exit(1);
+    }
+    if (!foreground)
+        daemonize();
+    if (log_start(log_file ? log_file : stderr) != 0) {
+        perror("log_start");
+        exit(1);
+    }
+    signal(SIGUSR1, toggle_debug);
+    init_disk();
+    if (trace_name != NULL)
+        trace_open(trace_name);
+    stats_reset();
+    if (stats_file != NULL &&
+        pthread_create(&dumper, NULL, stats_dumper, NULL) != 0) {
+        perror("pthread_create");
+        exit(1);
+    }
+    if (compact_kbps >= 0 && compact_start((u_int64_t)compact_kbps << 10) != 0) {
+        perror("pthread_create");
+        exit(1);
+    }
+    if (scrub_budget != 0) {
+        if (pthread_create(&scrub, NULL, scrubber, NULL) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+        pthread_detach(scrub);
+    }
+
+    (void) pmap_unset(SSNFSPROG, SSNFSVER);
+    transp = svcudp_create(bind_socket(SOCK_DGRAM, port));
+    if (transp == NULL) {
+        fprintf(stderr, "cannot create udp service.\n");
+        exit(1);
+    }
+    register_service(transp, IPPROTO_UDP, port);
+    transp = svctcp_create(bind_socket(SOCK_STREAM, port), 0, 0);
+    if (transp == NULL) {
+        fprintf(stderr, "cannot create tcp service.\n");
+        exit(1);
+    }
+    register_service(transp, IPPROTO_TCP, port);
+    log_info("ssnfs server ready");
+
+    svc_run();
+    log_error("svc_run returned");
+    exit(1);
+}
+
+#endif /* SSNFS_NO_MAIN */
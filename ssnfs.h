@@ -6,26 +6,37 @@
 #ifndef _SSNFS_H_RPCGEN
 #define _SSNFS_H_RPCGEN
 
-#define RPCGEN_VERSION	199506
-
 #include <rpc/rpc.h>
 
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #define USER_NAME_SIZE 15
 #define FILE_NAME_SIZE 20
+#define RETRY_LATER -2
+#define LEASE_ACQUIRE 1
+#define LEASE_RELEASE 2
+#define DEFRAG_REPORT 0
+#define DEFRAG_START 1
+#define DEFRAG_STOP 2
+#define SNAP_LIST 0
+#define SNAP_CREATE 1
+#define SNAP_DELETE 2
+#define SNAP_RESTORE 3
+#define SEARCH_PATTERN_MAX 256
+#define HASH_SIZE 32
+#define SIGN_STRONG 16
+#define EXPORT_MAX 4194304
+#define ARC_MAGIC 0x53534e41
+#define ARC_HEADER 32
 
 struct create_input {
 	char user_name[USER_NAME_SIZE];
 	char file_name[FILE_NAME_SIZE];
 };
 typedef struct create_input create_input;
-#ifdef __cplusplus
-extern "C" bool_t xdr_create_input(XDR *, create_input*);
-#elif __STDC__
-extern  bool_t xdr_create_input(XDR *, create_input*);
-#else /* Old Style C */
-bool_t xdr_create_input();
-#endif /* Old Style C */
-
 
 struct create_output {
 	int success;
@@ -35,28 +46,12 @@ struct create_output {
 	} out_msg;
 };
 typedef struct create_output create_output;
-#ifdef __cplusplus
-extern "C" bool_t xdr_create_output(XDR *, create_output*);
-#elif __STDC__
-extern  bool_t xdr_create_output(XDR *, create_output*);
-#else /* Old Style C */
-bool_t xdr_create_output();
-#endif /* Old Style C */
-
 
 struct open_input {
 	char user_name[USER_NAME_SIZE];
 	char file_name[FILE_NAME_SIZE];
 };
 typedef struct open_input open_input;
-#ifdef __cplusplus
-extern "C" bool_t xdr_open_input(XDR *, open_input*);
-#elif __STDC__
-extern  bool_t xdr_open_input(XDR *, open_input*);
-#else /* Old Style C */
-bool_t xdr_open_input();
-#endif /* Old Style C */
-
 
 struct open_output {
 	int fd;
@@ -66,14 +61,6 @@ struct open_output {
 	} out_msg;
 };
 typedef struct open_output open_output;
-#ifdef __cplusplus
-extern "C" bool_t xdr_open_output(XDR *, open_output*);
-#elif __STDC__
-extern  bool_t xdr_open_output(XDR *, open_output*);
-#else /* Old Style C */
-bool_t xdr_open_output();
-#endif /* Old Style C */
-
 
 struct read_input {
 	char user_name[USER_NAME_SIZE];
@@ -81,14 +68,6 @@ struct read_input {
 	int numbytes;
 };
 typedef struct read_input read_input;
-#ifdef __cplusplus
-extern "C" bool_t xdr_read_input(XDR *, read_input*);
-#elif __STDC__
-extern  bool_t xdr_read_input(XDR *, read_input*);
-#else /* Old Style C */
-bool_t xdr_read_input();
-#endif /* Old Style C */
-
 
 struct read_output {
 	int success;
@@ -102,14 +81,6 @@ struct read_output {
 	} out_msg;
 };
 typedef struct read_output read_output;
-#ifdef __cplusplus
-extern "C" bool_t xdr_read_output(XDR *, read_output*);
-#elif __STDC__
-extern  bool_t xdr_read_output(XDR *, read_output*);
-#else /* Old Style C */
-bool_t xdr_read_output();
-#endif /* Old Style C */
-
 
 struct write_input {
 	char user_name[USER_NAME_SIZE];
@@ -121,14 +92,6 @@ struct write_input {
 	} buffer;
 };
 typedef struct write_input write_input;
-#ifdef __cplusplus
-extern "C" bool_t xdr_write_input(XDR *, write_input*);
-#elif __STDC__
-extern  bool_t xdr_write_input(XDR *, write_input*);
-#else /* Old Style C */
-bool_t xdr_write_input();
-#endif /* Old Style C */
-
 
 struct write_output {
 	int success;
@@ -138,27 +101,11 @@ struct write_output {
 	} out_msg;
 };
 typedef struct write_output write_output;
-#ifdef __cplusplus
-extern "C" bool_t xdr_write_output(XDR *, write_output*);
-#elif __STDC__
-extern  bool_t xdr_write_output(XDR *, write_output*);
-#else /* Old Style C */
-bool_t xdr_write_output();
-#endif /* Old Style C */
-
 
 struct list_input {
 	char user_name[USER_NAME_SIZE];
 };
 typedef struct list_input list_input;
-#ifdef __cplusplus
-extern "C" bool_t xdr_list_input(XDR *, list_input*);
-#elif __STDC__
-extern  bool_t xdr_list_input(XDR *, list_input*);
-#else /* Old Style C */
-bool_t xdr_list_input();
-#endif /* Old Style C */
-
 
 struct list_output {
 	struct {
@@ -167,29 +114,13 @@ struct list_output {
 	} out_msg;
 };
 typedef struct list_output list_output;
-#ifdef __cplusplus
-extern "C" bool_t xdr_list_output(XDR *, list_output*);
-#elif __STDC__
-extern  bool_t xdr_list_output(XDR *, list_output*);
-#else /* Old Style C */
-bool_t xdr_list_output();
-#endif /* Old Style C */
-
 
 struct seek_input {
 	char user_name[USER_NAME_SIZE];
 	int fd;
-	int position;
+	quad_t position;
 };
 typedef struct seek_input seek_input;
-#ifdef __cplusplus
-extern "C" bool_t xdr_seek_input(XDR *, seek_input*);
-#elif __STDC__
-extern  bool_t xdr_seek_input(XDR *, seek_input*);
-#else /* Old Style C */
-bool_t xdr_seek_input();
-#endif /* Old Style C */
-
 
 struct seek_output {
 	int success;
@@ -199,58 +130,27 @@ struct seek_output {
 	} out_msg;
 };
 typedef struct seek_output seek_output;
-#ifdef __cplusplus
-extern "C" bool_t xdr_seek_output(XDR *, seek_output*);
-#elif __STDC__
-extern  bool_t xdr_seek_output(XDR *, seek_output*);
-#else /* Old Style C */
-bool_t xdr_seek_output();
-#endif /* Old Style C */
-
 
 struct delete_input {
 	char user_name[USER_NAME_SIZE];
 	char file_name[FILE_NAME_SIZE];
 };
 typedef struct delete_input delete_input;
-#ifdef __cplusplus
-extern "C" bool_t xdr_delete_input(XDR *, delete_input*);
-#elif __STDC__
-extern  bool_t xdr_delete_input(XDR *, delete_input*);
-#else /* Old Style C */
-bool_t xdr_delete_input();
-#endif /* Old Style C */
-
 
 struct delete_output {
+	int success;
 	struct {
 		u_int out_msg_len;
 		char *out_msg_val;
 	} out_msg;
 };
 typedef struct delete_output delete_output;
-#ifdef __cplusplus
-extern "C" bool_t xdr_delete_output(XDR *, delete_output*);
-#elif __STDC__
-extern  bool_t xdr_delete_output(XDR *, delete_output*);
-#else /* Old Style C */
-bool_t xdr_delete_output();
-#endif /* Old Style C */
-
 
 struct close_input {
 	char user_name[USER_NAME_SIZE];
 	int fd;
 };
 typedef struct close_input close_input;
-#ifdef __cplusplus
-extern "C" bool_t xdr_close_input(XDR *, close_input*);
-#elif __STDC__
-extern  bool_t xdr_close_input(XDR *, close_input*);
-#else /* Old Style C */
-bool_t xdr_close_input();
-#endif /* Old Style C */
-
 
 struct close_output {
 	struct {
@@ -259,95 +159,555 @@ struct close_output {
 	} out_msg;
 };
 typedef struct close_output close_output;
-#ifdef __cplusplus
-extern "C" bool_t xdr_close_output(XDR *, close_output*);
-#elif __STDC__
-extern  bool_t xdr_close_output(XDR *, close_output*);
-#else /* Old Style C */
-bool_t xdr_close_output();
-#endif /* Old Style C */
 
+struct get_input {
+	char user_name[USER_NAME_SIZE];
+	char file_name[FILE_NAME_SIZE];
+};
+typedef struct get_input get_input;
 
-#define SSNFSPROG ((rpc_uint)0x31234567)
-#define SSNFSVER ((rpc_uint)1)
+struct get_output {
+	int success;
+	struct {
+		u_int buffer_len;
+		char *buffer_val;
+	} buffer;
+	struct {
+		u_int out_msg_len;
+		char *out_msg_val;
+	} out_msg;
+};
+typedef struct get_output get_output;
 
-#ifdef __cplusplus
-#define open_file ((rpc_uint)1)
-extern "C" open_output * open_file_1(open_input *, CLIENT *);
-extern "C" open_output * open_file_1_svc(open_input *, struct svc_req *);
-#define read_file ((rpc_uint)2)
-extern "C" read_output * read_file_1(read_input *, CLIENT *);
-extern "C" read_output * read_file_1_svc(read_input *, struct svc_req *);
-#define write_file ((rpc_uint)3)
-extern "C" write_output * write_file_1(write_input *, CLIENT *);
-extern "C" write_output * write_file_1_svc(write_input *, struct svc_req *);
-#define list_files ((rpc_uint)4)
-extern "C" list_output * list_files_1(list_input *, CLIENT *);
-extern "C" list_output * list_files_1_svc(list_input *, struct svc_req *);
-#define delete_file ((rpc_uint)5)
-extern "C" delete_output * delete_file_1(delete_input *, CLIENT *);
-extern "C" delete_output * delete_file_1_svc(delete_input *, struct svc_req *);
-#define close_file ((rpc_uint)6)
-extern "C" close_output * close_file_1(close_input *, CLIENT *);
-extern "C" close_output * close_file_1_svc(close_input *, struct svc_req *);
-#define seek_position ((rpc_uint)7)
-extern "C" seek_output * seek_position_1(seek_input *, CLIENT *);
-extern "C" seek_output * seek_position_1_svc(seek_input *, struct svc_req *);
-#define create_file ((rpc_uint)8)
-extern "C" create_output * create_file_1(create_input *, CLIENT *);
-extern "C" create_output * create_file_1_svc(create_input *, struct svc_req *);
-
-#elif __STDC__
-#define open_file ((rpc_uint)1)
+struct put_input {
+	char user_name[USER_NAME_SIZE];
+	char file_name[FILE_NAME_SIZE];
+	struct {
+		u_int buffer_len;
+		char *buffer_val;
+	} buffer;
+};
+typedef struct put_input put_input;
+
+struct put_output {
+	int success;
+	struct {
+		u_int out_msg_len;
+		char *out_msg_val;
+	} out_msg;
+};
+typedef struct put_output put_output;
+
+struct lease_input {
+	char user_name[USER_NAME_SIZE];
+	char file_name[FILE_NAME_SIZE];
+	int op;
+};
+typedef struct lease_input lease_input;
+
+struct lease_output {
+	int granted;
+	int seconds;
+	u_int file_version;
+	quad_t size;
+	quad_t max_size;
+	struct {
+		u_int out_msg_len;
+		char *out_msg_val;
+	} out_msg;
+};
+typedef struct lease_output lease_output;
+
+struct stats_input {
+	int reset;
+};
+typedef struct stats_input stats_input;
+
+struct stats_output {
+	int success;
+	struct {
+		u_int out_msg_len;
+		char *out_msg_val;
+	} out_msg;
+};
+typedef struct stats_output stats_output;
+
+struct defrag_input {
+	int action;
+	int budget_kb;
+};
+typedef struct defrag_input defrag_input;
+
+struct defrag_output {
+	int success;
+	struct {
+		u_int out_msg_len;
+		char *out_msg_val;
+	} out_msg;
+};
+typedef struct defrag_output defrag_output;
+
+struct clone_input {
+	char user_name[USER_NAME_SIZE];
+	char file_name[FILE_NAME_SIZE];
+	char new_name[FILE_NAME_SIZE];
+};
+typedef struct clone_input clone_input;
+
+struct clone_output {
+	int success;
+	struct {
+		u_int out_msg_len;
+		char *out_msg_val;
+	} out_msg;
+};
+typedef struct clone_output clone_output;
+
+struct snapshot_input {
+	char user_name[USER_NAME_SIZE];
+	char snap_name[USER_NAME_SIZE];
+	int action;
+};
+typedef struct snapshot_input snapshot_input;
+
+struct snapshot_output {
+	int success;
+	struct {
+		u_int out_msg_len;
+		char *out_msg_val;
+	} out_msg;
+};
+typedef struct snapshot_output snapshot_output;
+
+struct copy_input {
+	char user_name[USER_NAME_SIZE];
+	int src_fd;
+	quad_t src_pos;
+	int dst_fd;
+	quad_t dst_pos;
+	quad_t length;
+};
+typedef struct copy_input copy_input;
+
+struct copy_output {
+	int success;
+	quad_t copied;
+	struct {
+		u_int out_msg_len;
+		char *out_msg_val;
+	} out_msg;
+};
+typedef struct copy_output copy_output;
+
+struct search_input {
+	char user_name[USER_NAME_SIZE];
+	struct {
+		u_int pattern_len;
+		char *pattern_val;
+	} pattern;
+	int max_matches;
+};
+typedef struct search_input search_input;
+
+struct search_match {
+	char file_name[FILE_NAME_SIZE];
+	quad_t offset;
+};
+typedef struct search_match search_match;
+
+struct search_output {
+	int success;
+	struct {
+		u_int matches_len;
+		search_match *matches_val;
+	} matches;
+	int files;
+	quad_t scanned;
+	struct {
+		u_int out_msg_len;
+		char *out_msg_val;
+	} out_msg;
+};
+typedef struct search_output search_output;
+
+struct hash_input {
+	char user_name[USER_NAME_SIZE];
+	char file_name[FILE_NAME_SIZE];
+	quad_t offset;
+	quad_t length;
+};
+typedef struct hash_input hash_input;
+
+struct hash_output {
+	int success;
+	char digest[HASH_SIZE];
+	quad_t size;
+	u_int file_version;
+	int cached;
+	struct {
+		u_int out_msg_len;
+		char *out_msg_val;
+	} out_msg;
+};
+typedef struct hash_output hash_output;
+
+struct sign_input {
+	char user_name[USER_NAME_SIZE];
+	char file_name[FILE_NAME_SIZE];
+	int block_len;
+};
+typedef struct sign_input sign_input;
+
+struct sign_block {
+	u_int weak;
+	char strong[SIGN_STRONG];
+};
+typedef struct sign_block sign_block;
+
+struct sign_output {
+	int success;
+	int block_len;
+	quad_t size;
+	u_int file_version;
+	struct {
+		u_int blocks_len;
+		sign_block *blocks_val;
+	} blocks;
+	struct {
+		u_int out_msg_len;
+		char *out_msg_val;
+	} out_msg;
+};
+typedef struct sign_output sign_output;
+
+struct delta_op {
+	quad_t offset;
+	quad_t length;
+};
+typedef struct delta_op delta_op;
+
+struct patch_input {
+	char user_name[USER_NAME_SIZE];
+	char file_name[FILE_NAME_SIZE];
+	u_int file_version;
+	struct {
+		u_int ops_len;
+		delta_op *ops_val;
+	} ops;
+	struct {
+		u_int data_len;
+		char *data_val;
+	} data;
+};
+typedef struct patch_input patch_input;
+
+struct patch_output {
+	int success;
+	quad_t size;
+	quad_t written;
+	u_int file_version;
+	struct {
+		u_int out_msg_len;
+		char *out_msg_val;
+	} out_msg;
+};
+typedef struct patch_output patch_output;
+
+struct export_input {
+	char user_name[USER_NAME_SIZE];
+	quad_t offset;
+	u_int generation;
+	int max_bytes;
+};
+typedef struct export_input export_input;
+
+struct export_output {
+	int success;
+	u_int generation;
+	quad_t total;
+	quad_t next;
+	int files;
+	struct {
+		u_int data_len;
+		char *data_val;
+	} data;
+	struct {
+		u_int out_msg_len;
+		char *out_msg_val;
+	} out_msg;
+};
+typedef struct export_output export_output;
+
+struct import_input {
+	char user_name[USER_NAME_SIZE];
+	quad_t offset;
+	int replace;
+	struct {
+		u_int data_len;
+		char *data_val;
+	} data;
+};
+typedef struct import_input import_input;
+
+struct import_output {
+	int success;
+	quad_t next;
+	int done;
+	int files;
+	int skipped;
+	struct {
+		u_int out_msg_len;
+		char *out_msg_val;
+	} out_msg;
+};
+typedef struct import_output import_output;
+
+#define SSNFSPROG 0x31234567
+#define SSNFSVER 1
+
+#if defined(__STDC__) || defined(__cplusplus)
+#define open_file 1
 extern  open_output * open_file_1(open_input *, CLIENT *);
 extern  open_output * open_file_1_svc(open_input *, struct svc_req *);
-#define read_file ((rpc_uint)2)
+#define read_file 2
 extern  read_output * read_file_1(read_input *, CLIENT *);
 extern  read_output * read_file_1_svc(read_input *, struct svc_req *);
-#define write_file ((rpc_uint)3)
+#define write_file 3
 extern  write_output * write_file_1(write_input *, CLIENT *);
 extern  write_output * write_file_1_svc(write_input *, struct svc_req *);
-#define list_files ((rpc_uint)4)
+#define list_files 4
 extern  list_output * list_files_1(list_input *, CLIENT *);
 extern  list_output * list_files_1_svc(list_input *, struct svc_req *);
-#define delete_file ((rpc_uint)5)
+#define delete_file 5
 extern  delete_output * delete_file_1(delete_input *, CLIENT *);
 extern  delete_output * delete_file_1_svc(delete_input *, struct svc_req *);
-#define close_file ((rpc_uint)6)
+#define close_file 6
 extern  close_output * close_file_1(close_input *, CLIENT *);
 extern  close_output * close_file_1_svc(close_input *, struct svc_req *);
-#define seek_position ((rpc_uint)7)
+#define seek_position 7
 extern  seek_output * seek_position_1(seek_input *, CLIENT *);
 extern  seek_output * seek_position_1_svc(seek_input *, struct svc_req *);
-#define create_file ((rpc_uint)8)
+#define create_file 8
 extern  create_output * create_file_1(create_input *, CLIENT *);
 extern  create_output * create_file_1_svc(create_input *, struct svc_req *);
-
-#else /* Old Style C */
-#define open_file ((rpc_uint)1)
+#define get_file 9
+extern  get_output * get_file_1(get_input *, CLIENT *);
+extern  get_output * get_file_1_svc(get_input *, struct svc_req *);
+#define put_file 10
+extern  put_output * put_file_1(put_input *, CLIENT *);
+extern  put_output * put_file_1_svc(put_input *, struct svc_req *);
+#define lease_file 11
+extern  lease_output * lease_file_1(lease_input *, CLIENT *);
+extern  lease_output * lease_file_1_svc(lease_input *, struct svc_req *);
+#define stats 12
+extern  stats_output * stats_1(stats_input *, CLIENT *);
+extern  stats_output * stats_1_svc(stats_input *, struct svc_req *);
+#define defrag 13
+extern  defrag_output * defrag_1(defrag_input *, CLIENT *);
+extern  defrag_output * defrag_1_svc(defrag_input *, struct svc_req *);
+#define clone_file 14
+extern  clone_output * clone_file_1(clone_input *, CLIENT *);
+extern  clone_output * clone_file_1_svc(clone_input *, struct svc_req *);
+#define snapshot 15
+extern  snapshot_output * snapshot_1(snapshot_input *, CLIENT *);
+extern  snapshot_output * snapshot_1_svc(snapshot_input *, struct svc_req *);
+#define copy_range 16
+extern  copy_output * copy_range_1(copy_input *, CLIENT *);
+extern  copy_output * copy_range_1_svc(copy_input *, struct svc_req *);
+#define search_files 17
+extern  search_output * search_files_1(search_input *, CLIENT *);
+extern  search_output * search_files_1_svc(search_input *, struct svc_req *);
+#define hash_file 18
+extern  hash_output * hash_file_1(hash_input *, CLIENT *);
+extern  hash_output * hash_file_1_svc(hash_input *, struct svc_req *);
+#define sign_file 19
+extern  sign_output * sign_file_1(sign_input *, CLIENT *);
+extern  sign_output * sign_file_1_svc(sign_input *, struct svc_req *);
+#define patch_file 20
+extern  patch_output * patch_file_1(patch_input *, CLIENT *);
+extern  patch_output * patch_file_1_svc(patch_input *, struct svc_req *);
+#define export_home 21
+extern  export_output * export_home_1(export_input *, CLIENT *);
+extern  export_output * export_home_1_svc(export_input *, struct svc_req *);
+#define import_home 22
+extern  import_output * import_home_1(import_input *, CLIENT *);
+extern  import_output * import_home_1_svc(import_input *, struct svc_req *);
+extern int ssnfsprog_1_freeresult (SVCXPRT *, xdrproc_t, caddr_t);
+
+#else /* K&R C */
+#define open_file 1
 extern  open_output * open_file_1();
 extern  open_output * open_file_1_svc();
-#define read_file ((rpc_uint)2)
+#define read_file 2
 extern  read_output * read_file_1();
 extern  read_output * read_file_1_svc();
-#define write_file ((rpc_uint)3)
+#define write_file 3
 extern  write_output * write_file_1();
 extern  write_output * write_file_1_svc();
-#define list_files ((rpc_uint)4)
+#define list_files 4
 extern  list_output * list_files_1();
 extern  list_output * list_files_1_svc();
-#define delete_file ((rpc_uint)5)
+#define delete_file 5
 extern  delete_output * delete_file_1();
 extern  delete_output * delete_file_1_svc();
-#define close_file ((rpc_uint)6)
+#define close_file 6
 extern  close_output * close_file_1();
 extern  close_output * close_file_1_svc();
-#define seek_position ((rpc_uint)7)
+#define seek_position 7
 extern  seek_output * seek_position_1();
 extern  seek_output * seek_position_1_svc();
-#define create_file ((rpc_uint)8)
+#define create_file 8
 extern  create_output * create_file_1();
 extern  create_output * create_file_1_svc();
-#endif /* Old Style C */
+#define get_file 9
+extern  get_output * get_file_1();
+extern  get_output * get_file_1_svc();
+#define put_file 10
+extern  put_output * put_file_1();
+extern  put_output * put_file_1_svc();
+#define lease_file 11
+extern  lease_output * lease_file_1();
+extern  lease_output * lease_file_1_svc();
+#define stats 12
+extern  stats_output * stats_1();
+extern  stats_output * stats_1_svc();
+#define defrag 13
+extern  defrag_output * defrag_1();
+extern  defrag_output * defrag_1_svc();
+#define clone_file 14
+extern  clone_output * clone_file_1();
+extern  clone_output * clone_file_1_svc();
+#define snapshot 15
+extern  snapshot_output * snapshot_1();
+extern  snapshot_output * snapshot_1_svc();
+#define copy_range 16
+extern  copy_output * copy_range_1();
+extern  copy_output * copy_range_1_svc();
+#define search_files 17
+extern  search_output * search_files_1();
+extern  search_output * search_files_1_svc();
+#define hash_file 18
+extern  hash_output * hash_file_1();
+extern  hash_output * hash_file_1_svc();
+#define sign_file 19
+extern  sign_output * sign_file_1();
+extern  sign_output * sign_file_1_svc();
+#define patch_file 20
+extern  patch_output * patch_file_1();
+extern  patch_output * patch_file_1_svc();
+#define export_home 21
+extern  export_output * export_home_1();
+extern  export_output * export_home_1_svc();
+#define import_home 22
+extern  import_output * import_home_1();
+extern  import_output * import_home_1_svc();
+extern int ssnfsprog_1_freeresult ();
+#endif /* K&R C */
+
+/* the xdr functions */
+
+#if defined(__STDC__) || defined(__cplusplus)
+extern  bool_t xdr_create_input (XDR *, create_input*);
+extern  bool_t xdr_create_output (XDR *, create_output*);
+extern  bool_t xdr_open_input (XDR *, open_input*);
+extern  bool_t xdr_open_output (XDR *, open_output*);
+extern  bool_t xdr_read_input (XDR *, read_input*);
+extern  bool_t xdr_read_output (XDR *, read_output*);
+extern  bool_t xdr_write_input (XDR *, write_input*);
+extern  bool_t xdr_write_output (XDR *, write_output*);
+extern  bool_t xdr_list_input (XDR *, list_input*);
+extern  bool_t xdr_list_output (XDR *, list_output*);
+extern  bool_t xdr_seek_input (XDR *, seek_input*);
+extern  bool_t xdr_seek_output (XDR *, seek_output*);
+extern  bool_t xdr_delete_input (XDR *, delete_input*);
+extern  bool_t xdr_delete_output (XDR *, delete_output*);
+extern  bool_t xdr_close_input (XDR *, close_input*);
+extern  bool_t xdr_close_output (XDR *, close_output*);
+extern  bool_t xdr_get_input (XDR *, get_input*);
+extern  bool_t xdr_get_output (XDR *, get_output*);
+extern  bool_t xdr_put_input (XDR *, put_input*);
+extern  bool_t xdr_put_output (XDR *, put_output*);
+extern  bool_t xdr_lease_input (XDR *, lease_input*);
+extern  bool_t xdr_lease_output (XDR *, lease_output*);
+extern  bool_t xdr_stats_input (XDR *, stats_input*);
+extern  bool_t xdr_stats_output (XDR *, stats_output*);
+extern  bool_t xdr_defrag_input (XDR *, defrag_input*);
+extern  bool_t xdr_defrag_output (XDR *, defrag_output*);
+extern  bool_t xdr_clone_input (XDR *, clone_input*);
+extern  bool_t xdr_clone_output (XDR *, clone_output*);
+extern  bool_t xdr_snapshot_input (XDR *, snapshot_input*);
+extern  bool_t xdr_snapshot_output (XDR *, snapshot_output*);
+extern  bool_t xdr_copy_input (XDR *, copy_input*);
+extern  bool_t xdr_copy_output (XDR *, copy_output*);
+extern  bool_t xdr_search_input (XDR *, search_input*);
+extern  bool_t xdr_search_match (XDR *, search_match*);
+extern  bool_t xdr_search_output (XDR *, search_output*);
+extern  bool_t xdr_hash_input (XDR *, hash_input*);
+extern  bool_t xdr_hash_output (XDR *, hash_output*);
+extern  bool_t xdr_sign_input (XDR *, sign_input*);
+extern  bool_t xdr_sign_block (XDR *, sign_block*);
+extern  bool_t xdr_sign_output (XDR *, sign_output*);
+extern  bool_t xdr_delta_op (XDR *, delta_op*);
+extern  bool_t xdr_patch_input (XDR *, patch_input*);
+extern  bool_t xdr_patch_output (XDR *, patch_output*);
+extern  bool_t xdr_export_input (XDR *, export_input*);
+extern  bool_t xdr_export_output (XDR *, export_output*);
+extern  bool_t xdr_import_input (XDR *, import_input*);
+extern  bool_t xdr_import_output (XDR *, import_output*);
+
+#else /* K&R C */
+extern bool_t xdr_create_input ();
+extern bool_t xdr_create_output ();
+extern bool_t xdr_open_input ();
+extern bool_t xdr_open_output ();
+extern bool_t xdr_read_input ();
+extern bool_t xdr_read_output ();
+extern bool_t xdr_write_input ();
+extern bool_t xdr_write_output ();
+extern bool_t xdr_list_input ();
+extern bool_t xdr_list_output ();
+extern bool_t xdr_seek_input ();
+extern bool_t xdr_seek_output ();
+extern bool_t xdr_delete_input ();
+extern bool_t xdr_delete_output ();
+extern bool_t xdr_close_input ();
+extern bool_t xdr_close_output ();
+extern bool_t xdr_get_input ();
+extern bool_t xdr_get_output ();
+extern bool_t xdr_put_input ();
+extern bool_t xdr_put_output ();
+extern bool_t xdr_lease_input ();
+extern bool_t xdr_lease_output ();
+extern bool_t xdr_stats_input ();
+extern bool_t xdr_stats_output ();
+extern bool_t xdr_defrag_input ();
+extern bool_t xdr_defrag_output ();
+extern bool_t xdr_clone_input ();
+extern bool_t xdr_clone_output ();
+extern bool_t xdr_snapshot_input ();
+extern bool_t xdr_snapshot_output ();
+extern bool_t xdr_copy_input ();
+extern bool_t xdr_copy_output ();
+extern bool_t xdr_search_input ();
+extern bool_t xdr_search_match ();
+extern bool_t xdr_search_output ();
+extern bool_t xdr_hash_input ();
+extern bool_t xdr_hash_output ();
+extern bool_t xdr_sign_input ();
+extern bool_t xdr_sign_block ();
+extern bool_t xdr_sign_output ();
+extern bool_t xdr_delta_op ();
+extern bool_t xdr_patch_input ();
+extern bool_t xdr_patch_output ();
+extern bool_t xdr_export_input ();
+extern bool_t xdr_export_output ();
+extern bool_t xdr_import_input ();
+extern bool_t xdr_import_output ();
+
+#endif /* K&R C */
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif /* !_SSNFS_H_RPCGEN */
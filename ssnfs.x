@@ -1,5 +1,21 @@
 const USER_NAME_SIZE = 15;
 const FILE_NAME_SIZE = 20;
+const RETRY_LATER = -2;      /* success code: another client holds a lease, retry */
+const LEASE_ACQUIRE = 1;
+const LEASE_RELEASE = 2;
+const DEFRAG_REPORT = 0;
+const DEFRAG_START = 1;
+const DEFRAG_STOP = 2;
+const SNAP_LIST = 0;
+const SNAP_CREATE = 1;
+const SNAP_DELETE = 2;
+const SNAP_RESTORE = 3;
+const SEARCH_PATTERN_MAX = 256;  /* longest pattern search_files takes */
+const HASH_SIZE = 32;            /* digest bytes, BLAKE2bp-256 */
+const SIGN_STRONG = 16;          /* strong sum bytes per block of a signature */
+const EXPORT_MAX = 4194304;      /* stream bytes one export_home call returns at most */
+const ARC_MAGIC = 0x53534e41;    /* "SSNA", starts every entry of an export stream */
+const ARC_HEADER = 32;           /* bytes of an entry header */
 
 struct create_input {
     char user_name[USER_NAME_SIZE];
@@ -7,7 +23,7 @@ struct create_input {
 };
 
 struct create_output {
-    int  success;      /* set to 1 if create was successful, otherwise -1 */
+    int  success;      /* set to 1 if create was successful, otherwise -1 or RETRY_LATER */
     char out_msg<>;    /* error/success message */
 };
 
@@ -41,7 +57,7 @@ struct write_input {
 };
 
 struct write_output {
-    int  success;      /* 1 on success, -1 on failure */
+    int  success;      /* 1 on success, -1 on failure, RETRY_LATER if leased */
     char out_msg<>;    /* error/success message */
 };
 
@@ -55,8 +71,8 @@ struct list_output {
 
 struct seek_input {
     char user_name[USER_NAME_SIZE];
-    int  fd;
-    int  position;
+    int   fd;
+    hyper position;    /* byte offset in the file */
 };
 
 struct seek_output {
@@ -70,6 +86,7 @@ struct delete_input {
 };
 
 struct delete_output {
+    int  success;      /* 1 on success, -1 on failure, RETRY_LATER if leased */
     char out_msg<>;    /* file deleted or file not found message */
 };
 
@@ -82,6 +99,215 @@ struct close_output {
     char out_msg<>;
 };
 
+struct get_input {
+    char user_name[USER_NAME_SIZE];
+    char file_name[FILE_NAME_SIZE];
+};
+
+struct get_output {
+    int  success;      /* 1 on success, -1 on failure */
+    char buffer<>;     /* whole file contents (size bytes) */
+    char out_msg<>;    /* error message, if any */
+};
+
+struct put_input {
+    char user_name[USER_NAME_SIZE];
+    char file_name[FILE_NAME_SIZE];
+    char buffer<>;     /* new file contents, replaces the old ones */
+};
+
+struct put_output {
+    int  success;      /* 1 on success, -1 on failure, RETRY_LATER if leased */
+    char out_msg<>;    /* error/success message */
+};
+
+struct lease_input {
+    char user_name[USER_NAME_SIZE];
+    char file_name[FILE_NAME_SIZE];  /* empty: lease on the directory listing */
+    int  op;                         /* LEASE_ACQUIRE or LEASE_RELEASE */
+};
+
+struct lease_output {
+    int   granted;     /* 1 if a read lease is held, -1 otherwise */
+    int   seconds;     /* lease term, cached data is valid this long */
+    u_int file_version; /* change counter of the file or directory */
+    hyper size;        /* file size (0 for the directory) */
+    hyper max_size;    /* largest position a file can seek to */
+    char  out_msg<>;
+};
+
+struct stats_input {
+    int  reset;        /* nonzero: clear the counters after reporting */
+};
+
+struct stats_output {
+    int  success;
+    char out_msg<>;    /* report, one "key value ..." line per counter */
+};
+
+struct defrag_input {
+    int  action;       /* DEFRAG_REPORT, DEFRAG_START or DEFRAG_STOP */
+    int  budget_kb;    /* DEFRAG_START: KiB/s the compactor may copy, 0 unlimited */
+};
+
+struct defrag_output {
+    int  success;
+    char out_msg<>;    /* free space and compactor report, as for stats */
+};
+
+struct clone_input {
+    char user_name[USER_NAME_SIZE];
+    char file_name[FILE_NAME_SIZE];  /* the file to clone */
+    char new_name[FILE_NAME_SIZE];   /* the clone, must not exist yet */
+};
+
+struct clone_output {
+    int  success;      /* 1 on success, -1 on failure, RETRY_LATER if leased */
+    char out_msg<>;
+};
+
+struct snapshot_input {
+    char user_name[USER_NAME_SIZE];
+    char snap_name[USER_NAME_SIZE];  /* the snapshot is read as user "user@snap" */
+    int  action;                     /* SNAP_LIST, SNAP_CREATE, SNAP_DELETE or SNAP_RESTORE */
+};
+
+struct snapshot_output {
+    int  success;
+    char out_msg<>;    /* SNAP_LIST: one "snapshot name files n bytes n" line each */
+};
+
+struct copy_input {
+    char  user_name[USER_NAME_SIZE];
+    int   src_fd;      /* open descriptors, of any users */
+    hyper src_pos;
+    int   dst_fd;
+    hyper dst_pos;
+    hyper length;      /* bytes, cut at the source's size and the file size */
+};
+
+struct copy_output {
+    int   success;     /* 1 on success, -1 on failure, RETRY_LATER if leased */
+    hyper copied;      /* bytes copied */
+    char  out_msg<>;
+};
+
+struct search_input {
+    char user_name[USER_NAME_SIZE];  /* the directory searched */
+    char pattern<>;    /* bytes to look for, 1 to SEARCH_PATTERN_MAX */
+    int  max_matches;  /* matches returned at most, 0 for the server's limit */
+};
+
+struct search_match {
+    char  file_name[FILE_NAME_SIZE];
+    hyper offset;      /* where the pattern starts in the file */
+};
+
+struct search_output {
+    int          success;
+    search_match matches<>;  /* by file, then offset */
+    int          files;      /* files that hold the pattern */
+    hyper        scanned;    /* bytes searched */
+    char         out_msg<>;
+};
+
+struct hash_input {
+    char  user_name[USER_NAME_SIZE];
+    char  file_name[FILE_NAME_SIZE];
+    hyper offset;      /* start of the range hashed */
+    hyper length;      /* bytes, cut at the file's size; -1 for the rest */
+};
+
+struct hash_output {
+    int    success;
+    opaque digest[HASH_SIZE];
+    hyper  size;       /* the file's size */
+    u_int  file_version; /* and version, as in lease replies */
+    int    cached;     /* 1 if the whole file's digest was kept from before */
+    char   out_msg<>;
+};
+
+struct sign_input {
+    char user_name[USER_NAME_SIZE];
+    char file_name[FILE_NAME_SIZE];
+    int  block_len;    /* 0: the server picks, about the square root of the size */
+};
+
+struct sign_block {
+    u_int  weak;       /* rolling sum, see delta.h */
+    opaque strong[SIGN_STRONG];
+};
+
+struct sign_output {
+    int        success;
+    int        block_len;   /* the block length used */
+    hyper      size;
+    u_int      file_version; /* patch_file is refused once this moves */
+    sign_block blocks<>;    /* the last may be short */
+    char       out_msg<>;
+};
+
+struct delta_op {
+    hyper offset;      /* in the signed file, -1 for the next bytes of data */
+    hyper length;
+};
+
+struct patch_input {
+    char     user_name[USER_NAME_SIZE];
+    char     file_name[FILE_NAME_SIZE];
+    u_int    file_version; /* of the signature the delta was made against */
+    delta_op ops<>;    /* the new contents, in order */
+    opaque   data<>;   /* the literal bytes */
+};
+
+struct patch_output {
+    int   success;     /* 1 on success, -1 on failure, RETRY_LATER if leased */
+    hyper size;        /* the new size */
+    hyper written;     /* bytes the server wrote */
+    u_int file_version;
+    char  out_msg<>;
+};
+
+/* An export stream is an entry per file, in file table order, and an end
+   entry.  An entry is a header, ARC_MAGIC, the name (FILE_NAME_SIZE bytes,
+   NUL-padded) and the size (8 bytes), integers big-endian; a file's entry
+   goes on with its data and the CRC-32C of the data (4 bytes).  The end
+   entry has an empty name, the number of files for its size, and nothing
+   after the header. */
+
+struct export_input {
+    char  user_name[USER_NAME_SIZE];  /* a snapshot's, "user@snap", for a fixed copy */
+    hyper offset;      /* in the stream, 0 to start */
+    u_int generation;  /* from the reply to the call at offset 0 */
+    int   max_bytes;   /* 0: 1 MB, at most EXPORT_MAX */
+};
+
+struct export_output {
+    int   success;     /* -1 also when the directory changed since offset 0 */
+    u_int generation;  /* of the directory, to pass back */
+    hyper total;       /* bytes in the stream */
+    hyper next;        /* offset of the next call, total at the end */
+    int   files;
+    opaque data<>;
+    char  out_msg<>;
+};
+
+struct import_input {
+    char  user_name[USER_NAME_SIZE];
+    hyper offset;      /* in the stream, 0 to start; each call goes on from the last */
+    int   replace;     /* 1: files already there are replaced, 0: left alone */
+    opaque data<>;
+};
+
+struct import_output {
+    int   success;     /* 1 on success, -1 on failure, RETRY_LATER if leased */
+    hyper next;        /* offset the next call goes on from */
+    int   done;        /* 1 once the end entry is in */
+    int   files;       /* stored so far */
+    int   skipped;     /* left alone so far, as they were there */
+    char  out_msg<>;
+};
+
 program SSNFSPROG {
     version SSNFSVER {
         open_output   open_file(open_input)        = 1;
@@ -92,5 +318,19 @@ program SSNFSPROG {
         close_output  close_file(close_input)      = 6;
         seek_output   seek_position(seek_input)    = 7;
         create_output create_file(create_input)    = 8;
+        get_output    get_file(get_input)          = 9;
+        put_output    put_file(put_input)          = 10;
+        lease_output  lease_file(lease_input)      = 11;
+        stats_output  stats(stats_input)           = 12;
+        defrag_output defrag(defrag_input)         = 13;
+        clone_output  clone_file(clone_input)      = 14;
+        snapshot_output snapshot(snapshot_input)   = 15;
+        copy_output   copy_range(copy_input)       = 16;
+        search_output search_files(search_input)   = 17;
+        hash_output   hash_file(hash_input)        = 18;
+        sign_output   sign_file(sign_input)        = 19;
+        patch_output  patch_file(patch_input)      = 20;
+        export_output export_home(export_input)    = 21;
+        import_output import_home(import_input)    = 22;
     } = 1;
 } = 0x31234567; /* change to some value different from sample */
@@ -3,143 +3,338 @@
  * It was generated using rpcgen.
  */
 
+#include <memory.h> /* for memset */
 #include "ssnfs.h"
-#include <string.h>
-#include <memory.h>
+
 /* Default timeout can be changed using clnt_control() */
 static struct timeval TIMEOUT = { 25, 0 };
 
 open_output *
-open_file_1(argp, clnt)
-	open_input *argp;
-	CLIENT *clnt;
+open_file_1(open_input *argp, CLIENT *clnt)
 {
 	static open_output clnt_res;
 
 	memset((char *)&clnt_res, 0, sizeof(clnt_res));
-	if (clnt_call(clnt, open_file,
-        (xdrproc_t)xdr_open_input, (caddr_t)argp,
-        (xdrproc_t)xdr_open_output, (caddr_t)&clnt_res,
-        TIMEOUT) != RPC_SUCCESS)
+	if (clnt_call (clnt, open_file,
+		(xdrproc_t) xdr_open_input, (caddr_t) argp,
+		(xdrproc_t) xdr_open_output, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
 		return (NULL);
+	}
 	return (&clnt_res);
 }
 
 read_output *
-read_file_1(argp, clnt)
-	read_input *argp;
-	CLIENT *clnt;
+read_file_1(read_input *argp, CLIENT *clnt)
 {
 	static read_output clnt_res;
 
 	memset((char *)&clnt_res, 0, sizeof(clnt_res));
-	if (clnt_call(clnt, read_file,
-              (xdrproc_t)xdr_read_input, (caddr_t)argp,
-              (xdrproc_t)xdr_read_output, (caddr_t)&clnt_res,
-              TIMEOUT) != RPC_SUCCESS)
-
+	if (clnt_call (clnt, read_file,
+		(xdrproc_t) xdr_read_input, (caddr_t) argp,
+		(xdrproc_t) xdr_read_output, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
 		return (NULL);
+	}
 	return (&clnt_res);
 }
 
 write_output *
-write_file_1(argp, clnt)
-	write_input *argp;
-	CLIENT *clnt;
+write_file_1(write_input *argp, CLIENT *clnt)
 {
 	static write_output clnt_res;
 
 	memset((char *)&clnt_res, 0, sizeof(clnt_res));
-	if (clnt_call(clnt, write_file,
-              (xdrproc_t)xdr_write_input, (caddr_t)argp,
-              (xdrproc_t)xdr_write_output, (caddr_t)&clnt_res,
-              TIMEOUT) != RPC_SUCCESS)
-
+	if (clnt_call (clnt, write_file,
+		(xdrproc_t) xdr_write_input, (caddr_t) argp,
+		(xdrproc_t) xdr_write_output, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
 		return (NULL);
+	}
 	return (&clnt_res);
 }
 
 list_output *
-list_files_1(argp, clnt)
-	list_input *argp;
-	CLIENT *clnt;
+list_files_1(list_input *argp, CLIENT *clnt)
 {
 	static list_output clnt_res;
 
 	memset((char *)&clnt_res, 0, sizeof(clnt_res));
-	if (clnt_call(clnt, list_files,
-              (xdrproc_t)xdr_list_input, (caddr_t)argp,
-              (xdrproc_t)xdr_list_output, (caddr_t)&clnt_res,
-              TIMEOUT) != RPC_SUCCESS)
-
+	if (clnt_call (clnt, list_files,
+		(xdrproc_t) xdr_list_input, (caddr_t) argp,
+		(xdrproc_t) xdr_list_output, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
 		return (NULL);
+	}
 	return (&clnt_res);
 }
 
 delete_output *
-delete_file_1(argp, clnt)
-	delete_input *argp;
-	CLIENT *clnt;
+delete_file_1(delete_input *argp, CLIENT *clnt)
 {
 	static delete_output clnt_res;
 
 	memset((char *)&clnt_res, 0, sizeof(clnt_res));
-	if (clnt_call(clnt, delete_file,
-              (xdrproc_t)xdr_delete_input, (caddr_t)argp,
-              (xdrproc_t)xdr_delete_output, (caddr_t)&clnt_res,
-              TIMEOUT) != RPC_SUCCESS)
-
+	if (clnt_call (clnt, delete_file,
+		(xdrproc_t) xdr_delete_input, (caddr_t) argp,
+		(xdrproc_t) xdr_delete_output, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
 		return (NULL);
+	}
 	return (&clnt_res);
 }
 
 close_output *
-close_file_1(argp, clnt)
-	close_input *argp;
-	CLIENT *clnt;
+close_file_1(close_input *argp, CLIENT *clnt)
 {
 	static close_output clnt_res;
 
 	memset((char *)&clnt_res, 0, sizeof(clnt_res));
-	if (clnt_call(clnt, close_file,
-              (xdrproc_t)xdr_close_input, (caddr_t)argp,
-              (xdrproc_t)xdr_close_output, (caddr_t)&clnt_res,
-              TIMEOUT) != RPC_SUCCESS)
-
+	if (clnt_call (clnt, close_file,
+		(xdrproc_t) xdr_close_input, (caddr_t) argp,
+		(xdrproc_t) xdr_close_output, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
 		return (NULL);
+	}
 	return (&clnt_res);
 }
 
 seek_output *
-seek_position_1(argp, clnt)
-	seek_input *argp;
-	CLIENT *clnt;
+seek_position_1(seek_input *argp, CLIENT *clnt)
 {
 	static seek_output clnt_res;
 
 	memset((char *)&clnt_res, 0, sizeof(clnt_res));
-	if (clnt_call(clnt, seek_position,
-              (xdrproc_t)xdr_seek_input, (caddr_t)argp,
-              (xdrproc_t)xdr_seek_output, (caddr_t)&clnt_res,
-              TIMEOUT) != RPC_SUCCESS)
-
+	if (clnt_call (clnt, seek_position,
+		(xdrproc_t) xdr_seek_input, (caddr_t) argp,
+		(xdrproc_t) xdr_seek_output, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
 		return (NULL);
+	}
 	return (&clnt_res);
 }
 
 create_output *
-create_file_1(argp, clnt)
-	create_input *argp;
-	CLIENT *clnt;
+create_file_1(create_input *argp, CLIENT *clnt)
 {
 	static create_output clnt_res;
 
 	memset((char *)&clnt_res, 0, sizeof(clnt_res));
-	if (clnt_call(clnt, create_file,
-              (xdrproc_t)xdr_create_input, (caddr_t)argp,
-              (xdrproc_t)xdr_create_output, (caddr_t)&clnt_res,
-              TIMEOUT) != RPC_SUCCESS)
+	if (clnt_call (clnt, create_file,
+		(xdrproc_t) xdr_create_input, (caddr_t) argp,
+		(xdrproc_t) xdr_create_output, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
+		return (NULL);
+	}
+	return (&clnt_res);
+}
+
+get_output *
+get_file_1(get_input *argp, CLIENT *clnt)
+{
+	static get_output clnt_res;
+
+	memset((char *)&clnt_res, 0, sizeof(clnt_res));
+	if (clnt_call (clnt, get_file,
+		(xdrproc_t) xdr_get_input, (caddr_t) argp,
+		(xdrproc_t) xdr_get_output, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
+		return (NULL);
+	}
+	return (&clnt_res);
+}
+
+put_output *
+put_file_1(put_input *argp, CLIENT *clnt)
+{
+	static put_output clnt_res;
+
+	memset((char *)&clnt_res, 0, sizeof(clnt_res));
+	if (clnt_call (clnt, put_file,
+		(xdrproc_t) xdr_put_input, (caddr_t) argp,
+		(xdrproc_t) xdr_put_output, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
+		return (NULL);
+	}
+	return (&clnt_res);
+}
+
+lease_output *
+lease_file_1(lease_input *argp, CLIENT *clnt)
+{
+	static lease_output clnt_res;
+
+	memset((char *)&clnt_res, 0, sizeof(clnt_res));
+	if (clnt_call (clnt, lease_file,
+		(xdrproc_t) xdr_lease_input, (caddr_t) argp,
+		(xdrproc_t) xdr_lease_output, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
+		return (NULL);
+	}
+	return (&clnt_res);
+}
+
+stats_output *
+stats_1(stats_input *argp, CLIENT *clnt)
+{
+	static stats_output clnt_res;
+
+	memset((char *)&clnt_res, 0, sizeof(clnt_res));
+	if (clnt_call (clnt, stats,
+		(xdrproc_t) xdr_stats_input, (caddr_t) argp,
+		(xdrproc_t) xdr_stats_output, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
+		return (NULL);
+	}
+	return (&clnt_res);
+}
+
+defrag_output *
+defrag_1(defrag_input *argp, CLIENT *clnt)
+{
+	static defrag_output clnt_res;
+
+	memset((char *)&clnt_res, 0, sizeof(clnt_res));
+	if (clnt_call (clnt, defrag,
+		(xdrproc_t) xdr_defrag_input, (caddr_t) argp,
+		(xdrproc_t) xdr_defrag_output, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
+		return (NULL);
+	}
+	return (&clnt_res);
+}
+
+clone_output *
+clone_file_1(clone_input *argp, CLIENT *clnt)
+{
+	static clone_output clnt_res;
+
+	memset((char *)&clnt_res, 0, sizeof(clnt_res));
+	if (clnt_call (clnt, clone_file,
+		(xdrproc_t) xdr_clone_input, (caddr_t) argp,
+		(xdrproc_t) xdr_clone_output, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
+		return (NULL);
+	}
+	return (&clnt_res);
+}
+
+snapshot_output *
+snapshot_1(snapshot_input *argp, CLIENT *clnt)
+{
+	static snapshot_output clnt_res;
+
+	memset((char *)&clnt_res, 0, sizeof(clnt_res));
+	if (clnt_call (clnt, snapshot,
+		(xdrproc_t) xdr_snapshot_input, (caddr_t) argp,
+		(xdrproc_t) xdr_snapshot_output, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
+		return (NULL);
+	}
+	return (&clnt_res);
+}
+
+copy_output *
+copy_range_1(copy_input *argp, CLIENT *clnt)
+{
+	static copy_output clnt_res;
+
+	memset((char *)&clnt_res, 0, sizeof(clnt_res));
+	if (clnt_call (clnt, copy_range,
+		(xdrproc_t) xdr_copy_input, (caddr_t) argp,
+		(xdrproc_t) xdr_copy_output, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
+		return (NULL);
+	}
+	return (&clnt_res);
+}
+
+search_output *
+search_files_1(search_input *argp, CLIENT *clnt)
+{
+	static search_output clnt_res;
+
+	memset((char *)&clnt_res, 0, sizeof(clnt_res));
+	if (clnt_call (clnt, search_files,
+		(xdrproc_t) xdr_search_input, (caddr_t) argp,
+		(xdrproc_t) xdr_search_output, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
+		return (NULL);
+	}
+	return (&clnt_res);
+}
+
+hash_output *
+hash_file_1(hash_input *argp, CLIENT *clnt)
+{
+	static hash_output clnt_res;
+
+	memset((char *)&clnt_res, 0, sizeof(clnt_res));
+	if (clnt_call (clnt, hash_file,
+		(xdrproc_t) xdr_hash_input, (caddr_t) argp,
+		(xdrproc_t) xdr_hash_output, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
+		return (NULL);
+	}
+	return (&clnt_res);
+}
+
+sign_output *
+sign_file_1(sign_input *argp, CLIENT *clnt)
+{
+	static sign_output clnt_res;
+
+	memset((char *)&clnt_res, 0, sizeof(clnt_res));
+	if (clnt_call (clnt, sign_file,
+		(xdrproc_t) xdr_sign_input, (caddr_t) argp,
+		(xdrproc_t) xdr_sign_output, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
+		return (NULL);
+	}
+	return (&clnt_res);
+}
+
+patch_output *
+patch_file_1(patch_input *argp, CLIENT *clnt)
+{
+	static patch_output clnt_res;
+
+	memset((char *)&clnt_res, 0, sizeof(clnt_res));
+	if (clnt_call (clnt, patch_file,
+		(xdrproc_t) xdr_patch_input, (caddr_t) argp,
+		(xdrproc_t) xdr_patch_output, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
+		return (NULL);
+	}
+	return (&clnt_res);
+}
 
+export_output *
+export_home_1(export_input *argp, CLIENT *clnt)
+{
+	static export_output clnt_res;
+
+	memset((char *)&clnt_res, 0, sizeof(clnt_res));
+	if (clnt_call (clnt, export_home,
+		(xdrproc_t) xdr_export_input, (caddr_t) argp,
+		(xdrproc_t) xdr_export_output, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
+		return (NULL);
+	}
+	return (&clnt_res);
+}
+
+import_output *
+import_home_1(import_input *argp, CLIENT *clnt)
+{
+	static import_output clnt_res;
+
+	memset((char *)&clnt_res, 0, sizeof(clnt_res));
+	if (clnt_call (clnt, import_home,
+		(xdrproc_t) xdr_import_input, (caddr_t) argp,
+		(xdrproc_t) xdr_import_output, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
 		return (NULL);
+	}
 	return (&clnt_res);
 }
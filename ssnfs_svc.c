@@ -4,75 +4,20 @@
  */
 
 #include "ssnfs.h"
-#include <string.h>
-#include <sys/ioctl.h>
-#include <unistd.h>
-#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <rpc/pmap_clnt.h>
-#include <sys/types.h>
-#include <netdb.h>
-#include <signal.h>
-#include <sys/ttycom.h>
+#include <string.h>
 #include <memory.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
-#include <syslog.h>
 
-#ifdef __STDC__
+#ifndef SIG_PF
 #define SIG_PF void(*)(int)
 #endif
 
-#ifdef DEBUG
-#define RPC_SVC_FG
-#endif
-
-#define _RPCSVC_CLOSEDOWN 120
-static int _rpcpmstart;		/* Started by a port monitor ? */
-static int _rpcfdtype;		/* Whether Stream or Datagram ? */
-static int _rpcsvcdirty;	/* Still serving ? */
-
-static
-void _msgout(msg)
-	char *msg;
-{
-#ifdef RPC_SVC_FG
-	if (_rpcpmstart)
-		syslog(LOG_ERR, "%s", msg);
-	else
-		(void) fprintf(stderr, "%s\n", msg);
-#else
-	syslog(LOG_ERR, "%s", msg);
-#endif
-}
-
-static void
-closedown()
-{
-	if (_rpcsvcdirty == 0) {
-		extern fd_set svc_fdset;
-		static int size;
-		int i, openfd;
-
-		if (_rpcfdtype == SOCK_DGRAM)
-			exit(0);
-		if (size == 0) {
-			size = getdtablesize();
-		}
-		for (i = 0, openfd = 0; i < size && openfd < 2; i++)
-			if (FD_ISSET(i, &svc_fdset))
-				openfd++;
-		if (openfd <= (_rpcpmstart?0:1))
-			exit(0);
-	}
-	(void) alarm(_RPCSVC_CLOSEDOWN);
-}
-
-static void
-ssnfsprog_1(rqstp, transp)
-	struct svc_req *rqstp;
-	SVCXPRT *transp;
+void
+ssnfsprog_1(struct svc_req *rqstp, register SVCXPRT *transp)
 {
 	union {
 		open_input open_file_1_arg;
@@ -83,184 +28,178 @@ ssnfsprog_1(rqstp, transp)
 		close_input close_file_1_arg;
 		seek_input seek_position_1_arg;
 		create_input create_file_1_arg;
+		get_input get_file_1_arg;
+		put_input put_file_1_arg;
+		lease_input lease_file_1_arg;
+		stats_input stats_1_arg;
+		defrag_input defrag_1_arg;
+		clone_input clone_file_1_arg;
+		snapshot_input snapshot_1_arg;
+		copy_input copy_range_1_arg;
+		search_input search_files_1_arg;
+		hash_input hash_file_1_arg;
+		sign_input sign_file_1_arg;
+		patch_input patch_file_1_arg;
+		export_input export_home_1_arg;
+		import_input import_home_1_arg;
 	} argument;
 	char *result;
-	bool_t (*xdr_argument)(), (*xdr_result)();
-	char *(*local)();
+	xdrproc_t _xdr_argument, _xdr_result;
+	char *(*local)(char *, struct svc_req *);
 
-	_rpcsvcdirty = 1;
 	switch (rqstp->rq_proc) {
 	case NULLPROC:
-		(void) svc_sendreply(transp, (xdrproc_t) xdr_void, (char *)NULL);
-		_rpcsvcdirty = 0;
+		(void) svc_sendreply (transp, (xdrproc_t) xdr_void, (char *)NULL);
 		return;
 
 	case open_file:
-		xdr_argument = (xdrproc_t)xdr_open_input;
-		xdr_result = (xdrproc_t)xdr_open_output;
-		local = (char *(*)()) open_file_1_svc;
+		_xdr_argument = (xdrproc_t) xdr_open_input;
+		_xdr_result = (xdrproc_t) xdr_open_output;
+		local = (char *(*)(char *, struct svc_req *)) open_file_1_svc;
 		break;
 
 	case read_file:
-		xdr_argument = (xdrproc_t)xdr_read_input;
-		xdr_result = (xdrproc_t)xdr_read_output;
-		local = (char *(*)()) read_file_1_svc;
+		_xdr_argument = (xdrproc_t) xdr_read_input;
+		_xdr_result = (xdrproc_t) xdr_read_output;
+		local = (char *(*)(char *, struct svc_req *)) read_file_1_svc;
 		break;
 
 	case write_file:
-		xdr_argument = (xdrproc_t)xdr_write_input;
-		xdr_result = (xdrproc_t)xdr_write_output;
-		local = (char *(*)()) write_file_1_svc;
+		_xdr_argument = (xdrproc_t) xdr_write_input;
+		_xdr_result = (xdrproc_t) xdr_write_output;
+		local = (char *(*)(char *, struct svc_req *)) write_file_1_svc;
 		break;
 
 	case list_files:
-		xdr_argument = (xdrproc_t)xdr_list_input;
-		xdr_result = (xdrproc_t)xdr_list_output;
-		local = (char *(*)()) list_files_1_svc;
+		_xdr_argument = (xdrproc_t) xdr_list_input;
+		_xdr_result = (xdrproc_t) xdr_list_output;
+		local = (char *(*)(char *, struct svc_req *)) list_files_1_svc;
 		break;
 
 	case delete_file:
-		xdr_argument = (xdrproc_t)xdr_delete_input;
-		xdr_result = (xdrproc_t)xdr_delete_output;
-		local = (char *(*)()) delete_file_1_svc;
+		_xdr_argument = (xdrproc_t) xdr_delete_input;
+		_xdr_result = (xdrproc_t) xdr_delete_output;
+		local = (char *(*)(char *, struct svc_req *)) delete_file_1_svc;
 		break;
 
 	case close_file:
-		xdr_argument = (xdrproc_t)xdr_close_input;
-		xdr_result = (xdrproc_t)xdr_close_output;
-		local = (char *(*)()) close_file_1_svc;
+		_xdr_argument = (xdrproc_t) xdr_close_input;
+		_xdr_result = (xdrproc_t) xdr_close_output;
+		local = (char *(*)(char *, struct svc_req *)) close_file_1_svc;
 		break;
 
 	case seek_position:
-		xdr_argument = (xdrproc_t)xdr_seek_input;
-		xdr_result = (xdrproc_t)xdr_seek_output;
-		local = (char *(*)()) seek_position_1_svc;
+		_xdr_argument = (xdrproc_t) xdr_seek_input;
+		_xdr_result = (xdrproc_t) xdr_seek_output;
+		local = (char *(*)(char *, struct svc_req *)) seek_position_1_svc;
 		break;
 
 	case create_file:
-		xdr_argument = (xdrproc_t)xdr_create_input;
-		xdr_result = (xdrproc_t)xdr_create_output;
-		local = (char *(*)()) create_file_1_svc;
+		_xdr_argument = (xdrproc_t) xdr_create_input;
+		_xdr_result = (xdrproc_t) xdr_create_output;
+		local = (char *(*)(char *, struct svc_req *)) create_file_1_svc;
 		break;
 
-	default:
-		svcerr_noproc(transp);
-		_rpcsvcdirty = 0;
-		return;
-	}
-	(void) memset((char *)&argument, 0, sizeof (argument));
-	if (!svc_getargs(transp, xdr_argument, (caddr_t) &argument)) {
-		svcerr_decode(transp);
-		_rpcsvcdirty = 0;
-		return;
-	}
-	result = (*local)(&argument, rqstp);
-	if (result != NULL && !svc_sendreply(transp, (xdrproc_t) xdr_result, result)) {
-		svcerr_systemerr(transp);
-	}
-	if (!svc_freeargs(transp, xdr_argument, (caddr_t) &argument)) {
-		_msgout("unable to free arguments");
-		exit(1);
-	}
-	_rpcsvcdirty = 0;
-	return;
-}
+	case get_file:
+		_xdr_argument = (xdrproc_t) xdr_get_input;
+		_xdr_result = (xdrproc_t) xdr_get_output;
+		local = (char *(*)(char *, struct svc_req *)) get_file_1_svc;
+		break;
 
+	case put_file:
+		_xdr_argument = (xdrproc_t) xdr_put_input;
+		_xdr_result = (xdrproc_t) xdr_put_output;
+		local = (char *(*)(char *, struct svc_req *)) put_file_1_svc;
+		break;
 
+	case lease_file:
+		_xdr_argument = (xdrproc_t) xdr_lease_input;
+		_xdr_result = (xdrproc_t) xdr_lease_output;
+		local = (char *(*)(char *, struct svc_req *)) lease_file_1_svc;
+		break;
 
-int
-main(argc, argv)
-int argc;
-char *argv[];
-{
-	SVCXPRT *transp = NULL;
-	int sock;
-	int proto = 0;
-	struct sockaddr_in saddr;
-	int asize = sizeof (saddr);
+	case stats:
+		_xdr_argument = (xdrproc_t) xdr_stats_input;
+		_xdr_result = (xdrproc_t) xdr_stats_output;
+		local = (char *(*)(char *, struct svc_req *)) stats_1_svc;
+		break;
 
-	if (getsockname(0, (struct sockaddr *)&saddr, &asize) == 0) {
-		int ssize = sizeof (int);
+	case defrag:
+		_xdr_argument = (xdrproc_t) xdr_defrag_input;
+		_xdr_result = (xdrproc_t) xdr_defrag_output;
+		local = (char *(*)(char *, struct svc_req *)) defrag_1_svc;
+		break;
 
-		if (saddr.sin_family != AF_INET)
-			exit(1);
-		if (getsockopt(0, SOL_SOCKET, SO_TYPE,
-				(char *)&_rpcfdtype, &ssize) == -1)
-			exit(1);
-		sock = 0;
-		_rpcpmstart = 1;
-		proto = 0;
-		openlog("ssnfs", LOG_PID, LOG_DAEMON);
-	} else {
-#ifndef RPC_SVC_FG
-		int size;
-		int pid, i;
+	case clone_file:
+		_xdr_argument = (xdrproc_t) xdr_clone_input;
+		_xdr_result = (xdrproc_t) xdr_clone_output;
+		local = (char *(*)(char *, struct svc_req *)) clone_file_1_svc;
+		break;
 
-		pid = fork();
-		if (pid < 0) {
-			perror("cannot fork");
-			exit(1);
-		}
-		if (pid)
-			exit(0);
-		size = getdtablesize();
-		for (i = 0; i < size; i++)
-			(void) close(i);
-		i = open("/dev/console", 2);
-		(void) dup2(i, 1);
-		(void) dup2(i, 2);
-		i = open("/dev/tty", 2);
-		if (i >= 0) {
-			(void) ioctl(i, TIOCNOTTY, (char *)NULL);
-			(void) close(i);
-		}
-		openlog("ssnfs", LOG_PID, LOG_DAEMON);
-#endif
-		sock = RPC_ANYSOCK;
-		(void) pmap_unset(SSNFSPROG, SSNFSVER);
-	}
+	case snapshot:
+		_xdr_argument = (xdrproc_t) xdr_snapshot_input;
+		_xdr_result = (xdrproc_t) xdr_snapshot_output;
+		local = (char *(*)(char *, struct svc_req *)) snapshot_1_svc;
+		break;
 
-	if ((_rpcfdtype == 0) || (_rpcfdtype == SOCK_DGRAM)) {
-		transp = svcudp_create(sock);
-		if (transp == NULL) {
-			_msgout("cannot create udp service.");
-			exit(1);
-		}
-		if (!_rpcpmstart)
-			proto = IPPROTO_UDP;
-		if (!svc_register(transp, SSNFSPROG, SSNFSVER, ssnfsprog_1, proto)) {
-			_msgout("unable to register (SSNFSPROG, SSNFSVER, udp).");
-			exit(1);
-		}
-	}
+	case copy_range:
+		_xdr_argument = (xdrproc_t) xdr_copy_input;
+		_xdr_result = (xdrproc_t) xdr_copy_output;
+		local = (char *(*)(char *, struct svc_req *)) copy_range_1_svc;
+		break;
 
-	if ((_rpcfdtype == 0) || (_rpcfdtype == SOCK_STREAM)) {
-		if (_rpcpmstart)
-			transp = svcfd_create(sock, 0, 0);
-		else
-			transp = svctcp_create(sock, 0, 0);
-		if (transp == NULL) {
-			_msgout("cannot create tcp service.");
-			exit(1);
-		}
-		if (!_rpcpmstart)
-			proto = IPPROTO_TCP;
-		if (!svc_register(transp, SSNFSPROG, SSNFSVER, ssnfsprog_1, proto)) {
-			_msgout("unable to register (SSNFSPROG, SSNFSVER, tcp).");
-			exit(1);
-		}
-	}
+	case search_files:
+		_xdr_argument = (xdrproc_t) xdr_search_input;
+		_xdr_result = (xdrproc_t) xdr_search_output;
+		local = (char *(*)(char *, struct svc_req *)) search_files_1_svc;
+		break;
+
+	case hash_file:
+		_xdr_argument = (xdrproc_t) xdr_hash_input;
+		_xdr_result = (xdrproc_t) xdr_hash_output;
+		local = (char *(*)(char *, struct svc_req *)) hash_file_1_svc;
+		break;
+
+	case sign_file:
+		_xdr_argument = (xdrproc_t) xdr_sign_input;
+		_xdr_result = (xdrproc_t) xdr_sign_output;
+		local = (char *(*)(char *, struct svc_req *)) sign_file_1_svc;
+		break;
+
+	case patch_file:
+		_xdr_argument = (xdrproc_t) xdr_patch_input;
+		_xdr_result = (xdrproc_t) xdr_patch_output;
+		local = (char *(*)(char *, struct svc_req *)) patch_file_1_svc;
+		break;
+
+	case export_home:
+		_xdr_argument = (xdrproc_t) xdr_export_input;
+		_xdr_result = (xdrproc_t) xdr_export_output;
+		local = (char *(*)(char *, struct svc_req *)) export_home_1_svc;
+		break;
+
+	case import_home:
+		_xdr_argument = (xdrproc_t) xdr_import_input;
+		_xdr_result = (xdrproc_t) xdr_import_output;
+		local = (char *(*)(char *, struct svc_req *)) import_home_1_svc;
+		break;
 
-	if (transp == (SVCXPRT *)NULL) {
-		_msgout("could not create a handle");
-		exit(1);
+	default:
+		svcerr_noproc (transp);
+		return;
+	}
+	memset ((char *)&argument, 0, sizeof (argument));
+	if (!svc_getargs (transp, (xdrproc_t) _xdr_argument, (caddr_t) &argument)) {
+		svcerr_decode (transp);
+		return;
+	}
+	result = (*local)((char *)&argument, rqstp);
+	if (result != NULL && !svc_sendreply(transp, (xdrproc_t) _xdr_result, result)) {
+		svcerr_systemerr (transp);
 	}
-	if (_rpcpmstart) {
-		(void) signal(SIGALRM, (void(*)()) closedown);
-		(void) alarm(_RPCSVC_CLOSEDOWN);
+	if (!svc_freeargs (transp, (xdrproc_t) _xdr_argument, (caddr_t) &argument)) {
+		fprintf (stderr, "%s", "unable to free arguments");
+		exit (1);
 	}
-	svc_run();
-	_msgout("svc_run returned");
-	exit(1);
-	/* NOTREACHED */
+	return;
 }
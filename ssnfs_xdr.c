@@ -6,211 +6,632 @@
 #include "ssnfs.h"
 
 bool_t
-xdr_create_input(xdrs, objp)
-	XDR *xdrs;
-	create_input *objp;
+xdr_create_input (XDR *xdrs, create_input *objp)
 {
+	 if (!xdr_vector (xdrs, (char *)objp->user_name, USER_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	 if (!xdr_vector (xdrs, (char *)objp->file_name, FILE_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_create_output (XDR *xdrs, create_output *objp)
+{
+	 if (!xdr_int (xdrs, &objp->success))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->out_msg.out_msg_val, (u_int *) &objp->out_msg.out_msg_len, ~0,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_open_input (XDR *xdrs, open_input *objp)
+{
+	 if (!xdr_vector (xdrs, (char *)objp->user_name, USER_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	 if (!xdr_vector (xdrs, (char *)objp->file_name, FILE_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_open_output (XDR *xdrs, open_output *objp)
+{
+	 if (!xdr_int (xdrs, &objp->fd))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->out_msg.out_msg_val, (u_int *) &objp->out_msg.out_msg_len, ~0,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_read_input (XDR *xdrs, read_input *objp)
+{
+	 if (!xdr_vector (xdrs, (char *)objp->user_name, USER_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->fd))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->numbytes))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_read_output (XDR *xdrs, read_output *objp)
+{
+	 if (!xdr_int (xdrs, &objp->success))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->buffer.buffer_val, (u_int *) &objp->buffer.buffer_len, ~0,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->out_msg.out_msg_val, (u_int *) &objp->out_msg.out_msg_len, ~0,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_write_input (XDR *xdrs, write_input *objp)
+{
+	 if (!xdr_vector (xdrs, (char *)objp->user_name, USER_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->fd))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->numbytes))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->buffer.buffer_val, (u_int *) &objp->buffer.buffer_len, ~0,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_write_output (XDR *xdrs, write_output *objp)
+{
+	 if (!xdr_int (xdrs, &objp->success))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->out_msg.out_msg_val, (u_int *) &objp->out_msg.out_msg_len, ~0,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_list_input (XDR *xdrs, list_input *objp)
+{
+	 if (!xdr_vector (xdrs, (char *)objp->user_name, USER_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_list_output (XDR *xdrs, list_output *objp)
+{
+	 if (!xdr_array (xdrs, (char **)&objp->out_msg.out_msg_val, (u_int *) &objp->out_msg.out_msg_len, ~0,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_seek_input (XDR *xdrs, seek_input *objp)
+{
+	 if (!xdr_vector (xdrs, (char *)objp->user_name, USER_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->fd))
+		 return FALSE;
+	 if (!xdr_quad_t (xdrs, &objp->position))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_seek_output (XDR *xdrs, seek_output *objp)
+{
+	 if (!xdr_int (xdrs, &objp->success))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->out_msg.out_msg_val, (u_int *) &objp->out_msg.out_msg_len, ~0,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_delete_input (XDR *xdrs, delete_input *objp)
+{
+	 if (!xdr_vector (xdrs, (char *)objp->user_name, USER_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	 if (!xdr_vector (xdrs, (char *)objp->file_name, FILE_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_delete_output (XDR *xdrs, delete_output *objp)
+{
+	 if (!xdr_int (xdrs, &objp->success))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->out_msg.out_msg_val, (u_int *) &objp->out_msg.out_msg_len, ~0,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_close_input (XDR *xdrs, close_input *objp)
+{
+	 if (!xdr_vector (xdrs, (char *)objp->user_name, USER_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->fd))
+		 return FALSE;
+	return TRUE;
+}
 
-	if (!xdr_vector(xdrs, (char *)objp->user_name, USER_NAME_SIZE, sizeof(char), (xdrproc_t)xdr_char))
-		return (FALSE);
-	if (!xdr_vector(xdrs, (char *)objp->file_name, FILE_NAME_SIZE, sizeof(char), (xdrproc_t)xdr_char))
-		return (FALSE);
-	return (TRUE);
+bool_t
+xdr_close_output (XDR *xdrs, close_output *objp)
+{
+	 if (!xdr_array (xdrs, (char **)&objp->out_msg.out_msg_val, (u_int *) &objp->out_msg.out_msg_len, ~0,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	return TRUE;
 }
 
 bool_t
-xdr_create_output(xdrs, objp)
-	XDR *xdrs;
-	create_output *objp;
+xdr_get_input (XDR *xdrs, get_input *objp)
 {
+	 if (!xdr_vector (xdrs, (char *)objp->user_name, USER_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	 if (!xdr_vector (xdrs, (char *)objp->file_name, FILE_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	return TRUE;
+}
 
-	if (!xdr_int(xdrs, &objp->success))
-		return (FALSE);
-	if (!xdr_array(xdrs, (char **)&objp->out_msg.out_msg_val, (u_int *)&objp->out_msg.out_msg_len, ~0, sizeof(char), (xdrproc_t)xdr_char))
-		return (FALSE);
-	return (TRUE);
+bool_t
+xdr_get_output (XDR *xdrs, get_output *objp)
+{
+	 if (!xdr_int (xdrs, &objp->success))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->buffer.buffer_val, (u_int *) &objp->buffer.buffer_len, ~0,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->out_msg.out_msg_val, (u_int *) &objp->out_msg.out_msg_len, ~0,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	return TRUE;
 }
 
 bool_t
-xdr_open_input(xdrs, objp)
-	XDR *xdrs;
-	open_input *objp;
+xdr_put_input (XDR *xdrs, put_input *objp)
 {
+	 if (!xdr_vector (xdrs, (char *)objp->user_name, USER_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	 if (!xdr_vector (xdrs, (char *)objp->file_name, FILE_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->buffer.buffer_val, (u_int *) &objp->buffer.buffer_len, ~0,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	return TRUE;
+}
 
-	if (!xdr_vector(xdrs, (char *)objp->user_name, USER_NAME_SIZE, sizeof(char), (xdrproc_t)xdr_char))
-		return (FALSE);
-	if (!xdr_vector(xdrs, (char *)objp->file_name, FILE_NAME_SIZE, sizeof(char), (xdrproc_t)xdr_char))
-		return (FALSE);
-	return (TRUE);
+bool_t
+xdr_put_output (XDR *xdrs, put_output *objp)
+{
+	 if (!xdr_int (xdrs, &objp->success))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->out_msg.out_msg_val, (u_int *) &objp->out_msg.out_msg_len, ~0,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	return TRUE;
 }
 
 bool_t
-xdr_open_output(xdrs, objp)
-	XDR *xdrs;
-	open_output *objp;
+xdr_lease_input (XDR *xdrs, lease_input *objp)
 {
+	 if (!xdr_vector (xdrs, (char *)objp->user_name, USER_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	 if (!xdr_vector (xdrs, (char *)objp->file_name, FILE_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->op))
+		 return FALSE;
+	return TRUE;
+}
 
-	if (!xdr_int(xdrs, &objp->fd))
-		return (FALSE);
-	if (!xdr_array(xdrs, (char **)&objp->out_msg.out_msg_val, (u_int *)&objp->out_msg.out_msg_len, ~0, sizeof(char), (xdrproc_t)xdr_char))
-		return (FALSE);
-	return (TRUE);
+bool_t
+xdr_lease_output (XDR *xdrs, lease_output *objp)
+{
+	 if (!xdr_int (xdrs, &objp->granted))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->seconds))
+		 return FALSE;
+	 if (!xdr_u_int (xdrs, &objp->file_version))
+		 return FALSE;
+	 if (!xdr_quad_t (xdrs, &objp->size))
+		 return FALSE;
+	 if (!xdr_quad_t (xdrs, &objp->max_size))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->out_msg.out_msg_val, (u_int *) &objp->out_msg.out_msg_len, ~0,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	return TRUE;
 }
 
 bool_t
-xdr_read_input(xdrs, objp)
-	XDR *xdrs;
-	read_input *objp;
+xdr_stats_input (XDR *xdrs, stats_input *objp)
 {
+	 if (!xdr_int (xdrs, &objp->reset))
+		 return FALSE;
+	return TRUE;
+}
 
-	if (!xdr_vector(xdrs, (char *)objp->user_name, USER_NAME_SIZE, sizeof(char), (xdrproc_t)xdr_char))
-		return (FALSE);
-	if (!xdr_int(xdrs, &objp->fd))
-		return (FALSE);
-	if (!xdr_int(xdrs, &objp->numbytes))
-		return (FALSE);
-	return (TRUE);
+bool_t
+xdr_stats_output (XDR *xdrs, stats_output *objp)
+{
+	 if (!xdr_int (xdrs, &objp->success))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->out_msg.out_msg_val, (u_int *) &objp->out_msg.out_msg_len, ~0,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	return TRUE;
 }
 
 bool_t
-xdr_read_output(xdrs, objp)
-	XDR *xdrs;
-	read_output *objp;
+xdr_defrag_input (XDR *xdrs, defrag_input *objp)
 {
+	 if (!xdr_int (xdrs, &objp->action))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->budget_kb))
+		 return FALSE;
+	return TRUE;
+}
 
-	if (!xdr_int(xdrs, &objp->success))
-		return (FALSE);
-	if (!xdr_array(xdrs, (char **)&objp->buffer.buffer_val, (u_int *)&objp->buffer.buffer_len, ~0, sizeof(char), (xdrproc_t)xdr_char))
-		return (FALSE);
-	if (!xdr_array(xdrs, (char **)&objp->out_msg.out_msg_val, (u_int *)&objp->out_msg.out_msg_len, ~0, sizeof(char), (xdrproc_t)xdr_char))
-		return (FALSE);
-	return (TRUE);
+bool_t
+xdr_defrag_output (XDR *xdrs, defrag_output *objp)
+{
+	 if (!xdr_int (xdrs, &objp->success))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->out_msg.out_msg_val, (u_int *) &objp->out_msg.out_msg_len, ~0,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	return TRUE;
 }
 
 bool_t
-xdr_write_input(xdrs, objp)
-	XDR *xdrs;
-	write_input *objp;
+xdr_clone_input (XDR *xdrs, clone_input *objp)
 {
+	 if (!xdr_vector (xdrs, (char *)objp->user_name, USER_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	 if (!xdr_vector (xdrs, (char *)objp->file_name, FILE_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	 if (!xdr_vector (xdrs, (char *)objp->new_name, FILE_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	return TRUE;
+}
 
-	if (!xdr_vector(xdrs, (char *)objp->user_name, USER_NAME_SIZE, sizeof(char), (xdrproc_t)xdr_char))
-		return (FALSE);
-	if (!xdr_int(xdrs, &objp->fd))
-		return (FALSE);
-	if (!xdr_int(xdrs, &objp->numbytes))
-		return (FALSE);
-	if (!xdr_array(xdrs, (char **)&objp->buffer.buffer_val, (u_int *)&objp->buffer.buffer_len, ~0, sizeof(char), (xdrproc_t)xdr_char))
-		return (FALSE);
-	return (TRUE);
+bool_t
+xdr_clone_output (XDR *xdrs, clone_output *objp)
+{
+	 if (!xdr_int (xdrs, &objp->success))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->out_msg.out_msg_val, (u_int *) &objp->out_msg.out_msg_len, ~0,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_snapshot_input (XDR *xdrs, snapshot_input *objp)
+{
+	 if (!xdr_vector (xdrs, (char *)objp->user_name, USER_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	 if (!xdr_vector (xdrs, (char *)objp->snap_name, USER_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->action))
+		 return FALSE;
+	return TRUE;
 }
 
 bool_t
-xdr_write_output(xdrs, objp)
-	XDR *xdrs;
-	write_output *objp;
+xdr_snapshot_output (XDR *xdrs, snapshot_output *objp)
 {
+	 if (!xdr_int (xdrs, &objp->success))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->out_msg.out_msg_val, (u_int *) &objp->out_msg.out_msg_len, ~0,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	return TRUE;
+}
 
-	if (!xdr_int(xdrs, &objp->success))
-		return (FALSE);
-	if (!xdr_array(xdrs, (char **)&objp->out_msg.out_msg_val, (u_int *)&objp->out_msg.out_msg_len, ~0, sizeof(char), (xdrproc_t)xdr_char))
-		return (FALSE);
-	return (TRUE);
+bool_t
+xdr_copy_input (XDR *xdrs, copy_input *objp)
+{
+	 if (!xdr_vector (xdrs, (char *)objp->user_name, USER_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->src_fd))
+		 return FALSE;
+	 if (!xdr_quad_t (xdrs, &objp->src_pos))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->dst_fd))
+		 return FALSE;
+	 if (!xdr_quad_t (xdrs, &objp->dst_pos))
+		 return FALSE;
+	 if (!xdr_quad_t (xdrs, &objp->length))
+		 return FALSE;
+	return TRUE;
 }
 
 bool_t
-xdr_list_input(xdrs, objp)
-	XDR *xdrs;
-	list_input *objp;
+xdr_copy_output (XDR *xdrs, copy_output *objp)
 {
+	 if (!xdr_int (xdrs, &objp->success))
+		 return FALSE;
+	 if (!xdr_quad_t (xdrs, &objp->copied))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->out_msg.out_msg_val, (u_int *) &objp->out_msg.out_msg_len, ~0,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	return TRUE;
+}
 
-	if (!xdr_vector(xdrs, (char *)objp->user_name, USER_NAME_SIZE, sizeof(char), (xdrproc_t)xdr_char))
-		return (FALSE);
-	return (TRUE);
+bool_t
+xdr_search_input (XDR *xdrs, search_input *objp)
+{
+	 if (!xdr_vector (xdrs, (char *)objp->user_name, USER_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->pattern.pattern_val, (u_int *) &objp->pattern.pattern_len, ~0,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->max_matches))
+		 return FALSE;
+	return TRUE;
 }
 
 bool_t
-xdr_list_output(xdrs, objp)
-	XDR *xdrs;
-	list_output *objp;
+xdr_search_match (XDR *xdrs, search_match *objp)
 {
+	 if (!xdr_vector (xdrs, (char *)objp->file_name, FILE_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	 if (!xdr_quad_t (xdrs, &objp->offset))
+		 return FALSE;
+	return TRUE;
+}
 
-	if (!xdr_array(xdrs, (char **)&objp->out_msg.out_msg_val, (u_int *)&objp->out_msg.out_msg_len, ~0, sizeof(char), (xdrproc_t)xdr_char))
-		return (FALSE);
-	return (TRUE);
+bool_t
+xdr_search_output (XDR *xdrs, search_output *objp)
+{
+	 if (!xdr_int (xdrs, &objp->success))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->matches.matches_val, (u_int *) &objp->matches.matches_len, ~0,
+		sizeof (search_match), (xdrproc_t) xdr_search_match))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->files))
+		 return FALSE;
+	 if (!xdr_quad_t (xdrs, &objp->scanned))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->out_msg.out_msg_val, (u_int *) &objp->out_msg.out_msg_len, ~0,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	return TRUE;
 }
 
 bool_t
-xdr_seek_input(xdrs, objp)
-	XDR *xdrs;
-	seek_input *objp;
+xdr_hash_input (XDR *xdrs, hash_input *objp)
 {
+	 if (!xdr_vector (xdrs, (char *)objp->user_name, USER_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	 if (!xdr_vector (xdrs, (char *)objp->file_name, FILE_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	 if (!xdr_quad_t (xdrs, &objp->offset))
+		 return FALSE;
+	 if (!xdr_quad_t (xdrs, &objp->length))
+		 return FALSE;
+	return TRUE;
+}
 
-	if (!xdr_vector(xdrs, (char *)objp->user_name, USER_NAME_SIZE, sizeof(char), (xdrproc_t)xdr_char))
-		return (FALSE);
-	if (!xdr_int(xdrs, &objp->fd))
-		return (FALSE);
-	if (!xdr_int(xdrs, &objp->position))
-		return (FALSE);
-	return (TRUE);
+bool_t
+xdr_hash_output (XDR *xdrs, hash_output *objp)
+{
+	 if (!xdr_int (xdrs, &objp->success))
+		 return FALSE;
+	 if (!xdr_opaque (xdrs, objp->digest, HASH_SIZE))
+		 return FALSE;
+	 if (!xdr_quad_t (xdrs, &objp->size))
+		 return FALSE;
+	 if (!xdr_u_int (xdrs, &objp->file_version))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->cached))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->out_msg.out_msg_val, (u_int *) &objp->out_msg.out_msg_len, ~0,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	return TRUE;
 }
 
 bool_t
-xdr_seek_output(xdrs, objp)
-	XDR *xdrs;
-	seek_output *objp;
+xdr_sign_input (XDR *xdrs, sign_input *objp)
 {
+	 if (!xdr_vector (xdrs, (char *)objp->user_name, USER_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	 if (!xdr_vector (xdrs, (char *)objp->file_name, FILE_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->block_len))
+		 return FALSE;
+	return TRUE;
+}
 
-	if (!xdr_int(xdrs, &objp->success))
-		return (FALSE);
-	if (!xdr_array(xdrs, (char **)&objp->out_msg.out_msg_val, (u_int *)&objp->out_msg.out_msg_len, ~0, sizeof(char), (xdrproc_t)xdr_char))
-		return (FALSE);
-	return (TRUE);
+bool_t
+xdr_sign_block (XDR *xdrs, sign_block *objp)
+{
+	 if (!xdr_u_int (xdrs, &objp->weak))
+		 return FALSE;
+	 if (!xdr_opaque (xdrs, objp->strong, SIGN_STRONG))
+		 return FALSE;
+	return TRUE;
 }
 
 bool_t
-xdr_delete_input(xdrs, objp)
-	XDR *xdrs;
-	delete_input *objp;
+xdr_sign_output (XDR *xdrs, sign_output *objp)
 {
+	 if (!xdr_int (xdrs, &objp->success))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->block_len))
+		 return FALSE;
+	 if (!xdr_quad_t (xdrs, &objp->size))
+		 return FALSE;
+	 if (!xdr_u_int (xdrs, &objp->file_version))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->blocks.blocks_val, (u_int *) &objp->blocks.blocks_len, ~0,
+		sizeof (sign_block), (xdrproc_t) xdr_sign_block))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->out_msg.out_msg_val, (u_int *) &objp->out_msg.out_msg_len, ~0,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	return TRUE;
+}
 
-	if (!xdr_vector(xdrs, (char *)objp->user_name, USER_NAME_SIZE, sizeof(char), (xdrproc_t)xdr_char))
-		return (FALSE);
-	if (!xdr_vector(xdrs, (char *)objp->file_name, FILE_NAME_SIZE, sizeof(char), (xdrproc_t)xdr_char))
-		return (FALSE);
-	return (TRUE);
+bool_t
+xdr_delta_op (XDR *xdrs, delta_op *objp)
+{
+	 if (!xdr_quad_t (xdrs, &objp->offset))
+		 return FALSE;
+	 if (!xdr_quad_t (xdrs, &objp->length))
+		 return FALSE;
+	return TRUE;
 }
 
 bool_t
-xdr_delete_output(xdrs, objp)
-	XDR *xdrs;
-	delete_output *objp;
+xdr_patch_input (XDR *xdrs, patch_input *objp)
 {
+	 if (!xdr_vector (xdrs, (char *)objp->user_name, USER_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	 if (!xdr_vector (xdrs, (char *)objp->file_name, FILE_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	 if (!xdr_u_int (xdrs, &objp->file_version))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->ops.ops_val, (u_int *) &objp->ops.ops_len, ~0,
+		sizeof (delta_op), (xdrproc_t) xdr_delta_op))
+		 return FALSE;
+	 if (!xdr_bytes (xdrs, (char **)&objp->data.data_val, (u_int *) &objp->data.data_len, ~0))
+		 return FALSE;
+	return TRUE;
+}
 
-	if (!xdr_array(xdrs, (char **)&objp->out_msg.out_msg_val, (u_int *)&objp->out_msg.out_msg_len, ~0, sizeof(char), (xdrproc_t)xdr_char))
-		return (FALSE);
-	return (TRUE);
+bool_t
+xdr_patch_output (XDR *xdrs, patch_output *objp)
+{
+	 if (!xdr_int (xdrs, &objp->success))
+		 return FALSE;
+	 if (!xdr_quad_t (xdrs, &objp->size))
+		 return FALSE;
+	 if (!xdr_quad_t (xdrs, &objp->written))
+		 return FALSE;
+	 if (!xdr_u_int (xdrs, &objp->file_version))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->out_msg.out_msg_val, (u_int *) &objp->out_msg.out_msg_len, ~0,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	return TRUE;
 }
 
 bool_t
-xdr_close_input(xdrs, objp)
-	XDR *xdrs;
-	close_input *objp;
+xdr_export_input (XDR *xdrs, export_input *objp)
 {
+	 if (!xdr_vector (xdrs, (char *)objp->user_name, USER_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	 if (!xdr_quad_t (xdrs, &objp->offset))
+		 return FALSE;
+	 if (!xdr_u_int (xdrs, &objp->generation))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->max_bytes))
+		 return FALSE;
+	return TRUE;
+}
 
-	if (!xdr_vector(xdrs, (char *)objp->user_name, USER_NAME_SIZE, sizeof(char), (xdrproc_t)xdr_char))
-		return (FALSE);
-	if (!xdr_int(xdrs, &objp->fd))
-		return (FALSE);
-	return (TRUE);
+bool_t
+xdr_export_output (XDR *xdrs, export_output *objp)
+{
+	 if (!xdr_int (xdrs, &objp->success))
+		 return FALSE;
+	 if (!xdr_u_int (xdrs, &objp->generation))
+		 return FALSE;
+	 if (!xdr_quad_t (xdrs, &objp->total))
+		 return FALSE;
+	 if (!xdr_quad_t (xdrs, &objp->next))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->files))
+		 return FALSE;
+	 if (!xdr_bytes (xdrs, (char **)&objp->data.data_val, (u_int *) &objp->data.data_len, ~0))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->out_msg.out_msg_val, (u_int *) &objp->out_msg.out_msg_len, ~0,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	return TRUE;
 }
 
 bool_t
-xdr_close_output(xdrs, objp)
-	XDR *xdrs;
-	close_output *objp;
+xdr_import_input (XDR *xdrs, import_input *objp)
 {
+	 if (!xdr_vector (xdrs, (char *)objp->user_name, USER_NAME_SIZE,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	 if (!xdr_quad_t (xdrs, &objp->offset))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->replace))
+		 return FALSE;
+	 if (!xdr_bytes (xdrs, (char **)&objp->data.data_val, (u_int *) &objp->data.data_len, ~0))
+		 return FALSE;
+	return TRUE;
+}
 
-	if (!xdr_array(xdrs, (char **)&objp->out_msg.out_msg_val, (u_int *)&objp->out_msg.out_msg_len, ~0, sizeof(char), (xdrproc_t)xdr_char))
-		return (FALSE);
-	return (TRUE);
+bool_t
+xdr_import_output (XDR *xdrs, import_output *objp)
+{
+	 if (!xdr_int (xdrs, &objp->success))
+		 return FALSE;
+	 if (!xdr_quad_t (xdrs, &objp->next))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->done))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->files))
+		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->skipped))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->out_msg.out_msg_val, (u_int *) &objp->out_msg.out_msg_len, ~0,
+		sizeof (char), (xdrproc_t) xdr_char))
+		 return FALSE;
+	return TRUE;
 }
@@ -0,0 +1,64 @@
+/*
+ * Procedure table and XDR routines for trace files, see trace.h.
+ */
+
+#include "trace.h"
+
+#define PROC(name, arg, res) \
+    { name, (xdrproc_t)xdr_##arg, sizeof(arg), (xdrproc_t)xdr_##res, sizeof(res) }
+
+const proc_info_t ssnfs_procs[NPROCS] = {
+    { "null", (xdrproc_t)xdr_void, 0, (xdrproc_t)xdr_void, 0 },
+    PROC("open_file", open_input, open_output),
+    PROC("read_file", read_input, read_output),
+    PROC("write_file", write_input, write_output),
+    PROC("list_files", list_input, list_output),
+    PROC("delete_file", delete_input, delete_output),
+    PROC("close_file", close_input, close_output),
+    PROC("seek_position", seek_input, seek_output),
+    PROC("create_file", create_input, create_output),
+    PROC("get_file", get_input, get_output),
+    PROC("put_file", put_input, put_output),
+    PROC("lease_file", lease_input, lease_output),
+    PROC("stats", stats_input, stats_output),
+    PROC("defrag", defrag_input, defrag_output),
+    PROC("clone_file", clone_input, clone_output),
+    PROC("snapshot", snapshot_input, snapshot_output),
+    PROC("copy_range", copy_input, copy_output),
+    PROC("search_files", search_input, search_output),
+    PROC("hash_file", hash_input, hash_output),
+    PROC("sign_file", sign_input, sign_output),
+    PROC("patch_file", patch_input, patch_output),
+    PROC("export_home", export_input, export_output),
+    PROC("import_home", import_input, import_output),
+};
+
+bool_t xdr_trace_hdr(XDR *xdrs, trace_hdr_t *objp) {
+    if (!xdr_u_int(xdrs, &objp->magic))
+        return (FALSE);
+    if (!xdr_u_int(xdrs, &objp->version))
+        return (FALSE);
+    if (!xdr_u_int(xdrs, &objp->flags))
+        return (FALSE);
+    if (!xdr_u_int64_t(xdrs, &objp->start))
+        return (FALSE);
+    return (TRUE);
+}
+
+bool_t xdr_trace_rec(XDR *xdrs, trace_rec_t *objp) {
+    if (!xdr_u_int(xdrs, &objp->proc))
+        return (FALSE);
+    if (!xdr_u_int64_t(xdrs, &objp->conn))
+        return (FALSE);
+    if (!xdr_u_int64_t(xdrs, &objp->arrival))
+        return (FALSE);
+    if (!xdr_u_int64_t(xdrs, &objp->service))
+        return (FALSE);
+    if (!xdr_int(xdrs, &objp->ret))
+        return (FALSE);
+    if (!xdr_u_int(xdrs, &objp->data_len))
+        return (FALSE);
+    if (!xdr_bytes(xdrs, &objp->args.args_val, &objp->args.args_len, ~0))
+        return (FALSE);
+    return (TRUE);
+}
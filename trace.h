@@ -0,0 +1,53 @@
+/*
+ * RPC trace files, written by server -T and read by replay.
+ *
+ * A trace is a stream of XDR items: one trace_hdr_t, then one
+ * trace_rec_t per call in the order the calls were served.
+ */
+
+#ifndef SSNFS_TRACE_H
+#define SSNFS_TRACE_H
+
+#include <rpc/rpc.h>
+#include "ssnfs.h"
+
+#define NPROCS        ((int)import_home + 1)  /* procedure numbers 0..import_home */
+#define TRACE_MAGIC   0x53534e54         /* "SSNT" */
+#define TRACE_VERSION 1
+#define TRACE_PAYLOAD 0x1                /* file data kept in write/put args */
+
+/* what a procedure takes and returns, indexed by procedure number */
+typedef struct {
+    const char *name;
+    xdrproc_t   xdr_arg;
+    size_t      arg_size;
+    xdrproc_t   xdr_res;
+    size_t      res_size;
+} proc_info_t;
+
+extern const proc_info_t ssnfs_procs[NPROCS];
+
+typedef struct {
+    u_int     magic;
+    u_int     version;
+    u_int     flags;
+    u_int64_t start;       /* wall clock of the first call, ns since epoch */
+} trace_hdr_t;
+
+typedef struct {
+    u_int     proc;
+    u_int64_t conn;        /* connection the call came in on */
+    u_int64_t arrival;     /* ns since the trace started */
+    u_int64_t service;     /* ns from arrival until the reply went out */
+    int       ret;         /* open_file: fd returned; else 1 ok, -1 failed */
+    u_int     data_len;    /* file data in the call, even when not kept */
+    struct {
+        u_int args_len;
+        char *args_val;    /* XDR-encoded arguments */
+    } args;
+} trace_rec_t;
+
+bool_t xdr_trace_hdr(XDR *xdrs, trace_hdr_t *objp);
+bool_t xdr_trace_rec(XDR *xdrs, trace_rec_t *objp);
+
+#endif /* SSNFS_TRACE_H */
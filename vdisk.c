@@ -0,0 +1,877 @@
+/*
+ * Virtual disk layout and formatting, see vdisk.h.
+ */
+
+#define _GNU_SOURCE     /* fallocate, copy_file_range */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "vdisk.h"
+#include "crc32c.h"
+
+#define VD_IOV 64       /* stripe units per member and round of a request */
+#define VD_COPY_BUF (256 * 1024)    /* vdisk_copy without copy_file_range */
+
+enum { VD_IDLE, VD_READ, VD_WRITE, VD_SYNC, VD_EXIT };
+
+/* a member's share of one round: pieces that are contiguous on the member,
+   the same for every copy */
+typedef struct {
+    struct iovec iov[VD_IOV];
+    int          iovcnt;
+    off_t        off;
+    size_t       len;
+} vd_seg_t;
+
+struct vdisk_worker {
+    pthread_t       thread;
+    vdisk_t        *vd;
+    int             file;      /* index into vd->fd */
+    int             op;        /* job posted, VD_IDLE once done */
+    vd_seg_t       *seg;
+    int             err;       /* errno of the last job, 0 if it worked */
+    pthread_mutex_t use;       /* held by the caller with a job posted */
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+};
+
+/* CRC-32C of a superblock or trailer, taken with its sum 0 */
+static u_int vd_sum(const superblock_t *sb) {
+    superblock_t copy = *sb;
+    u_int c;
+
+    copy.sum = 0;
+    c = crc32c(0, &copy, sizeof(copy));
+    return c ? c : 1;
+}
+
+/* blocks needed for len bytes */
+static u_int64_t blocks_for(u_int64_t len, u_int block_size) {
+    return (len + block_size - 1) / block_size;
+}
+
+int vdisk_layout(superblock_t *sb, char *err, int errlen) {
+    u_int64_t bs = sb->block_size, blocks, at;
+
+    if (bs < VDISK_MIN_BLOCK || bs > VDISK_MAX_BLOCK || (bs & (bs - 1)) != 0) {
+        snprintf(err, errlen, "block size %llu is not a power of two from %d to %d",
+                 (unsigned long long)bs, VDISK_MIN_BLOCK, VDISK_MAX_BLOCK);
+        return -1;
+    }
+    if (sb->max_users == 0 || sb->max_files_user == 0 || sb->blocks_per_file == 0) {
+        snprintf(err, errlen, "users, files per user and file size must be nonzero");
+        return -1;
+    }
+    if (sb->members < 1 || sb->members > VDISK_MAX_MEMBERS || sb->stripe_blocks == 0) {
+        snprintf(err, errlen, "need 1 to %d members and a nonzero stripe unit", VDISK_MAX_MEMBERS);
+        return -1;
+    }
+    if ((u_int64_t)sb->max_users * sb->max_files_user > INT_MAX) {
+        snprintf(err, errlen, "more than %d files in all", INT_MAX);
+        return -1;
+    }
+    blocks = sb->disk_size / bs;
+    blocks -= blocks % ((u_int64_t)sb->stripe_blocks * sb->members);
+    if (blocks > VDISK_MAX_BLOCKS) {
+        snprintf(err, errlen, "more than %llu blocks, use a larger block size", VDISK_MAX_BLOCKS);
+        return -1;
+    }
+
+    sb->magic = VDISK_MAGIC;
+    sb->version = VDISK_VERSION;
+    sb->total_blocks = blocks;
+    sb->disk_size = blocks * bs;
+    at = 1;                                         /* superblock */
+    sb->bitmap_off = at * bs;
+    at += blocks_for((blocks + 63) / 64 * sizeof(u_int64_t), bs);
+    sb->users_off = at * bs;
+    at += blocks_for((u_int64_t)sb->max_users * sizeof(user_meta_t), bs);
+    sb->files_off = at * bs;
+    at += blocks_for((u_int64_t)sb->max_users * sb->max_files_user * sizeof(file_meta_t), bs);
+    sb->sums_off = at * bs;
+    at += blocks_for(blocks * sizeof(u_int32_t), bs);
+    if (at + sb->blocks_per_file > blocks) {
+        snprintf(err, errlen, "disk of %llu blocks has no room for a file after %llu metadata blocks",
+                 (unsigned long long)blocks, (unsigned long long)at);
+        return -1;
+    }
+    sb->data_block = at;
+    sb->sum = vd_sum(sb);
+    return 0;
+}
+
+u_int64_t vdisk_chunk_size(const superblock_t *sb) {
+    u_int64_t file = (u_int64_t)sb->blocks_per_file * sb->block_size;
+    u_int64_t chunk = sb->block_size > VDISK_CHUNK_MIN ? sb->block_size : VDISK_CHUNK_MIN;
+
+    while (chunk * VDISK_CHUNKS < file)
+        chunk <<= 1;
+    return chunk / VDISK_CHUNK_UNIT <= 0xffff ? chunk : 0;
+}
+
+int vdisk_check(const superblock_t *sb, char *err, int errlen) {
+    superblock_t want;
+
+    if (sb->magic != VDISK_MAGIC) {
+        snprintf(err, errlen, "no superblock, format the image with mkdisk");
+        return -1;
+    }
+    if (sb->version != VDISK_VERSION) {
+        snprintf(err, errlen, "format version %u, this build reads %d (reformat with mkdisk)",
+                 sb->version, VDISK_VERSION);
+        return -1;
+    }
+    if (sb->sum != vd_sum(sb)) {
+        snprintf(err, errlen, "superblock checksum mismatch, the image is damaged");
+        return -1;
+    }
+    memset(&want, 0, sizeof(want));
+    want.block_size = sb->block_size;
+    want.disk_size = sb->disk_size;
+    want.blocks_per_file = sb->blocks_per_file;
+    want.max_users = sb->max_users;
+    want.max_files_user = sb->max_files_user;
+    want.members = sb->members;
+    want.stripe_blocks = sb->stripe_blocks;
+    want.image_id = sb->image_id;
+    want.member = sb->member;
+    want.generation = sb->generation;
+    if (vdisk_layout(&want, err, errlen) != 0)
+        return -1;
+    if (memcmp(&want, sb, sizeof(want)) != 0) {
+        snprintf(err, errlen, "superblock table offsets are inconsistent");
+        return -1;
+    }
+    return 0;
+}
+
+/* one file's share of a request, or an fsync; returns 0 or an errno */
+static int vd_file_io(vdisk_t *vd, int file, int op, vd_seg_t *seg) {
+    ssize_t n;
+
+    if (op == VD_SYNC)
+        return fsync(vd->fd[file]) < 0 ? errno : 0;
+    if (op == VD_READ)
+        n = preadv(vd->fd[file], seg->iov, seg->iovcnt, seg->off);
+    else
+        n = pwritev(vd->fd[file], seg->iov, seg->iovcnt, seg->off);
+    if (n < 0) return errno;
+    return (size_t)n == seg->len ? 0 : EIO;
+}
+
+static void *vd_worker(void *arg) {
+    struct vdisk_worker *w = arg;
+    int op, err;
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (w->op == VD_IDLE)
+            pthread_cond_wait(&w->cond, &w->lock);
+        if (w->op == VD_EXIT)
+            break;
+        op = w->op;
+        pthread_mutex_unlock(&w->lock);
+        err = vd_file_io(w->vd, w->file, op, w->seg);
+        pthread_mutex_lock(&w->lock);
+        w->err = err;
+        w->op = VD_IDLE;
+        pthread_cond_broadcast(&w->cond);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+/* A caller owns the worker from vd_post to vd_wait, so concurrent
+   requests queue up.  Callers post in ascending file order, which keeps
+   them from deadlocking on each other. */
+static void vd_post(struct vdisk_worker *w, int op, vd_seg_t *seg) {
+    pthread_mutex_lock(&w->use);
+    pthread_mutex_lock(&w->lock);
+    w->seg = seg;
+    w->op = op;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+}
+
+static int vd_wait(struct vdisk_worker *w) {
+    int err;
+    pthread_mutex_lock(&w->lock);
+    while (w->op != VD_IDLE)
+        pthread_cond_wait(&w->cond, &w->lock);
+    err = w->err;
+    pthread_mutex_unlock(&w->lock);
+    pthread_mutex_unlock(&w->use);
+    return err;
+}
+
+/* geometry for I/O, and a worker per file when there are several */
+static int vd_start(vdisk_t *vd, const superblock_t *sb) {
+    int f, files = vd->members * vd->copies;
+
+    vd->sb = *sb;
+    vd->unit = (u_int64_t)sb->stripe_blocks * sb->block_size;
+    vd->member_size = sb->disk_size / sb->members;
+    if (files == 1 || vd->workers != NULL)
+        return 0;
+    vd->workers = calloc(files, sizeof(*vd->workers));
+    if (vd->workers == NULL)
+        return -1;
+    for (f = 0; f < files; f++) {
+        struct vdisk_worker *w = &vd->workers[f];
+        w->vd = vd;
+        w->file = f;
+        pthread_mutex_init(&w->use, NULL);
+        pthread_mutex_init(&w->lock, NULL);
+        pthread_cond_init(&w->cond, NULL);
+        if (pthread_create(&w->thread, NULL, vd_worker, w) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+static u_int vd_up(const vdisk_t *vd) {
+    return ((1u << vd->copies) - 1) & ~vd->down;
+}
+
+static int vd_lowest(u_int copies) {
+    return __builtin_ctz(copies);
+}
+
+/* Run op for len bytes at off on each copy in copies.  The request is
+   split into per-member segments, a round of at most VD_IOV stripe units
+   per member at a time; the segments go to the same members of every
+   copy, all files of a round in parallel, the first served on the calling
+   thread.  A copy that fails is not tried again.  Returns the copies that
+   failed, with the errno of one failure in *errp. */
+static u_int vd_run(vdisk_t *vd, u_int copies, int op, char *buf, size_t len, off_t off, int *errp) {
+    vd_seg_t seg[VDISK_MAX_MEMBERS];
+    size_t   done = 0, k;
+    u_int64_t o, u, in;
+    u_int    failed = 0;
+    int      c, m, first, self, e;
+
+    while (done < len && copies != 0) {
+        for (m = 0; m < vd->members; m++) {
+            seg[m].iovcnt = 0;
+            seg[m].len = 0;
+        }
+        first = -1;
+        while (done < len) {
+            o = off + done;
+            u = o / vd->unit;
+            in = o % vd->unit;
+            m = u % vd->members;
+            if (seg[m].iovcnt == VD_IOV)
+                break;
+            k = vd->unit - in;
+            if (k > len - done) k = len - done;
+            if (seg[m].iovcnt == 0)
+                seg[m].off = (u / vd->members) * vd->unit + in;
+            if (first < 0)
+                first = m;
+            seg[m].iov[seg[m].iovcnt].iov_base = buf + done;
+            seg[m].iov[seg[m].iovcnt].iov_len = k;
+            seg[m].iovcnt++;
+            seg[m].len += k;
+            done += k;
+        }
+        self = vd_lowest(copies) * vd->members + first;
+        for (c = 0; c < vd->copies; c++) {
+            if (!(copies & 1u << c)) continue;
+            for (m = 0; m < vd->members; m++)
+                if (seg[m].iovcnt > 0 && c * vd->members + m != self)
+                    vd_post(&vd->workers[c * vd->members + m], op, &seg[m]);
+        }
+        if ((e = vd_file_io(vd, self, op, &seg[first])) != 0) {
+            failed |= 1u << (self / vd->members);
+            *errp = e;
+        }
+        for (c = 0; c < vd->copies; c++) {
+            if (!(copies & 1u << c)) continue;
+            for (m = 0; m < vd->members; m++) {
+                if (seg[m].iovcnt == 0 || c * vd->members + m == self)
+                    continue;
+                if ((e = vd_wait(&vd->workers[c * vd->members + m])) != 0) {
+                    failed |= 1u << c;
+                    *errp = e;
+                }
+            }
+        }
+        copies &= ~failed;
+    }
+    return failed;
+}
+
+/* Write the trailers of the copies in use with the current generation and
+   flush them.  A copy whose trailers cannot be written drops out.
+   Returns 0, or -1 if none could be written. */
+static int vd_mark(vdisk_t *vd) {
+    superblock_t trailer;
+    u_int up = vd_up(vd);
+    int c, m, f;
+
+    for (c = 0; c < vd->copies; c++) {
+        if (!(up & 1u << c)) continue;
+        for (m = 0; m < vd->members; m++) {
+            f = c * vd->members + m;
+            trailer = vd->sb;
+            trailer.member = m;
+            trailer.generation = vd->generation;
+            trailer.sum = vd_sum(&trailer);
+            if (pwrite(vd->fd[f], &trailer, sizeof(trailer), vd->member_size) != sizeof(trailer) ||
+                fsync(vd->fd[f]) < 0) {
+                up &= ~(1u << c);
+                break;
+            }
+        }
+    }
+    if (up == 0)
+        return -1;
+    vd->down = ((1u << vd->copies) - 1) & ~up;
+    return 0;
+}
+
+/* Take failed copies out of use while another remains, moving the others
+   to a new generation.  Returns -1 if no copy would be left. */
+static int vd_drop(vdisk_t *vd, u_int failed) {
+    if ((vd_up(vd) & ~failed) == 0)
+        return -1;
+    vd->down |= failed;
+    vd->generation++;
+    return vd_mark(vd);
+}
+
+/* The copy in use with the fewest reads in flight.  Ties go to the copy
+   the first stripe unit maps to, so each copy caches its own share of the
+   hot data and sequential reads alternate between copies. */
+static int vd_pick(vdisk_t *vd, off_t off) {
+    int i, c, n, best = -1, least = 0;
+
+    if (vd->copies == 1)
+        return 0;
+    for (i = 0; i < vd->copies; i++) {
+        c = (int)((off / vd->unit + i) % vd->copies);
+        if (vd->down & 1u << c) continue;
+        n = __atomic_load_n(&vd->inflight[c], __ATOMIC_RELAXED);
+        if (best < 0 || n < least) {
+            best = c;
+            least = n;
+        }
+    }
+    return best;
+}
+
+ssize_t vdisk_pread(vdisk_t *vd, void *buf, size_t len, off_t off) {
+    u_int failed;
+    int c, err = 0;
+
+    for (;;) {
+        c = vd_pick(vd, off);
+        __atomic_add_fetch(&vd->inflight[c], 1, __ATOMIC_RELAXED);
+        failed = vd_run(vd, 1u << c, VD_READ, buf, len, off, &err);
+        __atomic_sub_fetch(&vd->inflight[c], 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&vd->reads[c], 1, __ATOMIC_RELAXED);
+        if (failed == 0)
+            return len;
+        if (vd_drop(vd, failed) < 0) {
+            errno = err;
+            return -1;
+        }
+    }
+}
+
+ssize_t vdisk_pread_copy(vdisk_t *vd, int c, void *buf, size_t len, off_t off) {
+    int err = EIO;
+
+    if (c < 0 || c >= vd->copies || (vd->down & 1u << c)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (vd_run(vd, 1u << c, VD_READ, buf, len, off, &err) != 0) {
+        errno = err;
+        return -1;
+    }
+    return len;
+}
+
+ssize_t vdisk_pwrite(vdisk_t *vd, const void *buf, size_t len, off_t off) {
+    u_int failed;
+    int err = 0;
+
+    if (!vd->written) {
+        vd->written = 1;
+        vd->generation++;
+        if (vd_mark(vd) < 0)
+            return -1;
+    }
+    failed = vd_run(vd, vd_up(vd), VD_WRITE, (char *)buf, len, off, &err);
+    if (failed != 0 && vd_drop(vd, failed) < 0) {
+        errno = err;
+        return -1;
+    }
+    return len;
+}
+
+/* Copy len bytes from one file at from to another (or the same) at to:
+   in the kernel with copy_file_range where it can, which shares the
+   extents on file systems with reflinks, else through *buf, allocated
+   on first use.  0 or an errno. */
+static int vd_copy_file(int in, off_t from, int out, off_t to, size_t len, char **buf) {
+    ssize_t n;
+    size_t k;
+#ifdef __linux__
+    loff_t li, lo;
+    int kernel = 1;
+#else
+    int kernel = 0;
+#endif
+
+    while (len > 0) {
+#ifdef __linux__
+        if (kernel) {
+            li = from;
+            lo = to;
+            n = copy_file_range(in, &li, out, &lo, len, 0);
+            if (n > 0) {
+                from += n;
+                to += n;
+                len -= n;
+                continue;
+            }
+            if (n < 0 && errno != EXDEV && errno != EINVAL && errno != ENOSYS &&
+                errno != EOPNOTSUPP)
+                return errno;
+            kernel = 0;
+        }
+#endif
+        if (*buf == NULL && (*buf = malloc(VD_COPY_BUF)) == NULL)
+            return ENOMEM;
+        k = len < VD_COPY_BUF ? len : VD_COPY_BUF;
+        if ((n = pread(in, *buf, k, from)) != (ssize_t)k)
+            return n < 0 ? errno : EIO;
+        if ((n = pwrite(out, *buf, k, to)) != (ssize_t)k)
+            return n < 0 ? errno : EIO;
+        from += k;
+        to += k;
+        len -= k;
+    }
+    (void)kernel;
+    return 0;
+}
+
+/* Pieces that stay within a stripe unit at both ends, copied member to
+   member on each copy in turn. */
+ssize_t vdisk_copy(vdisk_t *vd, off_t from, off_t to, size_t len) {
+    u_int64_t M = vd->members, a, b;
+    u_int up, failed = 0;
+    size_t done, k;
+    char *buf = NULL;
+    int c, e, err = 0;
+
+    if (!vd->written) {
+        vd->written = 1;
+        vd->generation++;
+        if (vd_mark(vd) < 0)
+            return -1;
+    }
+    up = vd_up(vd);
+    for (done = 0; done < len; done += k) {
+        a = from + done;
+        b = to + done;
+        k = len - done;
+        if (M > 1) {
+            if (k > vd->unit - a % vd->unit) k = vd->unit - a % vd->unit;
+            if (k > vd->unit - b % vd->unit) k = vd->unit - b % vd->unit;
+        }
+        for (c = 0; c < vd->copies; c++) {
+            if (!(up & ~failed & 1u << c))
+                continue;
+            e = vd_copy_file(vd->fd[c * M + a / vd->unit % M], a / vd->unit / M * vd->unit + a % vd->unit,
+                             vd->fd[c * M + b / vd->unit % M], b / vd->unit / M * vd->unit + b % vd->unit,
+                             k, &buf);
+            if (e != 0) {
+                failed |= 1u << c;
+                err = e;
+            }
+        }
+    }
+    free(buf);
+    if (failed != 0 && vd_drop(vd, failed) < 0) {
+        errno = err;
+        return -1;
+    }
+    return len;
+}
+
+int vdisk_sync(vdisk_t *vd) {
+    u_int up = vd_up(vd), failed = 0;
+    int c, m, f, e, err = 0;
+
+    if (vd->workers == NULL)
+        err = vd_file_io(vd, 0, VD_SYNC, NULL);
+    else {
+        for (f = 0; f < vd->members * vd->copies; f++)
+            if (up & 1u << (f / vd->members))
+                vd_post(&vd->workers[f], VD_SYNC, NULL);
+        for (c = 0; c < vd->copies; c++) {
+            if (!(up & 1u << c)) continue;
+            for (m = 0; m < vd->members; m++)
+                if ((e = vd_wait(&vd->workers[c * vd->members + m])) != 0) {
+                    failed |= 1u << c;
+                    err = e;
+                }
+        }
+        if (failed == 0 || vd_drop(vd, failed) == 0)
+            err = 0;
+    }
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+/* punch len bytes at off of one file, writing zeros if it cannot */
+static int vd_punch_file(int fd, off_t off, u_int64_t len) {
+    static const char zeros[65536];
+    ssize_t w;
+    size_t n;
+
+#ifdef FALLOC_FL_PUNCH_HOLE
+    if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, off, len) == 0)
+        return 0;
+    if (errno != EOPNOTSUPP && errno != ENOSYS && errno != ENODEV)
+        return -1;
+#endif
+    for (; len > 0; off += n, len -= n) {
+        n = len < sizeof(zeros) ? len : sizeof(zeros);
+        if ((w = pwrite(fd, zeros, n, off)) != (ssize_t)n) {
+            if (w >= 0) errno = EIO;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* The units of a member within a range are consecutive on the member, so
+   each member has one piece to punch: from its first unit in the range
+   (cut at off if that is the range's first unit) to its last (cut at the
+   end likewise). */
+int vdisk_punch(vdisk_t *vd, off_t off, u_int64_t len) {
+    u_int64_t u0, u1, ua, ub, start, end, M = vd->members;
+    u_int up = vd_up(vd);
+    int c, m, err = 0;
+
+    if (len == 0)
+        return 0;
+    u0 = off / vd->unit;
+    u1 = (off + len - 1) / vd->unit;
+    for (m = 0; m < vd->members; m++) {
+        ua = u0 + (m + M - u0 % M) % M;
+        if (ua > u1)
+            continue;
+        ub = u1 - (u1 % M + M - m) % M;
+        start = (ua / M) * vd->unit + (ua == u0 ? off % vd->unit : 0);
+        end = (ub / M) * vd->unit + (ub == u1 ? (off + len - 1) % vd->unit + 1 : vd->unit);
+        for (c = 0; c < vd->copies; c++)
+            if ((up & 1u << c) && vd_punch_file(vd->fd[c * vd->members + m], start, end - start) < 0)
+                err = errno;
+    }
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+u_int64_t vdisk_usage(vdisk_t *vd) {
+    struct stat st;
+    u_int64_t bytes = 0;
+    int f;
+
+    for (f = 0; f < vd->members * vd->copies; f++)
+        if (!(vd->down & 1u << (f / vd->members)) && fstat(vd->fd[f], &st) == 0)
+            bytes += (u_int64_t)st.st_blocks * 512;
+    return bytes;
+}
+
+u_int64_t vdisk_new_id(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ((u_int64_t)ts.tv_sec << 32) ^ ((u_int64_t)getpid() << 20) ^ (u_int64_t)ts.tv_nsec;
+}
+
+/* Open the comma-separated files in paths as fd[at], fd[at + 1], ...
+   Returns how many, or -1 with nothing left open. */
+static int vd_open_files(vdisk_t *vd, int at, const char *paths, int flags, char *err, int errlen) {
+    char path[4096];
+    const char *p = paths, *end;
+    size_t n;
+    int count = 0;
+
+    while (*p != '\0') {
+        end = strchr(p, ',');
+        n = end ? (size_t)(end - p) : strlen(p);
+        if (n == 0 || n >= sizeof(path) || count == VDISK_MAX_MEMBERS) {
+            snprintf(err, errlen, "bad member list %s (at most %d members)", paths, VDISK_MAX_MEMBERS);
+            goto fail;
+        }
+        memcpy(path, p, n);
+        path[n] = '\0';
+        vd->fd[at + count] = open(path, O_RDWR | flags, 0666);
+        if (vd->fd[at + count] < 0) {
+            snprintf(err, errlen, "%s: %s", path, strerror(errno));
+            goto fail;
+        }
+        count++;
+        p += n;
+        if (*p == ',') p++;
+    }
+    if (count == 0) {
+        snprintf(err, errlen, "no image given");
+        return -1;
+    }
+    return count;
+fail:
+    while (count > 0)
+        close(vd->fd[at + --count]);
+    return -1;
+}
+
+int vdisk_open(vdisk_t *vd, const char *paths, int flags, char *err, int errlen) {
+    int n;
+
+    memset(vd, 0, sizeof(*vd));
+    if ((n = vd_open_files(vd, 0, paths, flags, err, errlen)) < 0)
+        return -1;
+    vd->members = n;
+    vd->copies = 1;
+    return 0;
+}
+
+int vdisk_mirror(vdisk_t *vd, const char *paths, int flags, char *err, int errlen) {
+    int n;
+
+    if (vd->unit != 0 || vd->copies == VDISK_MAX_COPIES) {
+        snprintf(err, errlen, "at most %d mirrors, added before the image is used",
+                 VDISK_MAX_COPIES - 1);
+        return -1;
+    }
+    if ((n = vd_open_files(vd, vd->copies * vd->members, paths, flags, err, errlen)) < 0)
+        return -1;
+    if (n != vd->members) {
+        snprintf(err, errlen, "mirror %s has %d members, the image %d", paths, n, vd->members);
+        while (n > 0)
+            close(vd->fd[vd->copies * vd->members + --n]);
+        return -1;
+    }
+    vd->copies++;
+    return 0;
+}
+
+int vdisk_format(vdisk_t *vd, const superblock_t *sb) {
+    u_int64_t meta = (u_int64_t)sb->data_block * sb->block_size;
+    char *buf;
+    int f;
+
+    if ((int)sb->members != vd->members) {
+        errno = EINVAL;
+        return -1;
+    }
+    /* truncating first drops old data, the data area is left sparse */
+    for (f = 0; f < vd->members * vd->copies; f++)
+        if (ftruncate(vd->fd[f], 0) < 0 ||
+            ftruncate(vd->fd[f], sb->disk_size / sb->members + sb->block_size) < 0)
+            return -1;
+    if (vd_start(vd, sb) < 0)
+        return -1;
+    vd->written = 1;
+    if (vd_mark(vd) < 0 || vd->down != 0)
+        return -1;
+    buf = calloc(1, meta);
+    if (buf == NULL)
+        return -1;
+    memcpy(buf, sb, sizeof(*sb));
+    if (vdisk_pwrite(vd, buf, meta, 0) < 0 || vd->down != 0) {
+        free(buf);
+        return -1;
+    }
+    free(buf);
+    return vdisk_sync(vd);
+}
+
+/* "member 2" of the image, "mirror 1 member 2" */
+static void vd_where(const vdisk_t *vd, int c, int m, char *buf, int len) {
+    if (c == 0)
+        snprintf(buf, len, "member %d", m + 1);
+    else
+        snprintf(buf, len, "mirror %d member %d", c, m + 1);
+}
+
+/* Read the superblock from the first member of copy c.  If the file holds
+   another member (its trailer opens the last block, whatever the block
+   size), say so. */
+static int vd_read_super(vdisk_t *vd, int c, superblock_t *sb, char *err, int errlen) {
+    superblock_t trailer;
+    struct stat st;
+    off_t bs;
+    int f = c * vd->members;
+
+    if (pread(vd->fd[f], sb, sizeof(*sb), 0) != sizeof(*sb))
+        memset(sb, 0, sizeof(*sb));
+    if (vdisk_check(sb, err, errlen) == 0)
+        return 0;
+    if (fstat(vd->fd[f], &st) == 0)
+        for (bs = VDISK_MIN_BLOCK; bs <= VDISK_MAX_BLOCK && bs <= st.st_size; bs *= 2)
+            if (pread(vd->fd[f], &trailer, sizeof(trailer), st.st_size - bs) == sizeof(trailer) &&
+                trailer.magic == VDISK_MAGIC && trailer.block_size == (u_int)bs &&
+                trailer.member != 0) {
+                char where[64];
+                vd_where(vd, c, 0, where, sizeof(where));
+                snprintf(err, errlen, "%s is member %u of the image, check the order",
+                         where, trailer.member + 1);
+                break;
+            }
+    return -1;
+}
+
+int vdisk_attach(vdisk_t *vd, superblock_t *sb, char *err, int errlen) {
+    superblock_t trailer;
+    u_int64_t gen[VDISK_MAX_COPIES], newest = 0;
+    u_int valid = 0;
+    char where[64], why[256];
+    int c, m;
+
+    /* the superblock of the first copy that has one */
+    for (c = 0; c < vd->copies; c++)
+        if (vd_read_super(vd, c, sb, c == 0 ? err : why, c == 0 ? errlen : sizeof(why)) == 0)
+            break;
+    if (c == vd->copies)
+        return -1;
+    if ((int)sb->members != vd->members) {
+        snprintf(err, errlen, "image has %u members, %d given", sb->members, vd->members);
+        return -1;
+    }
+
+    /* A copy is current if all its trailers are there with the newest
+       generation.  Blank trailers make a mirror stale, a foreign or
+       misplaced member is an error. */
+    for (c = 0; c < vd->copies; c++) {
+        gen[c] = ~0ULL;
+        for (m = 0; m < vd->members; m++) {
+            vd_where(vd, c, m, where, sizeof(where));
+            if (pread(vd->fd[c * vd->members + m], &trailer, sizeof(trailer),
+                      sb->disk_size / sb->members) != sizeof(trailer) ||
+                trailer.magic != VDISK_MAGIC) {
+                snprintf(err, errlen, "%s does not belong to this image", where);
+                break;
+            }
+            if (trailer.sum != vd_sum(&trailer)) {
+                snprintf(err, errlen, "%s has a damaged trailer", where);
+                break;
+            }
+            if (trailer.image_id != sb->image_id) {
+                snprintf(err, errlen, "%s does not belong to this image", where);
+                return -1;
+            }
+            if ((int)trailer.member != m) {
+                snprintf(err, errlen, "%s is member %u of the image, check the order",
+                         where, trailer.member + 1);
+                return -1;
+            }
+            if (trailer.generation < gen[c])
+                gen[c] = trailer.generation;
+        }
+        if (m == vd->members) {
+            valid |= 1u << c;
+            if (gen[c] > newest) newest = gen[c];
+        }
+    }
+    if (valid == 0 || (vd->copies == 1 && valid != 1))
+        return -1;
+    vd->generation = newest;
+    vd->down = 0;
+    for (c = 0; c < vd->copies; c++)
+        if (!(valid & 1u << c) || gen[c] != newest)
+            vd->down |= 1u << c;
+    if (vd_start(vd, sb) < 0) {
+        snprintf(err, errlen, "cannot start I/O threads");
+        return -1;
+    }
+    return 0;
+}
+
+int vdisk_resync(vdisk_t *vd, char *err, int errlen) {
+    const size_t chunk = 1 << 20;
+    superblock_t trailer;
+    u_int64_t o;
+    size_t n;
+    char *buf, where[64];
+    int c, m, src, dst, from = vd_lowest(vd_up(vd));
+
+    buf = malloc(chunk);
+    if (buf == NULL) {
+        snprintf(err, errlen, "out of memory");
+        return -1;
+    }
+    for (c = 0; c < vd->copies; c++) {
+        if (!(vd->down & 1u << c)) continue;
+        for (m = 0; m < vd->members; m++) {
+            src = vd->fd[from * vd->members + m];
+            dst = vd->fd[c * vd->members + m];
+            vd_where(vd, c, m, where, sizeof(where));
+            errno = 0;
+            /* start from an empty sparse file and copy only what is not zero */
+            if (ftruncate(dst, 0) < 0 || ftruncate(dst, vd->member_size + vd->sb.block_size) < 0)
+                goto fail;
+            for (o = 0; o < vd->member_size; o += n) {
+                n = vd->member_size - o < chunk ? vd->member_size - o : chunk;
+                if (pread(src, buf, n, o) != (ssize_t)n) {
+                    vd_where(vd, from, m, where, sizeof(where));
+                    goto fail;
+                }
+                if ((buf[0] != 0 || memcmp(buf, buf + 1, n - 1) != 0) &&
+                    pwrite(dst, buf, n, o) != (ssize_t)n)
+                    goto fail;
+            }
+            trailer = vd->sb;
+            trailer.member = m;
+            trailer.generation = vd->generation;
+            trailer.sum = vd_sum(&trailer);
+            if (pwrite(dst, &trailer, sizeof(trailer), vd->member_size) != sizeof(trailer) ||
+                fsync(dst) < 0)
+                goto fail;
+        }
+        vd->down &= ~(1u << c);
+    }
+    free(buf);
+    return 0;
+fail:
+    snprintf(err, errlen, "%s: %s", where, errno ? strerror(errno) : "short transfer");
+    free(buf);
+    return -1;
+}
+
+void vdisk_close(vdisk_t *vd) {
+    int f;
+
+    if (vd->workers != NULL) {
+        for (f = 0; f < vd->members * vd->copies; f++) {
+            vd_post(&vd->workers[f], VD_EXIT, NULL);
+            pthread_join(vd->workers[f].thread, NULL);
+        }
+        free(vd->workers);
+        vd->workers = NULL;
+    }
+    for (f = 0; f < vd->members * vd->copies; f++)
+        close(vd->fd[f]);
+    vd->members = 0;
+}
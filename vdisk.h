@@ -0,0 +1,217 @@
+/*
+ * On-disk layout of a virtual disk image, shared by the server and mkdisk.
+ *
+ *   block 0          superblock
+ *   bitmap_off       block map, one bit per block (1 used) in 64-bit words
+ *   users_off        user table, max_users user_meta_t
+ *   files_off        file table, max_files_user file_meta_t per user
+ *   sums_off         block sums, a u_int32_t per block
+ *   data_block       file data, blocks_per_file contiguous blocks per file
+ *
+ * A file of at most VDISK_INLINE_MAX bytes may instead keep its data in
+ * its file table record and own no blocks (FILE_INLINE).  Files with equal
+ * contents may share one file's blocks (dedup); they are found by the
+ * fingerprint in their records, and a shared file is copied to blocks of
+ * its own before it is changed.  A record may also hold the digest of its
+ * file's contents (FILE_HASHED), good while the file's version is still
+ * the one it was taken at.
+ *
+ * A file on blocks may be stored compressed (FILE_COMPRESSED), in chunks of
+ * vdisk_chunk_size() bytes: chunk k sits at offset k times the chunk size
+ * in the file's blocks, either as is or as a 4-byte length and an LZ stream
+ * (lz.h) with the rest of the chunk a hole.  The record's data is then the
+ * chunk map: per chunk a 16-bit count of VDISK_CHUNK_UNIT bytes stored
+ * compressed, 0 for a chunk stored as is.
+ *
+ * Checksums are CRC-32C (crc32c.h).  The superblock, the member trailers
+ * and every user and file record carry one of their own bytes, taken with
+ * the sum field 0; the sum table holds one per data block, of the whole
+ * block.  A sum of 0 means none: the record or block was never written
+ * (or the block was punched), and a computed sum of 0 is stored as 1.
+ *
+ * Each table starts on a block boundary and is padded to whole blocks, so
+ * all metadata I/O is block aligned.  Records are in host byte order.
+ *
+ * The block address space is striped over one or more member files in
+ * units of stripe_blocks: unit u lives on member u % members at unit
+ * u / members of that member.  Every member ends with a copy of the
+ * superblock naming its position, checked when the image is opened.
+ *
+ * An image may have mirrors: further copies with the same members, each
+ * written in full.  The member trailers carry a generation, raised on the
+ * copies in use when a session first writes and whenever a copy drops out,
+ * so a copy that missed writes is recognised as stale at the next attach.
+ */
+
+#ifndef SSNFS_VDISK_H
+#define SSNFS_VDISK_H
+
+#include <sys/types.h>
+#include <rpc/rpc.h>
+#include "ssnfs.h"
+
+#define VDISK_MAGIC    0x53534e46        /* "SSNF" */
+#define VDISK_VERSION  8               /* 7: no file digests; 6: no checksums;
+                                          5: no compression; 4: no fingerprints;
+                                          3: no inline files; 2: no striping;
+                                          1: 32-bit sizes */
+#define VDISK_MIN_BLOCK 512
+#define VDISK_MAX_BLOCK 65536
+#define VDISK_MAX_BLOCKS (1ULL << 40)
+#define VDISK_MAX_MEMBERS 16
+#define VDISK_MAX_COPIES  4             /* the image and up to 3 mirrors */
+#define VDISK_INLINE_MAX  164           /* fills file_meta_t to 256 bytes */
+#define VDISK_CHUNKS      (VDISK_INLINE_MAX / 2)   /* chunk map entries */
+#define VDISK_CHUNK_MIN   16384         /* smallest compression chunk */
+#define VDISK_CHUNK_UNIT  64            /* chunk map granularity */
+
+/* geometry of images the server creates on its own */
+#define VDISK_BLOCK_SIZE      4096
+#define VDISK_SIZE            (16ULL * 1024 * 1024)
+#define VDISK_BLOCKS_PER_FILE 8         /* 32 KiB files */
+#define VDISK_MAX_USERS       10
+#define VDISK_MAX_FILES_USER  10
+#define VDISK_STRIPE_BLOCKS   16        /* 64 KiB stripe unit */
+
+typedef struct {
+    u_int     magic;
+    u_int     version;
+    u_int     block_size;      /* power of two, VDISK_MIN_BLOCK..VDISK_MAX_BLOCK */
+    u_int     blocks_per_file;
+    u_int     max_users;
+    u_int     max_files_user;
+    u_int     members;         /* member files the blocks are striped over */
+    u_int     stripe_blocks;   /* stripe unit */
+    u_int64_t image_id;        /* the same in every member */
+    u_int     member;          /* member trailers: position of this member */
+    u_int     sum;             /* CRC-32C, see above */
+    u_int64_t total_blocks;    /* a whole number of stripes */
+    u_int64_t data_block;      /* first block after the tables */
+    u_int64_t disk_size;       /* total_blocks * block_size */
+    u_int64_t bitmap_off;      /* byte offsets of the tables */
+    u_int64_t users_off;
+    u_int64_t files_off;
+    u_int64_t sums_off;
+    u_int64_t generation;      /* member trailers: see above */
+} superblock_t;
+
+#define FILE_INLINE     0x1           /* data in the record, no blocks */
+#define FILE_COMPRESSED 0x2           /* data is the chunk map, see above */
+#define FILE_HASHED     0x4           /* hash is the digest at hash_version */
+
+typedef struct {
+    char      file_name[FILE_NAME_SIZE];
+    u_int     version;         /* bumped on every change, for client caches */
+    int64_t   start_block;     /* -1 if unused or inline */
+    int64_t   size;            /* bytes written so far (high-water mark) */
+    u_int     flags;           /* FILE_INLINE */
+    u_int     sum;             /* CRC-32C of the record */
+    u_int64_t fingerprint;     /* of the contents when last stored whole, 0 unknown */
+    u_int     hash_version;    /* FILE_HASHED: the version hash was taken at */
+    u_char    hash[HASH_SIZE]; /* BLAKE2bp-256 (blake2.h), for hash_file */
+    char      data[VDISK_INLINE_MAX];  /* FILE_INLINE: the file, zeros past size;
+                                          FILE_COMPRESSED: u_int16_t chunk map */
+} file_meta_t;
+
+/* a user's files are the user's slice of the file table */
+typedef struct {
+    char       user_name[USER_NAME_SIZE];
+    int        in_use;
+    unsigned int dir_version;  /* bumped when files are added or removed */
+    u_int      sum;            /* CRC-32C of the record */
+} user_meta_t;
+
+/* An open image.  With more than one file (members times copies), I/O
+   spanning several of them runs on a thread per file.  Writes go to every
+   copy in use; a read goes to one, and to another if it fails. */
+struct vdisk_worker;
+typedef struct {
+    int       members;         /* 0 until vdisk_open */
+    int       copies;          /* the image and its mirrors */
+    int       fd[VDISK_MAX_COPIES * VDISK_MAX_MEMBERS];  /* copy c, member m at c * members + m */
+    u_int     down;            /* copies out of use, a bit each */
+    u_int64_t generation;      /* of the copies in use */
+    int       written;         /* generation raised for this session */
+    int       inflight[VDISK_MAX_COPIES];   /* reads in progress */
+    u_int64_t reads[VDISK_MAX_COPIES];      /* reads served */
+    superblock_t sb;
+    u_int64_t unit;            /* stripe unit in bytes */
+    u_int64_t member_size;     /* data bytes per member */
+    struct vdisk_worker *workers;
+} vdisk_t;
+
+/* Fill in the derived fields of sb from block_size, disk_size (rounded
+   down to whole stripes), blocks_per_file, max_users, max_files_user,
+   members and stripe_blocks.  Returns 0, or -1 with the reason in err. */
+int vdisk_layout(superblock_t *sb, char *err, int errlen);
+
+/* Check a superblock read from an image.  Returns 0 or -1 as above. */
+int vdisk_check(const superblock_t *sb, char *err, int errlen);
+
+/* Compression chunk size for files of image sb: the smallest power of two
+   of at least VDISK_CHUNK_MIN and a block for which VDISK_CHUNKS chunks
+   cover a file, 0 if the chunk map cannot describe chunks that large. */
+u_int64_t vdisk_chunk_size(const superblock_t *sb);
+
+/* a fresh image_id */
+u_int64_t vdisk_new_id(void);
+
+/* Open the comma-separated member files in paths with O_RDWR | flags.
+   Returns 0, or -1 with the reason in err. */
+int vdisk_open(vdisk_t *vd, const char *paths, int flags, char *err, int errlen);
+
+/* Add a mirror, the comma-separated member files of another copy, before
+   vdisk_format or vdisk_attach.  Returns 0, or -1 with the reason in err. */
+int vdisk_mirror(vdisk_t *vd, const char *paths, int flags, char *err, int errlen);
+
+/* Write an empty file system with geometry sb (from vdisk_layout) to the
+   members of every copy: superblock, zeroed tables, sparse data area and
+   trailers.
+   Returns 0, or -1 with errno set. */
+int vdisk_format(vdisk_t *vd, const superblock_t *sb);
+
+/* Read and check the superblock and member trailers of an opened image
+   and get ready for I/O.  Mirrors that are stale or blank are left out of
+   use (see down).  Returns 0, or -1 with the reason in err. */
+int vdisk_attach(vdisk_t *vd, superblock_t *sb, char *err, int errlen);
+
+/* Copy a current copy over each copy out of use and put it back in use.
+   Returns 0, or -1 with the reason in err. */
+int vdisk_resync(vdisk_t *vd, char *err, int errlen);
+
+/* I/O at byte offset off of the block address space.  Return len, or -1
+   with errno set (EIO for a short transfer) once no copy could do it. */
+ssize_t vdisk_pread(vdisk_t *vd, void *buf, size_t len, off_t off);
+ssize_t vdisk_pwrite(vdisk_t *vd, const void *buf, size_t len, off_t off);
+
+/* Copy len bytes of the image from from to to on every copy in use,
+   without passing them through the caller: copy_file_range between the
+   member files, or a buffer where the host cannot.  The ranges must not
+   overlap.  Returns len, or -1 with errno set. */
+ssize_t vdisk_copy(vdisk_t *vd, off_t from, off_t to, size_t len);
+
+/* Read from copy c alone, which must be in use, with no failover: for
+   checking each copy, or finding a good one when the copy read gave bad
+   data.  Returns len, or -1 with errno set; the copy stays in use. */
+ssize_t vdisk_pread_copy(vdisk_t *vd, int c, void *buf, size_t len, off_t off);
+
+/* Drop len bytes at off on every copy in use so they read back as zeros:
+   a hole is punched in the members, or zeros written where the host file
+   system cannot punch.  Returns 0, or -1 with errno set. */
+int vdisk_punch(vdisk_t *vd, off_t off, u_int64_t len);
+
+/* bytes of host storage the files of the copies in use take up */
+u_int64_t vdisk_usage(vdisk_t *vd);
+
+/* fsync every file in use, in parallel; 0 or -1 */
+int vdisk_sync(vdisk_t *vd);
+
+void vdisk_close(vdisk_t *vd);
+
+/* table sizes on disk, padded to whole blocks */
+#define VDISK_BITMAP_LEN(sb) ((sb)->users_off - (sb)->bitmap_off)
+#define VDISK_USERS_LEN(sb)  ((sb)->files_off - (sb)->users_off)
+#define VDISK_FILES_LEN(sb)  ((sb)->sums_off - (sb)->files_off)
+#define VDISK_SUMS_LEN(sb)   ((u_int64_t)(sb)->data_block * (sb)->block_size - (sb)->sums_off)
+
+#endif /* SSNFS_VDISK_H */